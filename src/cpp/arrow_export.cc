@@ -0,0 +1,319 @@
+/*
+
+    Arrow Export Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "arrow_export.h"
+
+#include <algorithm>
+#include <climits>
+
+/* What an exported array owns, freed by its release callback */
+struct ArrowArrayData {
+    ColumnVector vec;
+    std::shared_ptr<const ArrowStrings> strings;
+    const void* buffers[3];
+    ArrowArray dictionary;          // Released with the array, `release` null if there is none
+    std::vector<ArrowArray> children;
+    std::vector<ArrowArray*> childPtrs;
+};
+
+/* What an exported schema owns, freed by its release callback */
+struct ArrowSchemaData {
+    std::string name;
+    ArrowSchema dictionary;         // Released with the schema, `release` null if there is none
+    std::vector<ArrowSchema> children;
+    std::vector<ArrowSchema*> childPtrs;
+};
+
+static void releaseArray(ArrowArray* array) {
+    ArrowArrayData* data = static_cast<ArrowArrayData*>(array->private_data);
+    for (auto& child : data->children) {
+        if (child.release) {
+            child.release(&child);
+        }
+    }
+    if (data->dictionary.release) {
+        data->dictionary.release(&data->dictionary);
+    }
+    delete data;
+    array->release = nullptr;
+}
+
+static void releaseSchema(ArrowSchema* schema) {
+    ArrowSchemaData* data = static_cast<ArrowSchemaData*>(schema->private_data);
+    for (auto& child : data->children) {
+        if (child.release) {
+            child.release(&child);
+        }
+    }
+    if (data->dictionary.release) {
+        data->dictionary.release(&data->dictionary);
+    }
+    delete data;
+    schema->release = nullptr;
+}
+
+static ArrowArrayData* newArray(int64_t length, int64_t nBuffers, ArrowArray* out) {
+    ArrowArrayData* data = new ArrowArrayData();
+    data->buffers[0] = data->buffers[1] = data->buffers[2] = nullptr;
+    data->dictionary.release = nullptr;
+    out->length = length;
+    out->null_count = 0;
+    out->offset = 0;
+    out->n_buffers = nBuffers;
+    out->n_children = 0;
+    out->buffers = data->buffers;
+    out->children = nullptr;
+    out->dictionary = nullptr;
+    out->release = releaseArray;
+    out->private_data = data;
+    return data;
+}
+
+static ArrowSchemaData* newSchema(const char* format, const std::string& name, int64_t flags, ArrowSchema* out) {
+    ArrowSchemaData* data = new ArrowSchemaData();
+    data->name = name;
+    data->dictionary.release = nullptr;
+    out->format = format;
+    out->name = data->name.c_str();
+    out->metadata = nullptr;
+    out->flags = flags;
+    out->n_children = 0;
+    out->children = nullptr;
+    out->dictionary = nullptr;
+    out->release = releaseSchema;
+    out->private_data = data;
+    return data;
+}
+
+/* Bits set in validity words over rows [begin, end) */
+static size_t countValid(const bitset<uint64_t>& validity, size_t begin, size_t end) {
+    size_t n = 0;
+    for (; begin < end && (begin & 63); ++begin) {
+        n += (validity[begin >> 6] >> (begin & 63)) & 1;
+    }
+    for (; begin + 64 <= end; begin += 64) {
+        n += __builtin_popcountll(validity[begin >> 6]);
+    }
+    for (; begin < end; ++begin) {
+        n += (validity[begin >> 6] >> (begin & 63)) & 1;
+    }
+    return n;
+}
+
+ColumnStatus ArrowStrings::assign(const std::vector<std::string>& strings) {
+
+    size_t total = 0;
+    for (auto& str : strings) {
+        total += str.size();
+    }
+    if (total > INT32_MAX) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;   // Past what utf8 offsets can address
+    }
+
+    offsets.resize(strings.size() + 1);
+    data.clear();
+    data.reserve(std::max<size_t>(total, 1));     // Never a null buffer, even for empty strings
+    offsets[0] = 0;
+    for (size_t i = 0; i < strings.size(); ++i) {
+        data.insert(data.end(), strings[i].begin(), strings[i].end());
+        offsets[i + 1] = static_cast<int32_t>(data.size());
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Utf8 array over shared strings, the dictionary of a STRING array */
+static void exportStrings(std::shared_ptr<const ArrowStrings> strings, ArrowArray* out) {
+    ArrowArrayData* data = newArray(static_cast<int64_t>(strings->size()), 3, out);
+    data->buffers[1] = strings->offsets.data();
+    data->buffers[2] = strings->data.data();
+    data->strings = std::move(strings);
+}
+
+/* Rows [offset, offset + length) of `vec`, which the array takes over */
+ColumnStatus ArrowExporter::exportArray(ColumnVector&& vec, size_t offset, size_t length,
+                                        std::shared_ptr<const ArrowStrings> strings, ArrowArray* out) const {
+
+    if (offset + length > vec.size()) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+
+    ArrowArrayData* data = newArray(static_cast<int64_t>(length), 2, out);
+    data->vec = std::move(vec);
+    data->vec.strings.clear();      // Already copied into `strings`
+    out->offset = static_cast<int64_t>(offset);
+    if (!data->vec.validity.empty()) {
+        out->null_count = static_cast<int64_t>(length - countValid(data->vec.validity, offset, offset + length));
+    }
+    data->buffers[0] = out->null_count > 0 ? data->vec.validity.data() : nullptr;
+    data->buffers[1] = data->vec.values.data();
+
+    if (type == ColumnType::STRING) {
+        exportStrings(std::move(strings), &data->dictionary);
+        out->dictionary = &data->dictionary;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Utf8 form of a segment's dictionary, built on the first array exported from the segment */
+ColumnStatus ArrowExporter::segmentStrings(const std::shared_ptr<const ColumnSegmentReader>& segment,
+                                           std::shared_ptr<const ArrowStrings>& strings) {
+    if (segment != dictSegment) {
+        auto built = std::make_shared<ArrowStrings>();
+        ColumnStatus rc = built->assign(segment->getDictionary());
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        dictSegment = segment;
+        dictStrings = std::move(built);
+    }
+    strings = dictStrings;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* The whole vector; codes of a STRING vector index `dictionary`, or `vec.strings` when it is null */
+ColumnStatus ArrowExporter::exportVector(ColumnVector&& vec, const std::vector<std::string>* dictionary,
+                                         ArrowArray* out) {
+    std::shared_ptr<const ArrowStrings> strings;
+    if (type == ColumnType::STRING) {
+        auto built = std::make_shared<ArrowStrings>();
+        ColumnStatus rc = built->assign(dictionary ? *dictionary : vec.strings);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        strings = std::move(built);
+    }
+    size_t n = vec.size();
+    return exportArray(std::move(vec), 0, n, std::move(strings), out);
+}
+
+/* The selected rows of a scan batch, in place when they are a contiguous run */
+ColumnStatus ArrowExporter::exportBatch(TableBatch&& batch, ArrowArray* out) {
+
+    std::shared_ptr<const ArrowStrings> strings;
+    if (type == ColumnType::STRING) {
+        ColumnStatus rc;
+        if (batch.segment && batch.dictionary == &batch.segment->getDictionary()) {
+            rc = segmentStrings(batch.segment, strings);
+        }
+        else {
+            auto built = std::make_shared<ArrowStrings>();
+            rc = built->assign(batch.dictionary ? *batch.dictionary : batch.values.strings);
+            strings = std::move(built);
+        }
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+
+    const sel_vec_t& sel = batch.sel;
+    size_t n = sel.size();
+    if (n == 0 || sel.back() - sel.front() + 1 == n) {
+        return exportArray(std::move(batch.values), n ? sel.front() : 0, n, std::move(strings), out);
+    }
+
+    ColumnVector vec;
+    vec.values.resize(n);
+    for (size_t i = 0; i < n; ++i) {
+        vec.values[i] = batch.values.values[sel[i]];
+    }
+    if (!batch.values.validity.empty()) {
+        vec.validity.assign((n + 63) / 64, 0);
+        for (size_t i = 0; i < n; ++i) {
+            if (!batch.values.isNull(sel[i])) {
+                vec.validity[i >> 6] |= 1ULL << (i & 63);
+            }
+        }
+    }
+    return exportArray(std::move(vec), 0, n, std::move(strings), out);
+}
+
+/* A whole decoded chunk of a segment */
+ColumnStatus ArrowExporter::exportChunk(const std::shared_ptr<ColumnSegmentReader>& segment, size_t idx,
+                                        ArrowArray* out) {
+
+    if (segment->getType() != type) {
+        return ColumnStatus::TYPE_MISMATCH;
+    }
+    ColumnVector vec;
+    ColumnStatus rc = segment->readChunk(idx, vec);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    if (type != ColumnType::STRING ||
+        segment->getChunk(idx).encoding == static_cast<uint8_t>(ColumnEncoding::STRING_HEAP)) {
+        return exportVector(std::move(vec), nullptr, out);
+    }
+
+    std::shared_ptr<const ArrowStrings> strings;
+    if ((rc = segmentStrings(segment, strings)) != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    size_t n = vec.size();
+    return exportArray(std::move(vec), 0, n, std::move(strings), out);
+}
+
+/* Schema of one column's arrays; STRING columns are int64 indices into a utf8 dictionary */
+void exportArrowSchema(ColumnType type, const std::string& name, ArrowSchema* out) {
+    const char* format = type == ColumnType::TIMESTAMP ? "tsu:UTC" : "l";
+    ArrowSchemaData* data = newSchema(format, name, ARROW_FLAG_NULLABLE, out);
+    if (type == ColumnType::STRING) {
+        newSchema("u", "", ARROW_FLAG_NULLABLE, &data->dictionary);
+        out->dictionary = &data->dictionary;
+    }
+}
+
+/* Schema of a record batch of the columns, a struct of one field per column */
+void exportArrowSchema(const std::vector<TableColumn>& columns, ArrowSchema* out) {
+    ArrowSchemaData* data = newSchema("+s", "", 0, out);
+    data->children.resize(columns.size());
+    for (size_t c = 0; c < columns.size(); ++c) {
+        exportArrowSchema(columns[c].type, columns[c].name, &data->children[c]);
+        data->childPtrs.push_back(&data->children[c]);
+    }
+    out->n_children = static_cast<int64_t>(columns.size());
+    out->children = data->childPtrs.data();
+}
+
+/*
+
+    Record batch of arrays of equal length, one per column, as a struct
+    array. The batch takes the arrays over, leaving them released; on
+    failure (lengths differ) they are left to the caller.
+
+*/
+ColumnStatus exportArrowRecordBatch(std::vector<ArrowArray>& columns, ArrowArray* out) {
+
+    for (auto& col : columns) {
+        if (col.length != columns[0].length) {
+            return ColumnStatus::GENERAL_FAILURE;
+        }
+    }
+
+    ArrowArrayData* data = newArray(columns.empty() ? 0 : columns[0].length, 1, out);
+    data->children = columns;
+    for (auto& col : columns) {
+        col.release = nullptr;
+    }
+    for (auto& child : data->children) {
+        data->childPtrs.push_back(&child);
+    }
+    out->n_children = static_cast<int64_t>(columns.size());
+    out->children = data->childPtrs.data();
+    return ColumnStatus::GENERAL_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,387 @@
+/*
+
+    Bit-Packing Kernels
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "bitpack.h"
+#include "simd.h"
+
+#include <cstring>
+
+#if SIMD_ENABLED && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#   define BITPACK_X86          1
+#   include <immintrin.h>
+#elif SIMD_ENABLED && defined(__aarch64__) && defined(__ARM_NEON)
+#   define BITPACK_NEON         1
+#   include <arm_neon.h>
+#endif
+
+/*
+
+    All kernels share the same addressing. Group j (values 8j .. 8j+7)
+    starts at bit j * width of every lane:
+
+        row   = (j * width) / 32
+        shift = (j * width) % 32
+        value = ((row[lane] >> shift) | (nextRow[lane] << (32 - shift))) & mask
+
+    A shift of 32 has to produce 0, which the SIMD shifts do natively and
+    the scalar code special-cases.
+
+*/
+
+typedef void (*decode_fn)(const uint32_t*, size_t, uint8_t, int64_t, int64_t*);
+typedef void (*filter_fn)(const uint32_t*, size_t, uint8_t, uint32_t, uint32_t, uint64_t*);
+
+static size_t groupsOf(size_t count) {
+    return (count + BITPACK_LANES - 1) / BITPACK_LANES;
+}
+
+static uint32_t maskOf(uint8_t width) {
+    return width >= 32 ? 0xFFFFFFFFu : (1u << width) - 1;
+}
+
+/* Packed bytes for `count` values, padding row included */
+size_t bitpackSize(size_t count, uint8_t width) {
+    if (width == 0) {
+        return 0;
+    }
+    size_t rows = (groupsOf(count) * width + 31) / 32;
+    return (rows + 1) * BITPACK_LANES * sizeof(uint32_t);
+}
+
+uint8_t bitpackWidth(uint64_t maxOffset) {
+    uint8_t width = 0;
+    while (width < 64 && (maxOffset >> width) != 0) {
+        ++width;
+    }
+    return width;
+}
+
+void bitpackEncode(const uint32_t* in, size_t count, uint8_t width, uint32_t* out) {
+
+    if (width == 0) {
+        return;
+    }
+    memset(out, 0, bitpackSize(count, width));
+
+    uint32_t mask = maskOf(width);
+    for (size_t j = 0; j < groupsOf(count); ++j) {
+        size_t pos = j * width;
+        uint32_t* row = out + (pos >> 5) * BITPACK_LANES;
+        uint32_t shift = pos & 31;
+
+        for (size_t lane = 0; lane < BITPACK_LANES; ++lane) {
+            size_t i = j * BITPACK_LANES + lane;
+            uint64_t val = i < count ? (in[i] & mask) : 0;
+            row[lane] |= static_cast<uint32_t>(val << shift);
+            if (shift + width > 32) {
+                row[lane + BITPACK_LANES] |= static_cast<uint32_t>(val >> (32 - shift));
+            }
+        }
+    }
+}
+
+/* Scalar kernels */
+
+static inline uint32_t unpackLane(const uint32_t* row, size_t lane, uint32_t shift, uint32_t mask) {
+    uint32_t val = row[lane] >> shift;
+    if (shift != 0) {
+        val |= row[lane + BITPACK_LANES] << (32 - shift);
+    }
+    return val & mask;
+}
+
+static void decodeScalar(const uint32_t* in, size_t count, uint8_t width, int64_t ref, int64_t* out) {
+    uint32_t mask = maskOf(width);
+    for (size_t j = 0; j < groupsOf(count); ++j) {
+        size_t pos = j * width;
+        const uint32_t* row = in + (pos >> 5) * BITPACK_LANES;
+        for (size_t lane = 0; lane < BITPACK_LANES; ++lane) {
+            out[j * BITPACK_LANES + lane] = ref + unpackLane(row, lane, pos & 31, mask);
+        }
+    }
+}
+
+static void filterScalar(const uint32_t* in, size_t count, uint8_t width,
+                         uint32_t lo, uint32_t hi, uint64_t* matches) {
+    uint32_t mask = maskOf(width);
+    uint64_t word = 0;
+    for (size_t j = 0; j < groupsOf(count); ++j) {
+        size_t pos = j * width;
+        const uint32_t* row = in + (pos >> 5) * BITPACK_LANES;
+        for (size_t lane = 0; lane < BITPACK_LANES; ++lane) {
+            uint32_t val = unpackLane(row, lane, pos & 31, mask);
+            word |= static_cast<uint64_t>(val >= lo && val <= hi) << ((j * BITPACK_LANES + lane) & 63);
+        }
+        if ((j & 7) == 7) {
+            matches[j >> 3] = word;
+            word = 0;
+        }
+    }
+    if (groupsOf(count) & 7) {
+        matches[groupsOf(count) >> 3] = word;
+    }
+}
+
+/* x86-64 kernels, compiled for their target and picked at runtime */
+
+#if defined(BITPACK_X86)
+
+SIMD_KERNELS_BEGIN
+
+__attribute__((target("avx2")))
+static inline __m256i unpackAvx2(const uint32_t* in, size_t j, uint8_t width, __m256i mask) {
+    size_t pos = j * width;
+    const uint32_t* row = in + (pos >> 5) * BITPACK_LANES;
+    __m128i shift = _mm_cvtsi32_si128(static_cast<int>(pos & 31));
+    __m128i back = _mm_cvtsi32_si128(static_cast<int>(32 - (pos & 31)));
+    __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row));
+    __m256i hi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + BITPACK_LANES));
+    __m256i val = _mm256_or_si256(_mm256_srl_epi32(lo, shift), _mm256_sll_epi32(hi, back));
+    return _mm256_and_si256(val, mask);
+}
+
+__attribute__((target("avx2")))
+static void decodeAvx2(const uint32_t* in, size_t count, uint8_t width, int64_t ref, int64_t* out) {
+    __m256i mask = _mm256_set1_epi32(static_cast<int>(maskOf(width)));
+    __m256i base = _mm256_set1_epi64x(ref);
+    for (size_t j = 0; j < groupsOf(count); ++j) {
+        __m256i val = unpackAvx2(in, j, width, mask);
+        __m256i a = _mm256_add_epi64(_mm256_cvtepu32_epi64(_mm256_castsi256_si128(val)), base);
+        __m256i b = _mm256_add_epi64(_mm256_cvtepu32_epi64(_mm256_extracti128_si256(val, 1)), base);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j * BITPACK_LANES), a);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j * BITPACK_LANES + 4), b);
+    }
+}
+
+__attribute__((target("avx2")))
+static void filterAvx2(const uint32_t* in, size_t count, uint8_t width,
+                       uint32_t lo, uint32_t hi, uint64_t* matches) {
+    __m256i mask = _mm256_set1_epi32(static_cast<int>(maskOf(width)));
+    __m256i vlo = _mm256_set1_epi32(static_cast<int>(lo));
+    __m256i vhi = _mm256_set1_epi32(static_cast<int>(hi));
+    uint64_t word = 0;
+    for (size_t j = 0; j < groupsOf(count); ++j) {
+        __m256i val = unpackAvx2(in, j, width, mask);
+        __m256i ge = _mm256_cmpeq_epi32(_mm256_max_epu32(val, vlo), val);
+        __m256i le = _mm256_cmpeq_epi32(_mm256_min_epu32(val, vhi), val);
+        uint64_t bits = static_cast<uint32_t>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(ge, le))));
+        word |= bits << ((j & 7) * BITPACK_LANES);
+        if ((j & 7) == 7) {
+            matches[j >> 3] = word;
+            word = 0;
+        }
+    }
+    if (groupsOf(count) & 7) {
+        matches[groupsOf(count) >> 3] = word;
+    }
+}
+
+/* Two groups per iteration, one 256-bit row pair in each half of the register */
+__attribute__((target("avx512f")))
+static inline __m512i unpackAvx512(const uint32_t* in, size_t j, uint8_t width, __m512i mask) {
+    size_t pos0 = j * width;
+    size_t pos1 = pos0 + width;
+    const uint32_t* row0 = in + (pos0 >> 5) * BITPACK_LANES;
+    const uint32_t* row1 = in + (pos1 >> 5) * BITPACK_LANES;
+
+    __m512i lo = _mm512_inserti64x4(_mm512_castsi256_si512(
+                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0))),
+                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1)), 1);
+    __m512i hi = _mm512_inserti64x4(_mm512_castsi256_si512(
+                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row0 + BITPACK_LANES))),
+                     _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row1 + BITPACK_LANES)), 1);
+    __m512i shift = _mm512_inserti64x4(_mm512_set1_epi32(static_cast<int>(pos0 & 31)),
+                                       _mm256_set1_epi32(static_cast<int>(pos1 & 31)), 1);
+    __m512i back = _mm512_sub_epi32(_mm512_set1_epi32(32), shift);
+
+    __m512i val = _mm512_or_si512(_mm512_srlv_epi32(lo, shift), _mm512_sllv_epi32(hi, back));
+    return _mm512_and_si512(val, mask);
+}
+
+__attribute__((target("avx512f,avx2")))
+static void decodeAvx512(const uint32_t* in, size_t count, uint8_t width, int64_t ref, int64_t* out) {
+    __m512i mask = _mm512_set1_epi32(static_cast<int>(maskOf(width)));
+    __m512i base = _mm512_set1_epi64(ref);
+    size_t nGroups = groupsOf(count);
+    size_t j = 0;
+    for (; j + 1 < nGroups; j += 2) {
+        __m512i val = unpackAvx512(in, j, width, mask);
+        __m512i a = _mm512_add_epi64(_mm512_cvtepu32_epi64(_mm512_castsi512_si256(val)), base);
+        __m512i b = _mm512_add_epi64(_mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(val, 1)), base);
+        _mm512_storeu_si512(out + j * BITPACK_LANES, a);
+        _mm512_storeu_si512(out + j * BITPACK_LANES + 8, b);
+    }
+    if (j < nGroups) {
+        __m256i val = unpackAvx2(in, j, width, _mm512_castsi512_si256(mask));
+        __m512i a = _mm512_add_epi64(_mm512_cvtepu32_epi64(val), base);
+        _mm512_storeu_si512(out + j * BITPACK_LANES, a);
+    }
+}
+
+__attribute__((target("avx512f,avx2")))
+static void filterAvx512(const uint32_t* in, size_t count, uint8_t width,
+                         uint32_t lo, uint32_t hi, uint64_t* matches) {
+    __m512i mask = _mm512_set1_epi32(static_cast<int>(maskOf(width)));
+    __m512i vlo = _mm512_set1_epi32(static_cast<int>(lo));
+    __m512i vhi = _mm512_set1_epi32(static_cast<int>(hi));
+    size_t nGroups = groupsOf(count);
+    size_t nWords = (nGroups + 7) >> 3;
+    size_t j = 0;
+    uint64_t word = 0;
+    for (; j + 1 < nGroups; j += 2) {
+        __m512i val = unpackAvx512(in, j, width, mask);
+        __mmask16 m = _mm512_mask_cmp_epu32_mask(_mm512_cmp_epu32_mask(val, vlo, _MM_CMPINT_NLT),
+                                                 val, vhi, _MM_CMPINT_LE);
+        word |= static_cast<uint64_t>(m) << ((j & 7) * BITPACK_LANES);
+        if ((j & 7) == 6) {
+            matches[j >> 3] = word;
+            word = 0;
+        }
+    }
+    if (j < nGroups) {
+        __m512i val = _mm512_castsi256_si512(unpackAvx2(in, j, width, _mm512_castsi512_si256(mask)));
+        __mmask16 m = _mm512_mask_cmp_epu32_mask(_mm512_cmp_epu32_mask(val, vlo, _MM_CMPINT_NLT),
+                                                 val, vhi, _MM_CMPINT_LE);
+        word |= static_cast<uint64_t>(m & 0xFF) << ((j & 7) * BITPACK_LANES);
+        ++j;
+    }
+    if (j & 7) {
+        matches[nWords - 1] = word;
+    }
+}
+
+SIMD_KERNELS_END
+
+#endif // BITPACK_X86
+
+/* AArch64 kernels, NEON is part of the base ISA there */
+
+#if defined(BITPACK_NEON)
+
+static inline void unpackNeon(const uint32_t* in, size_t j, uint8_t width, uint32x4_t mask,
+                              uint32x4_t& a, uint32x4_t& b) {
+    size_t pos = j * width;
+    const uint32_t* row = in + (pos >> 5) * BITPACK_LANES;
+    int32x4_t right = vdupq_n_s32(-static_cast<int32_t>(pos & 31));
+    int32x4_t left = vdupq_n_s32(32 - static_cast<int32_t>(pos & 31));   // USHL by 32 gives 0
+    a = vandq_u32(vorrq_u32(vshlq_u32(vld1q_u32(row), right),
+                            vshlq_u32(vld1q_u32(row + BITPACK_LANES), left)), mask);
+    b = vandq_u32(vorrq_u32(vshlq_u32(vld1q_u32(row + 4), right),
+                            vshlq_u32(vld1q_u32(row + BITPACK_LANES + 4), left)), mask);
+}
+
+static void decodeNeon(const uint32_t* in, size_t count, uint8_t width, int64_t ref, int64_t* out) {
+    uint32x4_t mask = vdupq_n_u32(maskOf(width));
+    int64x2_t base = vdupq_n_s64(ref);
+    for (size_t j = 0; j < groupsOf(count); ++j) {
+        uint32x4_t a, b;
+        unpackNeon(in, j, width, mask, a, b);
+        int64_t* dst = out + j * BITPACK_LANES;
+        vst1q_s64(dst,     vaddq_s64(vreinterpretq_s64_u64(vmovl_u32(vget_low_u32(a))), base));
+        vst1q_s64(dst + 2, vaddq_s64(vreinterpretq_s64_u64(vmovl_u32(vget_high_u32(a))), base));
+        vst1q_s64(dst + 4, vaddq_s64(vreinterpretq_s64_u64(vmovl_u32(vget_low_u32(b))), base));
+        vst1q_s64(dst + 6, vaddq_s64(vreinterpretq_s64_u64(vmovl_u32(vget_high_u32(b))), base));
+    }
+}
+
+static void filterNeon(const uint32_t* in, size_t count, uint8_t width,
+                       uint32_t lo, uint32_t hi, uint64_t* matches) {
+    static const uint32_t weights[4] = { 1, 2, 4, 8 };
+    uint32x4_t mask = vdupq_n_u32(maskOf(width));
+    uint32x4_t vlo = vdupq_n_u32(lo);
+    uint32x4_t vhi = vdupq_n_u32(hi);
+    uint32x4_t bit = vld1q_u32(weights);
+    uint64_t word = 0;
+    for (size_t j = 0; j < groupsOf(count); ++j) {
+        uint32x4_t a, b;
+        unpackNeon(in, j, width, mask, a, b);
+        uint32x4_t ma = vandq_u32(vcgeq_u32(a, vlo), vcleq_u32(a, vhi));
+        uint32x4_t mb = vandq_u32(vcgeq_u32(b, vlo), vcleq_u32(b, vhi));
+        uint64_t bits = vaddvq_u32(vandq_u32(ma, bit)) | (vaddvq_u32(vandq_u32(mb, bit)) << 4);
+        word |= bits << ((j & 7) * BITPACK_LANES);
+        if ((j & 7) == 7) {
+            matches[j >> 3] = word;
+            word = 0;
+        }
+    }
+    if (groupsOf(count) & 7) {
+        matches[groupsOf(count) >> 3] = word;
+    }
+}
+
+#endif // BITPACK_NEON
+
+/* Dispatch */
+
+struct BitpackKernels {
+    decode_fn decode;
+    filter_fn filter;
+    const char* name;
+};
+
+static const BitpackKernels& kernels() {
+    static const BitpackKernels best = [] {
+#if defined(BITPACK_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2")) {
+            return BitpackKernels{ decodeAvx512, filterAvx512, "avx512" };
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return BitpackKernels{ decodeAvx2, filterAvx2, "avx2" };
+        }
+#elif defined(BITPACK_NEON)
+        return BitpackKernels{ decodeNeon, filterNeon, "neon" };
+#endif
+        return BitpackKernels{ decodeScalar, filterScalar, "scalar" };
+    }();
+    return best;
+}
+
+/* Writes a multiple of BITPACK_LANES values, `out` must have room for the round-up */
+void bitpackDecode(const uint32_t* in, size_t count, uint8_t width, int64_t ref, int64_t* out) {
+    if (width == 0) {
+        for (size_t i = 0; i < groupsOf(count) * BITPACK_LANES; ++i) {
+            out[i] = ref;
+        }
+        return;
+    }
+    kernels().decode(in, count, width, ref, out);
+}
+
+/* Sets bit i of `matches` when lo <= offset i <= hi, bits past `count` are cleared */
+void bitpackFilter(const uint32_t* in, size_t count, uint8_t width,
+                   uint32_t lo, uint32_t hi, uint64_t* matches) {
+    size_t nWords = (count + 63) >> 6;
+    if (width == 0) {
+        uint64_t all = (lo == 0) ? ~0ULL : 0;
+        for (size_t w = 0; w < nWords; ++w) {
+            matches[w] = all;
+        }
+    }
+    else {
+        kernels().filter(in, count, width, lo, hi, matches);
+    }
+    if (count & 63) {
+        matches[nWords - 1] &= (1ULL << (count & 63)) - 1;
+    }
+}
+
+const char* bitpackKernelName() {
+    return kernels().name;
+}
\ No newline at end of file
@@ -0,0 +1,172 @@
+/*
+
+    Bloom Filter Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "bloom.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if SIMD_ENABLED && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#   define BLOOM_X86            1
+#   include <immintrin.h>
+#endif
+
+/* Odd multipliers, one per word of a block, that spread the low 32 bits of a hash */
+static const uint32_t BLOOM_SALTS[BLOOM_BLOCK_WORDS] = {
+    0x47B6137BU, 0x44974D91U, 0x8824AD5BU, 0xA2B7289DU, 0x705495C7U, 0x2DF1424BU, 0x9EFC4947U, 0x5C6BFB31U
+};
+
+/* Finalizer of MurmurHash3, every input bit reaches every output bit */
+static inline uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDULL;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+uint64_t bloomHash(int64_t key) {
+    return mix(static_cast<uint64_t>(key));
+}
+
+/* Eight bytes at a time, the length seeds the hash so that trailing zero bytes still count */
+uint64_t bloomHash(const char* data, size_t len) {
+    uint64_t h = len * 0x9E3779B97F4A7C15ULL;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        h = (h ^ mix(word)) * 0x9E3779B97F4A7C15ULL;
+        h = (h << 27) | (h >> 37);
+    }
+    if (i < len) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, len - i);
+        h ^= mix(word);
+    }
+    return mix(h);
+}
+
+size_t bloomBlockOf(uint64_t hash, size_t nBlocks) {
+    return static_cast<size_t>(((hash >> 32) * nBlocks) >> 32);
+}
+
+/* Bit of `word` that `hash` sets, 0 .. 63 */
+static inline uint32_t bitOf(uint64_t hash, size_t word) {
+    return (static_cast<uint32_t>(hash) * BLOOM_SALTS[word]) >> 26;
+}
+
+static bool containsScalar(const uint64_t* block, uint64_t hash) {
+    for (size_t w = 0; w < BLOOM_BLOCK_WORDS; ++w) {
+        if (!(block[w] & (1ULL << bitOf(hash, w)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#if defined(BLOOM_X86)
+
+SIMD_KERNELS_BEGIN
+
+/* Bit positions of all eight words from one 32-bit multiply per lane */
+__attribute__((target("avx2")))
+static inline __m256i bitsAvx2(uint64_t hash) {
+    const __m256i salts = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(BLOOM_SALTS));
+    __m256i key = _mm256_set1_epi32(static_cast<int32_t>(static_cast<uint32_t>(hash)));
+    return _mm256_srli_epi32(_mm256_mullo_epi32(key, salts), 26);
+}
+
+/* testc is 1 when every bit of the mask is also set in the block */
+__attribute__((target("avx2")))
+static bool containsAvx2(const uint64_t* block, uint64_t hash) {
+    const __m256i one = _mm256_set1_epi64x(1);
+    __m256i bits = bitsAvx2(hash);
+    __m256i lo = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(bits)));
+    __m256i hi = _mm256_sllv_epi64(one, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(bits, 1)));
+    __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block));
+    __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(block + 4));
+    return _mm256_testc_si256(b0, lo) & _mm256_testc_si256(b1, hi);
+}
+
+/* One lane per word, each mask has a single bit so every lane must test non-zero */
+__attribute__((target("avx512f")))
+static bool containsAvx512(const uint64_t* block, uint64_t hash) {
+    __m512i masks = _mm512_sllv_epi64(_mm512_set1_epi64(1), _mm512_cvtepu32_epi64(bitsAvx2(hash)));
+    return _mm512_test_epi64_mask(_mm512_loadu_si512(block), masks) == 0xFF;
+}
+
+SIMD_KERNELS_END
+
+#endif // BLOOM_X86
+
+/* Dispatch */
+
+typedef bool (*contains_fn)(const uint64_t*, uint64_t);
+
+struct BloomKernels {
+    contains_fn contains;
+    const char* name;
+};
+
+static const BloomKernels& kernels() {
+    static const BloomKernels best = [] {
+#if defined(BLOOM_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return BloomKernels{ containsAvx512, "avx512" };
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return BloomKernels{ containsAvx2, "avx2" };
+        }
+#endif
+        return BloomKernels{ containsScalar, "scalar" };
+    }();
+    return best;
+}
+
+bool bloomBlockContains(const uint64_t* block, uint64_t hash) {
+    return kernels().contains(block, hash);
+}
+
+const char* bloomKernelName() {
+    return kernels().name;
+}
+
+/* BloomFilter */
+
+/* Sized for `nKeys` keys at `bitsPerKey` bits each, at least one block */
+void BloomFilter::reset(size_t nKeys, size_t bitsPerKey) {
+    size_t blockBits = BLOOM_BLOCK_WORDS * 64;
+    size_t nBlocks = std::max<size_t>(1, (nKeys * bitsPerKey + blockBits - 1) / blockBits);
+    words.assign(nBlocks * BLOOM_BLOCK_WORDS, 0);
+}
+
+void BloomFilter::add(uint64_t hash) {
+    uint64_t* block = words.data() + bloomBlockOf(hash, getNumBlocks()) * BLOOM_BLOCK_WORDS;
+    for (size_t w = 0; w < BLOOM_BLOCK_WORDS; ++w) {
+        block[w] |= 1ULL << bitOf(hash, w);
+    }
+}
+
+bool BloomFilter::contains(uint64_t hash) const {
+    return bloomBlockContains(words.data() + bloomBlockOf(hash, getNumBlocks()) * BLOOM_BLOCK_WORDS, hash);
+}
\ No newline at end of file
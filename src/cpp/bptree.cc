@@ -0,0 +1,703 @@
+/*
+
+    B+ Tree Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "bptree.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+/*
+
+    Some basic rules about the tree:
+        - Nothing read from a node without its latch is acted on before the
+          version it was read at is validated; until then reads only stay
+          inside the page (counts are clamped to the node's capacity)
+        - A node's latch is only taken by upgrading the version the node was
+          read at on the way down, so what the path says about it still holds
+        - A split latches the nodes it changes before it changes any of them,
+          and allocates the pages it adds before too, so it either happens
+          whole or not at all; a thread latches at most 2 * height + 1 frames
+        - Every leaf is on one level, 0, and a node's children on the level
+          below it; the root is at level height - 1
+        - Separators are copies of entries, the first of the node on their
+          right when it was split off, and need not be in the tree anymore
+
+*/
+
+/* Views of a node page */
+static const BPTreeNode* nodeOf(const char* page) {
+    return reinterpret_cast<const BPTreeNode*>(page);
+}
+
+static BPTreeNode* nodeOf(char* page) {
+    return reinterpret_cast<BPTreeNode*>(page);
+}
+
+static const BPTreeEntry* entriesOf(const char* page) {
+    return reinterpret_cast<const BPTreeEntry*>(page + sizeof(BPTreeNode));
+}
+
+static BPTreeEntry* entriesOf(char* page) {
+    return reinterpret_cast<BPTreeEntry*>(page + sizeof(BPTreeNode));
+}
+
+static const page_id_t* childrenOf(const char* page) {
+    return reinterpret_cast<const page_id_t*>(page + sizeof(BPTreeNode) + BPTREE_INNER_CAPACITY * sizeof(BPTreeEntry));
+}
+
+static page_id_t* childrenOf(char* page) {
+    return reinterpret_cast<page_id_t*>(page + sizeof(BPTreeNode) + BPTREE_INNER_CAPACITY * sizeof(BPTreeEntry));
+}
+
+/* Entry count of a node read without its latch, kept inside the page */
+static size_t countOf(const char* page, size_t capacity) {
+    return std::min<size_t>(nodeOf(page)->nEntries, capacity);
+}
+
+/* Child of an inner node covering `entry` */
+static size_t childIndex(const char* page, const BPTreeEntry& entry) {
+    const BPTreeEntry* seps = entriesOf(page);
+    return std::upper_bound(seps, seps + countOf(page, BPTREE_INNER_CAPACITY), entry) - seps;
+}
+
+/* Position of the first entry of a leaf not below `entry` */
+static size_t leafIndex(const char* page, const BPTreeEntry& entry) {
+    const BPTreeEntry* entries = entriesOf(page);
+    return std::lower_bound(entries, entries + countOf(page, BPTREE_LEAF_CAPACITY), entry) - entries;
+}
+
+/* Put an entry in a leaf with room for it */
+static void insertLeaf(char* page, size_t pos, const BPTreeEntry& entry) {
+    BPTreeEntry* entries = entriesOf(page);
+    memmove(entries + pos + 1, entries + pos, (nodeOf(page)->nEntries - pos) * sizeof(BPTreeEntry));
+    entries[pos] = entry;
+    ++nodeOf(page)->nEntries;
+}
+
+/* Put a separator and the child on its right in an inner node with room for them */
+static void insertInner(char* page, size_t pos, const BPTreeEntry& sep, page_id_t right) {
+    size_t n = nodeOf(page)->nEntries;
+    BPTreeEntry* seps = entriesOf(page);
+    page_id_t* children = childrenOf(page);
+    memmove(seps + pos + 1, seps + pos, (n - pos) * sizeof(BPTreeEntry));
+    memmove(children + pos + 2, children + pos + 1, (n - pos) * sizeof(page_id_t));
+    seps[pos] = sep;
+    children[pos + 1] = right;
+    ++nodeOf(page)->nEntries;
+}
+
+/* Split a full leaf with `entry` going in at `pos`, the right half goes to the empty page `splitPage` */
+static void splitLeaf(char* page, size_t pos, const BPTreeEntry& entry, char* splitPage, page_id_t splitId,
+                      BPTreeEntry& sep) {
+    BPTreeEntry all[BPTREE_LEAF_CAPACITY + 1];
+    const BPTreeEntry* entries = entriesOf(page);
+    std::copy(entries, entries + pos, all);
+    all[pos] = entry;
+    std::copy(entries + pos, entries + BPTREE_LEAF_CAPACITY, all + pos + 1);
+
+    size_t nLeft = (BPTREE_LEAF_CAPACITY + 1) / 2;
+    size_t nRight = BPTREE_LEAF_CAPACITY + 1 - nLeft;
+    std::copy(all, all + nLeft, entriesOf(page));
+    std::copy(all + nLeft, all + nLeft + nRight, entriesOf(splitPage));
+
+    BPTreeNode* node = nodeOf(page);
+    BPTreeNode* splitNode = nodeOf(splitPage);
+    splitNode->level = 0;
+    splitNode->nEntries = static_cast<uint16_t>(nRight);
+    splitNode->next = node->next;
+    node->nEntries = static_cast<uint16_t>(nLeft);
+    node->next = splitId;
+    sep = all[nLeft];
+}
+
+/*
+    Split a full inner node with separator `sep` and child `right` going in
+    at `pos`, the right half goes to the empty page `splitPage`. The middle
+    separator moves up: it comes back in `sep`
+*/
+static void splitInner(char* page, size_t pos, BPTreeEntry& sep, page_id_t right, char* splitPage) {
+    BPTreeEntry seps[BPTREE_INNER_CAPACITY + 1];
+    page_id_t children[BPTREE_INNER_CAPACITY + 2];
+    const BPTreeEntry* oldSeps = entriesOf(page);
+    const page_id_t* oldChildren = childrenOf(page);
+    std::copy(oldSeps, oldSeps + pos, seps);
+    seps[pos] = sep;
+    std::copy(oldSeps + pos, oldSeps + BPTREE_INNER_CAPACITY, seps + pos + 1);
+    std::copy(oldChildren, oldChildren + pos + 1, children);
+    children[pos + 1] = right;
+    std::copy(oldChildren + pos + 1, oldChildren + BPTREE_INNER_CAPACITY + 1, children + pos + 2);
+
+    size_t nLeft = (BPTREE_INNER_CAPACITY + 1) / 2;
+    size_t nRight = BPTREE_INNER_CAPACITY - nLeft;
+    std::copy(seps, seps + nLeft, entriesOf(page));
+    std::copy(children, children + nLeft + 1, childrenOf(page));
+    std::copy(seps + nLeft + 1, seps + BPTREE_INNER_CAPACITY + 1, entriesOf(splitPage));
+    std::copy(children + nLeft + 1, children + BPTREE_INNER_CAPACITY + 2, childrenOf(splitPage));
+
+    BPTreeNode* splitNode = nodeOf(splitPage);
+    splitNode->level = nodeOf(page)->level;
+    splitNode->nEntries = static_cast<uint16_t>(nRight);
+    splitNode->next = INVALID_ID;
+    nodeOf(page)->nEntries = static_cast<uint16_t>(nLeft);
+    sep = seps[nLeft];
+}
+
+/* Release the latches of the lowest `n` nodes of a path, marking them dirty if they were changed */
+static void unlatchPath(BPTreePath& path, uint32_t n, bool dirty) {
+    for (uint32_t level = 0; level < n; ++level) {
+        if (dirty) {
+            path.frames[level]->dirty = true;
+        }
+        path.frames[level]->latch.unlock();
+    }
+}
+
+BPlusTree::BPlusTree(PagePool& pool) :
+    pool(pool), root(INVALID_ID), height(0), nEntries(0) {}
+
+/* Read the header, or lay out an empty tree (a header and one leaf) if the file is empty. Not concurrent */
+ColumnStatus BPlusTree::open() {
+    if (pool.getNumPages() == 0) {
+        PageFrame* header;
+        PageFrame* leaf;
+        ColumnStatus rc = pool.allocate(header);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        if (header->pageId != HEADER_PAGE_ID) {
+            header->latch.unlock();
+            return ColumnStatus::GENERAL_FAILURE;
+        }
+        rc = pool.allocate(leaf);
+        header->latch.unlock();
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        BPTreeNode* node = nodeOf(leaf->data);
+        node->level = 0;
+        node->nEntries = 0;
+        node->next = INVALID_ID;
+        root = leaf->pageId.load();
+        height = 1;
+        nEntries = 0;
+        leaf->latch.unlock();
+        return writeHeader();
+    }
+
+    PageFrame* frame;
+    ColumnStatus rc = pool.fixExclusive(HEADER_PAGE_ID, frame);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    BPTreeHeader hdr;
+    memcpy(&hdr, frame->data, sizeof(hdr));
+    frame->latch.unlock();
+    if (hdr.magic != BPTREE_MAGIC || hdr.version != BPTREE_VERSION || hdr.height == 0 ||
+        hdr.height > BPTREE_MAX_HEIGHT || hdr.root <= HEADER_PAGE_ID || hdr.root >= pool.getNumPages()) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    root = hdr.root;
+    height = hdr.height;
+    nEntries = hdr.nEntries;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+ColumnStatus BPlusTree::writeHeader() {
+    BPTreeHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = BPTREE_MAGIC;
+    hdr.version = BPTREE_VERSION;
+    for (uint64_t v; ; std::this_thread::yield()) {
+        if (rootLatch.readLock(v)) {
+            hdr.root = root;
+            hdr.height = height;
+            if (rootLatch.validate(v)) {
+                break;
+            }
+        }
+    }
+    hdr.nEntries = nEntries;
+
+    PageFrame* frame;
+    ColumnStatus rc = pool.fixExclusive(HEADER_PAGE_ID, frame);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    memcpy(frame->data, &hdr, sizeof(hdr));
+    frame->dirty = true;
+    frame->latch.unlock();
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Write the header and every changed page to the file */
+ColumnStatus BPlusTree::flush() {
+    ColumnStatus rc = writeHeader();
+    return rc == ColumnStatus::GENERAL_SUCCESS ? pool.flush() : rc;
+}
+
+/*
+    Go down to the leaf `entry` belongs in, noting every node and its
+    version in `path`. False if something changed on the way, to start
+    over, or on an error, which is then in `rc`
+*/
+bool BPlusTree::findLeaf(const BPTreeEntry& entry, BPTreePath& path, ColumnStatus& rc) {
+    rc = ColumnStatus::GENERAL_SUCCESS;
+    if (!rootLatch.readLock(path.rootVersion)) {
+        return false;
+    }
+    page_id_t pageId = root.load(std::memory_order_relaxed);
+    path.height = height.load(std::memory_order_relaxed);
+    if (!rootLatch.validate(path.rootVersion)) {
+        return false;
+    }
+
+    const OptimisticLatch* parent = &rootLatch;
+    uint64_t parentVersion = path.rootVersion;
+    for (uint32_t level = path.height - 1; ; --level) {
+        PageFrame* frame;
+        if ((rc = pool.fix(pageId, frame)) != ColumnStatus::GENERAL_SUCCESS) {
+            if (!parent->validate(parentVersion)) {
+                rc = ColumnStatus::GENERAL_SUCCESS;     // The id came from a node that changed
+            }
+            return false;
+        }
+        uint64_t v;
+        if (!frame->latch.readLock(v) || frame->pageId.load(std::memory_order_relaxed) != pageId ||
+            !parent->validate(parentVersion)) {
+            return false;
+        }
+        path.frames[level] = frame;
+        path.versions[level] = v;
+
+        const char* page = frame->data;
+        if (nodeOf(page)->level != level) {
+            if (frame->latch.validate(v)) {
+                rc = ColumnStatus::CORRUPT_SEGMENT;
+            }
+            return false;
+        }
+        if (level == 0) {
+            return true;
+        }
+        pageId = childrenOf(page)[childIndex(page, entry)];
+        parent = &frame->latch;
+        parentVersion = v;
+    }
+}
+
+/* Add an entry, GENERAL_FAILURE if it is in the tree already or the tree would get too high */
+ColumnStatus BPlusTree::insert(int64_t key, uint64_t value) {
+    BPTreeEntry entry = { key, value };
+    ColumnStatus rc;
+    for (BPTreePath path; ; std::this_thread::yield()) {
+        if (!findLeaf(entry, path, rc)) {
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            continue;
+        }
+        PageFrame* leaf = path.frames[0];
+        if (!leaf->latch.tryUpgrade(path.versions[0])) {
+            continue;
+        }
+
+        char* page = leaf->data;
+        size_t n = nodeOf(page)->nEntries;
+        size_t pos = leafIndex(page, entry);
+        if (pos < n && entriesOf(page)[pos] == entry) {
+            leaf->latch.unlock();
+            return ColumnStatus::GENERAL_FAILURE;
+        }
+        if (n < BPTREE_LEAF_CAPACITY) {
+            insertLeaf(page, pos, entry);
+            leaf->dirty = true;
+            leaf->latch.unlock();
+            nEntries.fetch_add(1, std::memory_order_relaxed);
+            return ColumnStatus::GENERAL_SUCCESS;
+        }
+        if (split(entry, path, rc) || rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+}
+
+/*
+    Insert `entry` into the full leaf of `path`, latched by the caller,
+    splitting it and the full nodes above it. Every latch is released on
+    return. False if a parent changed since the path was read, to start
+    over, or on an error, which is then in `rc`
+*/
+bool BPlusTree::split(const BPTreeEntry& entry, BPTreePath& path, ColumnStatus& rc) {
+    rc = ColumnStatus::GENERAL_SUCCESS;
+
+    /* Latch the parents the separators go into, up to one with room or the root */
+    uint32_t h = path.height;
+    uint32_t nLatched = 1;
+    bool room = false;
+    while (nLatched < h && !room) {
+        PageFrame* node = path.frames[nLatched];
+        if (!node->latch.tryUpgrade(path.versions[nLatched])) {
+            unlatchPath(path, nLatched, false);
+            return false;
+        }
+        room = nodeOf(node->data)->nEntries < BPTREE_INNER_CAPACITY;
+        ++nLatched;
+    }
+    if (!room) {
+        if (h == BPTREE_MAX_HEIGHT) {
+            unlatchPath(path, nLatched, false);
+            rc = ColumnStatus::GENERAL_FAILURE;
+            return true;
+        }
+        if (!rootLatch.tryUpgrade(path.rootVersion)) {
+            unlatchPath(path, nLatched, false);
+            return false;
+        }
+    }
+
+    /* One new page per node that splits, and one for a new root */
+    size_t nSplits = room ? nLatched - 1 : nLatched;
+    size_t nNew = room ? nSplits : nSplits + 1;
+    PageFrame* fresh[BPTREE_MAX_HEIGHT + 1];
+    for (size_t i = 0; i < nNew; ++i) {
+        if ((rc = pool.allocate(fresh[i])) != ColumnStatus::GENERAL_SUCCESS) {
+            for (size_t j = 0; j < i; ++j) {
+                fresh[j]->latch.unlock();       // Left unused, zeroed pages
+            }
+            unlatchPath(path, nLatched, false);
+            if (!room) {
+                rootLatch.unlock();
+            }
+            return false;
+        }
+    }
+
+    char* page = path.frames[0]->data;
+    BPTreeEntry sep;
+    page_id_t right = fresh[0]->pageId;
+    splitLeaf(page, leafIndex(page, entry), entry, fresh[0]->data, right, sep);
+    for (uint32_t level = 1; level < nLatched; ++level) {
+        page = path.frames[level]->data;
+        size_t pos = childIndex(page, sep);
+        if (level < nSplits) {
+            splitInner(page, pos, sep, right, fresh[level]->data);
+            right = fresh[level]->pageId;
+        }
+        else {
+            insertInner(page, pos, sep, right);
+        }
+    }
+    if (!room) {
+        char* rootPage = fresh[nSplits]->data;
+        BPTreeNode* node = nodeOf(rootPage);
+        node->level = static_cast<uint16_t>(h);
+        node->nEntries = 1;
+        node->next = INVALID_ID;
+        entriesOf(rootPage)[0] = sep;
+        childrenOf(rootPage)[0] = root.load(std::memory_order_relaxed);
+        childrenOf(rootPage)[1] = right;
+        root.store(fresh[nSplits]->pageId, std::memory_order_relaxed);
+        height.store(h + 1, std::memory_order_relaxed);
+    }
+
+    for (size_t i = 0; i < nNew; ++i) {
+        fresh[i]->latch.unlock();
+    }
+    unlatchPath(path, nLatched, true);
+    if (!room) {
+        rootLatch.unlock();
+    }
+    nEntries.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+/* Take an entry out, INDEX_OUT_OF_BOUNDS if it is not in the tree */
+ColumnStatus BPlusTree::remove(int64_t key, uint64_t value) {
+    BPTreeEntry entry = { key, value };
+    ColumnStatus rc;
+    for (BPTreePath path; ; std::this_thread::yield()) {
+        if (!findLeaf(entry, path, rc)) {
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            continue;
+        }
+        PageFrame* leaf = path.frames[0];
+        if (!leaf->latch.tryUpgrade(path.versions[0])) {
+            continue;
+        }
+
+        char* page = leaf->data;
+        size_t n = nodeOf(page)->nEntries;
+        size_t pos = leafIndex(page, entry);
+        if (pos == n || !(entriesOf(page)[pos] == entry)) {
+            leaf->latch.unlock();
+            return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+        }
+        BPTreeEntry* entries = entriesOf(page);
+        memmove(entries + pos, entries + pos + 1, (n - pos - 1) * sizeof(BPTreeEntry));
+        --nodeOf(page)->nEntries;
+        leaf->dirty = true;
+        leaf->latch.unlock();
+        nEntries.fetch_sub(1, std::memory_order_relaxed);
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+}
+
+/* Values of `key` in order, none if it is not in the tree */
+ColumnStatus BPlusTree::lookup(int64_t key, std::vector<uint64_t>& values) {
+    BPTreeEntry from = { key, 0 };
+    ColumnStatus rc;
+    for (BPTreePath path; ; std::this_thread::yield()) {
+        values.clear();
+        if (!findLeaf(from, path, rc)) {
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            continue;
+        }
+
+        /* The values may go on into the leaves to the right */
+        PageFrame* leaf = path.frames[0];
+        uint64_t v = path.versions[0];
+        for (size_t pos = leafIndex(leaf->data, from); ; pos = 0) {
+            const char* page = leaf->data;
+            const BPTreeEntry* entries = entriesOf(page);
+            size_t n = countOf(page, BPTREE_LEAF_CAPACITY);
+            for (; pos < n && entries[pos].key == key; ++pos) {
+                values.push_back(entries[pos].value);
+            }
+            page_id_t next = nodeOf(page)->next;
+            if (!leaf->latch.validate(v)) {
+                break;
+            }
+            if (pos < n || next == INVALID_ID) {
+                return ColumnStatus::GENERAL_SUCCESS;
+            }
+            if ((rc = pool.fix(next, leaf)) != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            if (!leaf->latch.readLock(v) || leaf->pageId.load(std::memory_order_relaxed) != next) {
+                break;
+            }
+        }
+    }
+}
+
+BPlusTreeScan::BPlusTreeScan(BPlusTree& tree, int64_t lo, int64_t hi) :
+    tree(tree), from({ lo, 0 }), hi(hi), done(lo > hi) {}
+
+/* Next batch of entries, along the leaves from where the last one ended */
+ColumnStatus BPlusTreeScan::next(std::vector<BPTreeEntry>& entries) {
+
+    entries.clear();
+    if (done) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+
+    ColumnStatus rc;
+    bool end = false;
+    for (BPTreePath path; ; std::this_thread::yield()) {
+        entries.clear();
+        end = false;
+        if (!tree.findLeaf(from, path, rc)) {
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            continue;
+        }
+
+        PageFrame* leaf = path.frames[0];
+        uint64_t v = path.versions[0];
+        bool consistent = false;
+        for (size_t pos = leafIndex(leaf->data, from); ; pos = 0) {
+            const char* page = leaf->data;
+            const BPTreeEntry* leafEntries = entriesOf(page);
+            size_t n = countOf(page, BPTREE_LEAF_CAPACITY);
+            for (; pos < n && entries.size() < COLUMN_VECTOR_SIZE && !end; ++pos) {
+                if (leafEntries[pos].key > hi) {
+                    end = true;
+                }
+                else {
+                    entries.push_back(leafEntries[pos]);
+                }
+            }
+            page_id_t next = nodeOf(page)->next;
+            if (!leaf->latch.validate(v)) {
+                break;
+            }
+            if (end || entries.size() == COLUMN_VECTOR_SIZE || next == INVALID_ID) {
+                end = end || (next == INVALID_ID && entries.size() < COLUMN_VECTOR_SIZE);
+                consistent = true;
+                break;
+            }
+            if ((rc = tree.pool.fix(next, leaf)) != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            if (!leaf->latch.readLock(v) || leaf->pageId.load(std::memory_order_relaxed) != next) {
+                break;
+            }
+        }
+        if (consistent) {
+            break;
+        }
+    }
+    done = end;
+
+    if (entries.empty()) {
+        done = true;
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+
+    /* Carry on right after the last entry returned */
+    const BPTreeEntry& last = entries.back();
+    if (last.value < UINT64_MAX) {
+        from = { last.key, last.value + 1 };
+    }
+    else if (last.key < INT64_MAX) {
+        from = { last.key + 1, 0 };
+    }
+    else {
+        done = true;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+BPlusTreeBuilder::BPlusTreeBuilder(BPlusTree& tree) :
+    tree(tree), leaf(nullptr), nEntries(0) {
+    setFillFactor(BPTREE_FILL_FACTOR);
+}
+
+BPlusTreeBuilder::~BPlusTreeBuilder() {
+    if (leaf) {
+        leaf->latch.unlock();       // Never linked into the tree
+    }
+}
+
+/* Start a load, GENERAL_FAILURE if the tree is not empty */
+ColumnStatus BPlusTreeBuilder::open() {
+    if (leaf || tree.getNumEntries() != 0 || tree.getHeight() != 1) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    ColumnStatus rc = tree.pool.allocate(leaf);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        leaf = nullptr;
+        return rc;
+    }
+    nodeOf(leaf->data)->next = INVALID_ID;
+    level.assign(1, leaf->pageId);
+    lows.clear();
+    nEntries = 0;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Percent of each node to fill, from 1 to 100 */
+ColumnStatus BPlusTreeBuilder::setFillFactor(int percent) {
+    if (percent < 1 || percent > 100) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    leafFill = std::max<size_t>(BPTREE_LEAF_CAPACITY * percent / 100, 1);
+    innerFill = std::max<size_t>(BPTREE_INNER_CAPACITY * percent / 100, 2);   // finish() needs 3 children to share
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Add the next entry, GENERAL_FAILURE if it is not above the last one */
+ColumnStatus BPlusTreeBuilder::append(int64_t key, uint64_t value) {
+    BPTreeEntry entry = { key, value };
+    if (!leaf || (nEntries > 0 && !(last < entry))) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+
+    BPTreeNode* node = nodeOf(leaf->data);
+    if (node->nEntries == leafFill) {
+        PageFrame* next;
+        ColumnStatus rc = tree.pool.allocate(next);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        node->next = next->pageId;
+        leaf->latch.unlock();
+        leaf = next;
+        node = nodeOf(leaf->data);
+        node->next = INVALID_ID;
+        level.push_back(leaf->pageId);
+    }
+    if (node->nEntries == 0) {
+        lows.push_back(entry);
+    }
+    entriesOf(leaf->data)[node->nEntries++] = entry;
+    last = entry;
+    ++nEntries;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Build the inner levels over the leaves, make them the tree and flush it */
+ColumnStatus BPlusTreeBuilder::finish() {
+    if (!leaf) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    leaf->latch.unlock();
+    leaf = nullptr;
+
+    uint32_t height = 1;
+    while (level.size() > 1) {
+        if (height == BPTREE_MAX_HEIGHT) {
+            return ColumnStatus::GENERAL_FAILURE;
+        }
+        std::vector<page_id_t> upper;
+        std::vector<BPTreeEntry> upperLows;
+        size_t fanout = innerFill + 1;
+        size_t nChildren;
+        for (size_t first = 0; first < level.size(); first += nChildren) {
+            size_t left = level.size() - first;
+            nChildren = std::min(fanout, left);
+            if (left > fanout && 2 * left < 3 * fanout) {
+                nChildren = (left + 1) / 2;     // Even out the last two rather than leave the last one nearly empty
+            }
+            PageFrame* frame;
+            ColumnStatus rc = tree.pool.allocate(frame);
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            char* page = frame->data;
+            BPTreeNode* node = nodeOf(page);
+            node->level = static_cast<uint16_t>(height);
+            node->nEntries = static_cast<uint16_t>(nChildren - 1);
+            node->next = INVALID_ID;
+            std::copy(lows.begin() + first + 1, lows.begin() + first + nChildren, entriesOf(page));
+            std::copy(level.begin() + first, level.begin() + first + nChildren, childrenOf(page));
+            upper.push_back(frame->pageId);
+            upperLows.push_back(lows[first]);
+            frame->latch.unlock();
+        }
+        level.swap(upper);
+        lows.swap(upperLows);
+        ++height;
+    }
+
+    tree.rootLatch.lock();
+    tree.root = level[0];
+    tree.height = height;
+    tree.nEntries = nEntries;
+    tree.rootLatch.unlock();
+    level.clear();
+    lows.clear();
+    return tree.flush();
+}
@@ -0,0 +1,323 @@
+/*
+
+    Bulk Load Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "bulk_load.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#define  CSV_SCAN_WINDOW        65536     // Bytes read at a time while looking for a line break
+
+/* Offset just past the first line break at or after `pos`, the file size if there is none */
+static ColumnStatus nextLine(os_fd_t fd, uint64_t pos, uint64_t fileSize, uint64_t& after) {
+    std::vector<char> window(CSV_SCAN_WINDOW);
+    while (pos < fileSize) {
+        size_t len = static_cast<size_t>(std::min<uint64_t>(window.size(), fileSize - pos));
+        if (osRead(fd, window.data(), len, static_cast<int64_t>(pos)) != static_cast<ssize_t>(len)) {
+            return ColumnStatus::IO_ERROR;
+        }
+        const char* eol = static_cast<const char*>(memchr(window.data(), '\n', len));
+        if (eol) {
+            after = pos + (eol - window.data()) + 1;
+            return ColumnStatus::GENERAL_SUCCESS;
+        }
+        pos += len;
+    }
+    after = fileSize;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Pieces of about `opts.pieceBytes` each, every one ending on a line break or at the end of the file */
+ColumnStatus csvSplit(os_fd_t fd, const CsvOptions& opts, std::vector<CsvPiece>& pieces) {
+
+    pieces.clear();
+    int64_t size = osFileSize(fd);
+    if (size < 0) {
+        return ColumnStatus::IO_ERROR;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(size);
+    uint64_t pieceBytes = std::max<uint64_t>(1, opts.pieceBytes);
+
+    uint64_t begin = 0;
+    ColumnStatus rc = ColumnStatus::GENERAL_SUCCESS;
+    if (opts.header) {
+        rc = nextLine(fd, 0, fileSize, begin);
+    }
+    while (rc == ColumnStatus::GENERAL_SUCCESS && begin < fileSize) {
+        uint64_t end = fileSize;
+        if (fileSize - begin > pieceBytes) {
+            rc = nextLine(fd, begin + pieceBytes - 1, fileSize, end);
+        }
+        pieces.push_back(CsvPiece{ begin, end, 0, 0 });
+        begin = end;
+    }
+    return rc;
+}
+
+/* Lines in `data`, the last one need not end in a line break */
+uint64_t csvCountRows(const char* data, size_t size) {
+    uint64_t n = 0;
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        ++n;
+        if (!eol) {
+            break;
+        }
+        p = eol + 1;
+    }
+    return n;
+}
+
+/* Decimal integer with an optional sign, false on anything else or on overflow */
+bool parseInt64(const char* str, size_t len, int64_t& val) {
+    size_t i = 0;
+    bool neg = false;
+    if (i < len && (str[i] == '-' || str[i] == '+')) {
+        neg = str[i++] == '-';
+    }
+    if (i == len) {
+        return false;
+    }
+    uint64_t limit = neg ? static_cast<uint64_t>(INT64_MAX) + 1 : static_cast<uint64_t>(INT64_MAX);
+    uint64_t acc = 0;
+    for (; i < len; ++i) {
+        unsigned digit = static_cast<unsigned char>(str[i]) - '0';
+        if (digit > 9 || acc > (limit - digit) / 10) {
+            return false;
+        }
+        acc = acc * 10 + digit;
+    }
+    val = neg ? static_cast<int64_t>(0 - acc) : static_cast<int64_t>(acc);
+    return true;
+}
+
+/* `len` digits at `str`, false if any is not a digit */
+static bool parseDigits(const char* str, size_t len, int& val) {
+    val = 0;
+    for (size_t i = 0; i < len; ++i) {
+        unsigned digit = static_cast<unsigned char>(str[i]) - '0';
+        if (digit > 9) {
+            return false;
+        }
+        val = val * 10 + static_cast<int>(digit);
+    }
+    return true;
+}
+
+/* Days from 1970-01-01 to a date of the proleptic Gregorian calendar */
+static int64_t daysFromCivil(int64_t y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* Microseconds since the epoch, or a UTC date and time: YYYY-MM-DD[( |T)HH:MM:SS[.f{1,6}]][Z] */
+bool parseTimestamp(const char* str, size_t len, int64_t& val) {
+
+    if (len < 10 || str[4] != '-' || str[7] != '-') {
+        return parseInt64(str, len, val);
+    }
+    static const int DAYS_IN_MONTH[] = { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+    int year, month, day, hour = 0, minute = 0, second = 0, micros = 0;
+    if (!parseDigits(str, 4, year) || !parseDigits(str + 5, 2, month) || !parseDigits(str + 8, 2, day) ||
+        month < 1 || month > 12 || day < 1 || day > DAYS_IN_MONTH[month - 1] ||
+        (month == 2 && day == 29 && (year % 4 != 0 || (year % 100 == 0 && year % 400 != 0)))) {
+        return false;
+    }
+
+    size_t i = 10;
+    if (i < len && (str[i] == ' ' || str[i] == 'T')) {
+        if (len < i + 9 || str[i + 3] != ':' || str[i + 6] != ':' ||
+            !parseDigits(str + i + 1, 2, hour) || !parseDigits(str + i + 4, 2, minute) ||
+            !parseDigits(str + i + 7, 2, second) || hour > 23 || minute > 59 || second > 59) {
+            return false;
+        }
+        i += 9;
+        if (i < len && str[i] == '.') {
+            size_t digits = 0;
+            for (++i; i < len && digits < 6 && str[i] >= '0' && str[i] <= '9'; ++i, ++digits) {
+                micros = micros * 10 + (str[i] - '0');
+            }
+            if (digits == 0) {
+                return false;
+            }
+            for (; digits < 6; ++digits) {
+                micros *= 10;
+            }
+        }
+    }
+    if (i < len && str[i] == 'Z') {
+        ++i;
+    }
+    if (i != len) {
+        return false;
+    }
+
+    int64_t secs = daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second;
+    val = secs * 1000000 + micros;
+    return true;
+}
+
+/* Append one field to its column, TYPE_MISMATCH if it is not a value of the column's type */
+static ColumnStatus addField(ColumnBatch& col, ColumnType type, const char* str, size_t len, bool quoted) {
+    bool null = len == 0 && !quoted;
+    col.nulls.push_back(null);
+    if (type == ColumnType::STRING) {
+        col.strings.emplace_back(str, len);
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    int64_t val = 0;
+    if (!null && !(type == ColumnType::TIMESTAMP ? parseTimestamp(str, len, val) : parseInt64(str, len, val))) {
+        return ColumnStatus::TYPE_MISMATCH;
+    }
+    col.values.push_back(val);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Parse whole lines into one ColumnBatch per column. GENERAL_FAILURE if
+    a line has the wrong number of fields or an unterminated quote,
+    TYPE_MISMATCH if a field does not parse as its column's type.
+
+*/
+ColumnStatus csvParse(const char* data, size_t size, char delimiter, const std::vector<ColumnType>& types,
+                      std::vector<ColumnBatch>& columns) {
+
+    size_t nRows = static_cast<size_t>(csvCountRows(data, size));
+    columns.assign(types.size(), ColumnBatch());
+    for (size_t c = 0; c < types.size(); ++c) {
+        columns[c].nulls.reserve(nRows);
+        if (types[c] == ColumnType::STRING) {
+            columns[c].strings.reserve(nRows);
+        }
+        else {
+            columns[c].values.reserve(nRows);
+        }
+    }
+
+    std::string unquoted;
+    const char* p = data;
+    const char* end = data + size;
+    while (p < end) {
+
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        const char* lineEnd = eol ? eol : end;
+        if (lineEnd > p && lineEnd[-1] == '\r') {
+            --lineEnd;
+        }
+
+        size_t c = 0;
+        const char* field = p;
+        for (;;) {
+            if (c == types.size()) {
+                return ColumnStatus::GENERAL_FAILURE;
+            }
+            const char* next;
+            ColumnStatus rc;
+            if (field < lineEnd && *field == '"') {
+
+                /* Up to the closing quote, a doubled quote stands for one */
+                unquoted.clear();
+                const char* q = field + 1;
+                for (;;) {
+                    const char* close = static_cast<const char*>(memchr(q, '"', lineEnd - q));
+                    if (!close) {
+                        return ColumnStatus::GENERAL_FAILURE;
+                    }
+                    unquoted.append(q, close);
+                    if (close + 1 < lineEnd && close[1] == '"') {
+                        unquoted.push_back('"');
+                        q = close + 2;
+                        continue;
+                    }
+                    next = close + 1;
+                    break;
+                }
+                if (next != lineEnd && *next != delimiter) {
+                    return ColumnStatus::GENERAL_FAILURE;
+                }
+                rc = addField(columns[c], types[c], unquoted.data(), unquoted.size(), true);
+            }
+            else {
+                next = static_cast<const char*>(memchr(field, delimiter, lineEnd - field));
+                if (!next) {
+                    next = lineEnd;
+                }
+                rc = addField(columns[c], types[c], field, next - field, false);
+            }
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            ++c;
+            if (next == lineEnd) {
+                break;
+            }
+            field = next + 1;
+        }
+        if (c != types.size()) {
+            return ColumnStatus::GENERAL_FAILURE;
+        }
+        p = eol ? eol + 1 : end;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* fn(0) .. fn(n - 1) on up to `nThreads` threads, the caller's included; stops at the first failure */
+ColumnStatus parallelFor(size_t n, size_t nThreads, const std::function<ColumnStatus(size_t)>& fn) {
+
+    std::atomic<size_t> next(0);
+    std::mutex latch;
+    ColumnStatus result = ColumnStatus::GENERAL_SUCCESS;
+
+    auto work = [&] {
+        for (;;) {
+            size_t i = next++;
+            if (i >= n) {
+                return;
+            }
+            ColumnStatus rc = fn(i);
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                std::lock_guard<std::mutex> lock(latch);
+                if (result == ColumnStatus::GENERAL_SUCCESS) {
+                    result = rc;
+                }
+                next = n;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < std::min(nThreads, n); ++t) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return result;
+}
\ No newline at end of file
@@ -0,0 +1,113 @@
+/*
+
+    Chunk Pool Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "chunk_pool.h"
+
+#include <atomic>
+
+/*
+
+    Some basic rules about the chunk pool:
+        - Frames are immutable once inserted, readers share them freely
+        - The pool may go over budget by one frame, a frame larger than
+          the whole budget is still cached until the next insert
+        - Segment ids are never reused, so a stale frame can't be mistaken
+          for a chunk of a newer segment
+
+*/
+
+ChunkPool::ChunkPool(size_t capacity) :
+    capacity(capacity), bytesUsed(0), nHits(0), nMisses(0) {}
+
+/* Look up a frame and mark it most recently used */
+std::shared_ptr<const ChunkFrame> ChunkPool::get(uint64_t segId, size_t chunkIdx) {
+    std::lock_guard<std::mutex> lock(latch);
+
+    auto it = frames.find(frame_key_t(segId, chunkIdx));
+    if (it == frames.end()) {
+        ++nMisses;
+        return nullptr;
+    }
+    ++nHits;
+    lru.splice(lru.begin(), lru, it->second);
+    return it->second->frame;
+}
+
+/* Insert a frame, replacing one already cached for the same chunk */
+void ChunkPool::put(uint64_t segId, size_t chunkIdx, std::shared_ptr<const ChunkFrame> frame) {
+    std::lock_guard<std::mutex> lock(latch);
+
+    frame_key_t key(segId, chunkIdx);
+    auto it = frames.find(key);
+    if (it != frames.end()) {
+        bytesUsed -= it->second->frame->bytes();
+        lru.erase(it->second);
+        frames.erase(it);
+    }
+
+    evict();
+    bytesUsed += frame->bytes();
+    lru.push_front({ key, std::move(frame) });
+    frames[key] = lru.begin();
+}
+
+/* Drop every frame of a segment, called when its reader goes away */
+void ChunkPool::evictSegment(uint64_t segId) {
+    std::lock_guard<std::mutex> lock(latch);
+
+    for (auto it = lru.begin(); it != lru.end();) {
+        if (it->key.first == segId) {
+            bytesUsed -= it->frame->bytes();
+            frames.erase(it->key);
+            it = lru.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+/* Make room at the cold end of the list, latch must be held */
+void ChunkPool::evict() {
+    while (!lru.empty() && bytesUsed >= capacity) {
+        bytesUsed -= lru.back().frame->bytes();
+        frames.erase(lru.back().key);
+        lru.pop_back();
+    }
+}
+
+size_t ChunkPool::getBytesUsed() {
+    std::lock_guard<std::mutex> lock(latch);
+    return bytesUsed;
+}
+
+uint64_t ChunkPool::getHits() {
+    std::lock_guard<std::mutex> lock(latch);
+    return nHits;
+}
+
+uint64_t ChunkPool::getMisses() {
+    std::lock_guard<std::mutex> lock(latch);
+    return nMisses;
+}
+
+uint64_t ChunkPool::nextSegmentId() {
+    static std::atomic<uint64_t> nextId(1);
+    return nextId++;
+}
\ No newline at end of file
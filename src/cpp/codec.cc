@@ -0,0 +1,308 @@
+/*
+
+    Block Compression Codecs
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "codec.h"
+
+#include <cstring>
+#include <vector>
+
+#if defined(HERACLES_HAVE_LZ4)
+#   include <lz4.h>
+#endif
+#if defined(HERACLES_HAVE_ZSTD)
+#   include <zstd.h>
+#endif
+
+/*
+
+    Some basic rules about the built-in LZ format:
+        - A block is a series of sequences: a token byte (literal length
+          in the high nibble, match length - 4 in the low nibble), extra
+          length bytes for a nibble of 15 (each adds up to 255), the
+          literals, then a 2-byte little-endian match offset
+        - The last sequence has literals only and ends the block
+        - Matches stop short of the last LZ_END_LITERALS bytes, so every
+          block ends in literals
+        - The decoder checks every length and offset, a corrupt block
+          fails instead of writing out of bounds
+
+*/
+
+#define  LZ_MIN_MATCH           4
+#define  LZ_HASH_BITS           13
+#define  LZ_MAX_OFFSET          65535
+#define  LZ_END_LITERALS        5
+
+static uint32_t load32(const uint8_t* p) {
+    uint32_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+static uint32_t lzHash(uint32_t seq) {
+    return (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/* Length with a 15 in its nibble continues in bytes of up to 255 */
+static bool putLength(uint8_t*& op, const uint8_t* end, size_t len) {
+    for (; len >= 255; len -= 255) {
+        if (op == end) {
+            return false;
+        }
+        *op++ = 255;
+    }
+    if (op == end) {
+        return false;
+    }
+    *op++ = static_cast<uint8_t>(len);
+    return true;
+}
+
+static bool getLength(const uint8_t*& ip, const uint8_t* end, size_t& len) {
+    uint8_t b;
+    do {
+        if (ip == end) {
+            return false;
+        }
+        b = *ip++;
+        len += b;
+    } while (b == 255);
+    return true;
+}
+
+static bool putSequence(uint8_t*& op, const uint8_t* end, const uint8_t* lit, size_t nLit,
+                        size_t offset, size_t matchLen) {
+
+    if (op == end) {
+        return false;
+    }
+    uint8_t* token = op++;
+    *token = static_cast<uint8_t>((nLit >= 15 ? 15 : nLit) << 4);
+    if (nLit >= 15 && !putLength(op, end, nLit - 15)) {
+        return false;
+    }
+    if (static_cast<size_t>(end - op) < nLit) {
+        return false;
+    }
+    if (nLit > 0) {
+        memcpy(op, lit, nLit);
+        op += nLit;
+    }
+
+    if (matchLen == 0) {
+        return true;        // Final sequence
+    }
+    if (end - op < 2) {
+        return false;
+    }
+    *op++ = static_cast<uint8_t>(offset);
+    *op++ = static_cast<uint8_t>(offset >> 8);
+
+    size_t code = matchLen - LZ_MIN_MATCH;
+    *token |= static_cast<uint8_t>(code >= 15 ? 15 : code);
+    return code < 15 || putLength(op, end, code - 15);
+}
+
+class LzCodec : public Codec {
+
+public:
+
+    const char* name() const override { return "lz"; }
+
+    size_t maxCompressedSize(size_t rawSize) const override {
+        return rawSize + rawSize / 255 + 16;
+    }
+
+    size_t compress(const char* src, size_t srcSize, char* dst, size_t dstCap) const override {
+
+        const uint8_t* in = reinterpret_cast<const uint8_t*>(src);
+        uint8_t* op = reinterpret_cast<uint8_t*>(dst);
+        const uint8_t* end = op + dstCap;
+        size_t anchor = 0;
+
+        if (srcSize > LZ_END_LITERALS + 8) {
+            std::vector<uint32_t> table(1 << LZ_HASH_BITS, UINT32_MAX);
+            size_t limit = srcSize - (LZ_END_LITERALS + 8);
+            size_t matchEnd = srcSize - LZ_END_LITERALS;
+            size_t pos = 0;
+
+            while (pos < limit) {
+                uint32_t seq = load32(in + pos);
+                uint32_t h = lzHash(seq);
+                uint32_t cand = table[h];
+                table[h] = static_cast<uint32_t>(pos);
+
+                if (cand == UINT32_MAX || pos - cand > LZ_MAX_OFFSET || load32(in + cand) != seq) {
+                    ++pos;
+                    continue;
+                }
+
+                size_t len = LZ_MIN_MATCH;
+                while (pos + len < matchEnd && in[cand + len] == in[pos + len]) {
+                    ++len;
+                }
+                if (!putSequence(op, end, in + anchor, pos - anchor, pos - cand, len)) {
+                    return 0;
+                }
+                pos += len;
+                anchor = pos;
+            }
+        }
+
+        if (!putSequence(op, end, in + anchor, srcSize - anchor, 0, 0)) {
+            return 0;
+        }
+        return op - reinterpret_cast<uint8_t*>(dst);
+    }
+
+    bool decompress(const char* src, size_t srcSize, char* dst, size_t rawSize) const override {
+
+        const uint8_t* ip = reinterpret_cast<const uint8_t*>(src);
+        const uint8_t* inEnd = ip + srcSize;
+        uint8_t* out = reinterpret_cast<uint8_t*>(dst);
+        size_t pos = 0;
+
+        while (ip < inEnd) {
+            uint8_t token = *ip++;
+
+            size_t nLit = token >> 4;
+            if (nLit == 15 && !getLength(ip, inEnd, nLit)) {
+                return false;
+            }
+            if (nLit > static_cast<size_t>(inEnd - ip) || nLit > rawSize - pos) {
+                return false;
+            }
+            if (nLit > 0) {
+                memcpy(out + pos, ip, nLit);
+                ip += nLit;
+                pos += nLit;
+            }
+
+            if (ip == inEnd) {
+                break;      // Final sequence
+            }
+            if (inEnd - ip < 2) {
+                return false;
+            }
+            size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+            ip += 2;
+
+            size_t len = token & 15;
+            if (len == 15 && !getLength(ip, inEnd, len)) {
+                return false;
+            }
+            len += LZ_MIN_MATCH;
+            if (offset == 0 || offset > pos || len > rawSize - pos) {
+                return false;
+            }
+
+            /* An overlapping match repeats its pattern, so it goes byte by byte */
+            const uint8_t* from = out + pos - offset;
+            if (offset >= len) {
+                memcpy(out + pos, from, len);
+            }
+            else {
+                for (size_t i = 0; i < len; ++i) {
+                    out[pos + i] = from[i];
+                }
+            }
+            pos += len;
+        }
+        return pos == rawSize;
+    }
+
+};
+
+#if defined(HERACLES_HAVE_LZ4)
+
+class Lz4Codec : public Codec {
+
+public:
+
+    const char* name() const override { return "lz4"; }
+
+    size_t maxCompressedSize(size_t rawSize) const override {
+        return LZ4_compressBound(static_cast<int>(rawSize));
+    }
+
+    size_t compress(const char* src, size_t srcSize, char* dst, size_t dstCap) const override {
+        int n = LZ4_compress_default(src, dst, static_cast<int>(srcSize), static_cast<int>(dstCap));
+        return n > 0 ? static_cast<size_t>(n) : 0;
+    }
+
+    bool decompress(const char* src, size_t srcSize, char* dst, size_t rawSize) const override {
+        int n = LZ4_decompress_safe(src, dst, static_cast<int>(srcSize), static_cast<int>(rawSize));
+        return n >= 0 && static_cast<size_t>(n) == rawSize;
+    }
+
+};
+
+#endif // HERACLES_HAVE_LZ4
+
+#if defined(HERACLES_HAVE_ZSTD)
+
+class ZstdCodec : public Codec {
+
+public:
+
+    const char* name() const override { return "zstd"; }
+
+    size_t maxCompressedSize(size_t rawSize) const override {
+        return ZSTD_compressBound(rawSize);
+    }
+
+    size_t compress(const char* src, size_t srcSize, char* dst, size_t dstCap) const override {
+        size_t n = ZSTD_compress(dst, dstCap, src, srcSize, CODEC_ZSTD_LEVEL);
+        return ZSTD_isError(n) ? 0 : n;
+    }
+
+    bool decompress(const char* src, size_t srcSize, char* dst, size_t rawSize) const override {
+        size_t n = ZSTD_decompress(dst, rawSize, src, srcSize);
+        return !ZSTD_isError(n) && n == rawSize;
+    }
+
+};
+
+#endif // HERACLES_HAVE_ZSTD
+
+const Codec* getCodec(ColumnCodec codec) {
+
+    static const LzCodec lz;
+#if defined(HERACLES_HAVE_LZ4)
+    static const Lz4Codec lz4;
+#endif
+#if defined(HERACLES_HAVE_ZSTD)
+    static const ZstdCodec zstd;
+#endif
+
+    switch (codec) {
+        case ColumnCodec::LZ:
+            return &lz;
+#if defined(HERACLES_HAVE_LZ4)
+        case ColumnCodec::LZ4:
+            return &lz4;
+#endif
+#if defined(HERACLES_HAVE_ZSTD)
+        case ColumnCodec::ZSTD:
+            return &zstd;
+#endif
+        default:
+            return nullptr;
+    }
+}
\ No newline at end of file
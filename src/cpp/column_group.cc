@@ -0,0 +1,241 @@
+/*
+
+    Column Group Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "column_group.h"
+#include "bloom.h"
+#include "column_segment.h"
+#include "os_unx.h"
+
+#include <algorithm>
+#include <cstring>
+
+/* A segment being copied into a group file */
+struct GroupMember {
+    os_fd_t fd = OS_INVALID_FD;
+    SegmentFooter footer;
+    std::vector<ChunkFooter> chunks;
+    uint64_t tailOffset = 0;        // Where the chunks end and the tail begins
+};
+
+/* Bytes of a chunk in its file, its Bloom filter (written right after it) included */
+static uint64_t chunkSpan(const ChunkFooter& cf) {
+    uint64_t end = cf.offset + cf.size;
+    if (cf.bloomBlocks > 0) {
+        end = std::max<uint64_t>(end, cf.bloomOffset + static_cast<uint64_t>(cf.bloomBlocks) * BLOOM_BLOCK_BYTES);
+    }
+    return end - cf.offset;
+}
+
+/* Footers of a finished segment file, checked only as far as copying it needs */
+static ColumnStatus openMember(const std::string& path, GroupMember& member) {
+
+    member.fd = osOpen(path.c_str(), false);
+    if (member.fd == OS_INVALID_FD) {
+        return ColumnStatus::IO_ERROR;
+    }
+    int64_t fileSize = osFileSize(member.fd);
+    if (fileSize < 0) {
+        return ColumnStatus::IO_ERROR;
+    }
+    ColumnStatus rc = readSegmentFooters(member.fd, static_cast<uint64_t>(fileSize), member.footer, member.chunks);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    const SegmentFooter& sf = member.footer;
+    for (auto& cf : member.chunks) {
+        if (cf.offset != member.tailOffset) {
+            return ColumnStatus::CORRUPT_SEGMENT;       // Chunks are written back to back
+        }
+        member.tailOffset += chunkSpan(cf);
+    }
+    return member.tailOffset <= sf.chunksOffset ? ColumnStatus::GENERAL_SUCCESS : ColumnStatus::CORRUPT_SEGMENT;
+}
+
+/* Copy `len` bytes at `from` in `src` to `to` in `dst` */
+static ColumnStatus copyBytes(os_fd_t src, uint64_t from, os_fd_t dst, uint64_t to, uint64_t len,
+                              std::vector<char>& buf) {
+    buf.resize(len);
+    if (osRead(src, buf.data(), len, from) != static_cast<ssize_t>(len) ||
+        osWrite(dst, buf.data(), len, to) < 0) {
+        return ColumnStatus::IO_ERROR;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* The pages, then each column's tail, then the entries and the group footer */
+static ColumnStatus writePages(std::vector<GroupMember>& members, os_fd_t fd) {
+
+    ColumnStatus rc;
+    std::vector<char> buf;
+    uint64_t writeOfst = 0;
+    size_t nPages = members[0].chunks.size();
+
+    for (size_t p = 0; p < nPages; ++p) {
+        for (auto& member : members) {
+            ChunkFooter& cf = member.chunks[p];
+            uint64_t span = chunkSpan(cf);
+            if ((rc = copyBytes(member.fd, cf.offset, fd, writeOfst, span, buf)) != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            if (cf.bloomBlocks > 0) {
+                cf.bloomOffset = cf.bloomOffset - cf.offset + writeOfst;
+            }
+            cf.offset = writeOfst;
+            writeOfst += span;
+        }
+    }
+
+    std::vector<ColumnGroupEntry> entries;
+    for (auto& member : members) {
+        SegmentFooter& sf = member.footer;
+        uint64_t tailSize = sf.chunksOffset - member.tailOffset;
+        rc = copyBytes(member.fd, member.tailOffset, fd, writeOfst, tailSize, buf);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        if (sf.dictSize > 0) {
+            sf.dictOffset = sf.dictOffset - member.tailOffset + writeOfst;
+        }
+        if (sf.statsSize > 0) {
+            sf.statsOffset = sf.statsOffset - member.tailOffset + writeOfst;
+        }
+        sf.chunksOffset = writeOfst + tailSize;
+
+        size_t footersSize = member.chunks.size() * sizeof(ChunkFooter);
+        if (osWrite(fd, member.chunks.data(), footersSize, sf.chunksOffset) < 0 ||
+            osWrite(fd, &sf, sizeof(sf), sf.chunksOffset + footersSize) < 0) {
+            return ColumnStatus::IO_ERROR;
+        }
+        writeOfst = sf.chunksOffset + footersSize + sizeof(sf);
+        entries.push_back({ sf.colId, 0, writeOfst });
+    }
+
+    ColumnGroupFooter gf;
+    memset(&gf, 0, sizeof(gf));
+    gf.magic = gf.magic2 = COLUMN_GROUP_MAGIC;
+    gf.version = COLUMN_GROUP_VERSION;
+    gf.nColumns = static_cast<uint32_t>(entries.size());
+    gf.nPages = static_cast<uint32_t>(nPages);
+    gf.entriesOffset = writeOfst;
+
+    size_t entriesSize = entries.size() * sizeof(ColumnGroupEntry);
+    if (osWrite(fd, entries.data(), entriesSize, writeOfst) < 0 ||
+        osWrite(fd, &gf, sizeof(gf), writeOfst + entriesSize) < 0 ||
+        osDataSync(fd) != 0) {
+        return ColumnStatus::IO_ERROR;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Interleave finished segments over the same rows into the group file
+    `path`. The segments must have been written with the same chunk size,
+    so that their chunks line up into pages; they are left in place, for
+    the caller to remove once the group file is in use. Like a segment,
+    the file is written under a temporary name and renamed when complete.
+
+*/
+ColumnStatus writeColumnGroup(const std::string& path, const std::vector<std::string>& segments) {
+
+    if (segments.empty()) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+
+    ColumnStatus rc = ColumnStatus::GENERAL_SUCCESS;
+    std::vector<GroupMember> members(segments.size());
+    for (size_t m = 0; m < segments.size() && rc == ColumnStatus::GENERAL_SUCCESS; ++m) {
+        rc = openMember(segments[m], members[m]);
+    }
+    for (size_t m = 1; m < members.size() && rc == ColumnStatus::GENERAL_SUCCESS; ++m) {
+        if (members[m].chunks.size() != members[0].chunks.size()) {
+            rc = ColumnStatus::CORRUPT_SEGMENT;
+        }
+        for (size_t p = 0; p < members[m].chunks.size() && rc == ColumnStatus::GENERAL_SUCCESS; ++p) {
+            if (members[m].chunks[p].zone.rowCount != members[0].chunks[p].zone.rowCount) {
+                rc = ColumnStatus::CORRUPT_SEGMENT;     // Chunks do not line up
+            }
+        }
+    }
+
+    std::string tmp = path + ".tmp";
+    if (rc == ColumnStatus::GENERAL_SUCCESS) {
+        osRemove(tmp.c_str());          // Leftover of an earlier failed write
+        os_fd_t fd = osOpen(tmp.c_str(), true);
+        if (fd == OS_INVALID_FD) {
+            rc = ColumnStatus::IO_ERROR;
+        }
+        else {
+            rc = writePages(members, fd);
+            osClose(fd);
+            if (rc == ColumnStatus::GENERAL_SUCCESS && osRename(tmp.c_str(), path.c_str()) != 0) {
+                rc = ColumnStatus::IO_ERROR;
+            }
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                osRemove(tmp.c_str());
+            }
+        }
+    }
+
+    for (auto& member : members) {
+        if (member.fd != OS_INVALID_FD) {
+            osClose(member.fd);
+        }
+    }
+    return rc;
+}
+
+/* Entries of the columns stored in a group file */
+ColumnStatus readColumnGroup(const std::string& path, std::vector<ColumnGroupEntry>& entries) {
+
+    os_fd_t fd = osOpen(path.c_str(), false);
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::IO_ERROR;
+    }
+
+    ColumnStatus rc = ColumnStatus::GENERAL_SUCCESS;
+    ColumnGroupFooter gf;
+    int64_t fileSize = osFileSize(fd);
+    if (fileSize < static_cast<int64_t>(sizeof(gf))) {
+        rc = ColumnStatus::CORRUPT_SEGMENT;
+    }
+    else if (osRead(fd, &gf, sizeof(gf), fileSize - sizeof(gf)) != static_cast<ssize_t>(sizeof(gf))) {
+        rc = ColumnStatus::IO_ERROR;
+    }
+    else if (gf.magic != COLUMN_GROUP_MAGIC || gf.magic2 != COLUMN_GROUP_MAGIC ||
+             gf.version != COLUMN_GROUP_VERSION ||
+             gf.entriesOffset + gf.nColumns * sizeof(ColumnGroupEntry) + sizeof(gf) !=
+                 static_cast<uint64_t>(fileSize)) {
+        rc = ColumnStatus::CORRUPT_SEGMENT;
+    }
+    else {
+        entries.resize(gf.nColumns);
+        size_t entriesSize = entries.size() * sizeof(ColumnGroupEntry);
+        if (osRead(fd, entries.data(), entriesSize, gf.entriesOffset) != static_cast<ssize_t>(entriesSize)) {
+            rc = ColumnStatus::IO_ERROR;
+        }
+        for (auto& entry : entries) {
+            if (rc == ColumnStatus::GENERAL_SUCCESS && entry.segmentEnd > gf.entriesOffset) {
+                rc = ColumnStatus::CORRUPT_SEGMENT;
+            }
+        }
+    }
+    osClose(fd);
+    return rc;
+}
\ No newline at end of file
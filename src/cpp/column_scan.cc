@@ -0,0 +1,984 @@
+/*
+
+    Column Scan Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "column_scan.h"
+#include "encoding.h"
+
+#include <algorithm>
+#include <cstring>
+
+bool ColumnPredicate::matches(int64_t val) const {
+    switch (op) {
+        case CompareOp::EQ:      return val == lo;
+        case CompareOp::NE:      return val != lo;
+        case CompareOp::LT:      return val < lo;
+        case CompareOp::LE:      return val <= lo;
+        case CompareOp::GT:      return val > lo;
+        case CompareOp::GE:      return val >= lo;
+        case CompareOp::BETWEEN: return val >= lo && val <= hi;
+        case CompareOp::PREFIX:  return false;     // No integer has a prefix
+    }
+    return false;
+}
+
+/* Can any non-null value in [minVal, maxVal] satisfy the predicate? */
+bool ColumnPredicate::mayMatch(const ZoneMap& zone) const {
+
+    if (zone.nullCount == zone.rowCount) {
+        return false;
+    }
+
+    switch (op) {
+        case CompareOp::EQ:      return lo >= zone.minVal && lo <= zone.maxVal;
+        case CompareOp::NE:      return !(zone.minVal == lo && zone.maxVal == lo);
+        case CompareOp::LT:      return zone.minVal < lo;
+        case CompareOp::LE:      return zone.minVal <= lo;
+        case CompareOp::GT:      return zone.maxVal > lo;
+        case CompareOp::GE:      return zone.maxVal >= lo;
+        case CompareOp::BETWEEN: return lo <= zone.maxVal && hi >= zone.minVal && lo <= hi;
+        case CompareOp::PREFIX:  return false;
+    }
+    return true;
+}
+
+/* Same predicate as a closed range, empty when rangeLo > rangeHi. NE has no such form. */
+bool ColumnPredicate::toRange(int64_t& rangeLo, int64_t& rangeHi) const {
+
+    rangeLo = INT64_MIN;
+    rangeHi = INT64_MAX;
+
+    switch (op) {
+        case CompareOp::EQ:      rangeLo = rangeHi = lo;    break;
+        case CompareOp::NE:      return false;
+        case CompareOp::LE:      rangeHi = lo;              break;
+        case CompareOp::GE:      rangeLo = lo;              break;
+        case CompareOp::BETWEEN: rangeLo = lo;
+                                 rangeHi = hi;              break;
+        case CompareOp::PREFIX:  rangeLo = 1;
+                                 rangeHi = 0;               break;
+        case CompareOp::LT:
+            if (lo == INT64_MIN) {
+                rangeLo = 1;
+                rangeHi = 0;
+            }
+            else {
+                rangeHi = lo - 1;
+            }
+            break;
+        case CompareOp::GT:
+            if (lo == INT64_MAX) {
+                rangeLo = 1;
+                rangeHi = 0;
+            }
+            else {
+                rangeLo = lo + 1;
+            }
+            break;
+    }
+    return true;
+}
+
+/*
+
+    Bits of the qualifying, non-null values among `count`. The predicate
+    runs on every value, nulls included, and the validity bitmap (null
+    when the values have no nulls) masks the result.
+
+*/
+static void matchValues(const int64_t* values, size_t count, const ColumnPredicate& pred,
+                        const uint64_t* validity, uint64_t* matches) {
+    int64_t lo, hi;
+    if (pred.toRange(lo, hi)) {
+        compareRange(values, count, lo, hi, false, matches);
+    }
+    else {
+        compareRange(values, count, pred.lo, pred.lo, true, matches);     // NE
+    }
+    if (validity) {
+        maskValidity(matches, validity, count);
+    }
+}
+
+/* Selection vector of the set bits of `words` */
+static void selectMatches(const uint64_t* words, size_t nWords, sel_vec_t& sel) {
+    sel.clear();
+    for (size_t w = 0; w < nWords; ++w) {
+        for (uint64_t bits = words[w]; bits != 0; bits &= bits - 1) {
+            sel.push_back(static_cast<uint32_t>(w * 64 + __builtin_ctzll(bits)));
+        }
+    }
+}
+
+void filterVector(const ColumnVector& vec, const ColumnPredicate& pred, sel_vec_t& sel) {
+    bitset<uint64_t> matches((vec.size() + 63) / 64);
+    matchValues(vec.values.data(), vec.size(), pred, vec.validity.empty() ? nullptr : vec.validity.data(),
+                matches.data());
+    selectMatches(matches.data(), matches.size(), sel);
+}
+
+/*
+
+    Rewrite a comparison against a string into one against codes of the
+    sorted dictionary `dict`. A value missing from the dictionary still
+    has a well-defined position (its lower bound), which is all the range
+    operators need.
+
+*/
+ColumnPredicate stringPredicate(const std::vector<std::string>& dict, CompareOp op,
+                                const std::string& lo, const std::string& hi) {
+
+    int64_t lower = std::lower_bound(dict.begin(), dict.end(), lo) - dict.begin();
+    int64_t upper = std::upper_bound(dict.begin(), dict.end(), lo) - dict.begin();
+    bool found = lower != upper;
+
+    switch (op) {
+        case CompareOp::EQ:
+            return found ? ColumnPredicate{ CompareOp::EQ, lower, 0 }
+                         : ColumnPredicate{ CompareOp::BETWEEN, 1, 0 };    // Matches nothing
+        case CompareOp::NE:
+            return found ? ColumnPredicate{ CompareOp::NE, lower, 0 }
+                         : ColumnPredicate{ CompareOp::GE, 0, 0 };         // Any non-null
+        case CompareOp::LT:
+            return { CompareOp::LT, lower, 0 };
+        case CompareOp::LE:
+            return { CompareOp::LT, upper, 0 };
+        case CompareOp::GT:
+            return { CompareOp::GE, upper, 0 };
+        case CompareOp::GE:
+            return { CompareOp::GE, lower, 0 };
+        case CompareOp::BETWEEN: {
+            int64_t last = std::upper_bound(dict.begin(), dict.end(), hi) - dict.begin();
+            return { CompareOp::BETWEEN, lower, last - 1 };
+        }
+        case CompareOp::PREFIX: {
+            /* Strings sharing a prefix are adjacent in sort order, starting at the prefix's own position */
+            int64_t last = std::partition_point(dict.begin() + lower, dict.end(), [&lo](const std::string& s) {
+                return s.compare(0, lo.size(), lo) == 0;
+            }) - dict.begin();
+            return { CompareOp::BETWEEN, lower, last - 1 };
+        }
+    }
+    return { CompareOp::BETWEEN, 1, 0 };
+}
+
+bool StringPredicate::matches(const std::string& val) const {
+    switch (op) {
+        case CompareOp::EQ:      return val == lo;
+        case CompareOp::NE:      return val != lo;
+        case CompareOp::LT:      return val < lo;
+        case CompareOp::LE:      return val <= lo;
+        case CompareOp::GT:      return val > lo;
+        case CompareOp::GE:      return val >= lo;
+        case CompareOp::BETWEEN: return val >= lo && val <= hi;
+        case CompareOp::PREFIX:  return val.compare(0, lo.size(), lo) == 0;
+    }
+    return false;
+}
+
+/*
+
+    Zone maps of STRING_HEAP chunks hold stringKey()s, which only keep the
+    first 8 bytes: s <= t gives key(s) <= key(t) but not the other way
+    round, so bounds are compared inclusively and the test only rules out
+    chunks that certainly have no match.
+
+*/
+bool StringPredicate::mayMatch(const ZoneMap& zone) const {
+
+    if (zone.nullCount == zone.rowCount) {
+        return false;
+    }
+
+    int64_t key = stringKey(lo.data(), lo.size());
+    switch (op) {
+        case CompareOp::EQ:      return key >= zone.minVal && key <= zone.maxVal;
+        case CompareOp::NE:      return true;
+        case CompareOp::LT:
+        case CompareOp::LE:      return zone.minVal <= key;
+        case CompareOp::GT:
+        case CompareOp::GE:      return zone.maxVal >= key;
+        case CompareOp::BETWEEN: return lo <= hi && key <= zone.maxVal && stringKey(hi.data(), hi.size()) >= zone.minVal;
+        case CompareOp::PREFIX: {
+            std::string last = lo.substr(0, sizeof(int64_t));
+            last.resize(sizeof(int64_t), '\xFF');     // Largest key of a string with this prefix
+            return key <= zone.maxVal && stringKey(last.data(), last.size()) >= zone.minVal;
+        }
+    }
+    return true;
+}
+
+/*
+
+    Bits of the strings among `count` from `begin` of a STRING_HEAP chunk
+    that satisfy `pred`, compared in their stored form. `packed` is the
+    operand as stored in this chunk (StringHeapView::pack()), which turns
+    EQ and NE into byte comparisons. Nulls are not masked here.
+
+*/
+static void matchStrings(const StringHeapView& strings, size_t begin, size_t count, const StringPredicate& pred,
+                         const std::string& packed, uint64_t* matches) {
+
+    memset(matches, 0, ((count + 63) / 64) * sizeof(uint64_t));
+    for (size_t i = 0; i < count; ++i) {
+        size_t row = begin + i;
+        bool in = false;
+        switch (pred.op) {
+            case CompareOp::EQ:      in = strings.equals(row, packed);                  break;
+            case CompareOp::NE:      in = !strings.equals(row, packed);                 break;
+            case CompareOp::LT:      in = strings.compare(row, pred.lo) < 0;            break;
+            case CompareOp::LE:      in = strings.compare(row, pred.lo) <= 0;           break;
+            case CompareOp::GT:      in = strings.compare(row, pred.lo) > 0;            break;
+            case CompareOp::GE:      in = strings.compare(row, pred.lo) >= 0;           break;
+            case CompareOp::BETWEEN: in = strings.compare(row, pred.lo) >= 0 &&
+                                          strings.compare(row, pred.hi) <= 0;           break;
+            case CompareOp::PREFIX:  in = strings.startsWith(row, pred.lo);             break;
+        }
+        matches[i >> 6] |= static_cast<uint64_t>(in) << (i & 63);
+    }
+}
+
+/* Group-by count on codes, `counts` is indexed by code (sized to the dictionary) */
+void countGroups(const ColumnVector& vec, const sel_vec_t& sel, std::vector<uint64_t>& counts) {
+    for (uint32_t i : sel) {
+        if (!vec.isNull(i)) {
+            ++counts[static_cast<size_t>(vec.values[i])];
+        }
+    }
+}
+
+ColumnScan::ColumnScan(ColumnSegmentReader& segment, const ColumnPredicate* pred) :
+    segment(segment), pred(pred), strPred(nullptr), ranged(false), rangeFound(false), rangeBegin(0), rangeEnd(0),
+    probe(pred && pred->op == CompareOp::EQ), probeHash(pred ? bloomHash(pred->lo) : 0), chunkIdx(0), frameIdx(0),
+    vecIdx(0), nRead(0), nSkipped(0), nDecoded(0), nVecSkipped(0), nBloomSkipped(0) {
+    int64_t lo, hi;
+    ranged = pred && segment.isSorted() && segment.getStringLayout() == StringLayout::DICTIONARY &&
+             pred->toRange(lo, hi);
+}
+
+ColumnScan::ColumnScan(ColumnSegmentReader& segment, const StringPredicate* strPred) :
+    segment(segment), pred(nullptr), strPred(strPred), ranged(false), rangeFound(false), rangeBegin(0),
+    rangeEnd(0), probe(strPred && strPred->op == CompareOp::EQ),
+    probeHash(strPred ? bloomHash(strPred->lo.data(), strPred->lo.size()) : 0), chunkIdx(0), frameIdx(0), vecIdx(0),
+    nRead(0), nSkipped(0), nDecoded(0), nVecSkipped(0), nBloomSkipped(0) {}
+
+/* Chunk holding segment row `row`, or the number of chunks past the end */
+static size_t chunkOfRow(ColumnSegmentReader& segment, uint64_t row) {
+    size_t lo = 0, hi = segment.getNumChunks();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (segment.getFirstRow(mid) + segment.getChunk(mid).zone.rowCount <= row) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/*
+
+    Produce the next vector with at least one qualifying row. `sel` holds
+    the qualifying offsets within `out` and `firstRow` the segment row
+    number of the vector's first value. Returns INDEX_OUT_OF_BOUNDS when
+    the scan is done, TYPE_MISMATCH when a STRING_HEAP chunk meets an
+    integer predicate or any other chunk a StringPredicate.
+
+*/
+ColumnStatus ColumnScan::next(ColumnVector& out, sel_vec_t& sel, uint64_t& firstRow) {
+
+    /* Straight to the chunk of the first qualifying row, or to the end if there is none */
+    if (ranged && !rangeFound) {
+        int64_t lo, hi;
+        pred->toRange(lo, hi);
+        ColumnStatus rc = findSortedRange(segment, lo, hi, rangeBegin, rangeEnd);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        rangeFound = true;
+        size_t first = rangeBegin < rangeEnd ? chunkOfRow(segment, rangeBegin) : segment.getNumChunks();
+        nSkipped += first - chunkIdx;
+        chunkIdx = first;
+    }
+
+    while (true) {
+
+        if (!frame) {
+            if (chunkIdx >= segment.getNumChunks()) {
+                return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+            }
+            size_t idx = chunkIdx++;
+            const ChunkFooter& cf = segment.getChunk(idx);
+            bool heap = cf.encoding == static_cast<uint8_t>(ColumnEncoding::STRING_HEAP);
+            if ((heap && pred) || (!heap && strPred)) {
+                return ColumnStatus::TYPE_MISMATCH;
+            }
+            if (ranged && segment.getFirstRow(idx) >= rangeEnd) {
+                nSkipped += segment.getNumChunks() - idx;
+                chunkIdx = segment.getNumChunks();
+                continue;
+            }
+            if (!ranged && ((pred && !pred->mayMatch(cf.zone)) || (strPred && !strPred->mayMatch(cf.zone)))) {
+                ++nSkipped;
+                continue;
+            }
+            if (probe && !ranged && segment.hasBloomFilter(idx)) {
+                bool maybe;
+                ColumnStatus rc = segment.probeBloom(idx, probeHash, maybe);
+                if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                    return rc;
+                }
+                if (!maybe) {
+                    ++nSkipped;
+                    ++nBloomSkipped;
+                    continue;
+                }
+            }
+
+            ColumnStatus rc = segment.loadChunk(idx, frame);
+            if (rc == ColumnStatus::GENERAL_SUCCESS && strPred) {
+                rc = segment.openStrings(idx, *frame, strings);
+                strings.pack(strPred->lo, packed);
+            }
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                frame.reset();
+                return rc;
+            }
+            ++nRead;
+            frameIdx = idx;
+            vecIdx = 0;
+        }
+
+        size_t nRows = segment.getChunk(frameIdx).zone.rowCount;
+        if (vecIdx * COLUMN_VECTOR_SIZE >= nRows) {
+            frame.reset();
+            continue;
+        }
+
+        size_t vec = vecIdx++;
+        ColumnStatus rc = scanVector(vec, out, sel);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        if (!sel.empty()) {
+            firstRow = segment.getFirstRow(frameIdx) + vec * COLUMN_VECTOR_SIZE;
+            return ColumnStatus::GENERAL_SUCCESS;
+        }
+    }
+}
+
+/* Filter one vector of the current chunk, decoding it only if some row may qualify */
+ColumnStatus ColumnScan::scanVector(size_t vec, ColumnVector& out, sel_vec_t& sel) {
+
+    const ChunkFooter& cf = segment.getChunk(frameIdx);
+    int64_t lo, hi;
+
+    if (strPred) {
+        return scanStrings(vec, out, sel);
+    }
+    if (ranged) {
+        return scanRange(vec, out, sel);
+    }
+
+    if (pred && !frame->data.empty() && cf.encoding == static_cast<uint8_t>(ColumnEncoding::BITPACK) &&
+        pred->toRange(lo, hi)) {
+
+        size_t count = std::min<size_t>(cf.zone.rowCount - vec * COLUMN_VECTOR_SIZE, COLUMN_VECTOR_SIZE);
+        size_t nWords = (count + 63) / 64;
+        matches.resize(COLUMN_VECTOR_SIZE / 64);
+
+        const char* values = frame->data.data() + cf.validitySize;
+        ColumnStatus rc = filterBitpackedVector(values, cf.valuesSize(), cf.zone.rowCount, vec,
+                                                lo, hi, matches.data());
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+
+        if (!frame->validity.empty()) {
+            maskValidity(matches.data(), frame->validity.data() + vec * COLUMN_VECTOR_SIZE / 64, count);
+        }
+
+        selectMatches(matches.data(), nWords, sel);
+        if (sel.empty()) {
+            ++nVecSkipped;
+            return ColumnStatus::GENERAL_SUCCESS;
+        }
+        ++nDecoded;
+        return segment.readVector(frameIdx, *frame, vec, out);
+    }
+
+    ColumnStatus rc = segment.readVector(frameIdx, *frame, vec, out);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    ++nDecoded;
+
+    if (pred) {
+        matches.resize(COLUMN_VECTOR_SIZE / 64);
+        matchValues(out.values.data(), out.size(), *pred, out.validity.empty() ? nullptr : out.validity.data(),
+                    matches.data());
+        selectMatches(matches.data(), (out.size() + 63) / 64, sel);
+    }
+    else {
+        sel.resize(out.size());
+        for (size_t i = 0; i < sel.size(); ++i) {
+            sel[i] = static_cast<uint32_t>(i);
+        }
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Same for a STRING_HEAP chunk, expanding the strings only if some row qualifies */
+ColumnStatus ColumnScan::scanStrings(size_t vec, ColumnVector& out, sel_vec_t& sel) {
+
+    const ChunkFooter& cf = segment.getChunk(frameIdx);
+    size_t begin = vec * COLUMN_VECTOR_SIZE;
+    size_t count = std::min<size_t>(cf.zone.rowCount - begin, COLUMN_VECTOR_SIZE);
+
+    matches.resize(COLUMN_VECTOR_SIZE / 64);
+    matchStrings(strings, begin, count, *strPred, packed, matches.data());
+    if (!frame->validity.empty()) {
+        maskValidity(matches.data(), frame->validity.data() + begin / 64, count);
+    }
+    selectMatches(matches.data(), (count + 63) / 64, sel);
+    if (sel.empty()) {
+        ++nVecSkipped;
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    ++nDecoded;
+    return segment.readVector(frameIdx, *frame, vec, out);
+}
+
+/* Same within the row range of a sorted segment, where only nulls need checking */
+ColumnStatus ColumnScan::scanRange(size_t vec, ColumnVector& out, sel_vec_t& sel) {
+
+    const ChunkFooter& cf = segment.getChunk(frameIdx);
+    uint64_t first = segment.getFirstRow(frameIdx) + vec * COLUMN_VECTOR_SIZE;
+    size_t count = std::min<size_t>(cf.zone.rowCount - vec * COLUMN_VECTOR_SIZE, COLUMN_VECTOR_SIZE);
+    uint64_t begin = std::max(first, rangeBegin);
+    uint64_t end = std::min(first + count, rangeEnd);
+
+    sel.clear();
+    if (begin >= end) {
+        ++nVecSkipped;
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    ColumnStatus rc = segment.readVector(frameIdx, *frame, vec, out);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    ++nDecoded;
+    for (uint64_t row = begin; row < end; ++row) {
+        if (!out.isNull(row - first)) {
+            sel.push_back(static_cast<uint32_t>(row - first));
+        }
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Non-null values in [begin, end) of a chunk */
+static uint64_t countValid(const bitset<uint64_t>& validity, size_t begin, size_t end) {
+
+    if (validity.empty()) {
+        return end - begin;
+    }
+
+    uint64_t n = 0;
+    while (begin < end && (begin & 63)) {
+        n += (validity[begin >> 6] >> (begin & 63)) & 1;
+        ++begin;
+    }
+    for (; begin + 64 <= end; begin += 64) {
+        n += __builtin_popcountll(validity[begin >> 6]);
+    }
+    for (; begin < end; ++begin) {
+        n += (validity[begin >> 6] >> (begin & 63)) & 1;
+    }
+    return n;
+}
+
+static void addToAggregate(ColumnAggregate& agg, int64_t val, uint64_t count) {
+    if (count == 0) {
+        return;
+    }
+    agg.count += count;
+    agg.sum = static_cast<int64_t>(static_cast<uint64_t>(agg.sum) +
+                                   static_cast<uint64_t>(val) * count);    // Wraps on overflow
+    agg.minVal = std::min(agg.minVal, val);
+    agg.maxVal = std::max(agg.maxVal, val);
+}
+
+/*
+
+    Visit the qualifying values of every chunk that survives the zone map
+    (and the Bloom filter, for EQ).
+    RLE chunks go to onRun as (value, count) pairs, one call per run.
+    Everything else goes to onVector a vector at a time, as the values and
+    a mask of the qualifying, non-null ones; the mask is null when every
+    value qualifies, which is the case for a chunk with no nulls and no
+    predicate. STRING_HEAP chunks have no values to fold (TYPE_MISMATCH).
+
+*/
+template <typename RunFn, typename VectorFn>
+static ColumnStatus foldSegment(ColumnSegmentReader& segment, const ColumnPredicate* pred,
+                                RunFn onRun, VectorFn onVector) {
+
+    std::vector<ColumnRun> runs;
+    bitset<uint64_t> validity;
+    bitset<uint64_t> matches(COLUMN_VECTOR_SIZE / 64);
+    ColumnVector vec;
+    ColumnStatus rc;
+    bool probe = pred && pred->op == CompareOp::EQ;
+    uint64_t probeHash = pred ? bloomHash(pred->lo) : 0;
+
+    for (size_t idx = 0; idx < segment.getNumChunks(); ++idx) {
+
+        const ChunkFooter& cf = segment.getChunk(idx);
+        if (cf.encoding == static_cast<uint8_t>(ColumnEncoding::STRING_HEAP)) {
+            return ColumnStatus::TYPE_MISMATCH;
+        }
+        if (pred && !pred->mayMatch(cf.zone)) {
+            continue;
+        }
+        if (probe && segment.hasBloomFilter(idx)) {
+            bool maybe;
+            if ((rc = segment.probeBloom(idx, probeHash, maybe)) != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            if (!maybe) {
+                continue;
+            }
+        }
+
+        if (cf.encoding == static_cast<uint8_t>(ColumnEncoding::RLE)) {
+            if ((rc = segment.readRuns(idx, runs, validity)) != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            size_t pos = 0;
+            for (auto& run : runs) {
+                if (!pred || pred->matches(run.value)) {
+                    onRun(run.value, countValid(validity, pos, pos + run.length));
+                }
+                pos += run.length;
+            }
+            continue;
+        }
+
+        if ((rc = segment.readChunk(idx, vec)) != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        const uint64_t* valid = vec.validity.empty() ? nullptr : vec.validity.data();
+        for (size_t begin = 0; begin < vec.size(); begin += COLUMN_VECTOR_SIZE) {
+            size_t count = std::min<size_t>(vec.size() - begin, COLUMN_VECTOR_SIZE);
+            const int64_t* values = vec.values.data() + begin;
+            const uint64_t* mask = valid ? valid + begin / 64 : nullptr;
+            if (pred) {
+                matchValues(values, count, *pred, mask, matches.data());
+                mask = matches.data();
+            }
+            onVector(values, mask, count);
+        }
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+ColumnStatus aggregateSegment(ColumnSegmentReader& segment, const ColumnPredicate* pred,
+                              ColumnAggregate& agg) {
+    return foldSegment(segment, pred,
+        [&agg](int64_t val, uint64_t count) {
+            addToAggregate(agg, val, count);
+        },
+        [&agg](const int64_t* values, const uint64_t* mask, size_t count) {
+            aggregateMasked(values, mask, count, agg);
+        });
+}
+
+ColumnStatus groupCountSegment(ColumnSegmentReader& segment, const ColumnPredicate* pred,
+                               std::unordered_map<int64_t, uint64_t>& counts) {
+    return foldSegment(segment, pred,
+        [&counts](int64_t val, uint64_t count) {
+            if (count > 0) {
+                counts[val] += count;
+            }
+        },
+        [&counts](const int64_t* values, const uint64_t* mask, size_t count) {
+            if (!mask) {
+                for (size_t i = 0; i < count; ++i) {
+                    ++counts[values[i]];
+                }
+                return;
+            }
+            for (size_t w = 0; w < (count + 63) / 64; ++w) {
+                for (uint64_t bits = mask[w]; bits != 0; bits &= bits - 1) {
+                    ++counts[values[w * 64 + __builtin_ctzll(bits)]];
+                }
+            }
+        });
+}
+
+/* Offsets of the qualifying, non-null rows */
+template <typename Predicate>
+static ColumnStatus filterRows(ColumnSegmentReader& segment, const Predicate* pred, RoaringBitmap& rows) {
+
+    if (segment.getNumRows() > UINT32_MAX) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+
+    ColumnScan scan(segment, pred);
+    ColumnVector vec;
+    sel_vec_t sel;
+    uint64_t firstRow;
+    ColumnStatus rc;
+    while ((rc = scan.next(vec, sel, firstRow)) == ColumnStatus::GENERAL_SUCCESS) {
+        if (!pred && !vec.validity.empty()) {
+            rows.addWords(static_cast<uint32_t>(firstRow), vec.validity.data(), vec.size());
+            continue;
+        }
+        for (uint32_t i : sel) {
+            rows.add(static_cast<uint32_t>(firstRow + i));    // Nulls never match a predicate
+        }
+    }
+    return rc == ColumnStatus::INDEX_OUT_OF_BOUNDS ? ColumnStatus::GENERAL_SUCCESS : rc;
+}
+
+ColumnStatus filterSegment(ColumnSegmentReader& segment, const ColumnPredicate* pred, RoaringBitmap& rows) {
+    return filterRows(segment, pred, rows);
+}
+
+ColumnStatus filterSegment(ColumnSegmentReader& segment, const StringPredicate* pred, RoaringBitmap& rows) {
+    return filterRows(segment, pred, rows);
+}
+
+/* End of the positions from `i` on that fall in one chunk, whose index is left in `idx` (searched forward) */
+static ColumnStatus chunkRun(const ColumnSegmentReader& segment, const uint32_t* positions, size_t count,
+                             size_t i, size_t& idx, size_t& end) {
+    if (positions[i] >= segment.getNumRows()) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+    if (idx >= segment.getNumChunks() || segment.getFirstRow(idx) > positions[i]) {
+        idx = 0;
+    }
+    while (idx + 1 < segment.getNumChunks() && segment.getFirstRow(idx + 1) <= positions[i]) {
+        ++idx;
+    }
+    uint64_t chunkEnd = segment.getFirstRow(idx) + segment.getChunk(idx).zone.rowCount;
+    for (end = i + 1; end < count && positions[end] < chunkEnd; ++end) {}
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Values of the rows at `positions` (ascending offsets) as one dense
+    vector, value k being that of row positions[k]. Rows of STRING_HEAP
+    chunks come back as strings, with `values` 0, 1, 2, ... as for any
+    STRING_HEAP vector. The cursor keeps the last chunk loaded, so calls
+    over consecutive parts of one position list read each chunk once.
+
+*/
+ColumnStatus fetchPositions(ColumnSegmentReader& segment, const uint32_t* positions, size_t count,
+                            ColumnVector& out, FetchCursor& cursor) {
+
+    out.clear();
+    out.values.resize(count);
+    ColumnVector vec;
+    std::string str;
+    for (size_t i = 0, j; i < count; i = j) {
+
+        size_t idx = cursor.chunkIdx;
+        ColumnStatus rc = chunkRun(segment, positions, count, i, idx, j);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        if (!cursor.frame || idx != cursor.chunkIdx) {
+            cursor.frame.reset();
+            if ((rc = segment.loadChunk(idx, cursor.frame)) != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            cursor.chunkIdx = idx;
+        }
+        const ChunkFrame* frame = cursor.frame.get();
+        const ChunkFooter& cf = segment.getChunk(idx);
+        uint64_t first = segment.getFirstRow(idx);
+
+        if (!frame->validity.empty()) {
+            if (out.validity.empty()) {
+                out.validity.assign((count + 63) / 64, ~0ULL);
+            }
+            for (size_t k = i; k < j; ++k) {
+                uint64_t row = positions[k] - first;
+                if (!(frame->validity[row >> 6] & (1ULL << (row & 63)))) {
+                    out.validity[k >> 6] &= ~(1ULL << (k & 63));
+                }
+            }
+        }
+
+        if (cf.encoding == static_cast<uint8_t>(ColumnEncoding::STRING_HEAP)) {
+            StringHeapView view;
+            if ((rc = segment.openStrings(idx, *frame, view)) != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            for (size_t k = i; k < j; ++k) {
+                view.get(positions[k] - first, str);
+                out.values[k] = static_cast<int64_t>(out.strings.size());
+                out.strings.push_back(str);
+            }
+        }
+        else if (frame->data.empty()) {
+            for (size_t k = i; k < j; ++k) {
+                out.values[k] = frame->values[positions[k] - first];
+            }
+        }
+        else {
+            /* Still compressed: decode only the vectors holding a position */
+            for (size_t k = i; k < j; ) {
+                size_t vecNo = (positions[k] - first) / COLUMN_VECTOR_SIZE;
+                if ((rc = segment.readVector(idx, *frame, vecNo, vec)) != ColumnStatus::GENERAL_SUCCESS) {
+                    return rc;
+                }
+                uint64_t vecFirst = first + vecNo * COLUMN_VECTOR_SIZE;
+                for (; k < j && positions[k] < vecFirst + vec.size(); ++k) {
+                    out.values[k] = vec.values[positions[k] - vecFirst];
+                }
+            }
+        }
+    }
+    if (!out.validity.empty() && (count & 63)) {
+        out.validity.back() &= (1ULL << (count & 63)) - 1;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Keep the positions whose rows match, reading only chunks whose zone map and Bloom filter allow a match */
+template <typename Predicate, typename Matches>
+static ColumnStatus keepPositions(ColumnSegmentReader& segment, const Predicate& pred, uint64_t probeHash,
+                                  pos_list_t& positions, Matches matches) {
+
+    ColumnVector vec;
+    FetchCursor cursor;
+    size_t kept = 0;
+    size_t idx = 0;
+    for (size_t i = 0, j; i < positions.size(); i = j) {
+
+        ColumnStatus rc = chunkRun(segment, positions.data(), positions.size(), i, idx, j);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        bool maybe = pred.mayMatch(segment.getChunk(idx).zone);
+        if (maybe && pred.op == CompareOp::EQ && segment.hasBloomFilter(idx) &&
+            (rc = segment.probeBloom(idx, probeHash, maybe)) != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        if (!maybe) {
+            continue;
+        }
+
+        rc = fetchPositions(segment, positions.data() + i, j - i, vec, cursor);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        for (size_t k = 0; k < j - i; ++k) {
+            if (!vec.isNull(k) && matches(vec, k)) {
+                positions[kept++] = positions[i + k];
+            }
+        }
+    }
+    positions.resize(kept);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+ColumnStatus filterPositions(ColumnSegmentReader& segment, const ColumnPredicate* pred, pos_list_t& positions) {
+    return keepPositions(segment, *pred, bloomHash(pred->lo), positions,
+        [pred](const ColumnVector& vec, size_t k) {
+            return pred->matches(vec.values[k]);
+        });
+}
+
+/* Same on a STRING_HEAP segment */
+ColumnStatus filterPositions(ColumnSegmentReader& segment, const StringPredicate* pred, pos_list_t& positions) {
+    return keepPositions(segment, *pred, bloomHash(pred->lo.data(), pred->lo.size()), positions,
+        [pred](const ColumnVector& vec, size_t k) {
+            return !vec.strings.empty() && pred->matches(vec.strings[vec.values[k]]);
+        });
+}
+
+/*
+
+    First row of a sorted segment whose value is at least `val` (greater
+    than `val` if `upper`), or the number of rows. Nulls count as smaller
+    than any value, which keeps them where a sorted segment has them.
+
+*/
+static ColumnStatus sortedBound(ColumnSegmentReader& segment, int64_t val, bool upper, uint64_t& row) {
+
+    size_t lo = 0, hi = segment.getNumChunks();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        const ZoneMap& zone = segment.getChunk(mid).zone;
+        if (zone.nullCount == zone.rowCount || zone.maxVal < val || (upper && zone.maxVal == val)) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    if (lo == segment.getNumChunks()) {
+        row = segment.getNumRows();
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    /* Leading nulls of the chunk hold its first value, so the values never decrease */
+    ColumnVector vec;
+    ColumnStatus rc = segment.readChunk(lo, vec);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    auto it = upper ? std::upper_bound(vec.values.begin(), vec.values.end(), val)
+                    : std::lower_bound(vec.values.begin(), vec.values.end(), val);
+    row = segment.getFirstRow(lo) + (it - vec.values.begin());
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Rows [begin, end) of a sorted segment holding lo <= v <= hi, nulls among them included */
+ColumnStatus findSortedRange(ColumnSegmentReader& segment, int64_t lo, int64_t hi, uint64_t& begin, uint64_t& end) {
+
+    if (!segment.isSorted()) {
+        return ColumnStatus::TYPE_MISMATCH;
+    }
+    begin = end = 0;
+    if (lo > hi) {
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    ColumnStatus rc = sortedBound(segment, lo, false, begin);
+    if (rc == ColumnStatus::GENERAL_SUCCESS) {
+        rc = sortedBound(segment, hi, true, end);
+    }
+    end = std::max(begin, end);
+    return rc;
+}
+
+/* Non-null values of a sorted segment in row order, loading only chunks that can hold a target */
+class SortedCursor {
+
+public:
+
+    SortedCursor(ColumnSegmentReader& segment) : segment(segment), chunkIdx(0), pos(0), firstRow(0) {}
+
+    int64_t value() const { return vec.values[pos]; }
+    uint64_t row() const { return firstRow + pos; }
+    void step() { ++pos; }
+
+    /* Move to the first value >= target from the current position, `found` false at the end */
+    ColumnStatus seek(int64_t target, bool& found) {
+        while (true) {
+            if (pos < vec.size() && vec.values.back() >= target) {
+                pos = std::lower_bound(vec.values.begin() + pos, vec.values.end(), target) - vec.values.begin();
+                while (pos < vec.size() && vec.isNull(pos)) {
+                    ++pos;
+                }
+                if (pos < vec.size()) {
+                    found = true;
+                    return ColumnStatus::GENERAL_SUCCESS;
+                }
+            }
+            while (chunkIdx < segment.getNumChunks()) {
+                const ZoneMap& zone = segment.getChunk(chunkIdx).zone;
+                if (zone.nullCount != zone.rowCount && zone.maxVal >= target) {
+                    break;
+                }
+                ++chunkIdx;
+            }
+            if (chunkIdx == segment.getNumChunks()) {
+                found = false;
+                return ColumnStatus::GENERAL_SUCCESS;
+            }
+            firstRow = segment.getFirstRow(chunkIdx);
+            pos = 0;
+            ColumnStatus rc = segment.readChunk(chunkIdx++, vec);
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+        }
+    }
+
+private:
+
+    ColumnSegmentReader& segment;
+    size_t chunkIdx;                // Next chunk to load
+    size_t pos;                     // Position in `vec`
+    uint64_t firstRow;              // Segment row of vec[0]
+    ColumnVector vec;
+
+};
+
+/*
+
+    Equi-join of two sorted integer segments: every (left row, right row)
+    pair with equal non-null values, in value order. Each side seeks to
+    the other's current value, so long stretches without a partner cost
+    a zone map check per chunk rather than a decode.
+
+*/
+ColumnStatus mergeJoinSegments(ColumnSegmentReader& left, ColumnSegmentReader& right,
+                               std::vector<std::pair<uint64_t, uint64_t>>& pairs) {
+
+    /* Codes of different dictionaries do not compare */
+    if (!left.isSorted() || !right.isSorted() ||
+        left.getType() == ColumnType::STRING || right.getType() == ColumnType::STRING) {
+        return ColumnStatus::TYPE_MISMATCH;
+    }
+
+    SortedCursor l(left), r(right);
+    bool lFound, rFound;
+    ColumnStatus rc = l.seek(INT64_MIN, lFound);
+    if (rc == ColumnStatus::GENERAL_SUCCESS) {
+        rc = r.seek(INT64_MIN, rFound);
+    }
+
+    std::vector<uint64_t> lRows, rRows;
+    while (rc == ColumnStatus::GENERAL_SUCCESS && lFound && rFound) {
+        int64_t val = l.value();
+        if (val < r.value()) {
+            rc = l.seek(r.value(), lFound);
+            continue;
+        }
+        if (val > r.value()) {
+            rc = r.seek(val, rFound);
+            continue;
+        }
+
+        lRows.clear();
+        rRows.clear();
+        while (rc == ColumnStatus::GENERAL_SUCCESS && lFound && l.value() == val) {
+            lRows.push_back(l.row());
+            l.step();
+            rc = l.seek(val, lFound);
+        }
+        while (rc == ColumnStatus::GENERAL_SUCCESS && rFound && r.value() == val) {
+            rRows.push_back(r.row());
+            r.step();
+            rc = r.seek(val, rFound);
+        }
+        for (uint64_t lRow : lRows) {
+            for (uint64_t rRow : rRows) {
+                pairs.emplace_back(lRow, rRow);
+            }
+        }
+    }
+    return rc;
+}
\ No newline at end of file
@@ -0,0 +1,991 @@
+/*
+
+    Column Segment Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "column_segment.h"
+#include "encoding.h"
+#include "roaring.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+
+/*
+
+    Some basic rules about segments:
+        - Every chunk but the last holds exactly COLUMN_CHUNK_SIZE values
+        - Null slots repeat the previous value (the first non-null value at
+          the start of a chunk), which keeps runs, deltas and packed ranges
+          intact, and are excluded from min and max
+        - A chunk with no nulls has no validity bitmap (validitySize 0),
+          and sparse or clustered nulls are stored as a RoaringBitmap of
+          null offsets; either way frames hold the plain bitmap
+        - A chunk of only nulls has min 0 and max 0, skipped via nullCount
+        - STRING chunks store codes, so their zone maps are in code space,
+          except STRING_HEAP chunks whose zone maps hold stringKey()s;
+          their null slots are empty strings
+        - A chunk's Bloom filter, if any, follows its data and holds the
+          hashes (bloomHash()) of the values the zone map covers, codes
+          for dictionary chunks and strings for STRING_HEAP chunks
+
+*/
+
+#define  DICT_NULL_CODE         UINT32_MAX  // Provisional code of a null string
+
+static size_t validityWords(size_t nValues) {
+    return (nValues + 63) >> 6;
+}
+
+
+/* ColumnSegmentWriter */
+
+ColumnSegmentWriter::ColumnSegmentWriter(const std::string& path, col_id_t colId, ColumnType type) :
+    path(path), colId(colId), type(type), fd(OS_INVALID_FD), writeOfst(0), nRows(0), chunkSize(COLUMN_CHUNK_SIZE),
+    nullCount(0), stringLayout(StringLayout::DICTIONARY), valueWidth(sizeof(int64_t)), codec(ColumnCodec::NONE), bloomBits(0),
+    inOrder(true), hasValue(false), lastVal(0), stats(type) {}
+
+ColumnSegmentWriter::~ColumnSegmentWriter() {
+    if (fd != OS_INVALID_FD) {
+        osClose(fd);
+        osRemove(tmpPath().c_str());    // Abandoned before finish()
+    }
+}
+
+ColumnStatus ColumnSegmentWriter::open() {
+    osRemove(tmpPath().c_str());        // Leftover of an earlier failed write
+    fd = osOpen(tmpPath().c_str(), true);
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::IO_ERROR;
+    }
+    chunk.values.reserve(chunkSize);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Compress every chunk from now on with `codec`, NONE turns compression off */
+ColumnStatus ColumnSegmentWriter::setCodec(ColumnCodec newCodec) {
+    if (newCodec != ColumnCodec::NONE && !getCodec(newCodec)) {
+        return ColumnStatus::UNSUPPORTED_CODEC;
+    }
+    codec = newCodec;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Give every chunk from now on a Bloom filter of `bitsPerKey` bits per distinct value, 0 turns them off */
+ColumnStatus ColumnSegmentWriter::setBloomFilter(size_t bitsPerKey) {
+    bloomBits = bitsPerKey;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Cut chunks of `nValues` values instead of COLUMN_CHUNK_SIZE, before anything is appended */
+ColumnStatus ColumnSegmentWriter::setChunkSize(size_t nValues) {
+    if (nValues == 0 || nValues > COLUMN_CHUNK_SIZE || nRows > 0) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+    chunkSize = nValues;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+ColumnStatus ColumnSegmentWriter::append(int64_t val) {
+    if (type == ColumnType::STRING) {
+        return ColumnStatus::TYPE_MISMATCH;
+    }
+    inOrder = inOrder && (!hasValue || val >= lastVal);
+    hasValue = true;
+    lastVal = val;
+    if (COLUMN_STATS_ENABLED) {
+        stats.add(val);
+    }
+    ++nRows;
+    return addValue(val);
+}
+
+ColumnStatus ColumnSegmentWriter::append(const std::string& val) {
+    if (type != ColumnType::STRING) {
+        return ColumnStatus::TYPE_MISMATCH;
+    }
+    codes.push_back(dict.add(val));
+    inOrder = inOrder && (!hasValue || val >= lastStr);
+    hasValue = true;
+    lastStr = val;
+    if (COLUMN_STATS_ENABLED) {
+        stats.add(val);
+    }
+    ++nRows;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+ColumnStatus ColumnSegmentWriter::appendNull() {
+    inOrder = inOrder && !hasValue;
+    if (COLUMN_STATS_ENABLED) {
+        stats.addNull();
+    }
+    ++nRows;
+    if (type == ColumnType::STRING) {
+        codes.push_back(DICT_NULL_CODE);
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    return addNull();
+}
+
+ColumnStatus ColumnSegmentWriter::addValue(int64_t val) {
+    if (!chunk.validity.empty()) {
+        size_t i = chunk.values.size();
+        if (validityWords(i + 1) > chunk.validity.size()) {
+            chunk.validity.push_back(0);
+        }
+        chunk.validity[i >> 6] |= 1ULL << (i & 63);
+    }
+    chunk.values.push_back(val);
+
+    if (chunk.values.size() == chunkSize) {
+        return flushChunk();
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* The validity bitmap is only materialized once the first null shows up */
+ColumnStatus ColumnSegmentWriter::addNull() {
+    size_t i = chunk.values.size();
+    if (chunk.validity.empty()) {
+        chunk.validity.assign(validityWords(i + 1), ~0ULL);
+    }
+    else if (validityWords(i + 1) > chunk.validity.size()) {
+        chunk.validity.push_back(0);
+    }
+    chunk.validity[i >> 6] &= ~(1ULL << (i & 63));
+    chunk.values.push_back(i == 0 ? 0 : chunk.values.back());
+    ++nullCount;
+
+    if (chunk.values.size() == chunkSize) {
+        return flushChunk();
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+ColumnStatus ColumnSegmentWriter::flushChunk() {
+
+    size_t n = chunk.values.size();
+    if (n == 0) {
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    /* Leading nulls hold 0, give them the first real value so they stay inside the range */
+    size_t first = 0;
+    while (first < n && chunk.isNull(first)) {
+        ++first;
+    }
+    if (first < n) {
+        std::fill(chunk.values.begin(), chunk.values.begin() + first, chunk.values[first]);
+    }
+
+    /* Heap chunks hold the strings, their values are only the keys that go into the zone map */
+    bool heap = stringLayout == StringLayout::HEAP;
+    ChunkFooter cf;
+    memset(&cf, 0, sizeof(cf));
+    cf.offset = writeOfst;
+    ColumnEncoding enc = heap ? ColumnEncoding::STRING_HEAP
+                              : chooseEncoding(sampleEncodingStats(chunk.values), n, type, valueWidth);
+    cf.encoding = static_cast<uint8_t>(enc);
+    cf.valueWidth = heap ? 0 : valueWidth;
+    cf.zone.rowCount = static_cast<uint32_t>(n);
+    cf.zone.nullCount = nullCount;
+    cf.zone.minVal = INT64_MAX;
+    cf.zone.maxVal = INT64_MIN;
+
+    for (size_t i = 0; i < n; ++i) {
+        if (!chunk.isNull(i)) {
+            cf.zone.minVal = std::min(cf.zone.minVal, chunk.values[i]);
+            cf.zone.maxVal = std::max(cf.zone.maxVal, chunk.values[i]);
+        }
+    }
+    if (nullCount == n) {
+        cf.zone.minVal = cf.zone.maxVal = 0;
+    }
+
+    if (nullCount > 0) {
+        RoaringBitmap nulls;
+        nulls.addWords(0, chunk.validity.data(), n, true);
+        nulls.runOptimize();
+        std::vector<char> packedNulls;
+        nulls.serialize(packedNulls);
+
+        const char* validity = reinterpret_cast<const char*>(chunk.validity.data());
+        cf.validitySize = static_cast<uint32_t>(validityWords(n) * sizeof(uint64_t));
+        if (packedNulls.size() < cf.validitySize) {
+            cf.validityFormat = static_cast<uint8_t>(ValidityFormat::ROARING);
+            cf.validitySize = static_cast<uint32_t>(packedNulls.size());
+            validity = packedNulls.data();
+        }
+        if (osWrite(fd, validity, cf.validitySize, writeOfst) < 0) {
+            return ColumnStatus::IO_ERROR;
+        }
+    }
+    std::vector<char> encoded;
+    if (heap) {
+        ColumnStatus rc = encodeStrings(heapChunk, STRING_FSST_ENABLED, encoded);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+    else {
+        encodeValues(enc, valueWidth, chunk.values, encoded);
+    }
+    size_t valSize = encoded.size();
+
+    /* Keep the compressed form only if it is actually smaller */
+    const Codec* compressor = heap ? nullptr : getCodec(codec);
+    if (compressor) {
+        std::vector<char> packed(compressor->maxCompressedSize(valSize));
+        size_t n = compressor->compress(encoded.data(), valSize, packed.data(), packed.size());
+        if (n > 0 && n < valSize) {
+            cf.codec = static_cast<uint8_t>(codec);
+            cf.rawSize = static_cast<uint32_t>(valSize);
+            packed.resize(n);
+            encoded.swap(packed);
+            valSize = n;
+        }
+    }
+
+    if (osWrite(fd, encoded.data(), valSize, writeOfst + cf.validitySize) < 0) {
+        return ColumnStatus::IO_ERROR;
+    }
+
+    cf.size = static_cast<uint32_t>(cf.validitySize + valSize);
+    writeOfst += cf.size;
+    if (bloomBits > 0 && nullCount < n) {
+        ColumnStatus rc = writeBloom(cf);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+    chunks.push_back(cf);
+
+    chunk.clear();
+    heapChunk.clear();
+    nullCount = 0;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Bloom filter of the chunk being flushed, sized on its distinct values and written after its data */
+ColumnStatus ColumnSegmentWriter::writeBloom(ChunkFooter& cf) {
+
+    bool heap = stringLayout == StringLayout::HEAP;
+    std::vector<uint64_t> hashes;
+    hashes.reserve(chunk.size() - nullCount);
+    for (size_t i = 0; i < chunk.size(); ++i) {
+        if (!chunk.isNull(i)) {
+            hashes.push_back(heap ? bloomHash(heapChunk[i]->data(), heapChunk[i]->size())
+                                  : bloomHash(chunk.values[i]));
+        }
+    }
+    std::sort(hashes.begin(), hashes.end());
+    hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+
+    BloomFilter filter(hashes.size(), bloomBits);
+    for (uint64_t hash : hashes) {
+        filter.add(hash);
+    }
+    if (osWrite(fd, filter.data(), filter.bytes(), writeOfst) < 0) {
+        return ColumnStatus::IO_ERROR;
+    }
+    cf.bloomOffset = writeOfst;
+    cf.bloomBlocks = static_cast<uint32_t>(filter.getNumBlocks());
+    writeOfst += filter.bytes();
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Write the last chunk and the footers, then move the file into place */
+ColumnStatus ColumnSegmentWriter::finish() {
+
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+
+    ColumnStatus rc;
+    std::vector<char> dictBytes;
+    std::vector<std::string> sorted;
+
+    /* Now that the dictionary is complete, chunk the final codes, or the strings if it does not pay */
+    if (type == ColumnType::STRING) {
+        size_t nValues = codes.size() - std::count(codes.begin(), codes.end(), DICT_NULL_CODE);
+        if (dict.size() * 100 > nValues * STRING_HEAP_THRESHOLD) {
+            stringLayout = StringLayout::HEAP;
+        }
+
+        std::vector<uint32_t> remap;
+        if (stringLayout == StringLayout::DICTIONARY) {
+            dict.finish(sorted, remap);
+            valueWidth = dictCodeWidth(sorted.size());
+        }
+
+        for (uint32_t code : codes) {
+            if (stringLayout == StringLayout::DICTIONARY) {
+                rc = (code == DICT_NULL_CODE) ? addNull() : addValue(remap[code]);
+            }
+            else if (code == DICT_NULL_CODE) {
+                heapChunk.push_back(nullptr);
+                rc = addNull();
+            }
+            else {
+                const std::string& val = dict.get(code);
+                heapChunk.push_back(&val);
+                rc = addValue(stringKey(val.data(), val.size()));
+            }
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+        }
+        codes.clear();
+    }
+
+    if ((rc = flushChunk()) != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    SegmentFooter sf;
+    memset(&sf, 0, sizeof(sf));
+    sf.magic = sf.magic2 = COLUMN_SEGMENT_MAGIC;
+    sf.version = COLUMN_SEGMENT_VERSION;
+    sf.colId = colId;
+    sf.type = static_cast<uint8_t>(type);
+    sf.stringLayout = static_cast<uint8_t>(stringLayout);
+    sf.sorted = inOrder;
+    sf.nRows = nRows;
+    sf.nChunks = static_cast<uint32_t>(chunks.size());
+
+    if (type == ColumnType::STRING && stringLayout == StringLayout::DICTIONARY) {
+        dictSerialize(sorted, dictBytes);
+        if (osWrite(fd, dictBytes.data(), dictBytes.size(), writeOfst) < 0) {
+            return ColumnStatus::IO_ERROR;
+        }
+        sf.dictOffset = writeOfst;
+        sf.dictSize = static_cast<uint32_t>(dictBytes.size());
+        sf.nDictEntries = static_cast<uint32_t>(sorted.size());
+        writeOfst += dictBytes.size();
+    }
+    if (COLUMN_STATS_ENABLED) {
+        std::vector<char> statsBytes;
+        stats.serialize(statsBytes);
+        if (osWrite(fd, statsBytes.data(), statsBytes.size(), writeOfst) < 0) {
+            return ColumnStatus::IO_ERROR;
+        }
+        sf.statsOffset = writeOfst;
+        sf.statsSize = static_cast<uint32_t>(statsBytes.size());
+        writeOfst += statsBytes.size();
+    }
+    sf.chunksOffset = writeOfst;
+
+    size_t footersSize = chunks.size() * sizeof(ChunkFooter);
+    if (osWrite(fd, chunks.data(), footersSize, writeOfst) < 0 ||
+        osWrite(fd, &sf, sizeof(sf), writeOfst + footersSize) < 0 ||
+        osDataSync(fd) != 0) {
+        return ColumnStatus::IO_ERROR;
+    }
+
+    osClose(fd);
+    fd = OS_INVALID_FD;
+    if (osRename(tmpPath().c_str(), path.c_str()) != 0) {
+        return ColumnStatus::IO_ERROR;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Footer layouts of segments written before the current version (column.h) */
+struct ChunkFooterV2 {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t validitySize;
+    ZoneMap  zone;
+    uint8_t  encoding;
+    uint8_t  valueWidth;
+    uint8_t  codec;
+    uint8_t  validityFormat;
+    uint32_t rawSize;
+};
+
+struct SegmentFooterV3 {
+    uint32_t magic;
+    uint32_t version;
+    col_id_t colId;
+    uint8_t  type;
+    uint8_t  stringLayout;
+    uint8_t  sorted;
+    uint8_t  reserved;
+    uint64_t nRows;
+    uint64_t chunksOffset;
+    uint64_t dictOffset;
+    uint32_t dictSize;
+    uint32_t nDictEntries;
+    uint32_t nChunks;
+    uint32_t magic2;
+};
+
+static_assert(offsetof(ChunkFooter, bloomOffset) == sizeof(ChunkFooterV2),
+              "a version 2 chunk footer must be a prefix of the current one");
+
+/*
+
+    Read the footers of the segment ending at `segmentEnd` in `fd` and
+    bring them to the current layout. A footer is tried as the current
+    version first, then as the shorter one of versions 2 and 3; those get
+    no statistics (statsSize 0), and version 2 chunks no Bloom filters
+    (bloomBlocks 0). The footers come back as version
+    COLUMN_SEGMENT_VERSION, so they can be written out again as they are.
+
+*/
+ColumnStatus readSegmentFooters(os_fd_t fd, uint64_t segmentEnd, SegmentFooter& footer,
+                                std::vector<ChunkFooter>& chunks) {
+
+    uint32_t version = 0;
+    size_t footerSize = sizeof(SegmentFooter);
+    memset(&footer, 0, sizeof(footer));
+    if (segmentEnd >= sizeof(footer)) {
+        if (osRead(fd, &footer, sizeof(footer), segmentEnd - sizeof(footer)) != static_cast<ssize_t>(sizeof(footer))) {
+            return ColumnStatus::IO_ERROR;
+        }
+        if (footer.magic == COLUMN_SEGMENT_MAGIC && footer.magic2 == COLUMN_SEGMENT_MAGIC) {
+            version = footer.version;
+        }
+    }
+
+    if (version != COLUMN_SEGMENT_VERSION) {
+        SegmentFooterV3 old;
+        footerSize = sizeof(old);
+        if (segmentEnd < sizeof(old)) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+        if (osRead(fd, &old, sizeof(old), segmentEnd - sizeof(old)) != static_cast<ssize_t>(sizeof(old))) {
+            return ColumnStatus::IO_ERROR;
+        }
+        if (old.magic != COLUMN_SEGMENT_MAGIC || old.magic2 != COLUMN_SEGMENT_MAGIC ||
+            old.version < 2 || old.version > 3) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+        version = old.version;
+
+        memset(&footer, 0, sizeof(footer));
+        footer.magic = footer.magic2 = COLUMN_SEGMENT_MAGIC;
+        footer.version = COLUMN_SEGMENT_VERSION;
+        footer.colId = old.colId;
+        footer.type = old.type;
+        footer.stringLayout = old.stringLayout;
+        footer.sorted = old.sorted;
+        footer.nRows = old.nRows;
+        footer.chunksOffset = old.chunksOffset;
+        footer.dictOffset = old.dictOffset;
+        footer.dictSize = old.dictSize;
+        footer.nDictEntries = old.nDictEntries;
+        footer.nChunks = old.nChunks;
+    }
+
+    size_t chunkFooterSize = version == 2 ? sizeof(ChunkFooterV2) : sizeof(ChunkFooter);
+    if (footer.chunksOffset + footer.nChunks * chunkFooterSize + footerSize != segmentEnd) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    chunks.resize(footer.nChunks);
+    if (version > 2) {
+        size_t footersSize = chunks.size() * sizeof(ChunkFooter);
+        if (osRead(fd, chunks.data(), footersSize, footer.chunksOffset) != static_cast<ssize_t>(footersSize)) {
+            return ColumnStatus::IO_ERROR;
+        }
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    std::vector<ChunkFooterV2> old(chunks.size());
+    size_t footersSize = old.size() * sizeof(ChunkFooterV2);
+    if (osRead(fd, old.data(), footersSize, footer.chunksOffset) != static_cast<ssize_t>(footersSize)) {
+        return ColumnStatus::IO_ERROR;
+    }
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        memset(&chunks[i], 0, sizeof(ChunkFooter));
+        memcpy(&chunks[i], &old[i], sizeof(ChunkFooterV2));
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+
+/* ColumnSegmentReader */
+
+ColumnSegmentReader::ColumnSegmentReader(const std::string& path, uint64_t segmentEnd) :
+    path(path), segmentEnd(segmentEnd), fd(OS_INVALID_FD), segId(ChunkPool::nextSegmentId()), pool(nullptr), cache(nullptr),
+    bytesRead(0), isDefault(false), defaultNull(false), defaultVal(0) {
+    memset(&footer, 0, sizeof(footer));
+}
+
+ColumnSegmentReader::~ColumnSegmentReader() {
+    if (pool) {
+        pool->evictSegment(segId);
+    }
+    if (cache) {
+        cache->evictSegment(segId);
+    }
+    if (fd != OS_INVALID_FD) {
+        osClose(fd);
+    }
+}
+
+/* Load the segment footer and the chunk footers, chunk data is read on demand */
+ColumnStatus ColumnSegmentReader::open() {
+
+    fd = osOpen(path.c_str(), false);
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::IO_ERROR;
+    }
+
+    int64_t fileSize = osFileSize(fd);
+    if (segmentEnd == 0) {
+        segmentEnd = static_cast<uint64_t>(std::max<int64_t>(fileSize, 0));
+    }
+    if (segmentEnd > static_cast<uint64_t>(fileSize)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    ColumnStatus rc = readSegmentFooters(fd, segmentEnd, footer, chunks);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    if (footer.stringLayout > static_cast<uint8_t>(StringLayout::HEAP) || footer.sorted > 1 ||
+        footer.statsOffset + footer.statsSize > footer.chunksOffset ||
+        (footer.stringLayout != 0 && getType() != ColumnType::STRING)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    firstRows.resize(chunks.size());
+    uint64_t row = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        firstRows[i] = row;
+        row += chunks[i].zone.rowCount;
+    }
+    if (row != footer.nRows) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    for (auto& cf : chunks) {
+        bool heap = cf.encoding == static_cast<uint8_t>(ColumnEncoding::STRING_HEAP);
+        if (heap != (getStringLayout() == StringLayout::HEAP) ||
+            cf.bloomOffset + static_cast<uint64_t>(cf.bloomBlocks) * BLOOM_BLOCK_BYTES > footer.chunksOffset) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+    }
+
+    if (getType() == ColumnType::STRING && getStringLayout() == StringLayout::DICTIONARY) {
+        std::vector<char> buf(footer.dictSize);
+        if (footer.dictOffset + footer.dictSize > footer.chunksOffset ||
+            osRead(fd, buf.data(), buf.size(), footer.dictOffset) != static_cast<ssize_t>(buf.size())) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+        return dictDeserialize(buf.data(), buf.size(), footer.nDictEntries, dictionary);
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    A segment of nRows rows holding `val` (`str` for STRING), or nulls if
+    `isNull`, without a file. Its chunks have the usual size and a zone
+    map each, and are made up when loaded, so such a segment costs a
+    chunk footer per COLUMN_CHUNK_SIZE rows until it is scanned.
+
+*/
+ColumnStatus ColumnSegmentReader::openDefault(col_id_t colId, ColumnType type, uint64_t nRows, bool isNull,
+                                              int64_t val, const std::string& str) {
+
+    footer.magic = footer.magic2 = COLUMN_SEGMENT_MAGIC;
+    footer.version = COLUMN_SEGMENT_VERSION;
+    footer.colId = colId;
+    footer.type = static_cast<uint8_t>(type);
+    footer.sorted = 1;
+    footer.nRows = nRows;
+
+    isDefault = true;
+    defaultNull = isNull;
+    defaultVal = isNull ? 0 : val;
+    if (type == ColumnType::STRING && !isNull) {
+        dictionary.assign(1, str);
+        footer.nDictEntries = 1;
+        defaultVal = 0;
+    }
+
+    ColumnEncoding enc = type == ColumnType::STRING ? ColumnEncoding::DICTIONARY : ColumnEncoding::PLAIN;
+    for (uint64_t row = 0; row < nRows; row += COLUMN_CHUNK_SIZE) {
+        ChunkFooter cf;
+        memset(&cf, 0, sizeof(cf));
+        cf.zone.rowCount = static_cast<uint32_t>(std::min<uint64_t>(nRows - row, COLUMN_CHUNK_SIZE));
+        cf.zone.nullCount = isNull ? cf.zone.rowCount : 0;
+        cf.zone.minVal = cf.zone.maxVal = defaultVal;
+        cf.encoding = static_cast<uint8_t>(enc);
+        cf.valueWidth = type == ColumnType::STRING ? dictCodeWidth(1) : sizeof(int64_t);
+        chunks.push_back(cf);
+        firstRows.push_back(row);
+    }
+    footer.nChunks = static_cast<uint32_t>(chunks.size());
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Bytes of a chunk: validity bitmap followed by encoded values. A
+    compressed chunk is read into a scratch buffer and decompressed
+    straight into `data`, which is usually the frame going into the pool.
+
+*/
+ColumnStatus ColumnSegmentReader::readChunkData(size_t idx, std::vector<char>& data) {
+
+    if (idx >= chunks.size()) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+    if (isDefault) {
+        return ColumnStatus::GENERAL_FAILURE;       // Nothing is stored
+    }
+
+    const ChunkFooter& cf = chunks[idx];
+    bool dense = cf.validityFormat == static_cast<uint8_t>(ValidityFormat::DENSE);
+    if (cf.validitySize > cf.size || cf.validityFormat > static_cast<uint8_t>(ValidityFormat::ROARING) ||
+        (dense && cf.validitySize != 0 && cf.validitySize != validityWords(cf.zone.rowCount) * sizeof(uint64_t)) ||
+        cf.offset + cf.size > footer.chunksOffset) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    bytesRead += cf.size;
+    if (cf.codec == static_cast<uint8_t>(ColumnCodec::NONE)) {
+        data.resize(cf.size);
+        if (osRead(fd, data.data(), cf.size, cf.offset) != static_cast<ssize_t>(cf.size)) {
+            return ColumnStatus::IO_ERROR;
+        }
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    const Codec* decompressor = getCodec(static_cast<ColumnCodec>(cf.codec));
+    if (!decompressor) {
+        return ColumnStatus::UNSUPPORTED_CODEC;
+    }
+    if (cf.rawSize > 2 * COLUMN_CHUNK_SIZE * sizeof(int64_t)) {
+        return ColumnStatus::CORRUPT_SEGMENT;     // Bigger than any encoding of a chunk
+    }
+
+    std::vector<char> stored(cf.size);
+    if (osRead(fd, stored.data(), cf.size, cf.offset) != static_cast<ssize_t>(cf.size)) {
+        return ColumnStatus::IO_ERROR;
+    }
+
+    data.resize(cf.validitySize + cf.rawSize);
+    memcpy(data.data(), stored.data(), cf.validitySize);
+    if (!decompressor->decompress(stored.data() + cf.validitySize, cf.size - cf.validitySize,
+                                  data.data() + cf.validitySize, cf.rawSize)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Plain validity bitmap of a chunk from its stored bytes, empty when it has no nulls */
+ColumnStatus ColumnSegmentReader::decodeValidity(const ChunkFooter& cf, const char* data,
+                                                 bitset<uint64_t>& validity) const {
+
+    validity.clear();
+    if (cf.validitySize == 0) {
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    if (cf.validityFormat == static_cast<uint8_t>(ValidityFormat::DENSE)) {
+        validity.resize(cf.validitySize / sizeof(uint64_t));
+        memcpy(validity.data(), data, cf.validitySize);
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    RoaringBitmap nulls;
+    if (!nulls.deserialize(data, cf.validitySize) || nulls.cardinality() != cf.zone.nullCount ||
+        nulls.maximum() >= cf.zone.rowCount) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    validity.resize(validityWords(cf.zone.rowCount));
+    nulls.getWords(0, cf.zone.rowCount, validity.data());
+    for (auto& word : validity) {
+        word = ~word;
+    }
+    if (cf.zone.rowCount & 63) {
+        validity.back() &= (1ULL << (cf.zone.rowCount & 63)) - 1;    // No bits past the last row
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Frame of chunk `idx`, from the decoded cache, the pool or the file, see the header */
+ColumnStatus ColumnSegmentReader::loadChunk(size_t idx, std::shared_ptr<const ChunkFrame>& frame) {
+
+    if (isDefault) {
+        return loadDefault(idx, frame);
+    }
+    if (cache && (frame = cache->get(segId, idx))) {
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    ColumnStatus rc = loadStored(idx, frame);
+    if (rc != ColumnStatus::GENERAL_SUCCESS || !cache || frame->data.empty() ||
+        chunks[idx].encoding == static_cast<uint8_t>(ColumnEncoding::STRING_HEAP)) {
+        return rc;
+    }
+
+    const ChunkFooter& cf = chunks[idx];
+    auto decoded = std::make_shared<ChunkFrame>();
+    auto start = std::chrono::steady_clock::now();
+    rc = decodeValues(static_cast<ColumnEncoding>(cf.encoding), cf.valueWidth,
+                      frame->data.data() + cf.validitySize, cf.valuesSize(),
+                      cf.zone.rowCount, decoded->values);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    double cost = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    decoded->validity = frame->validity;
+    cache->put(segId, idx, decoded, cost);
+    frame = std::move(decoded);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Decoded frame of a chunk of a default segment, neither pooled nor cached */
+ColumnStatus ColumnSegmentReader::loadDefault(size_t idx, std::shared_ptr<const ChunkFrame>& frame) const {
+    if (idx >= chunks.size()) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+    auto made = std::make_shared<ChunkFrame>();
+    made->values.assign(chunks[idx].zone.rowCount, defaultVal);
+    if (defaultNull) {
+        made->validity.assign(validityWords(chunks[idx].zone.rowCount), 0);
+    }
+    frame = std::move(made);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Get a chunk into memory, from the pool when it is there. Without
+    LAZY_DECOMPRESSION the chunk is decoded here, once per load; with it
+    the frame keeps the stored bytes and decoding is left to readVector().
+    STRING_HEAP chunks keep their stored bytes either way, only checked
+    here, so scans can compare on the compressed strings.
+
+*/
+ColumnStatus ColumnSegmentReader::loadStored(size_t idx, std::shared_ptr<const ChunkFrame>& frame) {
+
+    if (pool && (frame = pool->get(segId, idx))) {
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    auto loaded = std::make_shared<ChunkFrame>();
+    ColumnStatus rc = readChunkData(idx, loaded->data);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    const ChunkFooter& cf = chunks[idx];
+    rc = decodeValidity(cf, loaded->data.data(), loaded->validity);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    if (cf.encoding == static_cast<uint8_t>(ColumnEncoding::STRING_HEAP)) {
+        StringHeapView view;
+        rc = openStrings(idx, *loaded, view);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+    else if (!LAZY_DECOMPRESSION) {
+        rc = decodeValues(static_cast<ColumnEncoding>(cf.encoding), cf.valueWidth,
+                          loaded->data.data() + cf.validitySize, cf.valuesSize(),
+                          cf.zone.rowCount, loaded->values);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        std::vector<char>().swap(loaded->data);
+    }
+
+    if (pool) {
+        pool->put(segId, idx, loaded);
+    }
+    frame = std::move(loaded);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Vector `vec` of chunk `idx`, decoded on the spot if the frame is still compressed */
+ColumnStatus ColumnSegmentReader::readVector(size_t idx, const ChunkFrame& frame, size_t vec,
+                                             ColumnVector& out) const {
+
+    const ChunkFooter& cf = chunks[idx];
+    size_t begin = vec * COLUMN_VECTOR_SIZE;
+    if (begin >= cf.zone.rowCount) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+    size_t count = std::min<size_t>(cf.zone.rowCount - begin, COLUMN_VECTOR_SIZE);
+    size_t firstWord = begin / 64;
+    size_t nWords = validityWords(count);
+
+    if (frame.validity.empty()) {
+        out.validity.clear();
+    }
+    else {
+        out.validity.assign(frame.validity.begin() + firstWord, frame.validity.begin() + firstWord + nWords);
+    }
+
+    if (cf.encoding == static_cast<uint8_t>(ColumnEncoding::STRING_HEAP)) {
+        StringHeapView view;
+        ColumnStatus rc = openStrings(idx, frame, view);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        view.read(begin, count, out.strings);
+        out.values.resize(count);
+        std::iota(out.values.begin(), out.values.end(), 0);
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    out.strings.clear();
+    if (frame.data.empty()) {
+        out.values.assign(frame.values.begin() + begin, frame.values.begin() + begin + count);
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    return decodeVector(static_cast<ColumnEncoding>(cf.encoding), cf.valueWidth,
+                        frame.data.data() + cf.validitySize, cf.valuesSize(),
+                        cf.zone.rowCount, vec, out.values);
+}
+
+ColumnStatus ColumnSegmentReader::readChunk(size_t idx, ColumnVector& out) {
+
+    std::shared_ptr<const ChunkFrame> frame;
+    ColumnStatus rc = loadChunk(idx, frame);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    const ChunkFooter& cf = chunks[idx];
+    out.validity = frame->validity;
+    if (cf.encoding == static_cast<uint8_t>(ColumnEncoding::STRING_HEAP)) {
+        StringHeapView view;
+        if ((rc = openStrings(idx, *frame, view)) != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        view.read(0, cf.zone.rowCount, out.strings);
+        out.values.resize(cf.zone.rowCount);
+        std::iota(out.values.begin(), out.values.end(), 0);
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    out.strings.clear();
+    if (frame->data.empty()) {
+        out.values = frame->values;
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    return decodeValues(static_cast<ColumnEncoding>(cf.encoding), cf.valueWidth,
+                        frame->data.data() + cf.validitySize, cf.valuesSize(),
+                        cf.zone.rowCount, out.values);
+}
+
+/* Runs of an RLE chunk, without expanding them (rebuilt from values if the frame is decoded) */
+ColumnStatus ColumnSegmentReader::readRuns(size_t idx, std::vector<ColumnRun>& runs, bitset<uint64_t>& validity) {
+
+    if (idx >= chunks.size()) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+    const ChunkFooter& cf = chunks[idx];
+    if (cf.encoding != static_cast<uint8_t>(ColumnEncoding::RLE)) {
+        return ColumnStatus::TYPE_MISMATCH;
+    }
+
+    std::shared_ptr<const ChunkFrame> frame;
+    ColumnStatus rc = loadChunk(idx, frame);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    validity = frame->validity;
+    if (frame->data.empty()) {
+        runs.clear();
+        for (int64_t val : frame->values) {
+            if (runs.empty() || runs.back().value != val) {
+                runs.push_back({ val, 0 });
+            }
+            ++runs.back().length;
+        }
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    return decodeRuns(frame->data.data() + cf.validitySize, cf.valuesSize(), cf.zone.rowCount, runs);
+}
+
+/* Strings of a loaded STRING_HEAP chunk, in place in the frame (which must outlive `view`) */
+ColumnStatus ColumnSegmentReader::openStrings(size_t idx, const ChunkFrame& frame, StringHeapView& view) const {
+    const ChunkFooter& cf = chunks[idx];
+    if (cf.encoding != static_cast<uint8_t>(ColumnEncoding::STRING_HEAP)) {
+        return ColumnStatus::TYPE_MISMATCH;
+    }
+    if (frame.data.size() < cf.validitySize) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    return view.open(frame.data.data() + cf.validitySize, frame.data.size() - cf.validitySize, cf.zone.rowCount);
+}
+
+/* Statistics of the segment, GENERAL_FAILURE if it was written without them */
+ColumnStatus ColumnSegmentReader::readStats(ColumnStats& stats) const {
+    if (isDefault) {
+        stats = ColumnStats(getType());
+        if (defaultNull) {
+            stats.addNull(footer.nRows);
+        }
+        else if (getType() == ColumnType::STRING) {
+            stats.add(dictionary[0], footer.nRows);
+        }
+        else {
+            stats.add(defaultVal, footer.nRows);
+        }
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    if (footer.statsSize == 0) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    std::vector<char> buf(footer.statsSize);
+    if (osRead(fd, buf.data(), buf.size(), footer.statsOffset) != static_cast<ssize_t>(buf.size())) {
+        return ColumnStatus::IO_ERROR;
+    }
+    return stats.deserialize(buf.data(), buf.size());
+}
+
+/*
+
+    Whether chunk `idx` may hold a value with bloomHash() `hash`. Only the
+    block the hash falls in is read, so a probe costs one small read
+    however large the filter; `maybe` is always true for a chunk without
+    a filter.
+
+*/
+ColumnStatus ColumnSegmentReader::probeBloom(size_t idx, uint64_t hash, bool& maybe) const {
+
+    if (idx >= chunks.size()) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+    const ChunkFooter& cf = chunks[idx];
+    maybe = true;
+    if (cf.bloomBlocks == 0) {
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    alignas(BLOOM_BLOCK_BYTES) uint64_t block[BLOOM_BLOCK_WORDS];
+    uint64_t ofst = cf.bloomOffset + bloomBlockOf(hash, cf.bloomBlocks) * BLOOM_BLOCK_BYTES;
+    if (osRead(fd, block, sizeof(block), ofst) != static_cast<ssize_t>(sizeof(block))) {
+        return ColumnStatus::IO_ERROR;
+    }
+    maybe = bloomBlockContains(block, hash);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,647 @@
+/*
+
+    Column Statistics Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "column_stats.h"
+#include "bloom.h"
+#include "string_heap.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+
+/* HyperLogLog */
+
+/* The top bits pick the register, the rank of the first set bit among the rest is what it keeps */
+void HyperLogLog::add(uint64_t hash) {
+    size_t idx = hash >> (64 - STATS_HLL_BITS);
+    uint64_t rest = (hash << STATS_HLL_BITS) | (1ULL << (STATS_HLL_BITS - 1));
+    uint8_t rank = static_cast<uint8_t>(__builtin_clzll(rest) + 1);
+    registers[idx] = std::max(registers[idx], rank);
+}
+
+void HyperLogLog::merge(const HyperLogLog& other) {
+    for (size_t i = 0; i < registers.size(); ++i) {
+        registers[i] = std::max(registers[i], other.registers[i]);
+    }
+}
+
+/* Harmonic mean of the registers, linear counting while many registers are still empty */
+uint64_t HyperLogLog::estimate() const {
+    double m = static_cast<double>(registers.size());
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t r : registers) {
+        sum += std::ldexp(1.0, -r);
+        zeros += r == 0;
+    }
+    double est = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    if (est <= 2.5 * m && zeros > 0) {
+        est = m * std::log(m / zeros);
+    }
+    return static_cast<uint64_t>(std::llround(est));
+}
+
+bool HyperLogLog::setRegisters(const uint8_t* data, size_t size) {
+    if (size != registers.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        if (data[i] > 64 - STATS_HLL_BITS + 1) {
+            return false;
+        }
+    }
+    memcpy(registers.data(), data, size);
+    return true;
+}
+
+/* EquiDepthHistogram */
+
+/*
+
+    Cut a sorted sample of `nValues` values into buckets of equal depth.
+    Bucket b ends at the sample value at b / nBuckets of the way through,
+    and values repeated across a cut fold the buckets they span into one,
+    which keeps the uppers strictly increasing. The ends are widened to
+    the real minimum and maximum, which the sample may have missed.
+
+*/
+void EquiDepthHistogram::build(std::vector<int64_t>& sample, uint64_t nValues, int64_t minVal, int64_t maxVal,
+                               size_t nBuckets) {
+
+    buckets.clear();
+    if (sample.empty() || nValues == 0 || nBuckets == 0) {
+        return;
+    }
+    std::sort(sample.begin(), sample.end());
+    size_t n = sample.size();
+    nBuckets = std::min(nBuckets, n);
+    lower = std::min(minVal, sample.front());
+
+    uint64_t prev = 0;
+    for (size_t b = 1; b <= nBuckets; ++b) {
+        size_t idx = (b * n + nBuckets - 1) / nBuckets - 1;
+        int64_t upper = (b == nBuckets) ? std::max(maxVal, sample.back()) : sample[idx];
+        uint64_t cum = (b == nBuckets) ? nValues
+                                       : static_cast<uint64_t>(static_cast<long double>(nValues) * (idx + 1) / n);
+        if (!buckets.empty() && buckets.back().upper >= upper) {
+            buckets.back().count += cum - prev;
+        }
+        else {
+            buckets.push_back({ upper, cum - prev });
+        }
+        prev = cum;
+    }
+}
+
+uint64_t EquiDepthHistogram::getTotal() const {
+    uint64_t total = 0;
+    for (auto& b : buckets) {
+        total += b.count;
+    }
+    return total;
+}
+
+void EquiDepthHistogram::setBuckets(int64_t newLower, std::vector<HistogramBucket> newBuckets) {
+    lower = newLower;
+    buckets = std::move(newBuckets);
+}
+
+/* Rows <= val, values spread evenly over the integers of their bucket */
+double EquiDepthHistogram::estimateLessEqual(int64_t val) const {
+
+    if (buckets.empty() || val < lower) {
+        return 0;
+    }
+    long double cum = 0;
+    long double begin = lower;
+    for (auto& b : buckets) {
+        if (val >= b.upper) {
+            cum += b.count;
+            begin = static_cast<long double>(b.upper) + 1;
+            continue;
+        }
+        long double width = static_cast<long double>(b.upper) - begin + 1;
+        return static_cast<double>(cum + b.count * ((static_cast<long double>(val) - begin + 1) / width));
+    }
+    return static_cast<double>(cum);
+}
+
+double EquiDepthHistogram::estimateRange(int64_t lo, int64_t hi) const {
+    if (lo > hi) {
+        return 0;
+    }
+    double below = (lo == INT64_MIN) ? 0 : estimateLessEqual(lo - 1);
+    return std::max(0.0, estimateLessEqual(hi) - below);
+}
+
+/*
+
+    Both cumulative distributions are piecewise linear between bucket
+    ends, and so is their sum: it is evaluated at every end of either
+    histogram, and the new cuts are read off it by interpolating between
+    the two ends that bracket each multiple of total / nBuckets.
+
+*/
+void EquiDepthHistogram::merge(const EquiDepthHistogram& other, size_t nBuckets) {
+
+    if (other.empty()) {
+        return;
+    }
+    if (empty()) {
+        *this = other;
+        return;
+    }
+
+    int64_t newLower = std::min(lower, other.lower);
+    int64_t top = std::max(buckets.back().upper, other.buckets.back().upper);
+    uint64_t total = getTotal() + other.getTotal();
+
+    std::vector<int64_t> ends = { lower, other.lower };
+    for (auto& b : buckets) {
+        ends.push_back(b.upper);
+    }
+    for (auto& b : other.buckets) {
+        ends.push_back(b.upper);
+    }
+    std::sort(ends.begin(), ends.end());
+    ends.erase(std::unique(ends.begin(), ends.end()), ends.end());
+
+    std::vector<long double> pos = { static_cast<long double>(newLower) - 1 };
+    std::vector<long double> cdf = { 0 };
+    for (int64_t e : ends) {
+        pos.push_back(e);
+        cdf.push_back(static_cast<long double>(estimateLessEqual(e)) + other.estimateLessEqual(e));
+    }
+
+    std::vector<HistogramBucket> cut;
+    uint64_t prev = 0;
+    size_t seg = 1;
+    for (size_t k = 1; k <= nBuckets; ++k) {
+        int64_t upper = top;
+        uint64_t cum = total;
+        if (k < nBuckets) {
+            long double target = static_cast<long double>(total) * k / nBuckets;
+            while (seg + 1 < pos.size() && cdf[seg] < target) {
+                ++seg;
+            }
+            long double span = cdf[seg] - cdf[seg - 1];
+            long double at = span > 0 ? pos[seg - 1] + (target - cdf[seg - 1]) / span * (pos[seg] - pos[seg - 1])
+                                      : pos[seg];
+            at = std::min<long double>(std::max<long double>(std::ceil(at), newLower), top);
+            upper = static_cast<int64_t>(at);
+            cum = std::min<uint64_t>(total, static_cast<uint64_t>(std::llround(
+                      static_cast<long double>(estimateLessEqual(upper)) + other.estimateLessEqual(upper))));
+            cum = std::max(cum, prev);
+        }
+        if (!cut.empty() && cut.back().upper >= upper) {
+            cut.back().count += cum - prev;
+        }
+        else {
+            cut.push_back({ upper, cum - prev });
+        }
+        prev = cum;
+    }
+
+    lower = newLower;
+    buckets.swap(cut);
+}
+
+/* HeavyHitters */
+
+/* At most STATS_HEAVY_LIMIT counters live at once, so the table is never over half full */
+HeavyHitters::HeavyHitters() : nCounters(0), error(0) {
+    size_t nSlots = 1;
+    while (nSlots < 2 * STATS_HEAVY_LIMIT) {
+        nSlots <<= 1;
+    }
+    keys.resize(nSlots);
+    counts.resize(nSlots);
+}
+
+/* Slot holding `key`, or the free slot it would go into */
+size_t HeavyHitters::slotOf(int64_t key) const {
+    size_t mask = keys.size() - 1;
+    size_t idx = static_cast<size_t>(bloomHash(key)) & mask;
+    while (counts[idx] != 0 && keys[idx] != key) {
+        idx = (idx + 1) & mask;
+    }
+    return idx;
+}
+
+void HeavyHitters::add(const CommonValue& val) {
+    add(val.key, val.str.empty() ? nullptr : &val.str, val.count);
+}
+
+/* Count `count` occurrences of `key` */
+void HeavyHitters::add(int64_t key, const std::string* str, uint64_t count) {
+    size_t idx = slotOf(key);
+    if (counts[idx] != 0) {
+        counts[idx] += count;
+        return;
+    }
+    keys[idx] = key;
+    counts[idx] = count;
+    if (str) {
+        if (strs.empty()) {
+            strs.resize(keys.size());
+        }
+        strs[idx] = *str;
+    }
+    if (++nCounters > STATS_HEAVY_LIMIT) {
+        prune(STATS_HEAVY_COUNTERS);
+    }
+}
+
+/* Counters add up, and so do the errors of both sides and of cutting the sum back down */
+void HeavyHitters::merge(const HeavyHitters& other) {
+    for (size_t idx = 0; idx < other.keys.size(); ++idx) {
+        if (other.counts[idx] != 0) {
+            add(other.keys[idx], other.strs.empty() ? nullptr : &other.strs[idx], other.counts[idx]);
+        }
+    }
+    error += other.error;
+    prune(STATS_HEAVY_COUNTERS);
+}
+
+bool HeavyHitters::find(int64_t key, uint64_t& count) const {
+    count = counts[slotOf(key)];
+    return count != 0;
+}
+
+uint64_t HeavyHitters::getTracked() const {
+    uint64_t total = 0;
+    for (uint64_t count : counts) {
+        total += count;
+    }
+    return total;
+}
+
+/*
+
+    Misra-Gries step: take the count of the first counter past `keep` off
+    every counter. That count is nearly always small, so it is found by
+    counting the small counts rather than by selection. The counters left
+    are put back into an emptied table, so probe sequences never run
+    through a removed one.
+
+*/
+void HeavyHitters::prune(size_t keep) {
+    if (nCounters <= keep) {
+        return;
+    }
+
+    /* Smallest cut that leaves `keep` counters or fewer */
+    size_t small[STATS_SMALL_COUNTS] = { 0 };
+    for (uint64_t count : counts) {
+        if (count != 0 && count < STATS_SMALL_COUNTS) {
+            ++small[count];
+        }
+    }
+    uint64_t cut = 0;
+    size_t above = nCounters;
+    while (above > keep && cut + 1 < STATS_SMALL_COUNTS) {
+        above -= small[++cut];
+    }
+    if (above > keep) {
+        std::vector<uint64_t> live;
+        live.reserve(nCounters);
+        for (uint64_t count : counts) {
+            if (count != 0) {
+                live.push_back(count);
+            }
+        }
+        std::nth_element(live.begin(), live.begin() + keep, live.end(), std::greater<uint64_t>());
+        cut = live[keep];
+    }
+
+    std::vector<std::pair<int64_t, uint64_t>> kept;
+    std::vector<std::string> keptStrs;
+    for (size_t idx = 0; idx < keys.size(); ++idx) {
+        if (counts[idx] > cut) {
+            kept.emplace_back(keys[idx], counts[idx] - cut);
+            if (!strs.empty()) {
+                keptStrs.push_back(std::move(strs[idx]));
+            }
+        }
+    }
+    std::fill(counts.begin(), counts.end(), 0);
+    for (auto& str : strs) {
+        str.clear();
+    }
+    for (size_t k = 0; k < kept.size(); ++k) {
+        size_t idx = slotOf(kept[k].first);
+        keys[idx] = kept[k].first;
+        counts[idx] = kept[k].second;
+        if (!strs.empty()) {
+            strs[idx] = std::move(keptStrs[k]);
+        }
+    }
+    nCounters = kept.size();
+    error += cut;
+}
+
+/* Most frequent first, ties by key so the order does not depend on the hash table */
+std::vector<CommonValue> HeavyHitters::top(size_t k) const {
+    std::vector<CommonValue> vals;
+    vals.reserve(nCounters);
+    for (size_t idx = 0; idx < keys.size(); ++idx) {
+        if (counts[idx] != 0) {
+            vals.push_back(CommonValue{ keys[idx], counts[idx], strs.empty() ? std::string() : strs[idx] });
+        }
+    }
+    k = std::min(k, vals.size());
+    std::partial_sort(vals.begin(), vals.begin() + k, vals.end(), [](const CommonValue& a, const CommonValue& b) {
+        return a.count != b.count ? a.count > b.count : a.key < b.key;
+    });
+    vals.resize(k);
+    return vals;
+}
+
+/* ColumnStats */
+
+ColumnStats::ColumnStats(ColumnType type) :
+    type(type), nRows(0), nNulls(0), minVal(INT64_MAX), maxVal(INT64_MIN), nPending(0), nextSample(0),
+    sampleWeight(0), rng(0x9E3779B97F4A7C15ULL) {}
+
+/* `count` rows of the value, in O(1) short of the reservoir's replacements */
+void ColumnStats::add(int64_t val, uint64_t count) {
+    addKey(val, bloomHash(val), nullptr, count);
+}
+
+void ColumnStats::add(const std::string& val, uint64_t count) {
+    addKey(stringKey(val.data(), val.size()), bloomHash(val.data(), val.size()), &val, count);
+}
+
+void ColumnStats::addNull(uint64_t count) {
+    nRows += count;
+    nNulls += count;
+}
+
+/* `key` is what the histogram orders on, strings are counted under their hash */
+void ColumnStats::addKey(int64_t key, uint64_t hash, const std::string* str, uint64_t count) {
+
+    if (count == 0) {
+        return;
+    }
+    nRows += count;
+    minVal = std::min(minVal, key);
+    maxVal = std::max(maxVal, key);
+    distinct.add(hash);
+    common.add(str ? static_cast<int64_t>(hash) : key, str, count);
+
+    /*
+
+        Reservoir sampling that jumps straight to the next value to keep
+        (Li's algorithm L): the number of values to pass over follows
+        from the largest of the reservoir's random weights, so the values
+        in between cost no random number at all, and `count` copies of a
+        value are passed over as many at a time.
+
+    */
+    while (count > 0 && sample.size() < STATS_SAMPLE_SIZE) {
+        ++nPending;
+        --count;
+        sample.push_back(key);
+        if (sample.size() == STATS_SAMPLE_SIZE) {
+            sampleWeight = exp(log(nextRandom()) / STATS_SAMPLE_SIZE);
+            nextSample = nPending + static_cast<uint64_t>(log(nextRandom()) / log1p(-sampleWeight)) + 1;
+        }
+    }
+    while (count > 0) {
+        uint64_t skip = std::min(count, nextSample - nPending);     // nextSample is always ahead
+        nPending += skip;
+        count -= skip;
+        if (nPending == nextSample) {
+            sample[static_cast<size_t>(nextRandom() * STATS_SAMPLE_SIZE)] = key;
+            sampleWeight *= exp(log(nextRandom()) / STATS_SAMPLE_SIZE);
+            nextSample += static_cast<uint64_t>(log(nextRandom()) / log1p(-sampleWeight)) + 1;
+        }
+    }
+}
+
+/* Uniform in (0, 1) */
+double ColumnStats::nextRandom() {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (static_cast<double>(rng >> 11) + 0.5) / 9007199254740992.0;
+}
+
+void ColumnStats::resetSample() {
+    sample.clear();
+    nPending = 0;
+    nextSample = 0;
+}
+
+void ColumnStats::merge(const ColumnStats& other) {
+    EquiDepthHistogram merged = getHistogram();
+    merged.merge(other.getHistogram(), STATS_HISTOGRAM_BUCKETS);
+    histogram = merged;
+    resetSample();
+
+    nRows += other.nRows;
+    nNulls += other.nNulls;
+    minVal = std::min(minVal, other.minVal);
+    maxVal = std::max(maxVal, other.maxVal);
+    distinct.merge(other.distinct);
+    common.merge(other.common);
+}
+
+/* Never more than the non-null rows, nor less than one if there are any */
+uint64_t ColumnStats::getDistinct() const {
+    uint64_t nValues = nRows - nNulls;
+    return std::min(nValues, std::max<uint64_t>(nValues > 0, distinct.estimate()));
+}
+
+/* Merged histogram plus one cut from the values sampled since */
+EquiDepthHistogram ColumnStats::getHistogram() const {
+    EquiDepthHistogram result = histogram;
+    if (nPending > 0) {
+        std::vector<int64_t> values = sample;
+        EquiDepthHistogram pending;
+        pending.build(values, nPending, minVal, maxVal, STATS_HISTOGRAM_BUCKETS);
+        result.merge(pending, STATS_HISTOGRAM_BUCKETS);
+    }
+    return result;
+}
+
+/*
+
+    A tracked value is estimated at its count plus half the error bound.
+    An untracked one shares the untracked rows evenly with the other
+    untracked distinct values, but can have no more than the error bound,
+    which is 0 as long as no counter has ever been cut: the counters are
+    then exact and an untracked value does not occur at all.
+
+*/
+double ColumnStats::estimateKey(int64_t key) const {
+    uint64_t count;
+    if (common.find(key, count)) {
+        return static_cast<double>(count) + common.getError() / 2.0;
+    }
+    uint64_t nValues = nRows - nNulls;
+    uint64_t tracked = std::min(common.getTracked(), nValues);
+    uint64_t others = getDistinct() > common.size() ? getDistinct() - common.size() : 1;
+    return std::min(static_cast<double>(nValues - tracked) / others, static_cast<double>(common.getError()));
+}
+
+double ColumnStats::estimateEqual(int64_t val) const {
+    if (type == ColumnType::STRING || nRows == nNulls || val < minVal || val > maxVal) {
+        return 0;
+    }
+    return estimateKey(val);
+}
+
+double ColumnStats::estimateEqual(const std::string& val) const {
+    int64_t key = stringKey(val.data(), val.size());
+    if (type != ColumnType::STRING || nRows == nNulls || key < minVal || key > maxVal) {
+        return 0;
+    }
+    return estimateKey(static_cast<int64_t>(bloomHash(val.data(), val.size())));
+}
+
+double ColumnStats::estimateRange(int64_t lo, int64_t hi) const {
+    return getHistogram().estimateRange(lo, hi);
+}
+
+/*
+
+    Serialized form:
+
+        | StatsHeader | HLL registers | HistogramBucket x nBuckets | common values |
+
+    with every common value as key, count, length and the string bytes.
+
+*/
+struct StatsHeader {
+    uint32_t magic;
+    uint8_t  type;              // ColumnType
+    uint8_t  hllBits;
+    uint16_t nBuckets;
+    uint32_t nCommon;
+    uint32_t reserved;
+    uint64_t nRows;
+    uint64_t nNulls;
+    int64_t  minVal;
+    int64_t  maxVal;
+    int64_t  lower;             // Start of the first histogram bucket
+    uint64_t commonError;
+};
+
+template <typename T>
+static void put(std::vector<char>& out, const T& val) {
+    const char* p = reinterpret_cast<const char*>(&val);
+    out.insert(out.end(), p, p + sizeof(T));
+}
+
+template <typename T>
+static bool take(const char* data, size_t size, size_t& pos, T& val) {
+    if (size - pos < sizeof(T)) {
+        return false;
+    }
+    memcpy(&val, data + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+void ColumnStats::serialize(std::vector<char>& out) const {
+
+    EquiDepthHistogram hist = getHistogram();
+    std::vector<CommonValue> vals = common.top(STATS_HEAVY_COUNTERS);
+
+    StatsHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = STATS_MAGIC;
+    hdr.type = static_cast<uint8_t>(type);
+    hdr.hllBits = STATS_HLL_BITS;
+    hdr.nBuckets = static_cast<uint16_t>(hist.getBuckets().size());
+    hdr.nCommon = static_cast<uint32_t>(vals.size());
+    hdr.nRows = nRows;
+    hdr.nNulls = nNulls;
+    hdr.minVal = minVal;
+    hdr.maxVal = maxVal;
+    hdr.lower = hist.getLower();
+    hdr.commonError = common.getError();
+
+    out.clear();
+    put(out, hdr);
+    out.insert(out.end(), distinct.getRegisters().begin(), distinct.getRegisters().end());
+    for (auto& b : hist.getBuckets()) {
+        put(out, b);
+    }
+    for (auto& val : vals) {
+        put(out, val.key);
+        put(out, val.count);
+        put(out, static_cast<uint32_t>(val.str.size()));
+        out.insert(out.end(), val.str.begin(), val.str.end());
+    }
+}
+
+ColumnStatus ColumnStats::deserialize(const char* data, size_t size) {
+
+    size_t pos = 0;
+    StatsHeader hdr;
+    if (!take(data, size, pos, hdr) || hdr.magic != STATS_MAGIC || hdr.hllBits != STATS_HLL_BITS ||
+        hdr.type > static_cast<uint8_t>(ColumnType::STRING) || hdr.nNulls > hdr.nRows) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    size_t nRegisters = distinct.getRegisters().size();
+    if (size - pos < nRegisters ||
+        !distinct.setRegisters(reinterpret_cast<const uint8_t*>(data + pos), nRegisters)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    pos += nRegisters;
+
+    std::vector<HistogramBucket> buckets(hdr.nBuckets);
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        if (!take(data, size, pos, buckets[i]) ||
+            (i == 0 ? buckets[i].upper < hdr.lower : buckets[i].upper <= buckets[i - 1].upper)) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+    }
+
+    HeavyHitters vals;
+    for (uint32_t i = 0; i < hdr.nCommon; ++i) {
+        CommonValue val;
+        uint32_t len;
+        if (!take(data, size, pos, val.key) || !take(data, size, pos, val.count) || val.count == 0 ||
+            !take(data, size, pos, len) || size - pos < len) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+        val.str.assign(data + pos, len);
+        pos += len;
+        vals.add(val);
+    }
+    if (pos != size) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    vals.setError(hdr.commonError);
+
+    type = static_cast<ColumnType>(hdr.type);
+    nRows = hdr.nRows;
+    nNulls = hdr.nNulls;
+    minVal = hdr.minVal;
+    maxVal = hdr.maxVal;
+    histogram.setBuckets(hdr.lower, std::move(buckets));
+    common = std::move(vals);
+    resetSample();
+    return ColumnStatus::GENERAL_SUCCESS;
+}
\ No newline at end of file
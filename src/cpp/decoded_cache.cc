@@ -0,0 +1,120 @@
+/*
+
+    Decoded Cache Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "decoded_cache.h"
+
+#include <algorithm>
+
+/*
+
+    Some basic rules about the decoded cache:
+        - Frames hold decoded values, never stored bytes, and like pool
+          frames are immutable once inserted
+        - As in the pool, the budget may be exceeded by one frame
+        - Priorities only grow (the inflation never falls), so a frame
+          is reordered by erasing and reinserting its queue entry
+
+*/
+
+DecodedCache::DecodedCache(size_t capacity) :
+    capacity(capacity), bytesUsed(0), nHits(0), nMisses(0), inflation(0) {}
+
+/* Look up a frame and restore its priority */
+std::shared_ptr<const ChunkFrame> DecodedCache::get(uint64_t segId, size_t chunkIdx) {
+    std::lock_guard<std::mutex> lock(latch);
+
+    frame_key_t key(segId, chunkIdx);
+    auto it = frames.find(key);
+    if (it == frames.end()) {
+        ++nMisses;
+        return nullptr;
+    }
+    ++nHits;
+    Entry& entry = it->second;
+    queue.erase({ entry.priority, key });
+    entry.priority = inflation + entry.cost / std::max<size_t>(entry.frame->bytes(), 1);
+    queue.insert({ entry.priority, key });
+    return entry.frame;
+}
+
+/* Insert a decoded frame that took `cost` nanoseconds to decode, replacing one already cached */
+void DecodedCache::put(uint64_t segId, size_t chunkIdx, std::shared_ptr<const ChunkFrame> frame, double cost) {
+    std::lock_guard<std::mutex> lock(latch);
+
+    frame_key_t key(segId, chunkIdx);
+    if (frames.count(key)) {
+        remove(key);
+    }
+
+    evict();
+    Entry entry = { std::move(frame), cost, 0 };
+    entry.priority = inflation + cost / std::max<size_t>(entry.frame->bytes(), 1);
+    bytesUsed += entry.frame->bytes();
+    queue.insert({ entry.priority, key });
+    frames[key] = std::move(entry);
+}
+
+/* Drop every frame of a segment, called when its reader goes away */
+void DecodedCache::evictSegment(uint64_t segId) {
+    std::lock_guard<std::mutex> lock(latch);
+
+    for (auto it = frames.begin(); it != frames.end();) {
+        if (it->first.first == segId) {
+            bytesUsed -= it->second.frame->bytes();
+            queue.erase({ it->second.priority, it->first });
+            it = frames.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
+
+/* Take a frame out, latch must be held */
+void DecodedCache::remove(const frame_key_t& key) {
+    auto it = frames.find(key);
+    bytesUsed -= it->second.frame->bytes();
+    queue.erase({ it->second.priority, key });
+    frames.erase(it);
+}
+
+/* Evict the lowest priorities until under budget, latch must be held */
+void DecodedCache::evict() {
+    while (!queue.empty() && bytesUsed >= capacity) {
+        auto lowest = queue.begin();
+        inflation = lowest->first;
+        frame_key_t key = lowest->second;
+        remove(key);
+    }
+}
+
+size_t DecodedCache::getBytesUsed() {
+    std::lock_guard<std::mutex> lock(latch);
+    return bytesUsed;
+}
+
+uint64_t DecodedCache::getHits() {
+    std::lock_guard<std::mutex> lock(latch);
+    return nHits;
+}
+
+uint64_t DecodedCache::getMisses() {
+    std::lock_guard<std::mutex> lock(latch);
+    return nMisses;
+}
\ No newline at end of file
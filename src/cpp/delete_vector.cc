@@ -0,0 +1,217 @@
+/*
+
+    Delete Vector Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "delete_vector.h"
+#include "simd.h"
+#include "os_unx.h"
+
+#include <cstring>
+
+#if SIMD_ENABLED && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#   define DELMASK_X86          1
+#   include <immintrin.h>
+#endif
+
+#define  DELETE_VECTOR_MAGIC    0x4C454448  // "HDEL"
+
+struct DeleteVectorHeader {
+    uint32_t magic;
+    uint32_t reserved;
+    uint64_t size;                      // Bytes of the serialized bitmap that follows
+};
+
+/* Written once under a new name, so there is no need for a temporary file */
+ColumnStatus writeDeleteVector(const std::string& path, const DeleteVector& deletes) {
+
+    RoaringBitmap rows = deletes.rows;
+    rows.runOptimize();
+    std::vector<char> buf;
+    rows.serialize(buf);
+
+    DeleteVectorHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = DELETE_VECTOR_MAGIC;
+    hdr.size = buf.size();
+
+    osRemove(path.c_str());             // Leftover of a move that never reached the manifest
+    os_fd_t fd = osOpen(path.c_str(), true);
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::IO_ERROR;
+    }
+    bool ok = osWrite(fd, &hdr, sizeof(hdr), 0) == static_cast<ssize_t>(sizeof(hdr)) &&
+              osWrite(fd, buf.data(), buf.size(), sizeof(hdr)) == static_cast<ssize_t>(buf.size()) &&
+              osDataSync(fd) == 0;
+    osClose(fd);
+    return ok ? ColumnStatus::GENERAL_SUCCESS : ColumnStatus::IO_ERROR;
+}
+
+ColumnStatus readDeleteVector(const std::string& path, uint64_t nRows, DeleteVector& deletes) {
+
+    os_fd_t fd = osOpen(path.c_str(), false);
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::IO_ERROR;
+    }
+
+    DeleteVectorHeader hdr;
+    std::vector<char> buf;
+    bool ok = osRead(fd, &hdr, sizeof(hdr), 0) == static_cast<ssize_t>(sizeof(hdr)) &&
+              hdr.magic == DELETE_VECTOR_MAGIC &&
+              static_cast<uint64_t>(osFileSize(fd)) == sizeof(hdr) + hdr.size;
+    if (ok) {
+        buf.resize(hdr.size);
+        ok = osRead(fd, buf.data(), buf.size(), sizeof(hdr)) == static_cast<ssize_t>(buf.size());
+    }
+    osClose(fd);
+
+    if (!ok || !deletes.rows.deserialize(buf.data(), buf.size()) ||
+        (!deletes.rows.empty() && deletes.rows.maximum() >= nRows)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Mask kernels. Each one looks up the bit of every selected offset and
+    compacts the survivors to the front of `sel`, returning how many are
+    left. Writes never pass the entry being read, so this works in place.
+
+*/
+
+typedef size_t (*mask_fn)(const uint64_t*, uint32_t*, size_t);
+
+static size_t maskScalar(const uint64_t* deleted, uint32_t* sel, size_t n) {
+    size_t nKept = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t off = sel[i];
+        if (!(deleted[off >> 6] & (1ULL << (off & 63)))) {
+            sel[nKept++] = off;
+        }
+    }
+    return nKept;
+}
+
+#if defined(DELMASK_X86)
+
+SIMD_KERNELS_BEGIN
+
+/* Gather the word of 4 offsets, shift their bit down and keep the lanes where it is 0 */
+__attribute__((target("avx2")))
+static size_t maskAvx2(const uint64_t* deleted, uint32_t* sel, size_t n) {
+
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m128i low6 = _mm_set1_epi32(63);
+    const long long* words = reinterpret_cast<const long long*>(deleted);
+
+    size_t nKept = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i offs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(sel + i));
+        __m256i word = _mm256_i32gather_epi64(words, _mm_srli_epi32(offs, 6), 8);
+        __m256i shift = _mm256_cvtepu32_epi64(_mm_and_si128(offs, low6));
+        __m256i bit = _mm256_and_si256(_mm256_srlv_epi64(word, shift), one);
+        int gone = _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(bit, one)));
+
+        uint32_t lanes[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), offs);
+        for (int k = 0; k < 4; ++k) {
+            sel[nKept] = lanes[k];              // Written always, kept only if live
+            nKept += !((gone >> k) & 1);
+        }
+    }
+    for (; i < n; ++i) {
+        uint32_t off = sel[i];
+        sel[nKept] = off;
+        nKept += !(deleted[off >> 6] & (1ULL << (off & 63)));
+    }
+    return nKept;
+}
+
+/* Same for 16 offsets, with the survivors compacted by a compress store */
+__attribute__((target("avx512f")))
+static size_t maskAvx512(const uint64_t* deleted, uint32_t* sel, size_t n) {
+
+    const __m512i one = _mm512_set1_epi64(1);
+    const __m512i low6 = _mm512_set1_epi32(63);
+
+    size_t nKept = 0, i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i offs = _mm512_loadu_si512(sel + i);
+        __m512i word = _mm512_srli_epi32(offs, 6);
+        __m512i shift = _mm512_and_si512(offs, low6);
+
+        __m512i lo = _mm512_i32gather_epi64(_mm512_castsi512_si256(word), deleted, 8);
+        __m512i hi = _mm512_i32gather_epi64(_mm512_extracti64x4_epi64(word, 1), deleted, 8);
+        __mmask8 goneLo = _mm512_test_epi64_mask(
+            _mm512_srlv_epi64(lo, _mm512_cvtepu32_epi64(_mm512_castsi512_si256(shift))), one);
+        __mmask8 goneHi = _mm512_test_epi64_mask(
+            _mm512_srlv_epi64(hi, _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(shift, 1))), one);
+
+        __mmask16 keep = static_cast<__mmask16>(~(goneLo | (goneHi << 8)));
+        _mm512_mask_compressstoreu_epi32(sel + nKept, keep, offs);
+        nKept += __builtin_popcount(keep);
+    }
+    for (; i < n; ++i) {
+        uint32_t off = sel[i];
+        sel[nKept] = off;
+        nKept += !(deleted[off >> 6] & (1ULL << (off & 63)));
+    }
+    return nKept;
+}
+
+SIMD_KERNELS_END
+
+#endif // DELMASK_X86
+
+/* Dispatch */
+
+struct DeleteMaskKernel {
+    mask_fn mask;
+    const char* name;
+};
+
+static const DeleteMaskKernel& kernel() {
+    static const DeleteMaskKernel best = [] {
+#if defined(DELMASK_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return DeleteMaskKernel{ maskAvx512, "avx512" };
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return DeleteMaskKernel{ maskAvx2, "avx2" };
+        }
+#endif
+        return DeleteMaskKernel{ maskScalar, "scalar" };
+    }();
+    return best;
+}
+
+/* Vectors without a deleted row, by far the common case, cost one pass over their bits */
+void maskDeleted(const uint64_t* deleted, size_t count, sel_vec_t& sel) {
+    uint64_t any = 0;
+    for (size_t w = 0; w < (count + 63) >> 6; ++w) {
+        any |= deleted[w];
+    }
+    if (any != 0 && !sel.empty()) {
+        sel.resize(kernel().mask(deleted, sel.data(), sel.size()));
+    }
+}
+
+const char* deleteMaskKernelName() {
+    return kernel().name;
+}
\ No newline at end of file
@@ -0,0 +1,83 @@
+/*
+
+    Delta Store Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "delta_store.h"
+
+#include <mutex>
+
+void DeltaStore::insert(uint64_t rowId, table_row_t row) {
+    std::unique_lock<std::shared_mutex> lock(latch);
+    rows[rowId] = std::move(row);
+}
+
+/* Deleted rows stay in `rows`, so the store keeps covering a contiguous id range */
+void DeltaStore::remove(uint64_t rowId) {
+    std::unique_lock<std::shared_mutex> lock(latch);
+    deletes.insert(rowId);
+}
+
+bool DeltaStore::hasRow(uint64_t rowId) const {
+    std::shared_lock<std::shared_mutex> lock(latch);
+    return rows.count(rowId) != 0;
+}
+
+bool DeltaStore::isDeleted(uint64_t rowId) const {
+    std::shared_lock<std::shared_mutex> lock(latch);
+    return deletes.count(rowId) != 0;
+}
+
+size_t DeltaStore::getNumRows() const {
+    std::shared_lock<std::shared_mutex> lock(latch);
+    return rows.size();
+}
+
+size_t DeltaStore::getNumDeletes() const {
+    std::shared_lock<std::shared_mutex> lock(latch);
+    return deletes.size();
+}
+
+/* Copy of one column, so scans hold the latch only for the copy */
+void DeltaStore::getColumn(size_t col, std::vector<uint64_t>& rowIds, std::vector<FieldValue>& values) const {
+    std::shared_lock<std::shared_mutex> lock(latch);
+
+    rowIds.clear();
+    values.clear();
+    rowIds.reserve(rows.size());
+    values.reserve(rows.size());
+    for (auto& row : rows) {
+        rowIds.push_back(row.first);
+        values.push_back(col < row.second.size() ? row.second[col] : FieldValue::null());
+    }
+}
+
+void DeltaStore::getRows(std::vector<uint64_t>& rowIds, std::vector<table_row_t>& out) const {
+    std::shared_lock<std::shared_mutex> lock(latch);
+
+    rowIds.clear();
+    out.clear();
+    for (auto& row : rows) {
+        rowIds.push_back(row.first);
+        out.push_back(row.second);
+    }
+}
+
+void DeltaStore::getDeletes(std::vector<uint64_t>& rowIds) const {
+    std::shared_lock<std::shared_mutex> lock(latch);
+    rowIds.assign(deletes.begin(), deletes.end());
+}
\ No newline at end of file
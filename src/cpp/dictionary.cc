@@ -0,0 +1,100 @@
+/*
+
+    Segment Dictionary Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "dictionary.h"
+
+#include <algorithm>
+#include <cstring>
+
+/* Provisional code of `val`, assigned on first sight */
+uint32_t DictionaryBuilder::add(const std::string& val) {
+    auto res = codes.emplace(val, static_cast<uint32_t>(values.size()));
+    if (res.second) {
+        values.push_back(&res.first->first);   // Node-based map, the key never moves
+    }
+    return res.first->second;
+}
+
+/* Sorted dictionary plus the provisional -> final code mapping */
+void DictionaryBuilder::finish(std::vector<std::string>& sorted, std::vector<uint32_t>& remap) const {
+
+    std::vector<uint32_t> order(values.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+        return *values[a] < *values[b];
+    });
+
+    sorted.resize(order.size());
+    remap.resize(order.size());
+    for (uint32_t i = 0; i < order.size(); ++i) {
+        sorted[i] = *values[order[i]];
+        remap[order[i]] = i;
+    }
+}
+
+/* Narrowest code width that fits the dictionary */
+uint8_t dictCodeWidth(size_t nEntries) {
+    if (nEntries <= (1u << 8)) return 1;
+    if (nEntries <= (1u << 16)) return 2;
+    return 4;
+}
+
+void dictSerialize(const std::vector<std::string>& dict, std::vector<char>& out) {
+
+    std::vector<uint32_t> ends(dict.size() + 1);
+    size_t bytes = 0;
+    ends[0] = 0;
+    for (size_t i = 0; i < dict.size(); ++i) {
+        bytes += dict[i].size();
+        ends[i + 1] = static_cast<uint32_t>(bytes);
+    }
+
+    size_t hdr = ends.size() * sizeof(uint32_t);
+    out.resize(hdr + bytes);
+    memcpy(out.data(), ends.data(), hdr);
+    for (size_t i = 0; i < dict.size(); ++i) {
+        memcpy(out.data() + hdr + ends[i], dict[i].data(), dict[i].size());
+    }
+}
+
+ColumnStatus dictDeserialize(const char* data, size_t size, uint32_t nEntries,
+                             std::vector<std::string>& dict) {
+
+    size_t hdr = (static_cast<size_t>(nEntries) + 1) * sizeof(uint32_t);
+    if (size < hdr) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    std::vector<uint32_t> ends(nEntries + 1);
+    memcpy(ends.data(), data, hdr);
+    if (ends[0] != 0 || hdr + ends[nEntries] != size) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    dict.resize(nEntries);
+    for (uint32_t i = 0; i < nEntries; ++i) {
+        if (ends[i + 1] < ends[i]) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+        dict[i].assign(data + hdr + ends[i], ends[i + 1] - ends[i]);
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,687 @@
+/*
+
+    Column Encoding Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "encoding.h"
+#include "bitpack.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define  SAMPLE_WINDOW          64          // Consecutive values per sample window
+#define  BITPACK_HEADER_SIZE    16          // Reference, width and padding ahead of packed words
+#define  BITPACK_MAX_WIDTH      32          // Widest offset the kernels handle
+#define  BITPACK_BLOCK_WORDS    (COLUMN_VECTOR_SIZE + BITPACK_LANES)  // Packed words of a full block at the widest width
+
+/* Deltas are computed on unsigned values so that overflow wraps instead of being UB */
+static uint64_t zigzag(uint64_t delta) {
+    return (delta << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(delta) >> 63);
+}
+
+static uint64_t unzigzag(uint64_t val) {
+    return (val >> 1) ^ (~(val & 1) + 1);
+}
+
+static uint8_t widthFor(uint64_t maxVal) {
+    if (maxVal <= 0xFF) return 1;
+    if (maxVal <= 0xFFFF) return 2;
+    if (maxVal <= 0xFFFFFFFF) return 4;
+    return 8;
+}
+
+static void put(std::vector<char>& out, const void* src, size_t len) {
+    const char* bytes = static_cast<const char*>(src);
+    out.insert(out.end(), bytes, bytes + len);
+}
+
+/* Little-endian store and load of the low `width` bytes */
+static void putWidth(std::vector<char>& out, uint64_t val, uint8_t width) {
+    put(out, &val, width);
+}
+
+static uint64_t getWidth(const char* src, uint8_t width) {
+    uint64_t val = 0;
+    memcpy(&val, src, width);
+    return val;
+}
+
+/* Sampling */
+
+EncodingStats sampleEncodingStats(const std::vector<int64_t>& values) {
+
+    EncodingStats stats;
+    size_t n = values.size();
+    if (n == 0) {
+        return stats;
+    }
+
+    /* Small chunks are sampled whole, large ones in evenly spread windows */
+    size_t nWindows = 1;
+    size_t winLen = n;
+    if (n > ENCODING_SAMPLE_SIZE) {
+        nWindows = ENCODING_SAMPLE_SIZE / SAMPLE_WINDOW;
+        winLen = SAMPLE_WINDOW;
+    }
+    size_t stride = n / nWindows;
+    uint64_t maxDelta = 0;
+    uint64_t maxDod = 0;
+
+    for (size_t w = 0; w < nWindows; ++w) {
+        size_t begin = w * stride;
+        size_t end = begin + winLen;
+
+        for (size_t i = begin + 1; i < end; ++i) {
+            uint64_t delta = static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(values[i - 1]);
+            stats.nChanges += delta != 0;
+            maxDelta = std::max(maxDelta, zigzag(delta));
+            if (i >= begin + 2) {
+                uint64_t prev = static_cast<uint64_t>(values[i - 1]) - static_cast<uint64_t>(values[i - 2]);
+                maxDod = std::max(maxDod, zigzag(delta - prev));
+            }
+        }
+        stats.nSampled += end - begin;
+    }
+
+    /* The range is exact, a sampled one would make BITPACK look too good */
+    auto range = std::minmax_element(values.begin(), values.end());
+    stats.rangeBits = bitpackWidth(static_cast<uint64_t>(*range.second) - static_cast<uint64_t>(*range.first));
+
+    stats.deltaWidth = widthFor(maxDelta);
+    stats.dodWidth = widthFor(maxDod);
+    return stats;
+}
+
+/* Smallest estimated encoding, ties go to the cheaper one to decode */
+ColumnEncoding chooseEncoding(const EncodingStats& stats, size_t nValues, ColumnType type,
+                              uint8_t codeWidth) {
+
+    if (stats.nSampled == 0) {
+        return type == ColumnType::STRING ? ColumnEncoding::DICTIONARY : ColumnEncoding::PLAIN;
+    }
+
+    size_t nBlocks = (nValues + COLUMN_VECTOR_SIZE - 1) / COLUMN_VECTOR_SIZE;
+    size_t estRuns = 1 + stats.nChanges * nValues / stats.nSampled;
+    size_t rleSize = sizeof(uint32_t) + estRuns * (sizeof(int64_t) + sizeof(uint32_t));
+    size_t table = sizeof(uint32_t) * (nBlocks + 1);
+
+    /* Upper bound, blocks with a narrower range pack tighter */
+    size_t packSize = SIZE_MAX;
+    if (stats.rangeBits <= BITPACK_MAX_WIDTH) {
+        size_t blockLen = std::min(nValues, (size_t)COLUMN_VECTOR_SIZE);
+        packSize = table + nBlocks * (BITPACK_HEADER_SIZE + bitpackSize(blockLen, stats.rangeBits));
+    }
+
+    if (type == ColumnType::STRING) {
+        size_t best = nValues * codeWidth;
+        ColumnEncoding enc = ColumnEncoding::DICTIONARY;
+        if (packSize < best) {
+            best = packSize;
+            enc = ColumnEncoding::BITPACK;
+        }
+        return rleSize < best ? ColumnEncoding::RLE : enc;
+    }
+
+    size_t best = nValues * sizeof(int64_t);
+    ColumnEncoding enc = ColumnEncoding::PLAIN;
+
+    if (packSize < best) {
+        best = packSize;
+        enc = ColumnEncoding::BITPACK;
+    }
+
+    size_t deltaSize = table + nBlocks * (sizeof(int64_t) + 1) + nValues * stats.deltaWidth;
+    size_t dodSize = table + nBlocks * (2 * sizeof(int64_t) + 1) + nValues * stats.dodWidth;
+
+    if (rleSize < best) {
+        best = rleSize;
+        enc = ColumnEncoding::RLE;
+    }
+    if (deltaSize < best) {
+        best = deltaSize;
+        enc = ColumnEncoding::DELTA;
+    }
+    if (dodSize < best) {
+        enc = ColumnEncoding::DELTA_OF_DELTA;
+    }
+    return enc;
+}
+
+/* Encoding */
+
+static void encodeRle(const std::vector<int64_t>& values, std::vector<char>& out) {
+
+    std::vector<int64_t> runValues;
+    std::vector<uint32_t> runEnds;
+    for (size_t i = 0; i < values.size(); ++i) {
+        if (runValues.empty() || values[i] != runValues.back()) {
+            runValues.push_back(values[i]);
+            runEnds.push_back(0);
+        }
+        runEnds.back() = static_cast<uint32_t>(i + 1);
+    }
+
+    uint32_t nRuns = static_cast<uint32_t>(runValues.size());
+    put(out, &nRuns, sizeof(nRuns));
+    put(out, runValues.data(), nRuns * sizeof(int64_t));
+    put(out, runEnds.data(), nRuns * sizeof(uint32_t));
+}
+
+static void encodeDelta(const std::vector<int64_t>& values, bool ofDelta, std::vector<char>& out) {
+
+    size_t n = values.size();
+    uint32_t nBlocks = static_cast<uint32_t>((n + COLUMN_VECTOR_SIZE - 1) / COLUMN_VECTOR_SIZE);
+    put(out, &nBlocks, sizeof(nBlocks));
+    size_t tableOfst = out.size();
+    out.resize(out.size() + nBlocks * sizeof(uint32_t));
+
+    std::vector<uint64_t> zz;
+    for (uint32_t b = 0; b < nBlocks; ++b) {
+
+        uint32_t blockOfst = static_cast<uint32_t>(out.size());
+        memcpy(out.data() + tableOfst + b * sizeof(uint32_t), &blockOfst, sizeof(blockOfst));
+
+        size_t begin = b * static_cast<size_t>(COLUMN_VECTOR_SIZE);
+        size_t end = std::min(n, begin + COLUMN_VECTOR_SIZE);
+        uint64_t prevDelta = 0;
+        zz.clear();
+
+        put(out, &values[begin], sizeof(int64_t));
+        for (size_t i = begin + 1; i < end; ++i) {
+            uint64_t delta = static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(values[i - 1]);
+            if (!ofDelta) {
+                zz.push_back(zigzag(delta));
+            }
+            else if (i == begin + 1) {
+                put(out, &delta, sizeof(delta));
+            }
+            else {
+                zz.push_back(zigzag(delta - prevDelta));
+            }
+            prevDelta = delta;
+        }
+        if (ofDelta && end - begin == 1) {
+            put(out, &prevDelta, sizeof(prevDelta));    // Keeps the block layout uniform
+        }
+
+        uint8_t width = widthFor(zz.empty() ? 0 : *std::max_element(zz.begin(), zz.end()));
+        put(out, &width, sizeof(width));
+        for (uint64_t val : zz) {
+            putWidth(out, val, width);
+        }
+    }
+}
+
+static void encodeBitpack(const std::vector<int64_t>& values, std::vector<char>& out) {
+
+    size_t n = values.size();
+    uint32_t nBlocks = static_cast<uint32_t>((n + COLUMN_VECTOR_SIZE - 1) / COLUMN_VECTOR_SIZE);
+    put(out, &nBlocks, sizeof(nBlocks));
+    size_t tableOfst = out.size();
+    out.resize(out.size() + nBlocks * sizeof(uint32_t));
+
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> packed;
+    for (uint32_t b = 0; b < nBlocks; ++b) {
+
+        uint32_t blockOfst = static_cast<uint32_t>(out.size());
+        memcpy(out.data() + tableOfst + b * sizeof(uint32_t), &blockOfst, sizeof(blockOfst));
+
+        size_t begin = b * static_cast<size_t>(COLUMN_VECTOR_SIZE);
+        size_t end = std::min(n, begin + COLUMN_VECTOR_SIZE);
+        auto range = std::minmax_element(values.begin() + begin, values.begin() + end);
+        int64_t ref = *range.first;
+        uint8_t width = bitpackWidth(static_cast<uint64_t>(*range.second) - static_cast<uint64_t>(ref));
+
+        offsets.resize(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            offsets[i - begin] = static_cast<uint32_t>(static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(ref));
+        }
+
+        char header[BITPACK_HEADER_SIZE] = {};
+        memcpy(header, &ref, sizeof(ref));
+        header[sizeof(ref)] = static_cast<char>(width);
+        put(out, header, sizeof(header));
+
+        packed.resize(bitpackSize(offsets.size(), width) / sizeof(uint32_t));
+        bitpackEncode(offsets.data(), offsets.size(), width, packed.data());
+        put(out, packed.data(), packed.size() * sizeof(uint32_t));
+    }
+}
+
+void encodeValues(ColumnEncoding enc, uint8_t width, const std::vector<int64_t>& values,
+                  std::vector<char>& out) {
+
+    out.clear();
+    switch (enc) {
+        case ColumnEncoding::PLAIN:
+        case ColumnEncoding::DICTIONARY:
+            if (width == sizeof(int64_t)) {
+                put(out, values.data(), values.size() * sizeof(int64_t));
+                break;
+            }
+            out.reserve(values.size() * width);
+            for (int64_t val : values) {
+                putWidth(out, static_cast<uint64_t>(val), width);
+            }
+            break;
+        case ColumnEncoding::RLE:
+            encodeRle(values, out);
+            break;
+        case ColumnEncoding::DELTA:
+            encodeDelta(values, false, out);
+            break;
+        case ColumnEncoding::DELTA_OF_DELTA:
+            encodeDelta(values, true, out);
+            break;
+        case ColumnEncoding::BITPACK:
+            encodeBitpack(values, out);
+            break;
+        case ColumnEncoding::STRING_HEAP:       // Strings, not values: see encodeStrings()
+            break;
+    }
+}
+
+/* Decoding */
+
+ColumnStatus decodeRuns(const char* data, size_t size, size_t nValues, std::vector<ColumnRun>& runs) {
+
+    uint32_t nRuns;
+    if (size < sizeof(nRuns)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    memcpy(&nRuns, data, sizeof(nRuns));
+    if (size != sizeof(nRuns) + static_cast<size_t>(nRuns) * (sizeof(int64_t) + sizeof(uint32_t))) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    const char* vals = data + sizeof(nRuns);
+    const char* ends = vals + nRuns * sizeof(int64_t);
+    runs.resize(nRuns);
+
+    uint32_t prev = 0;
+    for (uint32_t r = 0; r < nRuns; ++r) {
+        uint32_t end;
+        memcpy(&runs[r].value, vals + r * sizeof(int64_t), sizeof(int64_t));
+        memcpy(&end, ends + r * sizeof(uint32_t), sizeof(uint32_t));
+        if (end <= prev) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+        runs[r].length = end - prev;
+        prev = end;
+    }
+    return prev == nValues ? ColumnStatus::GENERAL_SUCCESS : ColumnStatus::CORRUPT_SEGMENT;
+}
+
+/* Values [begin, begin + count) of an RLE chunk, found by binary search on the run ends */
+static ColumnStatus decodeRleRange(const char* data, size_t size, size_t nValues, size_t begin,
+                                   size_t count, int64_t* dst) {
+
+    uint32_t nRuns;
+    if (size < sizeof(nRuns)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    memcpy(&nRuns, data, sizeof(nRuns));
+    if (size != sizeof(nRuns) + static_cast<size_t>(nRuns) * (sizeof(int64_t) + sizeof(uint32_t))) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    const char* vals = data + sizeof(nRuns);
+    const char* ends = vals + nRuns * sizeof(int64_t);
+    auto endOf = [ends](uint32_t r) {
+        uint32_t end;
+        memcpy(&end, ends + r * sizeof(uint32_t), sizeof(end));
+        return end;
+    };
+
+    /* First run ending after `begin` */
+    uint32_t lo = 0, hi = nRuns;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (endOf(mid) <= begin) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    size_t pos = begin;
+    for (uint32_t r = lo; r < nRuns && pos < begin + count; ++r) {
+        uint32_t end = endOf(r);
+        if (end <= pos || end > nValues) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+        int64_t val;
+        memcpy(&val, vals + r * sizeof(int64_t), sizeof(val));
+        size_t stop = std::min(static_cast<size_t>(end), begin + count);
+        std::fill(dst + (pos - begin), dst + (stop - begin), val);
+        pos = stop;
+    }
+    return pos == begin + count ? ColumnStatus::GENERAL_SUCCESS : ColumnStatus::CORRUPT_SEGMENT;
+}
+
+/* Check the block table shared by DELTA, DELTA_OF_DELTA and BITPACK */
+static ColumnStatus checkBlockTable(const char* data, size_t size, size_t n, uint32_t& nBlocks) {
+    if (size < sizeof(nBlocks)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    memcpy(&nBlocks, data, sizeof(nBlocks));
+    if (nBlocks != (n + COLUMN_VECTOR_SIZE - 1) / COLUMN_VECTOR_SIZE ||
+        size < sizeof(nBlocks) * (nBlocks + 1)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+static uint32_t blockOffset(const char* data, uint32_t b) {
+    uint32_t ofst;
+    memcpy(&ofst, data + sizeof(uint32_t) * (b + 1), sizeof(ofst));
+    return ofst;
+}
+
+static size_t blockLength(size_t n, uint32_t b) {
+    return std::min(n - b * static_cast<size_t>(COLUMN_VECTOR_SIZE), (size_t)COLUMN_VECTOR_SIZE);
+}
+
+static ColumnStatus decodeDeltaBlock(const char* data, size_t size, size_t n, bool ofDelta,
+                                     uint32_t b, int64_t* dst) {
+
+    uint32_t ofst = blockOffset(data, b);
+    size_t count = blockLength(n, b);
+    size_t hdr = ofDelta ? 2 * sizeof(int64_t) + 1 : sizeof(int64_t) + 1;
+    if (ofst + hdr > size) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    const char* p = data + ofst;
+    uint64_t val, delta = 0;
+    memcpy(&val, p, sizeof(val));
+    p += sizeof(val);
+    if (ofDelta) {
+        memcpy(&delta, p, sizeof(delta));
+        p += sizeof(delta);
+    }
+    uint8_t width = static_cast<uint8_t>(*p++);
+
+    size_t nPacked = ofDelta ? (count > 2 ? count - 2 : 0) : count - 1;
+    if ((width != 1 && width != 2 && width != 4 && width != 8) ||
+        ofst + hdr + nPacked * width > size) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    dst[0] = static_cast<int64_t>(val);
+    size_t i = 1;
+    if (ofDelta && count > 1) {
+        val += delta;
+        dst[i++] = static_cast<int64_t>(val);
+    }
+    for (; i < count; ++i, p += width) {
+        uint64_t z = unzigzag(getWidth(p, width));
+        if (ofDelta) {
+            delta += z;
+            val += delta;
+        }
+        else {
+            val += z;
+        }
+        dst[i] = static_cast<int64_t>(val);
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Locate block `b` of a BITPACK chunk and check that it is complete.
+    The packed words are only 4-byte aligned within the encoded values,
+    and those follow a validity section of any length in the chunk, so a
+    block that is not aligned in memory is copied to `scratch` (room for
+    BITPACK_BLOCK_WORDS words) and `packed` points there instead.
+
+*/
+static ColumnStatus bitpackBlock(const char* data, size_t size, size_t n, uint32_t b,
+                                 int64_t& ref, uint8_t& width, uint32_t* scratch, const uint32_t*& packed) {
+
+    uint32_t ofst = blockOffset(data, b);
+    if (static_cast<size_t>(ofst) + BITPACK_HEADER_SIZE > size) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    memcpy(&ref, data + ofst, sizeof(ref));
+    width = static_cast<uint8_t>(data[ofst + sizeof(ref)]);
+    if (width > BITPACK_MAX_WIDTH || ofst + BITPACK_HEADER_SIZE + bitpackSize(blockLength(n, b), width) > size ||
+        (ofst % sizeof(uint32_t)) != 0) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    const char* words = data + ofst + BITPACK_HEADER_SIZE;
+    if (reinterpret_cast<uintptr_t>(words) % alignof(uint32_t) != 0) {
+        memcpy(scratch, words, bitpackSize(blockLength(n, b), width));
+        words = reinterpret_cast<const char*>(scratch);
+    }
+    packed = reinterpret_cast<const uint32_t*>(words);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* `dst` needs room for the block rounded up to BITPACK_LANES, the kernels write whole groups */
+static ColumnStatus decodeBitpackBlock(const char* data, size_t size, size_t n, uint32_t b, int64_t* dst) {
+    int64_t ref;
+    uint8_t width;
+    uint32_t scratch[BITPACK_BLOCK_WORDS];
+    const uint32_t* packed;
+    ColumnStatus rc = bitpackBlock(data, size, n, b, ref, width, scratch, packed);
+    if (rc == ColumnStatus::GENERAL_SUCCESS) {
+        bitpackDecode(packed, blockLength(n, b), width, ref, dst);
+    }
+    return rc;
+}
+
+static size_t roundToLanes(size_t n) {
+    return (n + BITPACK_LANES - 1) / BITPACK_LANES * BITPACK_LANES;
+}
+
+/* Decode block `b` of a block-structured encoding into `dst` */
+static ColumnStatus decodeBlock(ColumnEncoding enc, const char* data, size_t size, size_t n,
+                                uint32_t b, int64_t* dst) {
+    switch (enc) {
+        case ColumnEncoding::DELTA:          return decodeDeltaBlock(data, size, n, false, b, dst);
+        case ColumnEncoding::DELTA_OF_DELTA: return decodeDeltaBlock(data, size, n, true, b, dst);
+        case ColumnEncoding::BITPACK:        return decodeBitpackBlock(data, size, n, b, dst);
+        default:                             return ColumnStatus::CORRUPT_SEGMENT;
+    }
+}
+
+static bool validPlainWidth(uint8_t width) {
+    return width == 1 || width == 2 || width == 4 || width == 8;
+}
+
+static void decodePlainRange(const char* data, uint8_t width, size_t begin, size_t count, int64_t* dst) {
+    if (width == sizeof(int64_t)) {
+        memcpy(dst, data + begin * sizeof(int64_t), count * sizeof(int64_t));
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        dst[i] = static_cast<int64_t>(getWidth(data + (begin + i) * width, width));
+    }
+}
+
+/*
+
+    Evaluate lo <= v <= hi on vector `vec` of a BITPACK chunk without
+    unpacking it to int64_t. The bounds become offsets from the block
+    reference, and a block whose range misses them is not touched at all.
+    Bit i of `matches` is set when value i of the vector qualifies; nulls
+    are not considered.
+
+*/
+ColumnStatus filterBitpackedVector(const char* data, size_t size, size_t nValues, size_t vec,
+                                   int64_t lo, int64_t hi, uint64_t* matches) {
+
+    uint32_t nBlocks;
+    ColumnStatus rc = checkBlockTable(data, size, nValues, nBlocks);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    if (vec >= nBlocks) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+
+    uint32_t b = static_cast<uint32_t>(vec);
+    size_t count = blockLength(nValues, b);
+    memset(matches, 0, (count + 63) / 64 * sizeof(uint64_t));
+
+    int64_t ref;
+    uint8_t width;
+    uint32_t scratch[BITPACK_BLOCK_WORDS];
+    const uint32_t* packed;
+    if ((rc = bitpackBlock(data, size, nValues, b, ref, width, scratch, packed)) != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    uint64_t maxOfst = width == 0 ? 0 : (~0ULL >> (64 - width));
+    if (lo > hi || hi < ref) {
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    uint64_t ofstLo = lo <= ref ? 0 : static_cast<uint64_t>(lo) - static_cast<uint64_t>(ref);
+    uint64_t ofstHi = std::min(static_cast<uint64_t>(hi) - static_cast<uint64_t>(ref), maxOfst);
+    if (ofstLo > maxOfst) {
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    bitpackFilter(packed, count, width, static_cast<uint32_t>(ofstLo), static_cast<uint32_t>(ofstHi), matches);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* The same over a whole chunk, `matches` gets a bit per value */
+ColumnStatus filterBitpacked(const char* data, size_t size, size_t nValues, int64_t lo, int64_t hi,
+                             bitset<uint64_t>& matches) {
+
+    uint32_t nBlocks;
+    ColumnStatus rc = checkBlockTable(data, size, nValues, nBlocks);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    matches.assign((nValues + 63) / 64, 0);
+    for (uint32_t b = 0; b < nBlocks; ++b) {
+        uint64_t* dst = matches.data() + b * static_cast<size_t>(COLUMN_VECTOR_SIZE) / 64;
+        if ((rc = filterBitpackedVector(data, size, nValues, b, lo, hi, dst)) != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+ColumnStatus decodeValues(ColumnEncoding enc, uint8_t width, const char* data, size_t size,
+                          size_t nValues, std::vector<int64_t>& out) {
+
+    switch (enc) {
+        case ColumnEncoding::PLAIN:
+        case ColumnEncoding::DICTIONARY:
+            if (!validPlainWidth(width) || size != nValues * width) {
+                return ColumnStatus::CORRUPT_SEGMENT;
+            }
+            out.resize(nValues);
+            decodePlainRange(data, width, 0, nValues, out.data());
+            return ColumnStatus::GENERAL_SUCCESS;
+
+        case ColumnEncoding::RLE: {
+            std::vector<ColumnRun> runs;
+            ColumnStatus rc = decodeRuns(data, size, nValues, runs);
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            out.resize(nValues);
+            int64_t* dst = out.data();
+            for (auto& run : runs) {
+                std::fill(dst, dst + run.length, run.value);
+                dst += run.length;
+            }
+            return ColumnStatus::GENERAL_SUCCESS;
+        }
+
+        case ColumnEncoding::DELTA:
+        case ColumnEncoding::DELTA_OF_DELTA:
+        case ColumnEncoding::BITPACK: {
+            uint32_t nBlocks;
+            ColumnStatus rc = checkBlockTable(data, size, nValues, nBlocks);
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            out.resize(roundToLanes(nValues));
+            for (uint32_t b = 0; b < nBlocks && rc == ColumnStatus::GENERAL_SUCCESS; ++b) {
+                rc = decodeBlock(enc, data, size, nValues, b, out.data() + b * static_cast<size_t>(COLUMN_VECTOR_SIZE));
+            }
+            out.resize(nValues);
+            return rc;
+        }
+
+        case ColumnEncoding::STRING_HEAP:
+            break;
+    }
+    return ColumnStatus::CORRUPT_SEGMENT;
+}
+
+/*
+
+    Decode only vector `vec` of a chunk, the COLUMN_VECTOR_SIZE values
+    starting at vec * COLUMN_VECTOR_SIZE (fewer for the last one). Block
+    encodings decode the one matching block, PLAIN and DICTIONARY index
+    straight into the values and RLE binary searches its run ends.
+
+*/
+ColumnStatus decodeVector(ColumnEncoding enc, uint8_t width, const char* data, size_t size,
+                          size_t nValues, size_t vec, std::vector<int64_t>& out) {
+
+    size_t begin = vec * COLUMN_VECTOR_SIZE;
+    if (begin >= nValues) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+    size_t count = std::min(nValues - begin, (size_t)COLUMN_VECTOR_SIZE);
+
+    switch (enc) {
+        case ColumnEncoding::PLAIN:
+        case ColumnEncoding::DICTIONARY:
+            if (!validPlainWidth(width) || size != nValues * width) {
+                return ColumnStatus::CORRUPT_SEGMENT;
+            }
+            out.resize(count);
+            decodePlainRange(data, width, begin, count, out.data());
+            return ColumnStatus::GENERAL_SUCCESS;
+
+        case ColumnEncoding::RLE:
+            out.resize(count);
+            return decodeRleRange(data, size, nValues, begin, count, out.data());
+
+        case ColumnEncoding::DELTA:
+        case ColumnEncoding::DELTA_OF_DELTA:
+        case ColumnEncoding::BITPACK: {
+            uint32_t nBlocks;
+            ColumnStatus rc = checkBlockTable(data, size, nValues, nBlocks);
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            out.resize(roundToLanes(count));
+            rc = decodeBlock(enc, data, size, nValues, static_cast<uint32_t>(vec), out.data());
+            out.resize(count);
+            return rc;
+        }
+
+        case ColumnEncoding::STRING_HEAP:
+            break;
+    }
+    return ColumnStatus::CORRUPT_SEGMENT;
+}
\ No newline at end of file
@@ -33,17 +33,40 @@
 #define  PAGE_SIZE              4096      // Common page size, can be changed to any base 2 
 #define  LFU_CACHE_LIMIT        750       // Max number of unprivileged frames in cache
 #define  LRU_CACHE_LIMIT        1250      // Max number of privileged frames in cache
-#define  LAZY_DECOMPRESSION     0         // Decompress data when loading into memory, or when reading?
+#define  LAZY_DECOMPRESSION     1         // Keep chunks compressed in memory and decode vectors on read
+#define  CHUNK_POOL_SIZE        268435456 // Bytes of column chunks kept in memory (256 mb)
+#define  DECODED_CACHE_SIZE     268435456 // Bytes of decoded chunks kept in front of the pool (256 mb)
+#define  PAGE_POOL_FRAMES       65536     // Pages kept in memory by a page pool (256 mb at 4 kb pages)
 #define  LFRU_CACHE_LIMIT       LFU_CACHE_LIMIT + LRU_CACHE_LIMIT
 
+/* Columns */
+#define  COLUMN_CHUNK_SIZE      65536     // Values per column chunk, the zone map granularity
+#define  COLUMN_VECTOR_SIZE     2048      // Values per independently decodable block of a chunk
+#define  COLUMN_GROUP_PAGE_ROWS 4096      // Rows per page of a column group file, the chunk size of its columns
+#define  ENCODING_SAMPLE_SIZE   1024      // Values sampled from a chunk to pick its encoding
+#define  CODEC_ZSTD_LEVEL       3         // Zstd level for compressed columns, higher is smaller and slower
+#define  DELTA_MOVE_THRESHOLD   65536     // Delta store rows that make the tuple mover run
+#define  TUPLE_MOVER_INTERVAL   1000      // Milliseconds between tuple mover checks
+#define  COMPACTION_THRESHOLD   20        // Percent of a row group deleted before the mover rewrites it
+#define  STRING_HEAP_THRESHOLD  50        // Percent of distinct strings above which a segment drops its dictionary
+#define  STRING_FSST_ENABLED    1         // Compress string heaps with a symbol table when that is smaller
+#define  BLOOM_BITS_PER_KEY     10        // Bloom filter bits per distinct chunk value, about 1% false positives
+#define  COLUMN_STATS_ENABLED   1         // Collect column statistics while writing segments
+#define  STATS_HISTOGRAM_BUCKETS 64       // Buckets of an equi-depth histogram
+#define  STATS_COMMON_VALUES    32        // Most common values reported per column
+#define  BULK_LOAD_PIECE_BYTES  33554432  // CSV bytes per bulk load row group (32 mb)
+
 /* WAL */
 #define  LOGGING_ENABLED        1         // Default true, in rare instances may need to be false
 #define  LOG_BUFFER_SIZE        65536     // Journal size of 64 kb
+#define  LOG_SEGMENT_SIZE       16777216  // Fixed size of a preallocated log segment (16 mb)
+#define  LOG_SEGMENT_SPARES     4         // Max number of retired segments kept for recycling
 
 /* Limits */
 #define  EHT_MAX_BUCKET_DEPTH   50        // Maximum depth of a single EHT bucket 
 #define  EHT_MAX_BUCKET_SIZE    50        // Number of key-value pairs in a given EHT bucket
 #define  BPTREE_MAX_HEIGHT      20        // Maximum depth/height of a B+ tree
+#define  BPTREE_FILL_FACTOR     100       // Percent of each node a B+ tree bulk load fills
 #define  DB_MAX_PAGES           0         // Maximum number of pages in a database
 
 /* Queries */
@@ -53,6 +76,7 @@
 
 /* System */
 #define  DISK_LIMIT             30        // Measured as 2^N bytes
+#define  SIMD_ENABLED           1         // Use vector kernels when the CPU has them, 0 forces scalar
 
 #if defined(_M_AMD64) || defined(__x86_64__) || defined(__arm64__)
 #   define CRC_POLYNOMIAL       0xEDB88320          // Standard 32-bit polynomial
@@ -0,0 +1,45 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_SIMD_H
+#define HERACLES_SIMD_H
+
+/*
+
+    Brackets for the x86 vector kernels of a file. GCC flags the registers
+    its AVX-512 intrinsics leave undefined on purpose as uninitialized,
+    with -Wuninitialized or -Wmaybe-uninitialized depending on what gets
+    inlined, so every kernel section silences both, and only there:
+
+        SIMD_KERNELS_BEGIN
+        __attribute__((target("avx512f"))) static void kernel(...) { ... }
+        SIMD_KERNELS_END
+
+*/
+
+#if defined(__GNUC__) && !defined(__clang__)
+#   define SIMD_KERNELS_BEGIN   _Pragma("GCC diagnostic push") \
+                                _Pragma("GCC diagnostic ignored \"-Wuninitialized\"") \
+                                _Pragma("GCC diagnostic ignored \"-Wmaybe-uninitialized\"")
+#   define SIMD_KERNELS_END     _Pragma("GCC diagnostic pop")
+#else
+#   define SIMD_KERNELS_BEGIN
+#   define SIMD_KERNELS_END
+#endif
+
+#endif
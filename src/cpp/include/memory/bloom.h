@@ -0,0 +1,83 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_BLOOM_H
+#define HERACLES_BLOOM_H
+
+#include "config.h"
+
+#include <vector>
+
+/*
+
+    Blocked Bloom filter: an array of 512-bit blocks, one cache line each.
+    The high half of a key's hash picks the block, and the low half sets
+    one bit in each of the block's eight words (the low 32 bits times a
+    per-word odd constant, top 6 bits of the product).
+
+        hash        | block (32 bits)  | bits (32 bits)  |
+                           |                  |
+        blocks      | ... | w0 w1 w2 w3 w4 w5 w6 w7 | ... |
+                                 one bit in every word
+
+    A lookup therefore touches a single cache line and needs no loop over
+    hash functions: the eight bit positions come out of one multiply per
+    word, which the probe kernels do for all eight words at once and
+    test with a single AND-NOT against the block. Kernels are picked at
+    runtime like the other scan kernels: AVX-512, AVX2, or scalar.
+
+    With BLOOM_BITS_PER_KEY bits per key the false positive rate is about
+    1% at 10 bits and 0.1% at 16; keys are hashed with bloomHash() so
+    that integer and string keys spread over the blocks alike.
+
+*/
+
+#define  BLOOM_BLOCK_WORDS      8         // 64-bit words per block
+#define  BLOOM_BLOCK_BYTES      64        // One cache line
+
+class BloomFilter {
+
+public:
+
+    BloomFilter() {}
+    BloomFilter(size_t nKeys, size_t bitsPerKey) { reset(nKeys, bitsPerKey); }
+
+    void reset(size_t nKeys, size_t bitsPerKey);
+    void add(uint64_t hash);
+    bool contains(uint64_t hash) const;
+
+    size_t getNumBlocks() const { return words.size() / BLOOM_BLOCK_WORDS; }
+    const uint64_t* data() const { return words.data(); }
+    size_t bytes() const { return words.size() * sizeof(uint64_t); }
+
+private:
+
+    std::vector<uint64_t> words;    // getNumBlocks() x BLOOM_BLOCK_WORDS
+
+};
+
+uint64_t bloomHash(int64_t key);
+uint64_t bloomHash(const char* data, size_t len);
+
+/* Block of `nBlocks` that `hash` goes to, and whether that block holds it */
+size_t bloomBlockOf(uint64_t hash, size_t nBlocks);
+bool bloomBlockContains(const uint64_t* block, uint64_t hash);
+
+const char* bloomKernelName();
+
+#endif
\ No newline at end of file
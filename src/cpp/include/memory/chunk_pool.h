@@ -0,0 +1,115 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_CHUNK_POOL_H
+#define HERACLES_CHUNK_POOL_H
+
+#include "config.h"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+/*
+
+    Buffer pool for column chunks, bounded by bytes rather than frames
+    since chunks vary in size.
+
+    What a frame holds depends on LAZY_DECOMPRESSION:
+
+        0   The chunk is decoded once when it is loaded, and the frame
+            holds its int64_t values (8 bytes per value).
+
+        1   The frame holds the chunk exactly as stored. Readers decode
+            the vectors they need on every access, so pool memory follows
+            the compressed size.
+
+    Either way the validity bitmap is decoded at load time, since nulls
+    may be stored as a RoaringBitmap (see column.h).
+
+    Frames are handed out as shared pointers, so a frame evicted while a
+    scan is using it stays valid until the scan lets go of it.
+
+    Chunks a query keeps decoding can in addition be kept decoded, in a
+    DecodedCache in front of the pool (decoded_cache.h).
+
+        Pool        (segment, chunk) -> frame
+                     LRU list, most recent first
+
+                    | seg 3, c 7 | -> | seg 1, c 0 | -> | seg 3, c 6 | -> ...
+
+*/
+
+/* Contents of a pooled chunk, exactly one of `data` and `values` is filled */
+struct ChunkFrame {
+    std::vector<char> data;             // Stored bytes, LAZY_DECOMPRESSION only
+    std::vector<int64_t> values;        // Decoded values otherwise
+    bitset<uint64_t> validity;          // Decoded validity, empty = no nulls
+
+    size_t bytes() const {
+        return data.size() + values.size() * sizeof(int64_t) + validity.size() * sizeof(uint64_t);
+    }
+};
+
+class ChunkPool {
+
+    typedef std::pair<uint64_t, size_t> frame_key_t;   // (segment, chunk index)
+
+    struct KeyHash {
+        size_t operator()(const frame_key_t& key) const {
+            return std::hash<uint64_t>()(key.first * 0x9E3779B97F4A7C15ULL + key.second);
+        }
+    };
+
+    struct Entry {
+        frame_key_t key;
+        std::shared_ptr<const ChunkFrame> frame;
+    };
+
+public:
+
+    ChunkPool(size_t capacity = CHUNK_POOL_SIZE);
+
+    std::shared_ptr<const ChunkFrame> get(uint64_t segId, size_t chunkIdx);
+    void put(uint64_t segId, size_t chunkIdx, std::shared_ptr<const ChunkFrame> frame);
+    void evictSegment(uint64_t segId);
+
+    size_t getCapacity() const { return capacity; }
+    size_t getBytesUsed();
+    uint64_t getHits();
+    uint64_t getMisses();
+
+    static uint64_t nextSegmentId();
+
+private:
+
+    std::mutex latch;                   // Mutex for concurrency
+    size_t capacity;                    // Byte budget
+    size_t bytesUsed;
+    uint64_t nHits;
+    uint64_t nMisses;
+    std::list<Entry> lru;               // Most recently used first
+    std::unordered_map<frame_key_t, std::list<Entry>::iterator, KeyHash> frames;
+
+    void evict();
+
+};
+
+#endif
\ No newline at end of file
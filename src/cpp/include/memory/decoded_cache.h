@@ -0,0 +1,99 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_DECODED_CACHE_H
+#define HERACLES_DECODED_CACHE_H
+
+#include "chunk_pool.h"
+
+#include <set>
+
+/*
+
+    Cache of decoded chunks, in front of the chunk pool. With
+    LAZY_DECOMPRESSION the pool holds chunks as stored and every read of
+    a vector decodes it again, which for a compressed or bit-packed
+    column a query keeps coming back to costs more than the read itself.
+    A segment reader given this cache decodes a chunk once, on the first
+    load, and serves later loads from the decoded frame.
+
+    The cache has its own byte budget, and eviction weighs what a frame
+    costs to rebuild against the memory it takes (GreedyDual-Size):
+
+        priority = inflation + decode time / frame bytes
+
+    The frame of lowest priority goes first and the inflation rises to
+    its priority, so frames that are not used age out however costly
+    they were, while among recent frames a plain chunk, decoded by a
+    copy, gives way to a Zstd chunk of the same size. A hit brings a
+    frame's priority back up to the current inflation plus its cost.
+
+        Cache       (segment, chunk) -> decoded frame, cost, priority
+                     priority queue, lowest first
+
+    Frames are keyed like the pool's, by reader and chunk: a column id is
+    shared by the column's segments in every row group.
+
+*/
+
+class DecodedCache {
+
+    typedef std::pair<uint64_t, size_t> frame_key_t;   // (segment, chunk index)
+
+    struct KeyHash {
+        size_t operator()(const frame_key_t& key) const {
+            return std::hash<uint64_t>()(key.first * 0x9E3779B97F4A7C15ULL + key.second);
+        }
+    };
+
+    struct Entry {
+        std::shared_ptr<const ChunkFrame> frame;
+        double cost;                    // Nanoseconds the frame took to decode
+        double priority;
+    };
+
+public:
+
+    DecodedCache(size_t capacity = DECODED_CACHE_SIZE);
+
+    std::shared_ptr<const ChunkFrame> get(uint64_t segId, size_t chunkIdx);
+    void put(uint64_t segId, size_t chunkIdx, std::shared_ptr<const ChunkFrame> frame, double cost);
+    void evictSegment(uint64_t segId);
+
+    size_t getCapacity() const { return capacity; }
+    size_t getBytesUsed();
+    uint64_t getHits();
+    uint64_t getMisses();
+
+private:
+
+    std::mutex latch;                   // Mutex for concurrency
+    size_t capacity;                    // Byte budget
+    size_t bytesUsed;
+    uint64_t nHits;
+    uint64_t nMisses;
+    double inflation;                   // Priority of the last frame evicted
+    std::set<std::pair<double, frame_key_t>> queue;     // Lowest priority first
+    std::unordered_map<frame_key_t, Entry, KeyHash> frames;
+
+    void remove(const frame_key_t& key);
+    void evict();
+
+};
+
+#endif
\ No newline at end of file
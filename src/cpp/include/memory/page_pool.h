@@ -0,0 +1,161 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_PAGE_POOL_H
+#define HERACLES_PAGE_POOL_H
+
+#include "column.h"
+#include "os_unx.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/*
+
+    Buffer pool of PAGE_SIZE pages over one file, for structures that are
+    updated in place (the B+ tree, bptree.h). Unlike the chunk pool,
+    whose chunks are written once and only ever read, pages are read,
+    changed and written back, so frames are fixed size and latched while
+    in use rather than shared.
+
+    Page n is at offset n * PAGE_SIZE in the file. New pages are added at
+    the end of the file; pages are never freed.
+
+        Pool        page id -> frame, a flat table read without latching
+                    frames in a clock, a frame that is latched is skipped,
+                    one whose reference bit is set gets a second chance
+
+                    | page 0, latched | page 9, ref | page 4, dirty | ...
+
+    Every frame has an optimistic latch, a version that is odd while it
+    is held exclusively and goes up each time it is released. Readers do
+    not take it: they note the version, read the page, and check that the
+    version is still the same, starting over if it is not. So a page
+    read by many threads at once, the root of a tree, is never written by
+    any of them, and its cache line is not moved between cores.
+
+    Writers latch a frame exclusively to change its page, and the pool
+    latches a frame to take it for another page, so a page cannot be
+    evicted under a writer, and a reader whose frame was taken sees the
+    version change. The latch is a spin latch, held for the few stores of
+    one change, or while the pool reads or writes the frame's page. The
+    pool latch is a mutex, held only to pick a frame and change the page
+    table, never across I/O, so misses on different pages are read in
+    side by side.
+
+    A dirty page is written when its frame is taken for another page, or
+    by flush(). There is no logging: after flush() the file holds every
+    change made so far, after a crash only some of those since.
+
+    allocate() fails with GENERAL_FAILURE if every frame is latched, so
+    the pool must have a frame for every page its users latch at once.
+
+*/
+
+/* Version latch, odd while held exclusively */
+class OptimisticLatch {
+
+public:
+
+    OptimisticLatch() : version(0) {}
+
+    /* Version to validate reads against, false if the latch is held */
+    bool readLock(uint64_t& v) const {
+        v = version.load(std::memory_order_acquire);
+        return (v & 1) == 0;
+    }
+
+    /* Whether nothing changed since readLock() returned `v` */
+    bool validate(uint64_t v) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return version.load(std::memory_order_relaxed) == v;
+    }
+
+    /* Take the latch exclusively if nothing changed since `v` */
+    bool tryUpgrade(uint64_t v) {
+        return version.compare_exchange_strong(v, v + 1, std::memory_order_acquire);
+    }
+
+    bool tryLock() {
+        uint64_t v;
+        return readLock(v) && tryUpgrade(v);
+    }
+
+    void lock();
+
+    void unlock() {
+        version.fetch_add(1, std::memory_order_release);
+    }
+
+private:
+
+    std::atomic<uint64_t> version;
+
+};
+
+/* On-disk page buffer */
+struct PageFrame {
+    OptimisticLatch latch;
+    std::atomic<page_id_t> pageId; // Changed only under the latch
+    std::atomic<bool> dirty;        // Changed since it was read or written, set under the latch
+    std::atomic<bool> referenced;   // Used since the clock hand last passed
+    char* data;                     // PAGE_SIZE bytes
+};
+
+class PagePool {
+
+public:
+
+    PagePool(size_t nFrames = PAGE_POOL_FRAMES);
+    ~PagePool();
+
+    ColumnStatus open(const std::string& path);
+    ColumnStatus fix(page_id_t pageId, PageFrame*& frame);
+    ColumnStatus fixExclusive(page_id_t pageId, PageFrame*& frame);
+    ColumnStatus allocate(PageFrame*& frame);
+    ColumnStatus flush();
+    void close();
+
+    page_id_t getNumPages() const { return nPages.load(std::memory_order_acquire); }
+    size_t getNumFrames() const { return nFrames; }
+    uint64_t getReads() const { return nReads.load(); }     // Pages read from the file
+    uint64_t getWrites() const { return nWrites.load(); }   // Pages written to the file
+
+private:
+
+    std::mutex latch;               // Held to take a frame
+    os_fd_t fd;
+    size_t nFrames;
+    std::unique_ptr<char[]> memory; // Page buffers of every frame
+    std::unique_ptr<PageFrame[]> frames;
+    std::unique_ptr<std::atomic<std::atomic<int32_t>*>[]> pageTable;   // Chunks of page id -> frame, -1 if none
+    size_t hand;                    // Clock hand
+    std::atomic<page_id_t> nPages;  // Pages in the file, written or not
+    std::atomic<uint64_t> nReads;
+    std::atomic<uint64_t> nWrites;
+
+    int32_t frameOf(page_id_t pageId) const;
+    void map(page_id_t pageId, int32_t idx);
+    ColumnStatus takeFrame(std::unique_lock<std::mutex>& lock, size_t& idx);
+    ColumnStatus writeFrame(PageFrame& frame);
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,114 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_ROARING_H
+#define HERACLES_ROARING_H
+
+#include "config.h"
+
+#include <string>
+
+/*
+
+    Compressed bitmap of 32-bit values in the style of Roaring. The value
+    space is cut into 2^16 chunks by the high 16 bits, and every non-empty
+    chunk gets a container for its low 16 bits, in whichever form is
+    smallest for what it holds:
+
+        ARRAY       Sorted uint16_t values, at most ROARING_ARRAY_MAX of them
+        BITMAP      1024 words, one bit per value
+        RUN         (start, length - 1) pairs, only made by runOptimize()
+
+        Bitmap      | key 0 | key 3 | key 4 |       high 16 bits, sorted
+                        |       |       |
+                      ARRAY   BITMAP   RUN          low 16 bits
+
+    An array turns into a bitmap once it outgrows ROARING_ARRAY_MAX values
+    and a bitmap back into an array when it drops to that, so a container
+    never takes more than 8 kb. Run containers are read-only: changing one
+    expands it first.
+
+    Intersections, unions and differences go container by container.
+    Bitmap pairs are combined by word kernels that count the result as they
+    go, picked at runtime like the bitpack kernels: AVX-512 (with VPOPCNTQ),
+    AVX2, or scalar.
+
+    Uncompressed bitset<uint64_t> words stay the format the scan kernels
+    work on; getWords() cuts a window of a bitmap into that form.
+
+*/
+
+#define  ROARING_ARRAY_MAX      4096
+#define  ROARING_BITMAP_WORDS   1024
+
+enum class RoaringType : uint8_t {
+    ARRAY,
+    BITMAP,
+    RUN
+};
+
+struct RoaringContainer {
+    uint16_t key;                   // High 16 bits of every value in here
+    RoaringType type;
+    uint32_t card;                  // Number of values
+    std::vector<uint16_t> values;   // ARRAY values, or RUN pairs
+    std::vector<uint64_t> words;    // BITMAP words
+};
+
+class RoaringBitmap {
+
+public:
+
+    bool add(uint32_t val);         // False if it was already there
+    bool remove(uint32_t val);      // False if it was not there
+    bool contains(uint32_t val) const;
+
+    uint64_t cardinality() const;
+    bool empty() const { return containers.empty(); }
+    uint32_t maximum() const;       // Bitmap must not be empty
+    size_t bytes() const;
+
+    void addWords(uint32_t first, const uint64_t* words, size_t count, bool invert = false);
+    bool getWords(uint32_t first, size_t count, uint64_t* words) const;
+    void toArray(std::vector<uint32_t>& out) const;
+
+    void runOptimize();
+
+    void serialize(std::vector<char>& out) const;
+    bool deserialize(const char* data, size_t size);
+
+    friend RoaringBitmap roaringAnd(const RoaringBitmap& a, const RoaringBitmap& b);
+    friend RoaringBitmap roaringOr(const RoaringBitmap& a, const RoaringBitmap& b);
+    friend RoaringBitmap roaringAndNot(const RoaringBitmap& a, const RoaringBitmap& b);
+
+private:
+
+    std::vector<RoaringContainer> containers;   // Sorted by key
+
+    RoaringContainer* find(uint16_t key);
+    const RoaringContainer* find(uint16_t key) const;
+
+};
+
+RoaringBitmap roaringAnd(const RoaringBitmap& a, const RoaringBitmap& b);
+RoaringBitmap roaringOr(const RoaringBitmap& a, const RoaringBitmap& b);
+RoaringBitmap roaringAndNot(const RoaringBitmap& a, const RoaringBitmap& b);
+
+const char* roaringKernelName();
+
+#endif
\ No newline at end of file
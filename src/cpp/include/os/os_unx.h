@@ -0,0 +1,60 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_OS_UNX_H
+#define HERACLES_OS_UNX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+#include <string>
+#include <vector>
+
+/*
+
+    Thin wrappers over the POSIX file API. Everything above the OS layer
+    goes through these so that a Windows port only needs its own os_win.h.
+
+    All functions return 0 (or a byte count) on success and -1 on failure,
+    leaving the reason in errno.
+
+*/
+
+typedef int os_fd_t;                // File descriptor
+#define OS_INVALID_FD           -1
+
+os_fd_t osOpen(const char* path, bool create);
+os_fd_t osOpenRead(const char* path);
+int     osClose(os_fd_t fd);
+
+ssize_t osRead(os_fd_t fd, void* buf, size_t len, int64_t offset);
+ssize_t osWrite(os_fd_t fd, const void* buf, size_t len, int64_t offset);
+
+int     osDataSync(os_fd_t fd);
+int     osPreallocate(os_fd_t fd, int64_t size);
+int64_t osFileSize(os_fd_t fd);
+
+int     osRename(const char* from, const char* to);
+int     osRemove(const char* path);
+int     osCopyFile(const char* from, const char* to);
+int     osMkdir(const char* path);
+int     osSyncDir(const char* path);
+bool    osExists(const char* path);
+int     osListDir(const char* path, std::vector<std::string>& names);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_ARROW_EXPORT_H
+#define HERACLES_ARROW_EXPORT_H
+
+#include "table.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*
+
+    Export of column vectors, scan batches and decoded chunks through the
+    Arrow C data interface, so Arrow consumers (pyarrow, DuckDB, Polars,
+    ...) take them over without a copy or a row-wise transposition.
+
+        ColumnVector            ArrowArray
+        values (int64_t)   ->   buffers[1], format "l" or "tsu:UTC"
+        validity words     ->   buffers[0], null when nothing is null
+
+    A validity word holds rows 64i .. 64i+63 in bits 0 .. 63, which on the
+    little-endian machines the engine runs on is byte for byte Arrow's
+    LSB-first validity bitmap. The exported array takes the vector over
+    (it is moved into the array's private data) and frees it when the
+    consumer calls release().
+
+    STRING columns are always exported dictionary-encoded, int64 indices
+    into a utf8 dictionary, whatever the layout of their segment:
+
+        Segment dictionary      Codes are the indices; the utf8 form of the
+                                dictionary is built once per segment and
+                                shared by every array exported from it
+        STRING_HEAP vector      Indices 0 .. n-1 into the vector's strings
+        Delta rows              Indices into the batch dictionary
+
+    Only the dictionaries are copied, into utf8 offsets and bytes, since
+    std::string keeps every value in its own buffer.
+
+    A batch whose selection is a contiguous run of its vector is exported
+    in place, through the array's offset; any other selection is gathered
+    into new buffers first.
+
+*/
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+    const char* format;
+    const char* name;
+    const char* metadata;
+    int64_t flags;
+    int64_t n_children;
+    struct ArrowSchema** children;
+    struct ArrowSchema* dictionary;
+    void (*release)(struct ArrowSchema*);
+    void* private_data;
+};
+
+struct ArrowArray {
+    int64_t length;
+    int64_t null_count;
+    int64_t offset;
+    int64_t n_buffers;
+    int64_t n_children;
+    const void** buffers;
+    struct ArrowArray** children;
+    struct ArrowArray* dictionary;
+    void (*release)(struct ArrowArray*);
+    void* private_data;
+};
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+/* Strings as an Arrow utf8 array: string i is data[offsets[i] .. offsets[i + 1]) */
+struct ArrowStrings {
+    std::vector<int32_t> offsets;
+    std::vector<char> data;
+
+    ColumnStatus assign(const std::vector<std::string>& strings);
+    size_t size() const { return offsets.size() - 1; }
+};
+
+/* Exports the arrays of one column, keeping the utf8 form of the last segment dictionary it met */
+class ArrowExporter {
+
+public:
+
+    ArrowExporter(ColumnType type) : type(type) {}
+
+    ColumnStatus exportVector(ColumnVector&& vec, const std::vector<std::string>* dictionary, ArrowArray* out);
+    ColumnStatus exportBatch(TableBatch&& batch, ArrowArray* out);
+    ColumnStatus exportChunk(const std::shared_ptr<ColumnSegmentReader>& segment, size_t idx, ArrowArray* out);
+
+private:
+
+    ColumnType type;
+    std::shared_ptr<const ColumnSegmentReader> dictSegment;     // Segment whose dictionary `dictStrings` holds
+    std::shared_ptr<const ArrowStrings> dictStrings;
+
+    ColumnStatus exportArray(ColumnVector&& vec, size_t offset, size_t length,
+                             std::shared_ptr<const ArrowStrings> strings, ArrowArray* out) const;
+    ColumnStatus segmentStrings(const std::shared_ptr<const ColumnSegmentReader>& segment,
+                                std::shared_ptr<const ArrowStrings>& strings);
+
+};
+
+void exportArrowSchema(ColumnType type, const std::string& name, ArrowSchema* out);
+void exportArrowSchema(const std::vector<TableColumn>& columns, ArrowSchema* out);
+ColumnStatus exportArrowRecordBatch(std::vector<ArrowArray>& columns, ArrowArray* out);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,61 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_BITPACK_H
+#define HERACLES_BITPACK_H
+
+#include "config.h"
+
+/*
+
+    Bit-packing kernels for frame-of-reference (FOR) encoded blocks.
+
+    Values are stored as `width`-bit offsets from the block minimum, in a
+    vertical layout of BITPACK_LANES 32-bit lanes: value i goes to lane
+    i % 8, and each lane packs its own values into consecutive words.
+
+        Value       0   1   2  ...  7 |  8   9  ... 15 | ...
+        Lane        0   1   2  ...  7 |  0   1  ...  7 | ...
+
+        Memory      | w0 lane0 | w0 lane1 | ... | w0 lane7 |   row 0
+                    | w1 lane0 | w1 lane1 | ... | w1 lane7 |   row 1
+
+    Every group of 8 consecutive values sits at the same bit position of
+    each lane, so one 256-bit load plus two shifts yields 8 values with no
+    gathers or shuffles. One zero row of padding follows the packed data,
+    so a kernel can always read the row after the current one.
+
+    Kernels are picked at runtime: AVX-512 or AVX2 on x86-64, NEON on
+    AArch64, and a portable scalar version otherwise (or when SIMD_ENABLED
+    is 0). Widths are 0 to 32 bits.
+
+*/
+
+#define  BITPACK_LANES          8
+
+size_t bitpackSize(size_t count, uint8_t width);
+uint8_t bitpackWidth(uint64_t maxOffset);
+
+void bitpackEncode(const uint32_t* in, size_t count, uint8_t width, uint32_t* out);
+void bitpackDecode(const uint32_t* in, size_t count, uint8_t width, int64_t ref, int64_t* out);
+void bitpackFilter(const uint32_t* in, size_t count, uint8_t width,
+                   uint32_t lo, uint32_t hi, uint64_t* matches);
+
+const char* bitpackKernelName();
+
+#endif
\ No newline at end of file
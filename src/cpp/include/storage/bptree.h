@@ -0,0 +1,239 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_BPTREE_H
+#define HERACLES_BPTREE_H
+
+#include "page_pool.h"
+
+#include <atomic>
+#include <vector>
+
+/*
+
+    Disk-resident B+ tree, one per page file, its pages in a PagePool
+    (page_pool.h). It maps int64_t keys to uint64_t values, say the values
+    of an INT64 column to row ids, and a key may have any number of
+    values: what the tree holds is a set of (key, value) entries, ordered
+    on the key and then on the value.
+
+    Page 0 (HEADER_PAGE_ID) is the tree's header, every other page a node:
+
+        |============|=======================================|
+        | NodeHeader | Leaf    entries, in order             |
+        | (16 bytes) | Inner   separators  |  children       |
+        |============|=======================================|
+
+    A leaf holds up to BPTREE_LEAF_CAPACITY entries and links to the leaf
+    on its right, so a range scan walks the leaves without going back up.
+    An inner node holds n separators and n + 1 children, child i covering
+    the entries from separator i - 1 (inclusive) to separator i; up to
+    BPTREE_INNER_CAPACITY separators, with 4 KB pages 255 and 169.
+
+        root (level 2)          [ 50 | 90 ]
+                               /     |     \
+        level 1          [ 20 ]   [ 70 ]   [ 95 ]
+                         /   \    /   \    /   \
+        leaves (0)      L  -> L -> L -> L -> L -> L
+
+    A full node splits in half and hands a separator up, a full root
+    makes the tree one level higher. The height never goes past
+    BPTREE_MAX_HEIGHT: an insert that would need a taller tree fails,
+    leaving it unchanged (with 4 KB pages no file is big enough to get
+    there). Deletes take the entry out of its leaf and never merge nodes,
+    so a tree that shrank keeps its pages, and a leaf left empty stays
+    linked in for scans to step over.
+
+    Concurrency is optimistic lock coupling over the frame latches of the
+    pool. Going down, a thread notes the version of each node, reads the
+    child to go to, and checks the version again once it has the child's
+    version in hand; if anything changed it starts over from the root.
+    Lookups and scans latch nothing, so any number of them share the
+    upper levels without writing to them. An insert or delete latches
+    only the leaf it changes, by upgrading the version it went down with,
+    and a split also latches, the same way, the parents the separator
+    goes into up to the first one with room (the root latch if the root
+    splits). Latches are only ever tried, never waited for, so there is
+    no latch order to keep: a thread that fails to get one lets go of
+    the ones it has and starts over.
+
+    A scan re-descends from the root for every batch, from the entry
+    after the last it returned, and a batch that saw a leaf change starts
+    over, so every batch is a consistent read of the leaves it covers.
+
+    The root, the height and the entry count are kept in memory and
+    written to the header by flush(), which then flushes the pool; as
+    with the pool, nothing is logged.
+
+*/
+
+struct BPTreeEntry {
+    int64_t key;
+    uint64_t value;
+};
+
+inline bool operator<(const BPTreeEntry& a, const BPTreeEntry& b) {
+    return a.key < b.key || (a.key == b.key && a.value < b.value);
+}
+
+inline bool operator==(const BPTreeEntry& a, const BPTreeEntry& b) {
+    return a.key == b.key && a.value == b.value;
+}
+
+/* Header page */
+struct BPTreeHeader {
+    uint32_t magic;
+    uint32_t version;
+    page_id_t root;
+    uint32_t height;            // Levels, 1 while the root is a leaf
+    uint32_t reserved;
+    uint64_t nEntries;
+};
+
+/* Start of every node page */
+struct BPTreeNode {
+    uint16_t level;             // 0 for a leaf
+    uint16_t nEntries;          // Entries of a leaf, separators of an inner node
+    uint32_t reserved;
+    page_id_t next;             // Leaf to the right, INVALID_ID for the last leaf and inner nodes
+};
+
+#define  BPTREE_MAGIC           0x45525442  // "BTRE"
+#define  BPTREE_VERSION         1
+#define  BPTREE_LEAF_CAPACITY   ((PAGE_SIZE - sizeof(BPTreeNode)) / sizeof(BPTreeEntry))
+#define  BPTREE_INNER_CAPACITY  ((PAGE_SIZE - sizeof(BPTreeNode) - sizeof(page_id_t)) / \
+                                 (sizeof(BPTreeEntry) + sizeof(page_id_t)))
+
+/* Nodes passed on the way down, and the versions they were read at */
+struct BPTreePath {
+    uint64_t rootVersion;
+    uint32_t height;
+    PageFrame* frames[BPTREE_MAX_HEIGHT];   // By level, frames[0] the leaf
+    uint64_t versions[BPTREE_MAX_HEIGHT];
+};
+
+class BPlusTree {
+
+public:
+
+    BPlusTree(PagePool& pool);      // Pool must be open and outlive the tree
+
+    ColumnStatus open();
+    ColumnStatus insert(int64_t key, uint64_t value);
+    ColumnStatus remove(int64_t key, uint64_t value);
+    ColumnStatus lookup(int64_t key, std::vector<uint64_t>& values);
+    ColumnStatus flush();
+
+    uint32_t getHeight() const { return height.load(std::memory_order_relaxed); }
+    uint64_t getNumEntries() const { return nEntries.load(std::memory_order_relaxed); }
+
+private:
+
+    friend class BPlusTreeScan;
+    friend class BPlusTreeBuilder;
+
+    PagePool& pool;
+    OptimisticLatch rootLatch;      // Guards root and height
+    std::atomic<page_id_t> root;
+    std::atomic<uint32_t> height;
+    std::atomic<uint64_t> nEntries;
+
+    ColumnStatus writeHeader();
+    bool findLeaf(const BPTreeEntry& entry, BPTreePath& path, ColumnStatus& rc);
+    bool split(const BPTreeEntry& entry, BPTreePath& path, ColumnStatus& rc);
+
+};
+
+/*
+
+    Scan of the entries with keys in [lo, hi], in order, in batches of up
+    to COLUMN_VECTOR_SIZE entries. next() returns INDEX_OUT_OF_BOUNDS once
+    every entry has been returned; entries inserted or deleted while the
+    scan runs may or may not show up.
+
+*/
+class BPlusTreeScan {
+
+public:
+
+    BPlusTreeScan(BPlusTree& tree, int64_t lo, int64_t hi);
+
+    ColumnStatus next(std::vector<BPTreeEntry>& entries);
+
+private:
+
+    BPlusTree& tree;
+    BPTreeEntry from;               // Smallest entry not returned yet
+    int64_t hi;
+    bool done;
+
+};
+
+/*
+
+    Bulk load of an empty tree, bottom up, from entries appended in
+    ascending order (sorted on the key and then on the value, say a
+    column sorted along with its row ids). Leaves are filled one after
+    the other to the fill factor, BPTREE_FILL_FACTOR percent of their
+    capacity unless set otherwise, then each inner level is built over
+    the one below it the same way, so every page is written once, in
+    order, and none is split:
+
+        leaves      [ 1 2 3 ] -> [ 4 5 6 ] -> [ 7 8 9 ] -> [ 10 ]
+        level 1     [ 4 | 7 | 10 ]          (separators: first entries)
+
+    A fill factor below 100 leaves room in every node for later inserts
+    before it splits. Only the last two nodes of a level may be less
+    full: when the last one would get under half the fill, the two share
+    their children evenly, so no inner node is left with a single child.
+
+    The new nodes go at the end of the file and the tree's root is only
+    switched to them by finish(), which then flushes the tree, so the
+    tree is unchanged (and empty) until then. Nothing else may use the
+    tree while it is loaded. The first entry of each leaf is kept in
+    memory until finish(), 24 bytes a leaf.
+
+*/
+class BPlusTreeBuilder {
+
+public:
+
+    BPlusTreeBuilder(BPlusTree& tree);
+    ~BPlusTreeBuilder();
+
+    ColumnStatus open();
+    ColumnStatus setFillFactor(int percent);
+    ColumnStatus append(int64_t key, uint64_t value);
+    ColumnStatus finish();
+
+    uint64_t getNumEntries() const { return nEntries; }
+
+private:
+
+    BPlusTree& tree;
+    size_t leafFill;                // Entries per leaf
+    size_t innerFill;               // Separators per inner node
+    PageFrame* leaf;                // Leaf being filled, latched exclusively
+    std::vector<page_id_t> level;   // Nodes of the level being built, in order
+    std::vector<BPTreeEntry> lows;  // Their first entries
+    BPTreeEntry last;               // Last entry appended
+    uint64_t nEntries;
+
+};
+
+#endif
\ No newline at end of file
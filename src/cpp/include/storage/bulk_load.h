@@ -0,0 +1,88 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_BULK_LOAD_H
+#define HERACLES_BULK_LOAD_H
+
+#include "column.h"
+
+#include <functional>
+#include <string>
+#include <vector>
+
+/*
+
+    Bulk load of a CSV file straight into row groups (Table::bulkLoad()),
+    bypassing the delta store and the tuple mover's row-at-a-time path.
+
+        File        | header | piece 0 | piece 1 | piece 2 | ... |
+                               group n   group n+1 group n+2
+
+    csvSplit() cuts the file into pieces of about BULK_LOAD_PIECE_BYTES
+    that end on a line break, so every piece holds whole rows and becomes
+    one row group. Worker threads then go over the pieces twice: once to
+    count their rows, which gives each piece its row ids before any of it
+    is parsed, and once to parse the rows into columns (csvParse()) and
+    encode, compress and write the group's segments. Both passes run on
+    every core; nothing is logged, the groups become visible with the one
+    manifest that publishes them all.
+
+    Fields are separated by `delimiter` and may be quoted ("a ""b"" c"),
+    but may not contain line breaks, since pieces are cut at any of them.
+    An empty unquoted field is null. INT64 fields are decimal integers,
+    TIMESTAMP fields either microseconds since the epoch or UTC dates as
+    YYYY-MM-DD[ HH:MM:SS[.ffffff]] (a 'T' may replace the space). Lines
+    may end in "\r\n".
+
+*/
+
+struct CsvOptions {
+    char delimiter = ',';
+    bool header = false;            // Skip the first line
+    size_t threads = 0;             // Worker threads, 0 for one per core
+    size_t pieceBytes = BULK_LOAD_PIECE_BYTES;
+};
+
+/* Byte range [begin, end) of whole lines, loaded as one row group */
+struct CsvPiece {
+    uint64_t begin;
+    uint64_t end;
+    uint64_t nRows;                 // Set by csvCountRows()
+    uint64_t firstRow;              // Row id of the first row
+};
+
+/* Parsed values of one column, `values` for integer columns and `strings` for STRING ones */
+struct ColumnBatch {
+    std::vector<int64_t> values;
+    std::vector<std::string> strings;
+    std::vector<uint8_t> nulls;     // 1 for a null row
+
+    size_t size() const { return nulls.size(); }
+};
+
+ColumnStatus csvSplit(os_fd_t fd, const CsvOptions& opts, std::vector<CsvPiece>& pieces);
+uint64_t csvCountRows(const char* data, size_t size);
+ColumnStatus csvParse(const char* data, size_t size, char delimiter, const std::vector<ColumnType>& types,
+                      std::vector<ColumnBatch>& columns);
+
+bool parseInt64(const char* str, size_t len, int64_t& val);
+bool parseTimestamp(const char* str, size_t len, int64_t& val);
+
+ColumnStatus parallelFor(size_t n, size_t nThreads, const std::function<ColumnStatus(size_t)>& fn);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_CODEC_H
+#define HERACLES_CODEC_H
+
+#include "config.h"
+
+/*
+
+    General-purpose block compression, applied on top of the lightweight
+    encodings for cold data. A codec is chosen per column when the segment
+    is written and compresses the encoded values of each chunk; the
+    validity bitmap stays as it is.
+
+        LZ      Built-in byte-oriented LZ77 (LZ4-style sequences, 64 kb
+                window). Always available, no dependencies.
+        LZ4     liblz4, when built with HERACLES_HAVE_LZ4
+        ZSTD    libzstd at CODEC_ZSTD_LEVEL, when built with HERACLES_HAVE_ZSTD
+
+    Chunks are decompressed once, when they are loaded into the chunk pool,
+    so scans never see compressed bytes. A chunk that does not shrink is
+    stored uncompressed.
+
+*/
+
+enum class ColumnCodec : uint8_t {
+    NONE,
+    LZ,
+    LZ4,
+    ZSTD
+};
+
+class Codec {
+
+public:
+
+    virtual ~Codec() = default;
+
+    virtual const char* name() const = 0;
+    virtual size_t maxCompressedSize(size_t rawSize) const = 0;
+
+    /* Bytes written to `dst`, 0 if the output does not fit in `dstCap` */
+    virtual size_t compress(const char* src, size_t srcSize, char* dst, size_t dstCap) const = 0;
+
+    /* Fails unless `src` decompresses to exactly `rawSize` bytes */
+    virtual bool decompress(const char* src, size_t srcSize, char* dst, size_t rawSize) const = 0;
+
+};
+
+/* Null for NONE and for codecs this build has no library for */
+const Codec* getCodec(ColumnCodec codec);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,210 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_COLUMN_H
+#define HERACLES_COLUMN_H
+
+#include "config.h"
+
+#include <string>
+#include <vector>
+
+/*
+
+    Common types of the column store.
+
+    A column segment is one file holding the values of a single column for
+    a range of rows, split into chunks of COLUMN_CHUNK_SIZE values. Every
+    chunk has a footer entry with its zone map (min, max, null count and
+    row count), so a scan can rule a chunk out without reading it.
+
+       Segment file
+
+           |==========|==========|=====|==============|================|
+           | Chunk 0  | Chunk 1  | ... | ChunkFooter  | SegmentFooter  |
+           |          |          |     | x nChunks    | (fixed size)   |
+           |==========|==========|=====|==============|================|
+
+       Chunk
+
+           |==================|======================|
+           | Validity bitmap  | Encoded values       |
+           | (only if nulls)  | (maybe compressed)   |
+           |==================|======================|
+
+    The segment footer sits at the very end of the file, so a reader finds
+    everything else starting from the file size. Segments written since
+    version 2 can still be read: version 2 chunk footers end at `rawSize`
+    (no Bloom filters), and footers before version 4 end at `nChunks`
+    (no statistics).
+
+    String columns are dictionary encoded per segment: the distinct values
+    are sorted into a dictionary stored between the last chunk and the
+    chunk footers, and chunks hold fixed-width codes into it. Codes follow
+    the sort order of the strings, so zone maps, range predicates and
+    group-bys all work on the integer codes.
+
+    A string segment with mostly distinct values (STRING_HEAP_THRESHOLD)
+    would carry a dictionary as big as the column, so it stores the
+    strings in the chunks instead: offsets plus a byte heap per chunk,
+    usually compressed with a symbol table (string_heap.h). Which of the
+    two a segment uses is recorded in its footer (StringLayout).
+
+    The footer also records whether a segment is sorted, nulls first.
+    Zone maps of a sorted segment never overlap, so a range of values is
+    a range of rows that two binary searches find (column_scan.h).
+
+    Zone maps say nothing useful about an equality predicate on a column
+    whose values are spread out in every chunk (user ids, URLs), so a
+    writer can be asked for Bloom filters as well (bloom.h). A chunk's
+    filter is stored right behind its data and located by its footer
+    entry; a scan reads the one block a key hashes to and skips the chunk
+    if the key is not in it.
+
+           | Chunk 0 | Filter 0 | Chunk 1 | Filter 1 | ... | ChunkFooter ...
+
+    Statistics of the whole segment for the optimizer (distinct count,
+    histogram, common values, see column_stats.h) sit between the chunks
+    (or the dictionary) and the chunk footers, and are only read when
+    asked for.
+
+    Columns usually read together can instead share a column group file
+    (column_group.h), whose pages hold the same rows of each of them. Each
+    column in it is still a segment laid out as above, only ending at an
+    offset within the file rather than at its end.
+
+*/
+
+/* Status codes */
+enum class ColumnStatus {
+    GENERAL_SUCCESS,
+    GENERAL_FAILURE,
+    IO_ERROR,
+    CORRUPT_SEGMENT,
+    INDEX_OUT_OF_BOUNDS,
+    TYPE_MISMATCH,
+    UNSUPPORTED_CODEC
+};
+
+/* Logical column types, all integer types are stored as int64_t */
+enum class ColumnType : uint8_t {
+    INT64,
+    TIMESTAMP,      // Microseconds since the Unix epoch
+    STRING          // Values are codes into the segment dictionary
+};
+
+/* How the values of a chunk are laid out */
+enum class ColumnEncoding : uint8_t {
+    PLAIN,          // Raw int64_t values
+    DICTIONARY,     // Codes of `valueWidth` bytes into the segment dictionary
+    RLE,            // (value, run end) pairs
+    DELTA,          // Per block: base value, then zigzag deltas
+    DELTA_OF_DELTA, // Per block: base value and first delta, then zigzag delta changes
+    BITPACK,        // Per block: minimum, then bit-packed offsets from it (frame of reference)
+    STRING_HEAP     // End offsets and a heap of the strings themselves, see string_heap.h
+};
+
+/* How the validity bytes of a chunk are stored */
+enum class ValidityFormat : uint8_t {
+    DENSE,          // One bit per value, set when not null
+    ROARING         // Serialized RoaringBitmap of the null offsets, when that is smaller
+};
+
+/* Where the strings of a STRING segment are */
+enum class StringLayout : uint8_t {
+    DICTIONARY,     // Sorted dictionary after the chunks, chunks hold codes
+    HEAP            // STRING_HEAP chunks, no dictionary
+};
+
+/* Per-chunk statistics, min and max ignore nulls (stringKey() of the strings in STRING_HEAP chunks) */
+struct ZoneMap {
+    int64_t  minVal;
+    int64_t  maxVal;
+    uint32_t nullCount;
+    uint32_t rowCount;
+};
+
+/* On-disk footer entry of one chunk */
+struct ChunkFooter {
+    uint64_t offset;            // File offset of the chunk
+    uint32_t size;              // Stored bytes, validity bitmap included
+    uint32_t validitySize;      // Leading validity bytes, 0 when there are no nulls
+    ZoneMap  zone;
+    uint8_t  encoding;          // ColumnEncoding
+    uint8_t  valueWidth;        // Bytes per stored value, 0 for STRING_HEAP
+    uint8_t  codec;             // ColumnCodec of the encoded values
+    uint8_t  validityFormat;    // ValidityFormat of the validity bytes
+    uint32_t rawSize;           // Encoded values before compression, codec only
+    uint64_t bloomOffset;       // File offset of the chunk's Bloom filter
+    uint32_t bloomBlocks;       // BLOOM_BLOCK_BYTES blocks of the filter, 0 when the chunk has none
+    uint32_t reserved;
+
+    /* Bytes of encoded values once decompressed */
+    size_t valuesSize() const { return codec ? rawSize : size - validitySize; }
+};
+
+/* On-disk footer at the end of every segment */
+struct SegmentFooter {
+    uint32_t magic;
+    uint32_t version;
+    col_id_t colId;
+    uint8_t  type;              // ColumnType
+    uint8_t  stringLayout;      // StringLayout, STRING only
+    uint8_t  sorted;            // 1 when nulls come first and the values never decrease
+    uint8_t  reserved;
+    uint64_t nRows;
+    uint64_t chunksOffset;      // File offset of the ChunkFooter array
+    uint64_t dictOffset;        // File offset of the dictionary, STRING only
+    uint32_t dictSize;          // Dictionary bytes
+    uint32_t nDictEntries;      // Distinct values in the dictionary
+    uint32_t nChunks;
+    uint32_t statsSize;         // Serialized ColumnStats bytes, 0 if the segment has none
+    uint64_t statsOffset;       // File offset of the statistics
+    uint32_t reserved2;
+    uint32_t magic2;            // Same as `magic`, guards against a torn footer
+};
+
+#define  COLUMN_SEGMENT_MAGIC   0x4C4F4348  // "HCOL"
+#define  COLUMN_SEGMENT_VERSION 4
+
+/* Aggregates over the qualifying, non-null values */
+struct ColumnAggregate {
+    uint64_t count = 0;
+    int64_t sum = 0;
+    int64_t minVal = INT64_MAX;
+    int64_t maxVal = INT64_MIN;
+};
+
+/* Decoded values of a chunk (or part of one) */
+struct ColumnVector {
+    std::vector<int64_t> values;
+    bitset<uint64_t> validity;      // Bit set when the value is not null, empty if none are null
+    std::vector<std::string> strings;   // Strings of a STRING_HEAP chunk, `values` are then 0, 1, 2, ...
+
+    size_t size() const { return values.size(); }
+    bool isNull(size_t i) const {
+        return !validity.empty() && !(validity[i >> 6] & (1ULL << (i & 63)));
+    }
+    void clear() {
+        values.clear();
+        validity.clear();
+        strings.clear();
+    }
+};
+
+#endif
\ No newline at end of file
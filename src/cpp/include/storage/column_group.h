@@ -0,0 +1,90 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_COLUMN_GROUP_H
+#define HERACLES_COLUMN_GROUP_H
+
+#include "column.h"
+
+#include <string>
+#include <vector>
+
+/*
+
+    Column group files, the PAX layout for columns that are usually read
+    together. The columns of a group share one file in which the same
+    rows of every column sit side by side: a page is one chunk (the
+    column's minipage) of each column, all over the same rows.
+
+        |========|========|=====|===========|===========|=====|=========|==============|
+        | Page 0 | Page 1 | ... | Column 0  | Column 1  | ... | Entry   | GroupFooter  |
+        |        |        |     | tail      | tail      |     | x nCols | (fixed size) |
+        |========|========|=====|===========|===========|=====|=========|==============|
+
+        Page
+
+        |==================|==================|=====|
+        | Column 0 chunk   | Column 1 chunk   | ... |
+        | (+ Bloom filter) | (+ Bloom filter) |     |
+        |==================|==================|=====|
+
+    A column's tail is everything a segment file holds past its chunks
+    (dictionary, statistics, chunk footers and segment footer, see
+    column.h), with the offsets moved to where things now are. A column of
+    a group is therefore an ordinary segment ending inside the file, which
+    a ColumnSegmentReader opens given the offset its entry records, and
+    everything that works on a segment works on it unchanged.
+
+    Fetching a row touches one page, a short run of the file, rather than
+    one chunk in each of as many segment files, which is the point when
+    queries read most columns of few rows. The pages hold
+    COLUMN_GROUP_PAGE_ROWS rows, small beside COLUMN_CHUNK_SIZE, so that
+    such a fetch also reads little; the price is more chunk footers and
+    coarser zone maps than in a segment of its own, and a scan of one
+    column that skips over the other columns' minipages.
+
+    writeColumnGroup() builds the file out of finished segments written
+    with that chunk size, copying the chunks page by page.
+
+*/
+
+/* Where a column's segment ends within a group file */
+struct ColumnGroupEntry {
+    col_id_t colId;
+    uint32_t reserved;
+    uint64_t segmentEnd;        // File offset just past the column's SegmentFooter
+};
+
+/* On-disk footer at the end of every group file */
+struct ColumnGroupFooter {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nColumns;
+    uint32_t nPages;
+    uint64_t entriesOffset;     // File offset of the ColumnGroupEntry array
+    uint32_t reserved;
+    uint32_t magic2;            // Same as `magic`, guards against a torn footer
+};
+
+#define  COLUMN_GROUP_MAGIC     0x58415048  // "HPAX"
+#define  COLUMN_GROUP_VERSION   1
+
+ColumnStatus writeColumnGroup(const std::string& path, const std::vector<std::string>& segments);
+ColumnStatus readColumnGroup(const std::string& path, std::vector<ColumnGroupEntry>& entries);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,196 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_COLUMN_SCAN_H
+#define HERACLES_COLUMN_SCAN_H
+
+#include "column_segment.h"
+#include "roaring.h"
+#include "validity.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+
+    Scan of a single column segment with an optional predicate.
+
+    Before a chunk is read its zone map is checked against the predicate,
+    and chunks that cannot contain a match are skipped without any I/O.
+    Chunks that might match are loaded (through the segment's ChunkPool,
+    if any) and handed out one vector of COLUMN_VECTOR_SIZE rows at a
+    time, filtered into a selection vector of row offsets.
+
+    With LAZY_DECOMPRESSION the loaded chunk stays compressed and only the
+    vectors that are needed get decoded. A range predicate on a BITPACK
+    chunk is evaluated on the packed offsets first, so vectors without a
+    qualifying row are never decoded at all.
+
+    Predicates on STRING columns are translated once per segment into
+    predicates on dictionary codes (stringPredicate), after which they run
+    exactly like integer predicates, zone maps included. Segments without
+    a dictionary (StringLayout::HEAP) are scanned with a StringPredicate
+    instead, which is checked against the stringKey() zone maps and then
+    evaluated on the stored, usually compressed strings of each vector;
+    only vectors with a match get their strings expanded.
+
+    On a sorted segment (ColumnSegmentReader::isSorted()) a predicate with
+    a range form needs neither zone maps nor comparisons: two binary
+    searches, over the chunk zone maps and then within one chunk each,
+    find the first and last qualifying row, and the scan goes straight to
+    the first one and stops after the last. mergeJoinSegments() walks two
+    sorted segments side by side the same way, skipping chunks that fall
+    entirely below the other side's current value.
+
+    An EQ predicate also probes the Bloom filter of every chunk that has
+    one and passes its zone map (column_segment.h), which rules out
+    nearly every chunk of a high-cardinality column that does not hold
+    the value before any of its data is read.
+
+    Predicates never test values for null one at a time: they compare
+    every value of a vector and mask the result with its validity bitmap
+    (validity.h). Chunks without nulls have no bitmap and skip the mask.
+
+    Aggregates read RLE chunks as runs and fold each run in one step
+    (value x length), so sorted and low-cardinality columns aggregate
+    without ever being expanded.
+
+    filterSegment() collects the qualifying rows of a whole segment as a
+    RoaringBitmap of row offsets, so the results of predicates on several
+    columns of a row group combine with roaringAnd() and roaringOr().
+
+    Position lists serve late materialization (TableSelect): ascending
+    row offsets that earlier filters let through. filterPositions() tests
+    another predicate on those rows only, and fetchPositions() reads the
+    values of a projected column at them. Both load just the chunks that
+    hold a position, and with LAZY_DECOMPRESSION decode just the vectors
+    that do; filterPositions() also drops the positions of a chunk whole
+    when its zone map or Bloom filter rules the predicate out.
+
+*/
+
+/* Comparison operators, nulls never match */
+enum class CompareOp {
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+    BETWEEN,        // lo <= v <= hi
+    PREFIX          // v starts with lo, strings only
+};
+
+struct ColumnPredicate {
+    CompareOp op;
+    int64_t lo;     // Operand of every op, lower bound of BETWEEN
+    int64_t hi;     // Upper bound of BETWEEN
+
+    bool matches(int64_t val) const;
+    bool mayMatch(const ZoneMap& zone) const;
+    bool toRange(int64_t& rangeLo, int64_t& rangeHi) const;
+};
+
+/* Predicate on the strings of STRING_HEAP chunks */
+struct StringPredicate {
+    CompareOp op;
+    std::string lo;
+    std::string hi;
+
+    bool matches(const std::string& val) const;
+    bool mayMatch(const ZoneMap& zone) const;
+};
+
+typedef std::vector<uint32_t> sel_vec_t;    // Selected offsets within a chunk
+typedef std::vector<uint32_t> pos_list_t;   // Ascending row offsets within a segment
+
+/* Chunk fetchPositions() loaded last, kept for the next call on the same segment */
+struct FetchCursor {
+    size_t chunkIdx = 0;
+    std::shared_ptr<const ChunkFrame> frame;    // Null until a chunk is loaded
+};
+
+class ColumnScan {
+
+public:
+
+    ColumnScan(ColumnSegmentReader& segment, const ColumnPredicate* pred = nullptr);
+    ColumnScan(ColumnSegmentReader& segment, const StringPredicate* strPred);
+
+    ColumnStatus next(ColumnVector& out, sel_vec_t& sel, uint64_t& firstRow);
+
+    size_t getChunksRead() const { return nRead; }
+    size_t getChunksSkipped() const { return nSkipped; }
+    size_t getVectorsDecoded() const { return nDecoded; }
+    size_t getVectorsSkipped() const { return nVecSkipped; }
+    size_t getBloomSkipped() const { return nBloomSkipped; }
+    bool isRanged() const { return ranged; }
+
+private:
+
+    ColumnSegmentReader& segment;
+    const ColumnPredicate* pred;    // Null when every row qualifies
+    const StringPredicate* strPred; // Same, for STRING_HEAP chunks
+    bool ranged;                    // Qualifying rows are [rangeBegin, rangeEnd) of a sorted segment
+    bool rangeFound;                // Range searched for yet
+    uint64_t rangeBegin;
+    uint64_t rangeEnd;
+    bool probe;                     // EQ predicate, chunks with a Bloom filter are probed for `probeHash`
+    uint64_t probeHash;
+    size_t chunkIdx;                // Next chunk to consider
+    size_t frameIdx;                // Chunk held in `frame`
+    size_t vecIdx;                  // Next vector of that chunk
+    std::shared_ptr<const ChunkFrame> frame;
+    bitset<uint64_t> matches;       // Rows of a vector passing the packed filter
+    StringHeapView strings;         // Strings of `frame`, STRING_HEAP chunks with `strPred` only
+    std::string packed;             // `strPred` operand in the form stored in `frame`
+    size_t nRead;
+    size_t nSkipped;
+    size_t nDecoded;
+    size_t nVecSkipped;
+    size_t nBloomSkipped;           // Chunks among nSkipped ruled out by their Bloom filter
+
+    ColumnStatus scanVector(size_t vec, ColumnVector& out, sel_vec_t& sel);
+    ColumnStatus scanStrings(size_t vec, ColumnVector& out, sel_vec_t& sel);
+    ColumnStatus scanRange(size_t vec, ColumnVector& out, sel_vec_t& sel);
+
+};
+
+void filterVector(const ColumnVector& vec, const ColumnPredicate& pred, sel_vec_t& sel);
+
+ColumnPredicate stringPredicate(const std::vector<std::string>& dict, CompareOp op,
+                                const std::string& lo, const std::string& hi = std::string());
+void countGroups(const ColumnVector& vec, const sel_vec_t& sel, std::vector<uint64_t>& counts);
+
+ColumnStatus aggregateSegment(ColumnSegmentReader& segment, const ColumnPredicate* pred,
+                              ColumnAggregate& agg);
+ColumnStatus groupCountSegment(ColumnSegmentReader& segment, const ColumnPredicate* pred,
+                               std::unordered_map<int64_t, uint64_t>& counts);
+ColumnStatus filterSegment(ColumnSegmentReader& segment, const ColumnPredicate* pred, RoaringBitmap& rows);
+ColumnStatus filterSegment(ColumnSegmentReader& segment, const StringPredicate* pred, RoaringBitmap& rows);
+ColumnStatus filterPositions(ColumnSegmentReader& segment, const ColumnPredicate* pred, pos_list_t& positions);
+ColumnStatus filterPositions(ColumnSegmentReader& segment, const StringPredicate* pred, pos_list_t& positions);
+ColumnStatus fetchPositions(ColumnSegmentReader& segment, const uint32_t* positions, size_t count,
+                            ColumnVector& out, FetchCursor& cursor);
+
+ColumnStatus findSortedRange(ColumnSegmentReader& segment, int64_t lo, int64_t hi, uint64_t& begin, uint64_t& end);
+ColumnStatus mergeJoinSegments(ColumnSegmentReader& left, ColumnSegmentReader& right,
+                               std::vector<std::pair<uint64_t, uint64_t>>& pairs);
+
+#endif
\ No newline at end of file
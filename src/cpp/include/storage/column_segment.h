@@ -0,0 +1,206 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_COLUMN_SEGMENT_H
+#define HERACLES_COLUMN_SEGMENT_H
+
+#include "bloom.h"
+#include "chunk_pool.h"
+#include "codec.h"
+#include "column.h"
+#include "column_stats.h"
+#include "decoded_cache.h"
+#include "dictionary.h"
+#include "encoding.h"
+#include "string_heap.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+/*
+
+    Writer and reader for column segment files (layout in column.h).
+
+    The writer buffers one chunk of values, writes it out once it holds
+    COLUMN_CHUNK_SIZE values and appends the footers on finish(). The file
+    is written under a temporary name and only renamed into place when it
+    is complete, so a reader never sees a partial segment.
+
+    Every chunk is encoded on its own (see encoding.h), with the encoding
+    picked from a sample of the chunk's values. A codec set on the writer
+    (see codec.h) then compresses the encoded values of each chunk.
+
+    STRING segments are the exception to streaming: codes are held until
+    finish() because the dictionary, and with it the final code of every
+    value, is only known once the last string has been added. That is
+    also when the writer sees how many of the strings are distinct, and
+    past STRING_HEAP_THRESHOLD percent it writes STRING_HEAP chunks and no
+    dictionary. Those chunks are never run through the codec, their
+    symbol table is their compression and the scan compares on it.
+
+    setChunkSize() makes chunks smaller than COLUMN_CHUNK_SIZE, which is
+    how the segments that go into a column group file (column_group.h)
+    are written. A reader given the offset a column's segment ends at in
+    such a file reads it like any other segment.
+
+    The writer notices on its own whether the values arrive in order
+    (nulls first, then never decreasing) and marks the segment sorted.
+
+    With setBloomFilter() every chunk also gets a Bloom filter over its
+    distinct non-null values (dictionary codes, or the strings themselves
+    in STRING_HEAP chunks), sized on the number of distinct values, so a
+    chunk of a few repeated values gets a single block. probeBloom()
+    reads just the block a key falls in.
+
+    Unless COLUMN_STATS_ENABLED is 0, every value appended also goes into
+    the segment's statistics (column_stats.h), written out by finish()
+    and read back with readStats().
+
+    A reader can be given a ChunkPool, through which chunks are then
+    loaded and cached (compressed or decoded, see chunk_pool.h). Vectors
+    are read out of a loaded frame one at a time with readVector().
+    STRING_HEAP chunks always stay in their stored form in the frame, and
+    readVector() fills in the strings of just the vector asked for.
+
+    openDefault() opens a segment that has no file: every row holds one
+    value, or is null. The table reads a column added after a row group
+    was written this way (table.h), the chunks being made up on load.
+
+    A reader given a DecodedCache as well looks a chunk up there first;
+    on a miss it loads the chunk as above, decodes all of it, times the
+    decoding and hands the decoded frame to the cache (decoded_cache.h).
+    STRING_HEAP chunks are never cached decoded.
+
+*/
+
+class ColumnSegmentWriter {
+
+public:
+
+    ColumnSegmentWriter(const std::string& path, col_id_t colId, ColumnType type);
+    ~ColumnSegmentWriter();
+
+    ColumnStatus open();
+    ColumnStatus setCodec(ColumnCodec codec);
+    ColumnStatus setBloomFilter(size_t bitsPerKey);
+    ColumnStatus setChunkSize(size_t nValues);
+    ColumnStatus append(int64_t val);
+    ColumnStatus append(const std::string& val);
+    ColumnStatus appendNull();
+    ColumnStatus finish();
+
+    uint64_t getNumRows() const { return nRows; }
+    const ColumnStats& getStats() const { return stats; }
+
+private:
+
+    std::string path;               // Final segment path
+    col_id_t colId;
+    ColumnType type;
+    os_fd_t fd;                     // Temporary file being written
+    int64_t writeOfst;              // Offset of the next chunk
+    uint64_t nRows;                 // Rows appended so far
+    ColumnVector chunk;             // Values of the chunk being built
+    size_t chunkSize;               // Values per chunk
+    uint32_t nullCount;             // Nulls in `chunk`
+    std::vector<ChunkFooter> chunks;
+    DictionaryBuilder dict;         // STRING only
+    std::vector<uint32_t> codes;    // Provisional codes of the whole segment, STRING only
+    StringLayout stringLayout;
+    std::vector<const std::string*> heapChunk;  // Strings of `chunk` (null for nulls), HEAP only
+    uint8_t valueWidth;             // Bytes per stored value
+    ColumnCodec codec;              // Compression of the encoded values
+    size_t bloomBits;               // Bloom filter bits per distinct value, 0 for no filters
+    bool inOrder;                   // No value so far was smaller than the one before, or came after a null
+    bool hasValue;                  // Some non-null value has been appended
+    int64_t lastVal;                // Last value appended, not STRING
+    std::string lastStr;            // Last string appended, STRING only
+    ColumnStats stats;
+
+    std::string tmpPath() const { return path + ".tmp"; }
+    ColumnStatus addValue(int64_t val);
+    ColumnStatus addNull();
+    ColumnStatus flushChunk();
+    ColumnStatus writeBloom(ChunkFooter& cf);
+
+};
+
+class ColumnSegmentReader {
+
+public:
+
+    ColumnSegmentReader(const std::string& path, uint64_t segmentEnd = 0);
+    ~ColumnSegmentReader();
+
+    ColumnStatus open();
+    ColumnStatus openDefault(col_id_t colId, ColumnType type, uint64_t nRows, bool isNull, int64_t val,
+                             const std::string& str);
+    void setPool(ChunkPool* chunkPool) { pool = chunkPool; }     // Pool must outlive the reader
+    void setDecodedCache(DecodedCache* decodedCache) { cache = decodedCache; }    // Cache must outlive the reader
+
+    col_id_t getColId() const { return footer.colId; }
+    ColumnType getType() const { return static_cast<ColumnType>(footer.type); }
+    uint64_t getNumRows() const { return footer.nRows; }
+    size_t getNumChunks() const { return chunks.size(); }
+    const ChunkFooter& getChunk(size_t idx) const { return chunks[idx]; }
+    uint64_t getFirstRow(size_t idx) const { return firstRows[idx]; }
+    const std::vector<std::string>& getDictionary() const { return dictionary; }
+    StringLayout getStringLayout() const { return static_cast<StringLayout>(footer.stringLayout); }
+    bool isSorted() const { return footer.sorted != 0; }
+    bool hasBloomFilter(size_t idx) const { return chunks[idx].bloomBlocks > 0; }
+    bool hasStats() const { return footer.statsSize > 0 || isDefault; }
+    bool isDefaulted() const { return isDefault; }
+    uint64_t getBytesRead() const { return bytesRead; }
+
+    ColumnStatus readChunkData(size_t idx, std::vector<char>& data);
+    ColumnStatus loadChunk(size_t idx, std::shared_ptr<const ChunkFrame>& frame);
+    ColumnStatus readVector(size_t idx, const ChunkFrame& frame, size_t vec, ColumnVector& out) const;
+    ColumnStatus readChunk(size_t idx, ColumnVector& out);
+    ColumnStatus readRuns(size_t idx, std::vector<ColumnRun>& runs, bitset<uint64_t>& validity);
+    ColumnStatus openStrings(size_t idx, const ChunkFrame& frame, StringHeapView& view) const;
+    ColumnStatus probeBloom(size_t idx, uint64_t hash, bool& maybe) const;
+    ColumnStatus readStats(ColumnStats& stats) const;
+
+private:
+
+    std::string path;
+    uint64_t segmentEnd;            // File offset just past the segment footer, 0 for the end of the file
+    os_fd_t fd;
+    uint64_t segId;                 // Key of this segment's frames in the pool
+    ChunkPool* pool;                // Null when chunks are not cached
+    DecodedCache* cache;            // Null when decoded chunks are not cached
+    SegmentFooter footer;
+    std::vector<ChunkFooter> chunks;
+    std::vector<uint64_t> firstRows;    // Row number of each chunk's first value
+    std::vector<std::string> dictionary;    // Sorted distinct values, STRING only
+    std::atomic<uint64_t> bytesRead;        // Chunk bytes read from the file, pool hits excluded
+    bool isDefault;                 // No file, every row holds `defaultVal` (see openDefault())
+    bool defaultNull;               // ... or is null
+    int64_t defaultVal;             // Dictionary code 0 for STRING
+
+    ColumnStatus loadStored(size_t idx, std::shared_ptr<const ChunkFrame>& frame);
+    ColumnStatus loadDefault(size_t idx, std::shared_ptr<const ChunkFrame>& frame) const;
+    ColumnStatus decodeValidity(const ChunkFooter& cf, const char* data, bitset<uint64_t>& validity) const;
+
+};
+
+ColumnStatus readSegmentFooters(os_fd_t fd, uint64_t segmentEnd, SegmentFooter& footer,
+                                std::vector<ChunkFooter>& chunks);
+
+#endif
\ No newline at end of file
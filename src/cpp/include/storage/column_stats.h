@@ -0,0 +1,201 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_COLUMN_STATS_H
+#define HERACLES_COLUMN_STATS_H
+
+#include "column.h"
+
+#include <string>
+#include <vector>
+
+/*
+
+    Column statistics for costing: how many distinct values a column has,
+    how its values are distributed and which of them are most common.
+    The segment writer feeds every value it appends into a ColumnStats and
+    stores the result with the segment (column_segment.h), so statistics
+    cost no extra pass over the data, and the statistics of any number of
+    segments merge into those of the whole column (Table::getColumnStats).
+
+        HyperLogLog         Distinct count: 2^STATS_HLL_BITS registers
+                            holding the longest run of leading zeros seen
+                            among the hashes that map to each; merged by
+                            taking the larger register, about 1.6% error
+        EquiDepthHistogram  Buckets of about equal row counts, cut from a
+                            reservoir sample of the values; merged through
+                            the sum of both cumulative distributions
+        HeavyHitters        Most common values (Misra-Gries): a bounded
+                            set of counters that are all cut down when it
+                            overflows; merged by adding the counters. A
+                            count is low by at most getError() rows
+
+    STRING columns are hashed (bloomHash()) for the distinct count and the
+    common values, which keep the strings themselves, and go into the
+    histogram, min and max as stringKey()s, their first 8 bytes in order.
+
+    Sketches only grow: deleting a row does not take it out again, so a
+    table's statistics describe every row it has held since the group was
+    last rewritten.
+
+*/
+
+#define  STATS_HLL_BITS         12        // 4096 registers
+#define  STATS_SAMPLE_SIZE      4096      // Values kept for the histogram of one segment
+#define  STATS_HEAVY_COUNTERS   (4 * STATS_COMMON_VALUES)   // Counters kept after a cut
+#define  STATS_HEAVY_LIMIT      (4 * STATS_HEAVY_COUNTERS)  // Counters that make for a cut
+#define  STATS_SMALL_COUNTS     64        // Counts below this are tallied directly when cutting counters
+#define  STATS_MAGIC            0x54415453  // "STAT"
+
+class HyperLogLog {
+
+public:
+
+    HyperLogLog() : registers(1 << STATS_HLL_BITS, 0) {}
+
+    void add(uint64_t hash);
+    void merge(const HyperLogLog& other);
+    uint64_t estimate() const;
+
+    const std::vector<uint8_t>& getRegisters() const { return registers; }
+    bool setRegisters(const uint8_t* data, size_t size);
+
+private:
+
+    std::vector<uint8_t> registers;
+
+};
+
+/* Rows in [previous upper + 1, upper], the first bucket starts at `lower` */
+struct HistogramBucket {
+    int64_t upper;
+    uint64_t count;
+};
+
+class EquiDepthHistogram {
+
+public:
+
+    void build(std::vector<int64_t>& sample, uint64_t nValues, int64_t minVal, int64_t maxVal, size_t nBuckets);
+    void merge(const EquiDepthHistogram& other, size_t nBuckets);
+
+    bool empty() const { return buckets.empty(); }
+    uint64_t getTotal() const;
+    int64_t getLower() const { return lower; }
+    const std::vector<HistogramBucket>& getBuckets() const { return buckets; }
+    void setBuckets(int64_t newLower, std::vector<HistogramBucket> newBuckets);
+
+    double estimateLessEqual(int64_t val) const;
+    double estimateRange(int64_t lo, int64_t hi) const;
+
+private:
+
+    int64_t lower = 0;
+    std::vector<HistogramBucket> buckets;   // Uppers strictly increasing
+
+};
+
+struct CommonValue {
+    int64_t key;                    // The value, or bloomHash() of `str` for STRING columns
+    uint64_t count;                 // Lower bound, at most getError() short of the true count
+    std::string str;
+};
+
+class HeavyHitters {
+
+public:
+
+    HeavyHitters();
+
+    void add(int64_t key, const std::string* str, uint64_t count = 1);
+    void add(const CommonValue& val);
+    void merge(const HeavyHitters& other);
+
+    bool find(int64_t key, uint64_t& count) const;
+    std::vector<CommonValue> top(size_t k) const;
+    size_t size() const { return nCounters; }
+    uint64_t getTracked() const;    // Sum of the counters
+    uint64_t getError() const { return error; }
+    void setError(uint64_t newError) { error = newError; }
+
+private:
+
+    std::vector<int64_t> keys;      // Open addressing on bloomHash() of the key
+    std::vector<uint64_t> counts;   // 0 when the slot is free
+    std::vector<std::string> strs;  // Empty unless strings were added
+    size_t nCounters;
+    uint64_t error;                 // Total cut from every counter so far
+
+    size_t slotOf(int64_t key) const;
+    void prune(size_t keep);
+
+};
+
+class ColumnStats {
+
+public:
+
+    ColumnStats(ColumnType type = ColumnType::INT64);
+
+    void add(int64_t val, uint64_t count = 1);
+    void add(const std::string& val, uint64_t count = 1);
+    void addNull(uint64_t count = 1);
+    void merge(const ColumnStats& other);
+
+    ColumnType getType() const { return type; }
+    uint64_t getNumRows() const { return nRows; }
+    uint64_t getNumNulls() const { return nNulls; }
+    int64_t getMin() const { return minVal; }       // Meaningless while every row is null
+    int64_t getMax() const { return maxVal; }
+    uint64_t getDistinct() const;
+    EquiDepthHistogram getHistogram() const;
+    std::vector<CommonValue> getCommonValues() const { return common.top(STATS_COMMON_VALUES); }
+    uint64_t getCommonError() const { return common.getError(); }
+
+    /* Estimated rows equal to a value, or in a range of values (stringKey()s for STRING) */
+    double estimateEqual(int64_t val) const;
+    double estimateEqual(const std::string& val) const;
+    double estimateRange(int64_t lo, int64_t hi) const;
+
+    void serialize(std::vector<char>& out) const;
+    ColumnStatus deserialize(const char* data, size_t size);
+
+private:
+
+    ColumnType type;
+    uint64_t nRows;
+    uint64_t nNulls;
+    int64_t minVal;
+    int64_t maxVal;
+    HyperLogLog distinct;
+    EquiDepthHistogram histogram;   // Values up to the last merge()
+    HeavyHitters common;
+    std::vector<int64_t> sample;    // Reservoir of the values added since
+    uint64_t nPending;              // Non-null values added since
+    uint64_t nextSample;            // Value of those that goes into the reservoir next
+    double sampleWeight;            // Largest random weight among the values in the reservoir
+    uint64_t rng;                   // Xorshift state of the reservoir
+
+    void addKey(int64_t key, uint64_t hash, const std::string* str, uint64_t count);
+    double nextRandom();
+    void resetSample();
+    double estimateKey(int64_t key) const;
+
+};
+
+#endif
\ No newline at end of file
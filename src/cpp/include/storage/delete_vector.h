@@ -0,0 +1,69 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_DELETE_VECTOR_H
+#define HERACLES_DELETE_VECTOR_H
+
+#include "column_scan.h"
+#include "roaring.h"
+
+#include <string>
+
+/*
+
+    Delete vector of a row group: the offsets of its deleted rows, in a
+    RoaringBitmap (roaring.h), so a group with a handful of deletes costs a
+    few bytes rather than a bit per row. Segments are never rewritten for a
+    delete; the tuple mover adds to a copy of the vector and publishes it
+    with the next table version, so a vector is never changed once a scan
+    can see it.
+
+        Offset      0 1 2 3 4 5 6 7 ...
+        Deleted     0 0 1 0 0 0 1 0 ...     stored as { 2, 6 }
+
+    Scans cut the window of each vector of COLUMN_VECTOR_SIZE rows into
+    plain words (getWords) and apply it to their selection vectors with
+    maskDeleted(). Vectors with no deleted row skip the mask altogether.
+
+    On disk a vector is a small file next to the group's segments,
+    written under a new name whenever it changes (see table.h).
+
+*/
+
+struct DeleteVector {
+    RoaringBitmap rows;             // Offsets of the deleted rows
+
+    bool isDeleted(uint64_t offset) const { return rows.contains(static_cast<uint32_t>(offset)); }
+    void markDeleted(uint64_t offset) { rows.add(static_cast<uint32_t>(offset)); }
+    uint64_t getNumDeleted() const { return rows.cardinality(); }
+
+    /* Bits of rows firstRow .. firstRow + count - 1, false if none is deleted */
+    bool getWords(uint64_t firstRow, size_t count, uint64_t* words) const {
+        return rows.getWords(static_cast<uint32_t>(firstRow), count, words);
+    }
+};
+
+ColumnStatus writeDeleteVector(const std::string& path, const DeleteVector& deletes);
+ColumnStatus readDeleteVector(const std::string& path, uint64_t nRows, DeleteVector& deletes);
+
+/* Drop the offsets of `sel` (all below `count`) whose bit is set in `deleted` */
+void maskDeleted(const uint64_t* deleted, size_t count, sel_vec_t& sel);
+
+const char* deleteMaskKernelName();
+
+#endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_DELTA_STORE_H
+#define HERACLES_DELTA_STORE_H
+
+#include "column.h"
+
+#include <map>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+/*
+
+    Write-optimized, row-wise store for the changes to a table that have
+    not been moved into column segments yet.
+
+        Rows        row id -> one FieldValue per column, in row id order
+        Deletes     row ids deleted while this store was active, wherever
+                    the row lives (a segment, an older store or this one)
+
+    A table has one active store taking every insert and delete. The tuple
+    mover freezes it, after which it is only read, and eventually folds it
+    into a new row group (see table.h). Row ids are handed out in order, so
+    the rows of a store always cover a contiguous id range.
+
+*/
+
+/* A single field of a row, STRING columns use `strVal` */
+struct FieldValue {
+    bool isNull = true;
+    int64_t intVal = 0;
+    std::string strVal;
+
+    static FieldValue null() { return FieldValue(); }
+    static FieldValue of(int64_t val) { FieldValue f; f.isNull = false; f.intVal = val; return f; }
+    static FieldValue of(const std::string& val) { FieldValue f; f.isNull = false; f.strVal = val; return f; }
+};
+
+typedef std::vector<FieldValue> table_row_t;
+
+class DeltaStore {
+
+public:
+
+    void insert(uint64_t rowId, table_row_t row);
+    void remove(uint64_t rowId);
+
+    bool hasRow(uint64_t rowId) const;
+    bool isDeleted(uint64_t rowId) const;
+    size_t getNumRows() const;
+    size_t getNumDeletes() const;
+
+    void getColumn(size_t col, std::vector<uint64_t>& rowIds, std::vector<FieldValue>& values) const;
+    void getRows(std::vector<uint64_t>& rowIds, std::vector<table_row_t>& rows) const;
+    void getDeletes(std::vector<uint64_t>& rowIds) const;
+
+private:
+
+    mutable std::shared_mutex latch;    // Shared for readers, exclusive for changes
+    std::map<uint64_t, table_row_t> rows;
+    std::set<uint64_t> deletes;
+
+};
+
+#endif
\ No newline at end of file
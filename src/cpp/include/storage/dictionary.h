@@ -0,0 +1,69 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_DICTIONARY_H
+#define HERACLES_DICTIONARY_H
+
+#include "column.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/*
+
+    Segment dictionaries for string columns.
+
+    While a segment is ingested every string gets a provisional code in
+    arrival order from a hash table. When the segment is finished the
+    distinct values are sorted and the provisional codes remapped, so the
+    stored codes are order-preserving:
+
+        Ingest        "b" "a" "c" "a"   ->  provisional 0 1 2 1
+        Dictionary    [ "a", "b", "c" ] ->  remap 0->1, 1->0, 2->2
+        Stored codes                    ->  1 0 2 0
+
+    On disk the dictionary is (nEntries + 1) uint32_t end offsets followed
+    by the concatenated string bytes.
+
+*/
+
+class DictionaryBuilder {
+
+public:
+
+    DictionaryBuilder() = default;
+
+    uint32_t add(const std::string& val);
+    size_t size() const { return values.size(); }
+    const std::string& get(uint32_t code) const { return *values[code]; }
+    void finish(std::vector<std::string>& sorted, std::vector<uint32_t>& remap) const;
+
+private:
+
+    std::unordered_map<std::string, uint32_t> codes;   // Value -> provisional code
+    std::vector<const std::string*> values;             // Provisional code -> value
+
+};
+
+uint8_t dictCodeWidth(size_t nEntries);
+void dictSerialize(const std::vector<std::string>& dict, std::vector<char>& out);
+ColumnStatus dictDeserialize(const char* data, size_t size, uint32_t nEntries,
+                             std::vector<std::string>& dict);
+
+#endif
\ No newline at end of file
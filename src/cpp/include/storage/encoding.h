@@ -0,0 +1,89 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_ENCODING_H
+#define HERACLES_ENCODING_H
+
+#include "column.h"
+
+#include <vector>
+
+/*
+
+    Lightweight encodings of the value stream of a chunk. The validity
+    bitmap is kept apart, so every encoding sees a dense int64_t array
+    (null slots repeat the previous value to keep runs and deltas short).
+
+    RLE             [nRuns][value x nRuns][run end x nRuns]
+
+    DELTA           [nBlocks][block offset x nBlocks] then per block of
+                    COLUMN_VECTOR_SIZE values:
+                    [base][width][zigzag(v[i] - v[i-1]) x (count - 1)]
+
+    DELTA_OF_DELTA  Same block table, then per block:
+                    [base][first delta][width][zigzag(d[i] - d[i-1]) x (count - 2)]
+
+    BITPACK         Same block table, then per block:
+                    [reference][width][pad x 7][packed v[i] - reference]
+
+    Deltas are stored in 1, 2, 4 or 8 bytes, the narrowest that fits the
+    block. BITPACK offsets use exactly as many bits as the block range
+    needs (up to 32) in the SIMD-friendly layout of bitpack.h, and range
+    predicates run on them without unpacking (filterBitpacked). Blocks
+    start from an absolute value, so any block decodes on its own and
+    decodeVector() can pull a single vector out of a chunk.
+
+    The writer picks an encoding per chunk from ENCODING_SAMPLE_SIZE
+    sampled values: runs favour RLE, steady increments (sorted keys) favour
+    DELTA, evenly spaced timestamps favour DELTA_OF_DELTA and values
+    confined to a narrow range favour BITPACK.
+
+*/
+
+/* A run of identical values */
+struct ColumnRun {
+    int64_t value;
+    uint32_t length;
+};
+
+/* Estimates from a sample of a chunk */
+struct EncodingStats {
+    size_t nSampled = 0;
+    size_t nChanges = 0;        // Value changes within the sampled windows
+    uint8_t deltaWidth = 1;     // Bytes needed by the widest sampled delta
+    uint8_t dodWidth = 1;       // Bytes needed by the widest sampled delta change
+    uint8_t rangeBits = 64;     // Bits needed by max - min over the whole chunk
+};
+
+EncodingStats sampleEncodingStats(const std::vector<int64_t>& values);
+ColumnEncoding chooseEncoding(const EncodingStats& stats, size_t nValues, ColumnType type,
+                              uint8_t codeWidth);
+
+void encodeValues(ColumnEncoding enc, uint8_t width, const std::vector<int64_t>& values,
+                  std::vector<char>& out);
+ColumnStatus decodeValues(ColumnEncoding enc, uint8_t width, const char* data, size_t size,
+                          size_t nValues, std::vector<int64_t>& out);
+ColumnStatus decodeVector(ColumnEncoding enc, uint8_t width, const char* data, size_t size,
+                          size_t nValues, size_t vec, std::vector<int64_t>& out);
+ColumnStatus decodeRuns(const char* data, size_t size, size_t nValues, std::vector<ColumnRun>& runs);
+ColumnStatus filterBitpacked(const char* data, size_t size, size_t nValues, int64_t lo, int64_t hi,
+                             bitset<uint64_t>& matches);
+ColumnStatus filterBitpackedVector(const char* data, size_t size, size_t nValues, size_t vec,
+                                   int64_t lo, int64_t hi, uint64_t* matches);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,133 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_STRING_HEAP_H
+#define HERACLES_STRING_HEAP_H
+
+#include "column.h"
+
+#include <string>
+#include <vector>
+
+/*
+
+    STRING_HEAP chunks: the strings themselves rather than dictionary
+    codes, for columns with too many distinct values for a dictionary to
+    pay off (URLs, log messages).
+
+        | StringHeapHeader | symbol table | end offsets (count x uint32_t) | heap |
+
+    String i is heap[end[i - 1] .. end[i]), nulls are empty strings. The
+    heap is either the raw bytes or, when that is smaller, the strings
+    compressed with a symbol table in the style of FSST: up to 255
+    symbols of 1 to 8 bytes, each replaced by a one byte code, and code
+    255 escaping a literal byte.
+
+        "http://www.example.com/a"   ->   [http://w][ww.][example][.com/][a]
+                                          5 codes in place of 24 bytes
+
+    Every string is compressed on its own with the chunk's table, so
+    string i can be read without touching the others, and the table is
+    trained on a sample of the chunk (a few rounds of counting which
+    symbols and symbol pairs the current table produces, keeping those
+    that save the most bytes).
+
+    Comparisons run on the stored form:
+
+        equals()        Compression is deterministic for a given table, so
+                        equal strings have equal codes: the operand is
+                        compressed once (pack()) and compared as bytes
+        startsWith()    Expands symbols only until the prefix is covered
+                        or a byte differs
+        compare()       Same, stopping at the first differing byte
+
+    Zone maps of STRING_HEAP chunks hold stringKey() of the smallest and
+    largest string, its first 8 bytes as an order-preserving integer.
+
+*/
+
+#define  STRING_SYMBOL_MAX      255       // Codes 0 .. 254, 255 escapes a literal byte
+#define  STRING_SYMBOL_LEN      8         // Longest symbol
+#define  STRING_SAMPLE_BYTES    16384     // String bytes sampled to train a table
+
+class SymbolTable {
+
+public:
+
+    SymbolTable() : nSymbols(0) {}
+
+    void build(const std::vector<const std::string*>& sample);
+    size_t size() const { return nSymbols; }
+
+    void compress(const char* in, size_t len, std::string& out) const;
+    size_t decompress(const uint8_t* in, size_t len, char* out) const;
+
+    void serialize(std::vector<char>& out) const;
+    bool deserialize(const char* data, size_t size);
+
+    /* Bytes and length of a code's symbol */
+    const char* symbol(uint8_t code) const { return reinterpret_cast<const char*>(&symbols[code]); }
+    uint8_t length(uint8_t code) const { return lengths[code]; }
+
+private:
+
+    size_t nSymbols;
+    uint64_t symbols[STRING_SYMBOL_MAX];    // Symbol bytes, zero padded
+    uint8_t lengths[STRING_SYMBOL_MAX];
+    uint8_t order[STRING_SYMBOL_MAX];       // Codes by first byte, longest first
+    uint16_t firstIdx[257];                 // Start of each first byte's codes in `order`
+
+    void index();
+    int match(const char* in, size_t len) const;
+
+};
+
+class StringHeapView {
+
+public:
+
+    ColumnStatus open(const char* data, size_t size, size_t count);
+
+    size_t size() const { return count; }
+    bool isCompressed() const { return table.size() > 0; }
+
+    void get(size_t i, std::string& out) const;
+    void read(size_t begin, size_t n, std::vector<std::string>& out) const;
+
+    void pack(const std::string& val, std::string& out) const;
+    bool equals(size_t i, const std::string& packed) const;
+    bool startsWith(size_t i, const std::string& prefix) const;
+    int compare(size_t i, const std::string& val) const;
+
+private:
+
+    size_t count;
+    const char* ends;               // Unaligned uint32_t end offsets
+    const uint8_t* heap;
+    uint32_t heapSize;
+    SymbolTable table;
+
+    uint32_t begin(size_t i) const { return i == 0 ? 0 : end(i - 1); }
+    uint32_t end(size_t i) const;
+
+};
+
+int64_t stringKey(const char* data, size_t len);
+ColumnStatus encodeStrings(const std::vector<const std::string*>& vals, bool compress, std::vector<char>& out);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,360 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_TABLE_H
+#define HERACLES_TABLE_H
+
+#include "bulk_load.h"
+#include "column_stats.h"
+#include "delete_vector.h"
+#include "delta_store.h"
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+
+    A columnar table: read-optimized row groups plus write-optimized
+    delta stores.
+
+        Version     | Row group 0 | Row group 1 | ... | Frozen delta | Active delta |
+                      rows 0..n-1   rows n..m-1         being moved    takes writes
+
+    Every row has a row id, handed out in insert order. A row group holds
+    one column segment per column over a contiguous id range, plus a delete
+    vector (delete_vector.h). Inserts go to the active delta store, and a
+    delete only records the row id there, so nothing is ever updated in
+    place; an update is a delete plus an insert under a new row id.
+
+    The tuple mover (moveTuples(), run periodically by a background thread
+    once the active store holds DELTA_MOVE_THRESHOLD rows) works in three
+    steps:
+
+        1. Freeze: the active store becomes the frozen store, and a new
+           empty store takes the writes
+        2. Write a new row group from the frozen rows, with no locks held
+        3. Publish a version with the new group, the frozen deletes set in
+           the delete vectors of their groups and no frozen store
+
+    Between steps 2 and 3, every group with at least COMPACTION_THRESHOLD
+    percent of its rows deleted is rewritten without them. The row ids of
+    a compacted group are no longer contiguous, so they are kept in one
+    more segment (g<no>_ids.seg) and in memory.
+
+    A version is immutable and shared by pointer. Scans pin the version
+    they start on, so the mover never waits for readers and readers never
+    wait for the mover; the table latch is only held to swap pointers.
+
+    A table may declare a sort key, a list of columns (TableColumn::
+    sortKey gives each one's position in it). The mover then writes every
+    group sorted on that key, nulls first, so the segments of the leading
+    key column come out sorted and scans on it turn range predicates into
+    binary searches (column_scan.h). The later key columns only break ties.
+    Row order in such a group no longer follows row ids, so its ids are
+    kept in an ids segment like those of a compacted group.
+
+    Storage is columnar unless the schema puts columns into groups
+    (TableColumn::columnGroup): the columns of one group are then written
+    into a single PAX file per row group (g<no>_p<group>.seg, see
+    column_group.h), pages of a few thousand rows holding a minipage of
+    each. That suits columns that queries mostly read together, say the
+    payload columns TableSelect fetches for the rows a filter kept, while
+    columns that are scanned on their own do better in segments of their
+    own. The choice is the schema's, per table and per column, and a
+    table must be opened with the grouping it was written with.
+
+    bulkLoad() skips the delta store: a CSV file is parsed and written as
+    row groups on every core at once (bulk_load.h), and the groups are
+    published by a move like any other.
+
+    Columns are added and dropped without touching the data. A column's
+    files are named by its id (TableColumn::colId), not its position, and
+    a column added when the next group to be written is number N lives
+    in groups N and up only: the groups before it read it as its default
+    value, through segments with no file that make up their chunks on
+    load (ColumnSegmentReader::openDefault()). A dropped column vanishes
+    from the schema, and the groups still holding its segments are marked
+    in the manifest; the mover rewrites one of them per pass, which frees
+    the dropped segments with the rest of the group's files. The manifest
+    records the id, first group and default of every column, so a table
+    must be opened with the schema of its last change (getSchema()).
+    Schema changes take the mover's latch and rewrite the rows in the
+    delta stores (which the mover bounds). Every version carries the
+    schema it was published with, and scans and getColumnStats() take
+    the columns from the version they pin, so a schema change may run
+    while scans are being opened.
+
+    getColumnStats() merges the statistics stored with every segment of a
+    column (column_stats.h) with those of its delta rows, so the optimizer
+    gets the whole column's without a scan.
+
+    Groups are recorded in a manifest file, replaced atomically after every
+    move. A changed delete vector is written to a new file (g<no>_<gen>.del)
+    before the manifest that names it, and files no manifest names any more
+    are removed once the new one is in place. Delta stores live in memory
+    only.
+
+*/
+
+/* Schema entry, the codec compresses the column's segments (codec.h) */
+struct TableColumn {
+    std::string name;
+    ColumnType type;
+    ColumnCodec codec = ColumnCodec::NONE;
+    int sortKey = -1;               // Position in the table's sort key, -1 if not part of it
+    bool bloomFilter = false;       // Give every chunk a Bloom filter for EQ lookups
+    int columnGroup = -1;           // Column group stored with, -1 for a segment of its own
+    col_id_t colId = -1;            // Names the column's files, -1 for its position in the first schema
+    FieldValue defaultValue = FieldValue::null();   // Value in the rows of groups written before the column was added
+    uint64_t firstGroupNo = 0;      // Set by the table, groups numbered below it hold `defaultValue`
+};
+
+/*
+
+    One segment per column over nRows rows, either ids firstRow .. firstRow
+    + nRows - 1 or, once compacted or sorted, the ids listed in `rowIds`.
+    A delete only replaces `deletes`, so the segments are shared with a
+    copy of the group rather than reopened.
+
+*/
+struct RowGroup {
+    uint64_t groupNo;
+    uint64_t firstRow;
+    uint64_t nRows;
+    std::shared_ptr<const std::vector<uint64_t>> rowIds;    // Id of each row, null while ids are contiguous
+    std::shared_ptr<const std::vector<uint32_t>> idOrder;   // Offsets in row id order, null while `rowIds` is sorted
+    std::vector<std::shared_ptr<ColumnSegmentReader>> columns;
+    std::shared_ptr<const DeleteVector> deletes;            // Null while no row is deleted
+    uint64_t deleteGen;             // Generation of the delete vector file, 0 if none
+    bool hasDropped;                // Still stores segments of dropped columns
+
+    uint64_t getEndRow() const {
+        return rowIds ? (idOrder ? (*rowIds)[idOrder->back()] : rowIds->back()) + 1 : firstRow + nRows;
+    }
+    uint64_t getRowId(uint64_t offset) const { return rowIds ? (*rowIds)[offset] : firstRow + offset; }
+    bool findRow(uint64_t rowId, uint64_t& offset) const;
+};
+
+/* Layout of a table at one point in time, never changed once published */
+struct TableVersion {
+    std::vector<std::shared_ptr<const RowGroup>> groups;    // In row id order
+    std::shared_ptr<DeltaStore> frozen;     // Null unless a move is under way
+    std::shared_ptr<DeltaStore> active;
+    std::shared_ptr<const std::vector<TableColumn>> schema;     // Columns of the groups and delta rows, by position
+
+    const RowGroup* findGroup(uint64_t rowId) const;
+};
+
+class Table {
+
+public:
+
+    Table(const std::string& dir, const std::vector<TableColumn>& schema, ChunkPool* pool = nullptr,
+          DecodedCache* cache = nullptr);
+    ~Table();
+
+    ColumnStatus open();
+
+    ColumnStatus insert(const table_row_t& row, uint64_t& rowId);
+    ColumnStatus remove(uint64_t rowId);
+    ColumnStatus update(uint64_t rowId, const table_row_t& row, uint64_t& newRowId);
+
+    ColumnStatus addColumn(const TableColumn& column);
+    ColumnStatus dropColumn(size_t col);
+
+    ColumnStatus moveTuples();
+    ColumnStatus bulkLoad(const std::string& csvPath, const CsvOptions& opts, uint64_t& nRows);
+    void startMover();
+    void stopMover();
+
+    std::shared_ptr<const TableVersion> getVersion();
+    ColumnStatus getColumnStats(size_t col, ColumnStats& stats);
+    std::vector<TableColumn> getSchema();
+    ChunkPool* getPool() const { return pool; }
+    DecodedCache* getDecodedCache() const { return cache; }
+
+private:
+
+    std::mutex latch;               // Mutex for concurrency
+    std::mutex moveLatch;           // One tuple mover pass at a time
+    std::string dir;
+    std::vector<TableColumn> schema;
+    std::vector<size_t> sortKey;    // Columns of the sort key, leading column first
+    std::vector<std::vector<size_t>> columnGroups;  // Columns of each column group, by group number
+    ChunkPool* pool;                // Shared by the segment readers, may be null
+    DecodedCache* cache;            // Decoded chunks shared by the segment readers, may be null
+    std::shared_ptr<const TableVersion> version;
+    uint64_t nextRowId;
+    uint64_t nextGroupNo;
+
+    std::thread mover;              // Background tuple mover
+    std::condition_variable moverCv;
+    bool moverStopping;
+
+    void indexSchema();
+    std::string segPath(uint64_t groupNo, col_id_t colId) const;
+    std::string groupPath(uint64_t groupNo, size_t columnGroup) const;
+    std::string idsPath(uint64_t groupNo) const;
+    std::string deletesPath(uint64_t groupNo, uint64_t gen) const;
+    std::string manifestPath() const;
+    bool isLive(const TableVersion& ver, uint64_t rowId) const;
+    ColumnStatus openGroup(uint64_t groupNo, uint64_t firstRow, uint64_t nRows, bool hasIds, uint64_t deleteGen,
+                           std::shared_ptr<RowGroup>& group);
+    ColumnStatus startSegment(ColumnSegmentWriter& writer, size_t col) const;
+    ColumnStatus writeIds(uint64_t groupNo, const std::vector<uint64_t>& ids) const;
+    ColumnStatus packColumnGroups(uint64_t groupNo) const;
+    ColumnStatus writeGroup(const std::vector<uint64_t>& rowIds, const std::vector<table_row_t>& rows,
+                            std::shared_ptr<RowGroup>& group);
+    ColumnStatus writeBatchGroup(uint64_t groupNo, uint64_t firstRow, const std::vector<ColumnBatch>& columns,
+                                 std::shared_ptr<RowGroup>& group);
+    ColumnStatus compactGroup(const RowGroup& group, std::shared_ptr<RowGroup>& compacted);
+    ColumnStatus writeManifest(const std::vector<TableColumn>& columns,
+                               const std::vector<std::shared_ptr<const RowGroup>>& groups);
+    void freezeActive();
+    ColumnStatus moveFrozen(const std::vector<std::shared_ptr<const RowGroup>>& loaded);
+    void removeSegments(uint64_t groupNo) const;
+    void removeGroupFiles(const RowGroup& group, bool segments);
+    void moverLoop();
+
+};
+
+/* Predicate on a table column, STRING columns compare `strVal` */
+struct TablePredicate {
+    CompareOp op;
+    FieldValue lo;
+    FieldValue hi;
+};
+
+/* A batch of one column's values, from a segment vector or from a delta store */
+struct TableBatch {
+    ColumnVector values;            // Values, or codes into `dictionary` for STRING columns
+    sel_vec_t sel;                  // Qualifying, live offsets into `values`
+    std::vector<uint64_t> rowIds;   // Row id of each entry of `sel`
+    const std::vector<std::string>* dictionary = nullptr;
+    std::shared_ptr<const ColumnSegmentReader> segment;     // Segment of the values, null for delta rows
+};
+
+/*
+
+    Scan of one column over the version current when the scan is created:
+    the row groups first, then the frozen and active delta rows. Deleted
+    rows never show up.
+
+*/
+class TableScan {
+
+public:
+
+    TableScan(Table& table, size_t col, const TablePredicate* pred = nullptr);
+
+    ColumnStatus next(TableBatch& batch);
+
+private:
+
+    std::shared_ptr<const TableVersion> version;
+    size_t col;
+    ColumnType type;
+    const TablePredicate* pred;     // Null when every row qualifies
+    std::vector<uint64_t> deleted;  // Deletes still in delta stores, sorted
+
+    size_t groupIdx;                // Next row group to open
+    std::unique_ptr<ColumnScan> scan;
+    std::shared_ptr<const RowGroup> group;
+    ColumnPredicate groupPred;
+    StringPredicate groupStrPred;   // In place of `groupPred` for STRING segments without a dictionary
+    const DeleteVector* groupDeletes;   // Null if nothing in the group is deleted
+    DeleteVector mergedDeletes;     // Group deletes plus those still in delta stores
+    bitset<uint64_t> deleteWords;   // Delete bits of the current vector
+
+    std::vector<uint64_t> deltaIds; // Delta rows of the column, in row id order
+    std::vector<FieldValue> deltaValues;
+    size_t deltaPos;
+    std::vector<std::string> deltaDict;
+    std::vector<std::string> vectorDict;    // Strings of a STRING_HEAP vector, its batch dictionary
+
+    bool isDeleted(uint64_t rowId) const;
+    void openGroup();
+    bool matches(const FieldValue& val) const;
+    ColumnStatus nextDelta(TableBatch& batch);
+
+};
+
+/* Predicate on one column of a TableSelect */
+struct TableFilter {
+    size_t col;
+    TablePredicate pred;
+};
+
+/*
+
+    Scan of several columns with late materialization. Per row group the
+    filters run first, in the order given, and narrow a position list of
+    the group's live rows: the first one scans its column (zone maps,
+    Bloom filters and sorted ranges included), every later one reads only
+    the rows still on the list (filterPositions()). The projected columns
+    are then fetched at the surviving positions alone (fetchPositions()),
+    so chunks without a qualifying row are never read for them.
+
+        filter 1    | scan ................................ |
+        filter 2    |   x   x x  x     x  x   x        x    |  positions
+        project     |       x        x            x         |  fetched
+
+    next() hands out up to COLUMN_VECTOR_SIZE rows at a time, one batch
+    per projected column, all holding the same rows in the same order,
+    dense (`sel` is 0 .. n-1). Delta rows follow the groups. Put the most
+    selective filter first.
+
+*/
+class TableSelect {
+
+public:
+
+    TableSelect(Table& table, const std::vector<TableFilter>& filters, const std::vector<size_t>& columns);
+
+    ColumnStatus next(std::vector<TableBatch>& batches);
+
+private:
+
+    std::shared_ptr<const TableVersion> version;
+    std::vector<ColumnType> types;  // Type of every column of the table
+    std::vector<TableFilter> filters;
+    std::vector<size_t> columns;    // Projected columns
+    std::vector<uint64_t> deleted;  // Deletes still in delta stores, sorted
+
+    size_t groupIdx;                // Next row group to filter
+    std::shared_ptr<const RowGroup> group;
+    pos_list_t positions;           // Qualifying, live rows of `group`
+    size_t posIdx;                  // Next position to fetch
+    std::vector<FetchCursor> cursors;   // Chunk each projected column last read in `group`
+    std::vector<std::vector<std::string>> heapDicts;   // Strings of each column's last STRING_HEAP batch
+
+    std::vector<uint64_t> deltaIds; // Qualifying delta rows, in row id order
+    std::vector<std::vector<FieldValue>> deltaValues;  // Their projected values, by projected column
+    size_t deltaPos;
+    std::vector<std::vector<std::string>> deltaDicts;
+
+    ColumnStatus filterGroup();
+    void nextDelta(std::vector<TableBatch>& batches);
+
+};
+
+#endif
\ No newline at end of file
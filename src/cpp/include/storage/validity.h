@@ -0,0 +1,56 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_VALIDITY_H
+#define HERACLES_VALIDITY_H
+
+#include "column.h"
+
+/*
+
+    Validity-aware kernels over decoded vectors.
+
+    Nothing here looks at a value to decide whether it is null. Kernels
+    run over every slot of a vector, nulls included, and their results
+    are masked with the validity bitmap afterwards. That is safe because a
+    null slot always holds a real value (the writer repeats the previous
+    one, see column_segment.cc), so it can be compared and added like any
+    other and simply drops out at the mask.
+
+        Values      7  3  3  9  ...     slot 2 is null, holds 3
+        v >= 5      1  0  0  1          computed for every slot
+        Validity    1  1  0  1
+        Matches     1  0  0  1          compare & validity
+
+    A chunk whose footer has nullCount 0 has no validity bitmap, and its
+    vectors skip the masking step entirely, so nullable columns pay only
+    for the chunks that really hold nulls.
+
+    Kernels are picked at runtime like the bitpack kernels: AVX-512, AVX2,
+    or scalar (the only choice when SIMD_ENABLED is 0).
+
+*/
+
+void compareRange(const int64_t* values, size_t count, int64_t lo, int64_t hi, bool negate,
+                  uint64_t* matches);
+void maskValidity(uint64_t* matches, const uint64_t* validity, size_t count);
+void aggregateMasked(const int64_t* values, const uint64_t* mask, size_t count, ColumnAggregate& agg);
+
+const char* validityKernelName();
+
+#endif
\ No newline at end of file
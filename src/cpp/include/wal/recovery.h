@@ -0,0 +1,99 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_RECOVERY_H
+#define HERACLES_RECOVERY_H
+
+#include "wal.h"
+
+#include <string>
+#include <vector>
+
+/*
+
+    Redo of PAGE_WRITE records onto a data file, used by crash recovery
+    and by point-in-time restore from the log archive.
+
+    Records are dispatched by page id to a pool of workers, so every page
+    sees its records in LSN order while different pages are written in
+    parallel:
+
+                              |==========|
+                         |==> | Worker 0 | pages 0, 4, 8, ...
+         |============|  |    |==========|
+         | LogReader  | =|==> | Worker 1 | pages 1, 5, 9, ...
+         | (dispatch) |  |    |==========|
+         |============|  |==> |   ...    |
+                              |==========|
+
+    A base backup (takeBaseBackup()) is a copy of the data file taken while
+    writes go on, plus a label holding the redo LSN of the last checkpoint
+    before the copy started and the last LSN logged once it ended. Replaying
+    the archive from the first to at least the second makes the copy
+    consistent.
+
+    Replay stops on LSNs or on record timestamps, not on commits: records
+    are physical page writes, so a restore to a point in time can end in
+    the middle of a transaction, as a crash can.
+
+*/
+
+#define  BACKUP_DATA_FILE       "heracles.db"
+#define  BACKUP_LABEL_FILE      "backup_label"
+#define  REDO_BATCH_SIZE        1024        // Records per batch handed to a worker
+
+/* Where replay starts and stops, whichever limit is hit first */
+struct RedoTarget {
+    log_id_t fromLsn = INVALID_ID;      // First record must be this one or the next, INVALID_ID for any
+    log_id_t untilLsn = INT32_MAX;      // Last LSN to apply
+    int64_t untilRecordTime = INT64_MAX;    // Last record timestamp to apply (microseconds)
+};
+
+struct RedoStats {
+    size_t nRecords = 0;        // Records read from the log
+    size_t nApplied = 0;        // Page writes applied
+    size_t nBytes = 0;          // Payload bytes applied
+    log_id_t firstLsn = INVALID_ID;
+    log_id_t lastLsn = INVALID_ID;
+    int64_t lastTimestamp = 0;
+    bool reachedTarget = false; // Stopped by the target rather than the end of the log
+    double seconds = 0;
+};
+
+class RedoApplier {
+
+public:
+
+    RedoApplier(os_fd_t dataFd, size_t nWorkers);
+    ~RedoApplier();
+
+    LogStatus replay(LogReader& reader, const RedoTarget& target, RedoStats& stats);
+
+private:
+
+    os_fd_t dataFd;         // Data file the pages are written to
+    size_t nWorkers;        // Number of redo threads
+
+};
+
+LogStatus takeBaseBackup(LogManager& log, const std::string& dataPath, log_id_t redoLsn,
+                         const std::string& backupDir);
+LogStatus writeBackupLabel(const std::string& dir, log_id_t startLsn, log_id_t stopLsn);
+LogStatus readBackupLabel(const std::string& dir, log_id_t& startLsn, log_id_t& stopLsn);
+
+#endif
\ No newline at end of file
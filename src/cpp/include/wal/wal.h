@@ -0,0 +1,206 @@
+/*
+
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#ifndef HERACLES_WAL_H
+#define HERACLES_WAL_H
+
+#include "config.h"
+
+#include <string>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+
+    The write-ahead log (WAL) is stored as a chain of fixed-size segment
+    files, each LOG_SEGMENT_SIZE bytes and zero-filled when first created.
+    Records are appended in place, so the file size never changes and
+    fdatasync() on a commit only has to flush data blocks.
+
+        0000000000000001.wal    0000000000000002.wal    0000000000000003.wal
+       |==========|=======|    |==========|=======|    |==========|=======|
+       | Seg. hdr | Recs  | -> | Seg. hdr | Recs  | -> | Seg. hdr | (old) |
+       |==========|=======|    |==========|=======|    |==========|=======|
+           retired at              current                 spare
+           checkpoint
+
+    Once a checkpoint moves the redo point past a segment, the file is not
+    deleted but renamed ahead of the current segment as a spare and reused.
+    A recycled segment still holds stale records after its header; readers
+    tell them apart because LSNs must be consecutive and every record is
+    covered by a CRC.
+
+    With an archive directory set, every completed segment is copied there
+    by a background thread, and a segment is not recycled until its copy
+    is durable. The archive uses the same file format, so a LogReader can
+    replay it directly (see recovery.h).
+
+*/
+
+/* Status codes */
+enum class LogStatus {
+    GENERAL_SUCCESS,
+    GENERAL_FAILURE,
+    IO_ERROR,
+    RECORD_TOO_LARGE,
+    END_OF_LOG
+};
+
+/* Record types */
+enum class LogRecordType : uint16_t {
+    INVALID = 0,
+    PAGE_WRITE,     // After-image of a byte range within a page
+    TXN_COMMIT,
+    TXN_ABORT,
+    CHECKPOINT      // Payload is the redo LSN of the checkpoint
+};
+
+/* On-disk record header, followed by `size` payload bytes */
+struct LogRecordHeader {
+    uint32_t crc;           // CRC-32 of the remaining header fields and payload
+    uint32_t size;          // Payload size in bytes
+    log_id_t lsn;           // Log sequence number
+    txn_id_t txnId;         // Owning transaction
+    uint16_t type;          // LogRecordType
+    uint16_t reserved;
+    uint32_t reserved2;
+    int64_t  timestamp;     // Microseconds since the Unix epoch
+};
+
+/* On-disk header at offset 0 of every segment */
+struct LogSegmentHeader {
+    uint32_t magic;
+    uint32_t crc;           // CRC-32 of the remaining header fields
+    uint64_t segNo;         // Must match the file name, or the file is a spare
+    uint64_t segSize;
+    log_id_t firstLsn;      // LSN of the first record in this segment
+    uint32_t reserved;
+};
+
+/* Payload of a PAGE_WRITE record, followed by `len` bytes */
+struct LogPageWrite {
+    page_id_t pageId;
+    uint32_t  offset;       // Byte offset within the page
+    uint32_t  len;
+};
+
+#define  LOG_SEGMENT_MAGIC      0x4C415748  // "HWAL"
+#define  LOG_RECORD_ALIGN       8
+
+std::string logSegmentName(uint64_t segNo);
+bool logParseSegmentName(const std::string& name, uint64_t& segNo);
+uint32_t logCrc(const void* data, size_t len, uint32_t crc = 0);
+int64_t logTimestamp();
+
+/* Sequential reader over the segments in a directory (live log or archive) */
+class LogReader {
+
+public:
+
+    LogReader(const std::string& dir);
+    ~LogReader();
+
+    LogStatus open(log_id_t startLsn = 0);
+    LogStatus next(LogRecordHeader& hdr, std::vector<char>& payload);
+
+    uint64_t getSegNo() const { return segNo; }
+    int64_t getOffset() const { return offset; }
+    log_id_t getNextLsn() const { return nextLsn; }
+    size_t getSegSize() const { return segSize; }
+
+private:
+
+    std::string dir;
+    std::vector<uint64_t> segNos;   // Segment files found in `dir`, ascending
+    std::vector<char> data;         // Contents of the current segment
+    size_t segIdx;                  // Index into segNos
+    uint64_t segNo;                 // Current segment number
+    size_t segSize;                 // Segment size from the first header
+    int64_t offset;                 // Next record offset in the current segment
+    log_id_t nextLsn;               // Expected LSN of the next record
+    log_id_t startLsn;              // Records below this are skipped
+
+    LogStatus loadSegment(size_t idx, bool first);
+
+};
+
+/* Appends records to the current segment and manages segment recycling */
+class LogManager {
+
+    struct Segment {
+        uint64_t segNo;
+        log_id_t firstLsn;
+    };
+
+public:
+
+    LogManager(const std::string& dir, size_t segSize = LOG_SEGMENT_SIZE);
+    ~LogManager();
+
+    void setArchiveDir(const std::string& path);
+    LogStatus open();
+    void close();
+
+    LogStatus append(LogRecordType type, txn_id_t txnId,
+                     const void* data, uint32_t size, log_id_t& lsn);
+    LogStatus flush();
+    LogStatus checkpoint(log_id_t redoLsn);
+    LogStatus switchLog();
+
+    log_id_t getNextLsn();
+    log_id_t getFlushedLsn();
+    size_t getNumSegments();
+    size_t getNumSpares();
+    size_t getNumUnarchived();
+
+private:
+
+    std::mutex latch;               // Mutex for concurrency
+    std::string dir;                // Log directory
+    size_t segSize;                 // Bytes per segment file
+    os_fd_t fd;                     // Current segment
+    uint64_t maxSegNo;              // Highest segment number named on disk
+    int64_t writeOfst;              // File offset the buffer will be written to
+    std::vector<char> buffer;       // Records not yet written (LOG_BUFFER_SIZE)
+    size_t bufLen;                  // Bytes used in `buffer`
+    log_id_t nextLsn;               // LSN assigned to the next record
+    log_id_t flushedLsn;            // Highest LSN known durable
+    std::deque<Segment> segments;   // Live segments, current one at the back
+    std::deque<uint64_t> spares;    // Preallocated segments ahead of the current
+
+    std::string archiveDir;         // Completed segments are copied here when set
+    std::thread archiver;           // Background copier
+    std::condition_variable archiveCv;
+    std::deque<uint64_t> archiveQueue;  // Completed segments not yet archived
+    bool stopArchiver;
+
+    std::string segPath(uint64_t segNo) const;
+    LogStatus writeBuffer();
+    LogStatus switchSegment();
+    LogStatus startSegment(uint64_t segNo);
+    LogStatus prepareSpare();
+    LogStatus retireSegment();
+    bool isArchived(uint64_t segNo) const;
+    void archiveLoop();
+
+};
+
+#endif
\ No newline at end of file
@@ -0,0 +1,205 @@
+/*
+
+    POSIX OS Layer
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "config.h"
+
+#if defined(OS_LINUX) || defined(OS_UNIX)
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+os_fd_t osOpen(const char* path, bool create) {
+    int flags = O_RDWR | (create ? O_CREAT : 0);
+    int fd;
+    do {
+        fd = open(path, flags, 0644);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+}
+
+/* Read-only, for input files the process may not write */
+os_fd_t osOpenRead(const char* path) {
+    int fd;
+    do {
+        fd = open(path, O_RDONLY);
+    } while (fd < 0 && errno == EINTR);
+    return fd;
+}
+
+int osClose(os_fd_t fd) {
+    return close(fd);
+}
+
+/* Positional read, retried until `len` bytes or EOF */
+ssize_t osRead(os_fd_t fd, void* buf, size_t len, int64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pread(fd, static_cast<char*>(buf) + done, len - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+        done += n;
+    }
+    return static_cast<ssize_t>(done);
+}
+
+/* Positional write, retried until all of `len` is written */
+ssize_t osWrite(os_fd_t fd, const void* buf, size_t len, int64_t offset) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = pwrite(fd, static_cast<const char*>(buf) + done, len - done, offset + done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        done += n;
+    }
+    return static_cast<ssize_t>(done);
+}
+
+/* Flush file data (not metadata unless the file size changed) */
+int osDataSync(os_fd_t fd) {
+#if defined(OS_LINUX)
+    return fdatasync(fd);
+#else
+    return fsync(fd);
+#endif
+}
+
+/*
+
+    Reserve `size` bytes for the file by writing zeros over the whole range.
+    fallocate() alone is not enough: the extents it reserves are flagged as
+    unwritten, and the first write into each one still costs a metadata
+    update at fdatasync time. Zero-filling once up front means every later
+    overwrite of the file is a pure data write.
+
+*/
+int osPreallocate(os_fd_t fd, int64_t size) {
+#if defined(OS_LINUX)
+    posix_fallocate(fd, 0, size);   // Best effort, keeps the file contiguous
+#endif
+    std::vector<char> zeros(1 << 20, 0);
+    for (int64_t ofst = 0; ofst < size; ofst += zeros.size()) {
+        size_t len = static_cast<size_t>(std::min<int64_t>(zeros.size(), size - ofst));
+        if (osWrite(fd, zeros.data(), len, ofst) < 0) {
+            return -1;
+        }
+    }
+    return fsync(fd);
+}
+
+int64_t osFileSize(os_fd_t fd) {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        return -1;
+    }
+    return static_cast<int64_t>(st.st_size);
+}
+
+int osRename(const char* from, const char* to) {
+    return rename(from, to);
+}
+
+int osRemove(const char* path) {
+    return unlink(path);
+}
+
+/* Copy a whole file and sync the copy, `to` is created or truncated */
+int osCopyFile(const char* from, const char* to) {
+    int src = open(from, O_RDONLY);
+    if (src < 0) {
+        return -1;
+    }
+    int dst = open(to, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (dst < 0) {
+        close(src);
+        return -1;
+    }
+
+    std::vector<char> buf(1 << 20);
+    int64_t ofst = 0;
+    int rc = 0;
+    for (;;) {
+        ssize_t n = osRead(src, buf.data(), buf.size(), ofst);
+        if (n <= 0) {
+            rc = static_cast<int>(n);
+            break;
+        }
+        if (osWrite(dst, buf.data(), n, ofst) < 0) {
+            rc = -1;
+            break;
+        }
+        ofst += n;
+    }
+
+    if (rc == 0) {
+        rc = fsync(dst);
+    }
+    close(src);
+    close(dst);
+    return rc;
+}
+
+int osMkdir(const char* path) {
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Persist directory entries (file creation and renames) */
+int osSyncDir(const char* path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        return -1;
+    }
+    int rc = fsync(fd);
+    close(fd);
+    return rc;
+}
+
+bool osExists(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+int osListDir(const char* path, std::vector<std::string>& names) {
+    DIR* dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+    while (struct dirent* ent = readdir(dir)) {
+        if (strcmp(ent->d_name, ".") != 0 && strcmp(ent->d_name, "..") != 0) {
+            names.emplace_back(ent->d_name);
+        }
+    }
+    closedir(dir);
+    return 0;
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,297 @@
+/*
+
+    Page Pool Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "page_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+/*
+
+    Some basic rules about the page pool:
+        - A frame holds at most one page, and a page is in at most one frame
+        - A frame's page only changes while the pool holds the frame's latch,
+          so whoever holds a frame's latch, or validated a version of it,
+          has the page the frame had when the latch was taken or the version read
+        - The pool latch is held to pick a frame and to change the page table,
+          never while waiting for a frame latch (frames latched by others are
+          skipped) and never across I/O: a frame being read or written is
+          latched instead, and whoever finds it mapped waits for the latch
+        - A page that was allocated but never written reads as zeros only
+          while it is in the pool, so an evicted page is always written
+
+*/
+
+#define  PAGE_TABLE_CHUNK_BITS  16
+#define  PAGE_TABLE_CHUNK_SIZE  (1 << PAGE_TABLE_CHUNK_BITS)
+#define  PAGE_TABLE_CHUNKS      65536       // Up to 2^32 pages, 16 TB at 4 KB pages
+
+void OptimisticLatch::lock() {
+    while (!tryLock()) {
+        std::this_thread::yield();
+    }
+}
+
+PagePool::PagePool(size_t nFrames) :
+    fd(OS_INVALID_FD), nFrames(std::max<size_t>(std::min<size_t>(nFrames, INT32_MAX), 1)), hand(0), nPages(0),
+    nReads(0), nWrites(0) {
+    memory.reset(new char[this->nFrames * PAGE_SIZE]);
+    frames.reset(new PageFrame[this->nFrames]);
+    for (size_t idx = 0; idx < this->nFrames; ++idx) {
+        frames[idx].pageId = INVALID_ID;
+        frames[idx].dirty = false;
+        frames[idx].referenced = false;
+        frames[idx].data = memory.get() + idx * PAGE_SIZE;
+    }
+    pageTable.reset(new std::atomic<std::atomic<int32_t>*>[PAGE_TABLE_CHUNKS]);
+    for (size_t c = 0; c < PAGE_TABLE_CHUNKS; ++c) {
+        pageTable[c] = nullptr;
+    }
+}
+
+PagePool::~PagePool() {
+    if (fd != OS_INVALID_FD) {
+        flush();
+    }
+    close();
+}
+
+/* Open (or create) the page file, the pool must not be in use */
+ColumnStatus PagePool::open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(latch);
+
+    if (fd != OS_INVALID_FD) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    fd = osOpen(path.c_str(), true);
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::IO_ERROR;
+    }
+    int64_t fileSize = osFileSize(fd);
+    if (fileSize < 0 || fileSize % PAGE_SIZE != 0 ||
+        fileSize / PAGE_SIZE > static_cast<int64_t>(PAGE_TABLE_CHUNKS) * PAGE_TABLE_CHUNK_SIZE) {
+        osClose(fd);
+        fd = OS_INVALID_FD;
+        return fileSize < 0 ? ColumnStatus::IO_ERROR : ColumnStatus::CORRUPT_SEGMENT;
+    }
+    nPages = fileSize / PAGE_SIZE;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Close the file without writing anything, dirty pages are lost. The pool must not be in use */
+void PagePool::close() {
+    std::lock_guard<std::mutex> lock(latch);
+
+    if (fd != OS_INVALID_FD) {
+        osClose(fd);
+        fd = OS_INVALID_FD;
+    }
+    for (size_t c = 0; c < PAGE_TABLE_CHUNKS; ++c) {
+        delete[] pageTable[c].exchange(nullptr);
+    }
+    for (size_t idx = 0; idx < nFrames; ++idx) {
+        frames[idx].pageId = INVALID_ID;
+        frames[idx].dirty = frames[idx].referenced = false;
+    }
+    nPages = 0;
+}
+
+/*
+    Frame holding page `pageId`, reading it in if it is not in the pool.
+    The frame is not latched, and may be taken for another page at any
+    time: check its page id under a version of its latch, or latch it and
+    then check, before trusting what it holds
+*/
+ColumnStatus PagePool::fix(page_id_t pageId, PageFrame*& frame) {
+    if (pageId < 0 || pageId >= getNumPages()) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+
+    int32_t idx = frameOf(pageId);
+    if (idx < 0) {
+        std::unique_lock<std::mutex> lock(latch);
+        size_t taken;
+        ColumnStatus rc = takeFrame(lock, taken);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+
+        /* Another thread may have read the page in while the latch was let go */
+        PageFrame& newFrame = frames[taken];
+        if ((idx = frameOf(pageId)) >= 0) {
+            newFrame.latch.unlock();
+        }
+        else {
+            newFrame.pageId = pageId;
+            map(pageId, static_cast<int32_t>(taken));
+            lock.unlock();
+            if (osRead(fd, newFrame.data, PAGE_SIZE, pageId * PAGE_SIZE) != PAGE_SIZE) {
+                lock.lock();
+                map(pageId, -1);
+                newFrame.pageId = INVALID_ID;
+                newFrame.latch.unlock();
+                return ColumnStatus::IO_ERROR;
+            }
+            ++nReads;
+            newFrame.latch.unlock();
+            idx = static_cast<int32_t>(taken);
+        }
+    }
+
+    frame = &frames[idx];
+    if (!frame->referenced.load(std::memory_order_relaxed)) {
+        frame->referenced.store(true, std::memory_order_relaxed);
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Frame holding page `pageId`, latched exclusively */
+ColumnStatus PagePool::fixExclusive(page_id_t pageId, PageFrame*& frame) {
+    for (;;) {
+        ColumnStatus rc = fix(pageId, frame);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        frame->latch.lock();
+        if (frame->pageId == pageId) {
+            return ColumnStatus::GENERAL_SUCCESS;
+        }
+        frame->latch.unlock();
+    }
+}
+
+/* A new zeroed page at the end of the file, its frame latched exclusively */
+ColumnStatus PagePool::allocate(PageFrame*& frame) {
+    std::unique_lock<std::mutex> lock(latch);
+
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    size_t idx;
+    ColumnStatus rc = takeFrame(lock, idx);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    page_id_t pageId = nPages;
+    if (pageId >= static_cast<page_id_t>(PAGE_TABLE_CHUNKS) * PAGE_TABLE_CHUNK_SIZE) {
+        frames[idx].latch.unlock();
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+
+    frame = &frames[idx];
+    memset(frame->data, 0, PAGE_SIZE);
+    frame->pageId = pageId;
+    frame->dirty = true;
+    frame->referenced = true;
+    map(pageId, static_cast<int32_t>(idx));
+    nPages.store(pageId + 1, std::memory_order_release);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Write every dirty page, then sync the file. The caller must hold no frame latch */
+ColumnStatus PagePool::flush() {
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    for (size_t idx = 0; idx < nFrames; ++idx) {
+        PageFrame& frame = frames[idx];
+        if (!frame.dirty) {
+            continue;
+        }
+        frame.latch.lock();
+        ColumnStatus rc = ColumnStatus::GENERAL_SUCCESS;
+        if (frame.dirty && frame.pageId != INVALID_ID) {
+            rc = writeFrame(frame);
+        }
+        frame.latch.unlock();
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+    return osDataSync(fd) == 0 ? ColumnStatus::GENERAL_SUCCESS : ColumnStatus::IO_ERROR;
+}
+
+int32_t PagePool::frameOf(page_id_t pageId) const {
+    const std::atomic<int32_t>* chunk = pageTable[pageId >> PAGE_TABLE_CHUNK_BITS].load(std::memory_order_acquire);
+    return chunk ? chunk[pageId & (PAGE_TABLE_CHUNK_SIZE - 1)].load(std::memory_order_acquire) : -1;
+}
+
+/* Latch must be held */
+void PagePool::map(page_id_t pageId, int32_t idx) {
+    std::atomic<std::atomic<int32_t>*>& slot = pageTable[pageId >> PAGE_TABLE_CHUNK_BITS];
+    std::atomic<int32_t>* chunk = slot.load(std::memory_order_acquire);
+    if (!chunk) {
+        if (idx < 0) {
+            return;
+        }
+        chunk = new std::atomic<int32_t>[PAGE_TABLE_CHUNK_SIZE];
+        for (size_t i = 0; i < PAGE_TABLE_CHUNK_SIZE; ++i) {
+            chunk[i].store(-1, std::memory_order_relaxed);
+        }
+        slot.store(chunk, std::memory_order_release);
+    }
+    chunk[pageId & (PAGE_TABLE_CHUNK_SIZE - 1)].store(idx, std::memory_order_release);
+}
+
+/*
+    A frame for a new page (clock), its old page written out if dirty and
+    unmapped. The frame comes back latched exclusively. `lock` must hold
+    the latch, which is let go while the old page is written: the page
+    stays mapped until then, so it is not read back from the file stale
+*/
+ColumnStatus PagePool::takeFrame(std::unique_lock<std::mutex>& lock, size_t& idx) {
+    for (size_t step = 0; step < 2 * nFrames; ++step) {
+        PageFrame& frame = frames[hand];
+        idx = hand;
+        hand = (hand + 1) % nFrames;
+        if (frame.referenced.load(std::memory_order_relaxed)) {
+            frame.referenced.store(false, std::memory_order_relaxed);
+            continue;
+        }
+        if (!frame.latch.tryLock()) {
+            continue;
+        }
+        if (frame.dirty) {
+            lock.unlock();
+            ColumnStatus rc = writeFrame(frame);
+            lock.lock();
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                frame.latch.unlock();
+                return rc;
+            }
+        }
+        if (frame.pageId != INVALID_ID) {
+            map(frame.pageId, -1);
+            frame.pageId = INVALID_ID;
+        }
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+    return ColumnStatus::GENERAL_FAILURE;   // Every frame is latched
+}
+
+/* Frame latch must be held */
+ColumnStatus PagePool::writeFrame(PageFrame& frame) {
+    if (osWrite(fd, frame.data, PAGE_SIZE, frame.pageId * PAGE_SIZE) != PAGE_SIZE) {
+        return ColumnStatus::IO_ERROR;
+    }
+    ++nWrites;
+    frame.dirty = false;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
\ No newline at end of file
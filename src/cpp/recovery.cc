@@ -0,0 +1,253 @@
+/*
+
+    Parallel Redo Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "recovery.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <stdio.h>
+
+#define  REDO_QUEUE_DEPTH       8           // Batches queued per worker before the reader waits
+
+/* Page writes for one worker, payload bytes stored back to back */
+struct RedoBatch {
+    std::vector<LogPageWrite> writes;
+    std::vector<char> bytes;
+};
+
+/* A redo thread and its bounded queue of batches */
+struct RedoWorker {
+
+    std::mutex latch;
+    std::condition_variable cv;
+    std::deque<RedoBatch> queue;
+    std::thread thread;
+    bool done = false;
+    bool failed = false;
+
+    void push(RedoBatch&& batch) {
+        std::unique_lock<std::mutex> lock(latch);
+        cv.wait(lock, [this] { return queue.size() < REDO_QUEUE_DEPTH; });
+        queue.push_back(std::move(batch));
+        cv.notify_all();
+    }
+
+    void finish() {
+        std::lock_guard<std::mutex> lock(latch);
+        done = true;
+        cv.notify_all();
+    }
+
+    void run(os_fd_t fd) {
+        for (;;) {
+            RedoBatch batch;
+            {
+                std::unique_lock<std::mutex> lock(latch);
+                cv.wait(lock, [this] { return done || !queue.empty(); });
+                if (queue.empty()) {
+                    return;
+                }
+                batch = std::move(queue.front());
+                queue.pop_front();
+                cv.notify_all();
+            }
+
+            size_t pos = 0;
+            for (auto& w : batch.writes) {
+                int64_t ofst = w.pageId * static_cast<int64_t>(PAGE_SIZE) + w.offset;
+                if (osWrite(fd, batch.bytes.data() + pos, w.len, ofst) < 0) {
+                    failed = true;
+                }
+                pos += w.len;
+            }
+        }
+    }
+};
+
+RedoApplier::RedoApplier(os_fd_t dataFd, size_t nWorkers) :
+    dataFd(dataFd), nWorkers(nWorkers ? nWorkers : 1) {}
+
+RedoApplier::~RedoApplier() = default;
+
+/*
+
+    Replay records from `reader` until the log ends or `target` is reached,
+    then sync the data file. Only PAGE_WRITE records touch the data file,
+    the rest are counted and skipped. If the first record comes after
+    `target.fromLsn` and the one after it, the log has a gap and nothing
+    is applied (GENERAL_FAILURE).
+
+*/
+LogStatus RedoApplier::replay(LogReader& reader, const RedoTarget& target, RedoStats& stats) {
+
+    auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::unique_ptr<RedoWorker>> workers;
+    for (size_t i = 0; i < nWorkers; ++i) {
+        workers.emplace_back(new RedoWorker());
+        workers.back()->thread = std::thread(&RedoWorker::run, workers.back().get(), dataFd);
+    }
+    std::vector<RedoBatch> pending(nWorkers);
+
+    LogRecordHeader hdr;
+    std::vector<char> payload;
+    LogStatus rc;
+
+    while ((rc = reader.next(hdr, payload)) == LogStatus::GENERAL_SUCCESS) {
+
+        if (stats.firstLsn == INVALID_ID) {
+            stats.firstLsn = hdr.lsn;
+            if (target.fromLsn != INVALID_ID && hdr.lsn > target.fromLsn + 1) {
+                rc = LogStatus::GENERAL_FAILURE;
+                break;
+            }
+        }
+        if (hdr.lsn > target.untilLsn || hdr.timestamp > target.untilRecordTime) {
+            stats.reachedTarget = true;
+            rc = LogStatus::END_OF_LOG;
+            break;
+        }
+        ++stats.nRecords;
+        stats.lastLsn = hdr.lsn;
+        stats.lastTimestamp = hdr.timestamp;
+
+        if (hdr.type != static_cast<uint16_t>(LogRecordType::PAGE_WRITE)) {
+            continue;
+        }
+
+        LogPageWrite pw;
+        if (payload.size() < sizeof(pw)) {
+            rc = LogStatus::GENERAL_FAILURE;
+            break;
+        }
+        memcpy(&pw, payload.data(), sizeof(pw));
+        if (pw.pageId < 0 || pw.offset + static_cast<size_t>(pw.len) > PAGE_SIZE ||
+            payload.size() != sizeof(pw) + pw.len) {
+            rc = LogStatus::GENERAL_FAILURE;
+            break;
+        }
+
+        size_t w = static_cast<size_t>(pw.pageId) % nWorkers;
+        RedoBatch& batch = pending[w];
+        batch.writes.push_back(pw);
+        batch.bytes.insert(batch.bytes.end(), payload.begin() + sizeof(pw), payload.end());
+        ++stats.nApplied;
+        stats.nBytes += pw.len;
+
+        if (batch.writes.size() >= REDO_BATCH_SIZE) {
+            workers[w]->push(std::move(batch));
+            batch = RedoBatch();
+        }
+    }
+
+    bool failed = false;
+    for (size_t i = 0; i < nWorkers; ++i) {
+        if (!pending[i].writes.empty()) {
+            workers[i]->push(std::move(pending[i]));
+        }
+        workers[i]->finish();
+    }
+    for (auto& worker : workers) {
+        worker->thread.join();
+        failed |= worker->failed;
+    }
+
+    if (failed || osDataSync(dataFd) != 0) {
+        rc = LogStatus::IO_ERROR;
+    }
+    stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    return rc == LogStatus::END_OF_LOG ? LogStatus::GENERAL_SUCCESS : rc;
+}
+
+/*
+
+    Base backup of the data file at `dataPath` into `backupDir`, taken
+    while writes go on. `redoLsn` is the redo LSN of the last checkpoint:
+    every change logged below it must be in the data file before the copy
+    starts. Pages written during the copy may be copied torn or stale,
+    their records come after `redoLsn` and replay fixes them. Once copied,
+    the log is switched so everything logged so far reaches the archive,
+    and the label records both LSNs; it is written last, so a directory
+    without one holds no usable backup.
+
+*/
+LogStatus takeBaseBackup(LogManager& log, const std::string& dataPath, log_id_t redoLsn,
+                         const std::string& backupDir) {
+
+    if (osMkdir(backupDir.c_str()) != 0 ||
+        osCopyFile(dataPath.c_str(), (backupDir + "/" + BACKUP_DATA_FILE).c_str()) != 0) {
+        return LogStatus::IO_ERROR;
+    }
+
+    log_id_t stopLsn = log.getNextLsn() - 1;
+    LogStatus rc = log.switchLog();
+    if (rc != LogStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    return writeBackupLabel(backupDir, redoLsn, stopLsn);
+}
+
+/* The label is written under a temporary name so a backup is never half-labeled */
+LogStatus writeBackupLabel(const std::string& dir, log_id_t startLsn, log_id_t stopLsn) {
+
+    std::string path = dir + "/" + BACKUP_LABEL_FILE;
+    std::string tmp = path + ".tmp";
+
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        return LogStatus::IO_ERROR;
+    }
+    bool ok = fprintf(f, "START LSN: %d\nSTOP LSN: %d\n", static_cast<int>(startLsn),
+                      static_cast<int>(stopLsn)) > 0;
+    ok = (fclose(f) == 0) && ok;
+
+    if (!ok || osRename(tmp.c_str(), path.c_str()) != 0 || osSyncDir(dir.c_str()) != 0) {
+        return LogStatus::IO_ERROR;
+    }
+    return LogStatus::GENERAL_SUCCESS;
+}
+
+/* A label without a stop LSN (written by hand) gets the start LSN as its stop LSN */
+LogStatus readBackupLabel(const std::string& dir, log_id_t& startLsn, log_id_t& stopLsn) {
+
+    std::string path = dir + "/" + BACKUP_LABEL_FILE;
+    FILE* f = fopen(path.c_str(), "r");
+    if (!f) {
+        return LogStatus::IO_ERROR;
+    }
+    int lsn, stop;
+    bool ok = fscanf(f, "START LSN: %d", &lsn) == 1;
+    if (ok && fscanf(f, " STOP LSN: %d", &stop) != 1) {
+        stop = lsn;
+    }
+    fclose(f);
+
+    if (!ok) {
+        return LogStatus::GENERAL_FAILURE;
+    }
+    startLsn = static_cast<log_id_t>(lsn);
+    stopLsn = static_cast<log_id_t>(stop);
+    return LogStatus::GENERAL_SUCCESS;
+}
\ No newline at end of file
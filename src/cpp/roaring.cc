@@ -0,0 +1,810 @@
+/*
+
+    Roaring Bitmap Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "roaring.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#if SIMD_ENABLED && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#   define ROARING_X86          1
+#   include <immintrin.h>
+#endif
+
+/*
+
+    Some basic rules about containers:
+        - A container is never empty, the last value out takes it with it
+        - An ARRAY never holds more than ROARING_ARRAY_MAX values, and a
+          BITMAP that drops to that many turns back into an ARRAY
+        - RUN pairs are sorted and never touch, so every value is in at
+          most one run
+        - Anything that changes a RUN container expands it first
+
+*/
+
+#define  ROARING_MAGIC          0x414F5248  // "HROA"
+
+enum WordOp {
+    WORD_AND,
+    WORD_OR,
+    WORD_ANDNOT
+};
+
+/* out = a op b over `n` words, returns the number of bits set in `out` */
+typedef uint64_t (*combine_fn)(const uint64_t*, const uint64_t*, uint64_t*, size_t);
+
+template <int Op>
+static inline uint64_t combineWord(uint64_t a, uint64_t b) {
+    return Op == WORD_AND ? a & b : Op == WORD_OR ? a | b : a & ~b;
+}
+
+template <int Op>
+static uint64_t combineScalar(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n) {
+    uint64_t count = 0;
+    for (size_t i = 0; i < n; ++i) {
+        out[i] = combineWord<Op>(a[i], b[i]);
+        count += __builtin_popcountll(out[i]);
+    }
+    return count;
+}
+
+#if defined(ROARING_X86)
+
+SIMD_KERNELS_BEGIN
+
+/* Nibble lookup popcount (Mula), summed per 64-bit lane by the SAD against zero */
+template <int Op>
+__attribute__((target("avx2")))
+static uint64_t combineAvx2(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n) {
+
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low4 = _mm256_set1_epi8(0x0F);
+    __m256i total = _mm256_setzero_si256();
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        __m256i v = Op == WORD_AND ? _mm256_and_si256(x, y)
+                  : Op == WORD_OR  ? _mm256_or_si256(x, y)
+                  : _mm256_andnot_si256(y, x);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), v);
+
+        __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(v, low4)),
+                                      _mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(v, 4), low4)));
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(cnt, _mm256_setzero_si256()));
+    }
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), total);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + combineScalar<Op>(a + i, b + i, out + i, n - i);
+}
+
+template <int Op>
+__attribute__((target("avx512f,avx512vpopcntdq")))
+static uint64_t combineAvx512(const uint64_t* a, const uint64_t* b, uint64_t* out, size_t n) {
+
+    __m512i total = _mm512_setzero_si512();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i x = _mm512_loadu_si512(a + i);
+        __m512i y = _mm512_loadu_si512(b + i);
+        __m512i v = Op == WORD_AND ? _mm512_and_si512(x, y)
+                  : Op == WORD_OR  ? _mm512_or_si512(x, y)
+                  : _mm512_andnot_si512(y, x);
+        _mm512_storeu_si512(out + i, v);
+        total = _mm512_add_epi64(total, _mm512_popcnt_epi64(v));
+    }
+    return _mm512_reduce_add_epi64(total) + combineScalar<Op>(a + i, b + i, out + i, n - i);
+}
+
+SIMD_KERNELS_END
+
+#endif // ROARING_X86
+
+/* Dispatch */
+
+struct RoaringKernels {
+    combine_fn combine[3];          // Indexed by WordOp
+    const char* name;
+};
+
+static const RoaringKernels& kernels() {
+    static const RoaringKernels best = [] {
+#if defined(ROARING_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vpopcntdq")) {
+            return RoaringKernels{ { combineAvx512<WORD_AND>, combineAvx512<WORD_OR>, combineAvx512<WORD_ANDNOT> },
+                                   "avx512" };
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return RoaringKernels{ { combineAvx2<WORD_AND>, combineAvx2<WORD_OR>, combineAvx2<WORD_ANDNOT> },
+                                   "avx2" };
+        }
+#endif
+        return RoaringKernels{ { combineScalar<WORD_AND>, combineScalar<WORD_OR>, combineScalar<WORD_ANDNOT> },
+                               "scalar" };
+    }();
+    return best;
+}
+
+const char* roaringKernelName() {
+    return kernels().name;
+}
+
+/* Containers */
+
+/* Set bits [lo, hi) */
+static void setRange(uint64_t* words, uint64_t lo, uint64_t hi) {
+    for (uint64_t i = lo; i < hi; ) {
+        uint64_t bit = i & 63;
+        uint64_t n = std::min<uint64_t>(64 - bit, hi - i);
+        words[i >> 6] |= (n == 64 ? ~0ULL : ((1ULL << n) - 1) << bit);
+        i += n;
+    }
+}
+
+static inline bool testBit(const uint64_t* words, uint32_t i) {
+    return words[i >> 6] & (1ULL << (i & 63));
+}
+
+/* Calls fn(low) for every value of the container, in order */
+template <typename Fn>
+static void forEachValue(const RoaringContainer& c, Fn fn) {
+    switch (c.type) {
+        case RoaringType::ARRAY:
+            for (uint16_t val : c.values) {
+                fn(val);
+            }
+            break;
+        case RoaringType::BITMAP:
+            for (uint32_t w = 0; w < ROARING_BITMAP_WORDS; ++w) {
+                for (uint64_t word = c.words[w]; word; word &= word - 1) {
+                    fn(static_cast<uint16_t>(w * 64 + __builtin_ctzll(word)));
+                }
+            }
+            break;
+        case RoaringType::RUN:
+            for (size_t r = 0; r < c.values.size(); r += 2) {
+                for (uint32_t val = c.values[r]; val <= uint32_t(c.values[r]) + c.values[r + 1]; ++val) {
+                    fn(static_cast<uint16_t>(val));
+                }
+            }
+            break;
+    }
+}
+
+static void toBitmap(RoaringContainer& c) {
+    std::vector<uint64_t> words(ROARING_BITMAP_WORDS, 0);
+    if (c.type == RoaringType::ARRAY) {
+        for (uint16_t val : c.values) {
+            words[val >> 6] |= 1ULL << (val & 63);
+        }
+    }
+    else if (c.type == RoaringType::RUN) {
+        for (size_t r = 0; r < c.values.size(); r += 2) {
+            setRange(words.data(), c.values[r], uint64_t(c.values[r]) + c.values[r + 1] + 1);
+        }
+    }
+    else {
+        return;
+    }
+    c.words.swap(words);
+    std::vector<uint16_t>().swap(c.values);
+    c.type = RoaringType::BITMAP;
+}
+
+/* A bitmap that fits in an array becomes one */
+static void shrink(RoaringContainer& c) {
+    if (c.type != RoaringType::BITMAP || c.card > ROARING_ARRAY_MAX) {
+        return;
+    }
+    std::vector<uint16_t> values;
+    values.reserve(c.card);
+    forEachValue(c, [&](uint16_t val) { values.push_back(val); });
+    c.values.swap(values);
+    std::vector<uint64_t>().swap(c.words);
+    c.type = RoaringType::ARRAY;
+}
+
+/* RUN containers are read-only, everything else works on their expansion */
+static void expand(RoaringContainer& c) {
+    if (c.type == RoaringType::RUN) {
+        toBitmap(c);
+        shrink(c);
+    }
+}
+
+static bool containerContains(const RoaringContainer& c, uint16_t low) {
+    switch (c.type) {
+        case RoaringType::ARRAY:
+            return std::binary_search(c.values.begin(), c.values.end(), low);
+        case RoaringType::BITMAP:
+            return testBit(c.words.data(), low);
+        case RoaringType::RUN: {
+            size_t lo = 0, hi = c.values.size() / 2;   // First run starting after `low`
+            while (lo < hi) {
+                size_t mid = (lo + hi) / 2;
+                if (c.values[2 * mid] <= low) {
+                    lo = mid + 1;
+                }
+                else {
+                    hi = mid;
+                }
+            }
+            return lo > 0 && low <= uint32_t(c.values[2 * lo - 2]) + c.values[2 * lo - 1];
+        }
+    }
+    return false;
+}
+
+/* The three set operations on one pair of containers, the result may be empty */
+
+static RoaringContainer andContainers(const RoaringContainer& ca, const RoaringContainer& cb) {
+
+    RoaringContainer ta, tb;
+    const RoaringContainer* a = &ca;
+    const RoaringContainer* b = &cb;
+    if (a->type == RoaringType::RUN) { ta = *a; expand(ta); a = &ta; }
+    if (b->type == RoaringType::RUN) { tb = *b; expand(tb); b = &tb; }
+    if (a->type == RoaringType::BITMAP && b->type == RoaringType::ARRAY) {
+        std::swap(a, b);
+    }
+
+    RoaringContainer out;
+    out.key = ca.key;
+    out.type = RoaringType::ARRAY;
+    if (a->type == RoaringType::ARRAY && b->type == RoaringType::ARRAY) {
+        std::set_intersection(a->values.begin(), a->values.end(), b->values.begin(), b->values.end(),
+                              std::back_inserter(out.values));
+    }
+    else if (a->type == RoaringType::ARRAY) {
+        for (uint16_t val : a->values) {
+            if (testBit(b->words.data(), val)) {
+                out.values.push_back(val);
+            }
+        }
+    }
+    else {
+        out.type = RoaringType::BITMAP;
+        out.words.resize(ROARING_BITMAP_WORDS);
+        out.card = static_cast<uint32_t>(
+            kernels().combine[WORD_AND](a->words.data(), b->words.data(), out.words.data(), ROARING_BITMAP_WORDS));
+        shrink(out);
+        return out;
+    }
+    out.card = static_cast<uint32_t>(out.values.size());
+    return out;
+}
+
+static RoaringContainer orContainers(const RoaringContainer& ca, const RoaringContainer& cb) {
+
+    RoaringContainer ta, tb;
+    const RoaringContainer* a = &ca;
+    const RoaringContainer* b = &cb;
+    if (a->type == RoaringType::RUN) { ta = *a; expand(ta); a = &ta; }
+    if (b->type == RoaringType::RUN) { tb = *b; expand(tb); b = &tb; }
+    if (a->type == RoaringType::ARRAY && b->type == RoaringType::BITMAP) {
+        std::swap(a, b);
+    }
+
+    RoaringContainer out;
+    out.key = ca.key;
+    if (a->type == RoaringType::ARRAY) {
+        out.type = RoaringType::ARRAY;
+        std::set_union(a->values.begin(), a->values.end(), b->values.begin(), b->values.end(),
+                       std::back_inserter(out.values));
+        out.card = static_cast<uint32_t>(out.values.size());
+        if (out.card > ROARING_ARRAY_MAX) {
+            toBitmap(out);
+        }
+    }
+    else if (b->type == RoaringType::ARRAY) {
+        out = *a;
+        out.key = ca.key;
+        for (uint16_t val : b->values) {
+            if (!testBit(out.words.data(), val)) {
+                out.words[val >> 6] |= 1ULL << (val & 63);
+                ++out.card;
+            }
+        }
+    }
+    else {
+        out.type = RoaringType::BITMAP;
+        out.words.resize(ROARING_BITMAP_WORDS);
+        out.card = static_cast<uint32_t>(
+            kernels().combine[WORD_OR](a->words.data(), b->words.data(), out.words.data(), ROARING_BITMAP_WORDS));
+    }
+    return out;
+}
+
+static RoaringContainer andNotContainers(const RoaringContainer& ca, const RoaringContainer& cb) {
+
+    RoaringContainer ta, tb;
+    const RoaringContainer* a = &ca;
+    const RoaringContainer* b = &cb;
+    if (a->type == RoaringType::RUN) { ta = *a; expand(ta); a = &ta; }
+    if (b->type == RoaringType::RUN) { tb = *b; expand(tb); b = &tb; }
+
+    RoaringContainer out;
+    out.key = ca.key;
+    out.type = RoaringType::ARRAY;
+    if (a->type == RoaringType::ARRAY && b->type == RoaringType::ARRAY) {
+        std::set_difference(a->values.begin(), a->values.end(), b->values.begin(), b->values.end(),
+                            std::back_inserter(out.values));
+    }
+    else if (a->type == RoaringType::ARRAY) {
+        for (uint16_t val : a->values) {
+            if (!testBit(b->words.data(), val)) {
+                out.values.push_back(val);
+            }
+        }
+    }
+    else if (b->type == RoaringType::ARRAY) {
+        out = *a;
+        out.key = ca.key;
+        for (uint16_t val : b->values) {
+            if (testBit(out.words.data(), val)) {
+                out.words[val >> 6] &= ~(1ULL << (val & 63));
+                --out.card;
+            }
+        }
+        shrink(out);
+        return out;
+    }
+    else {
+        out.type = RoaringType::BITMAP;
+        out.words.resize(ROARING_BITMAP_WORDS);
+        out.card = static_cast<uint32_t>(
+            kernels().combine[WORD_ANDNOT](a->words.data(), b->words.data(), out.words.data(), ROARING_BITMAP_WORDS));
+        shrink(out);
+        return out;
+    }
+    out.card = static_cast<uint32_t>(out.values.size());
+    return out;
+}
+
+/* RoaringBitmap */
+
+/* Bitmaps over row offsets usually have every key up to the last, so try the key as an index first */
+RoaringContainer* RoaringBitmap::find(uint16_t key) {
+    if (key < containers.size() && containers[key].key == key) {
+        return &containers[key];
+    }
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [](const RoaringContainer& c, uint16_t k) { return c.key < k; });
+    return (it != containers.end() && it->key == key) ? &*it : nullptr;
+}
+
+const RoaringContainer* RoaringBitmap::find(uint16_t key) const {
+    return const_cast<RoaringBitmap*>(this)->find(key);
+}
+
+bool RoaringBitmap::add(uint32_t val) {
+
+    uint16_t key = static_cast<uint16_t>(val >> 16);
+    uint16_t low = static_cast<uint16_t>(val);
+
+    auto it = std::lower_bound(containers.begin(), containers.end(), key,
+                               [](const RoaringContainer& c, uint16_t k) { return c.key < k; });
+    if (it == containers.end() || it->key != key) {
+        RoaringContainer c;
+        c.key = key;
+        c.type = RoaringType::ARRAY;
+        c.card = 1;
+        c.values.push_back(low);
+        containers.insert(it, std::move(c));
+        return true;
+    }
+
+    RoaringContainer& c = *it;
+    expand(c);
+    if (c.type == RoaringType::ARRAY) {
+        auto pos = std::lower_bound(c.values.begin(), c.values.end(), low);
+        if (pos != c.values.end() && *pos == low) {
+            return false;
+        }
+        if (c.card < ROARING_ARRAY_MAX) {
+            c.values.insert(pos, low);
+            ++c.card;
+            return true;
+        }
+        toBitmap(c);
+    }
+    if (testBit(c.words.data(), low)) {
+        return false;
+    }
+    c.words[low >> 6] |= 1ULL << (low & 63);
+    ++c.card;
+    return true;
+}
+
+bool RoaringBitmap::remove(uint32_t val) {
+
+    RoaringContainer* c = find(static_cast<uint16_t>(val >> 16));
+    uint16_t low = static_cast<uint16_t>(val);
+    if (!c || !containerContains(*c, low)) {
+        return false;
+    }
+
+    expand(*c);
+    if (c->type == RoaringType::ARRAY) {
+        c->values.erase(std::lower_bound(c->values.begin(), c->values.end(), low));
+    }
+    else {
+        c->words[low >> 6] &= ~(1ULL << (low & 63));
+    }
+    if (--c->card == 0) {
+        containers.erase(containers.begin() + (c - containers.data()));
+    }
+    else {
+        shrink(*c);
+    }
+    return true;
+}
+
+bool RoaringBitmap::contains(uint32_t val) const {
+    const RoaringContainer* c = find(static_cast<uint16_t>(val >> 16));
+    return c && containerContains(*c, static_cast<uint16_t>(val));
+}
+
+uint64_t RoaringBitmap::cardinality() const {
+    uint64_t total = 0;
+    for (auto& c : containers) {
+        total += c.card;
+    }
+    return total;
+}
+
+uint32_t RoaringBitmap::maximum() const {
+    const RoaringContainer& c = containers.back();
+    uint32_t low = 0;
+    switch (c.type) {
+        case RoaringType::ARRAY:
+            low = c.values.back();
+            break;
+        case RoaringType::BITMAP:
+            for (uint32_t w = ROARING_BITMAP_WORDS; w-- > 0; ) {
+                if (c.words[w]) {
+                    low = w * 64 + 63 - __builtin_clzll(c.words[w]);
+                    break;
+                }
+            }
+            break;
+        case RoaringType::RUN:
+            low = uint32_t(c.values[c.values.size() - 2]) + c.values.back();
+            break;
+    }
+    return (uint32_t(c.key) << 16) | low;
+}
+
+/* Memory held by the containers */
+size_t RoaringBitmap::bytes() const {
+    size_t total = containers.size() * sizeof(RoaringContainer);
+    for (auto& c : containers) {
+        total += c.values.size() * sizeof(uint16_t) + c.words.size() * sizeof(uint64_t);
+    }
+    return total;
+}
+
+/* Add the bits set (clear, if `invert`) among the first `count` bits of `words` as first + i */
+void RoaringBitmap::addWords(uint32_t first, const uint64_t* words, size_t count, bool invert) {
+    for (size_t w = 0; w < (count + 63) >> 6; ++w) {
+        uint64_t word = invert ? ~words[w] : words[w];
+        if (w == count >> 6) {
+            word &= (1ULL << (count & 63)) - 1;
+        }
+        for (; word; word &= word - 1) {
+            add(first + static_cast<uint32_t>(w * 64 + __builtin_ctzll(word)));
+        }
+    }
+}
+
+/*
+
+    Values first .. first + count - 1 as bits of `words`, which must have
+    room for (count + 63) / 64 words. `first` has to be a multiple of 64.
+    Returns false when none of them is set.
+
+*/
+bool RoaringBitmap::getWords(uint32_t first, size_t count, uint64_t* words) const {
+
+    size_t nWords = (count + 63) >> 6;
+    memset(words, 0, nWords * sizeof(uint64_t));
+    if (count == 0 || containers.empty()) {
+        return false;
+    }
+
+    uint64_t lo = first, hi = uint64_t(first) + count;
+    auto it = std::lower_bound(containers.begin(), containers.end(), static_cast<uint16_t>(lo >> 16),
+                               [](const RoaringContainer& c, uint16_t k) { return c.key < k; });
+
+    for (; it != containers.end() && (uint64_t(it->key) << 16) < hi; ++it) {
+        const RoaringContainer& c = *it;
+        uint64_t base = uint64_t(c.key) << 16;
+        uint32_t cLo = static_cast<uint32_t>(std::max(lo, base) - base);
+        uint32_t cHi = static_cast<uint32_t>(std::min(hi, base + 65536) - base);
+
+        switch (c.type) {
+            case RoaringType::ARRAY:
+                for (auto v = std::lower_bound(c.values.begin(), c.values.end(), cLo);
+                     v != c.values.end() && *v < cHi; ++v) {
+                    uint64_t bit = base + *v - lo;
+                    words[bit >> 6] |= 1ULL << (bit & 63);
+                }
+                break;
+            case RoaringType::BITMAP:
+                for (uint32_t w = cLo >> 6; w < (cHi + 63) >> 6; ++w) {
+                    words[(base + w * 64 - lo) >> 6] = c.words[w];
+                }
+                break;
+            case RoaringType::RUN:
+                for (size_t r = 0; r < c.values.size(); r += 2) {
+                    uint64_t start = std::max<uint64_t>(c.values[r], cLo);
+                    uint64_t end = std::min<uint64_t>(uint64_t(c.values[r]) + c.values[r + 1] + 1, cHi);
+                    if (start < end) {
+                        setRange(words, base + start - lo, base + end - lo);
+                    }
+                }
+                break;
+        }
+    }
+
+    if (count & 63) {
+        words[nWords - 1] &= (1ULL << (count & 63)) - 1;
+    }
+    uint64_t any = 0;
+    for (size_t w = 0; w < nWords; ++w) {
+        any |= words[w];
+    }
+    return any != 0;
+}
+
+void RoaringBitmap::toArray(std::vector<uint32_t>& out) const {
+    out.clear();
+    out.reserve(cardinality());
+    for (auto& c : containers) {
+        uint32_t base = uint32_t(c.key) << 16;
+        forEachValue(c, [&](uint16_t low) { out.push_back(base | low); });
+    }
+}
+
+/* Turn every container that is smaller as runs into a RUN container */
+void RoaringBitmap::runOptimize() {
+    for (auto& c : containers) {
+        if (c.type == RoaringType::RUN) {
+            continue;
+        }
+
+        std::vector<uint16_t> runs;
+        forEachValue(c, [&](uint16_t val) {
+            if (!runs.empty() && uint32_t(runs[runs.size() - 2]) + runs.back() + 1 == val) {
+                ++runs.back();
+            }
+            else {
+                runs.push_back(val);
+                runs.push_back(0);
+            }
+        });
+
+        size_t current = (c.type == RoaringType::ARRAY) ? c.card * sizeof(uint16_t)
+                                                         : ROARING_BITMAP_WORDS * sizeof(uint64_t);
+        if (runs.size() * sizeof(uint16_t) < current) {
+            c.values.swap(runs);
+            std::vector<uint64_t>().swap(c.words);
+            c.type = RoaringType::RUN;
+        }
+    }
+}
+
+/*
+
+    Serialized layout:
+
+        | magic | nContainers | container 0 | container 1 | ...
+
+        Container   | key (2) | type (1) | pad (1) | card (4) | nElems (4) | elems |
+
+    Elements are the uint16_t values or run pairs, or the 1024 bitmap words.
+
+*/
+
+struct RoaringHeader {
+    uint32_t magic;
+    uint32_t nContainers;
+};
+
+struct RoaringContainerHeader {
+    uint16_t key;
+    uint8_t  type;
+    uint8_t  pad;
+    uint32_t card;
+    uint32_t nElems;
+};
+
+void RoaringBitmap::serialize(std::vector<char>& out) const {
+
+    RoaringHeader hdr = { ROARING_MAGIC, static_cast<uint32_t>(containers.size()) };
+    out.assign(reinterpret_cast<const char*>(&hdr), reinterpret_cast<const char*>(&hdr + 1));
+
+    for (auto& c : containers) {
+        bool isBitmap = c.type == RoaringType::BITMAP;
+        RoaringContainerHeader ch = { c.key, static_cast<uint8_t>(c.type), 0, c.card,
+                                      static_cast<uint32_t>(isBitmap ? c.words.size() : c.values.size()) };
+        out.insert(out.end(), reinterpret_cast<const char*>(&ch), reinterpret_cast<const char*>(&ch + 1));
+
+        const char* elems = isBitmap ? reinterpret_cast<const char*>(c.words.data())
+                                     : reinterpret_cast<const char*>(c.values.data());
+        size_t len = isBitmap ? c.words.size() * sizeof(uint64_t) : c.values.size() * sizeof(uint16_t);
+        out.insert(out.end(), elems, elems + len);
+    }
+}
+
+/* Everything is checked, a bitmap that loads keeps every invariant above */
+bool RoaringBitmap::deserialize(const char* data, size_t size) {
+
+    containers.clear();
+    RoaringHeader hdr;
+    if (size < sizeof(hdr)) {
+        return false;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.magic != ROARING_MAGIC || hdr.nContainers > 65536) {
+        return false;
+    }
+
+    size_t pos = sizeof(hdr);
+    std::vector<RoaringContainer> loaded(hdr.nContainers);
+    for (uint32_t i = 0; i < hdr.nContainers; ++i) {
+
+        RoaringContainerHeader ch;
+        if (size - pos < sizeof(ch)) {
+            return false;
+        }
+        memcpy(&ch, data + pos, sizeof(ch));
+        pos += sizeof(ch);
+        if ((i > 0 && ch.key <= loaded[i - 1].key) || ch.card == 0 || ch.card > 65536) {
+            return false;
+        }
+
+        RoaringContainer& c = loaded[i];
+        c.key = ch.key;
+        c.card = ch.card;
+        c.type = static_cast<RoaringType>(ch.type);
+
+        if (c.type == RoaringType::BITMAP) {
+            if (ch.nElems != ROARING_BITMAP_WORDS || size - pos < ROARING_BITMAP_WORDS * sizeof(uint64_t)) {
+                return false;
+            }
+            c.words.resize(ROARING_BITMAP_WORDS);
+            memcpy(c.words.data(), data + pos, ROARING_BITMAP_WORDS * sizeof(uint64_t));
+            pos += ROARING_BITMAP_WORDS * sizeof(uint64_t);
+
+            uint64_t count = 0;
+            for (uint64_t word : c.words) {
+                count += __builtin_popcountll(word);
+            }
+            if (count != c.card) {
+                return false;
+            }
+            shrink(c);
+            continue;
+        }
+
+        if (ch.type > static_cast<uint8_t>(RoaringType::RUN) || ch.nElems > 65536 ||
+            size - pos < ch.nElems * sizeof(uint16_t)) {
+            return false;
+        }
+        c.values.resize(ch.nElems);
+        memcpy(c.values.data(), data + pos, ch.nElems * sizeof(uint16_t));
+        pos += ch.nElems * sizeof(uint16_t);
+
+        if (c.type == RoaringType::ARRAY) {
+            if (ch.nElems != c.card || c.card > ROARING_ARRAY_MAX ||
+                std::adjacent_find(c.values.begin(), c.values.end(), std::greater_equal<uint16_t>()) != c.values.end()) {
+                return false;
+            }
+            continue;
+        }
+
+        /* Runs: sorted, apart, inside the container and adding up to `card` */
+        if (ch.nElems == 0 || ch.nElems % 2 != 0) {
+            return false;
+        }
+        uint64_t count = 0;
+        for (size_t r = 0; r < c.values.size(); r += 2) {
+            uint32_t end = uint32_t(c.values[r]) + c.values[r + 1];
+            if (end > 65535 || (r > 0 && c.values[r] <= uint32_t(c.values[r - 2]) + c.values[r - 1] + 1)) {
+                return false;
+            }
+            count += c.values[r + 1] + 1;
+        }
+        if (count != c.card) {
+            return false;
+        }
+    }
+
+    if (pos != size) {
+        return false;
+    }
+    containers.swap(loaded);
+    return true;
+}
+
+/* Set operations, merging the two container lists by key */
+
+RoaringBitmap roaringAnd(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap out;
+    auto ia = a.containers.begin(), ib = b.containers.begin();
+    while (ia != a.containers.end() && ib != b.containers.end()) {
+        if (ia->key < ib->key) {
+            ++ia;
+        }
+        else if (ib->key < ia->key) {
+            ++ib;
+        }
+        else {
+            RoaringContainer c = andContainers(*ia++, *ib++);
+            if (c.card > 0) {
+                out.containers.push_back(std::move(c));
+            }
+        }
+    }
+    return out;
+}
+
+RoaringBitmap roaringOr(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap out;
+    auto ia = a.containers.begin(), ib = b.containers.begin();
+    while (ia != a.containers.end() || ib != b.containers.end()) {
+        if (ib == b.containers.end() || (ia != a.containers.end() && ia->key < ib->key)) {
+            out.containers.push_back(*ia++);
+        }
+        else if (ia == a.containers.end() || ib->key < ia->key) {
+            out.containers.push_back(*ib++);
+        }
+        else {
+            out.containers.push_back(orContainers(*ia++, *ib++));
+        }
+    }
+    return out;
+}
+
+RoaringBitmap roaringAndNot(const RoaringBitmap& a, const RoaringBitmap& b) {
+    RoaringBitmap out;
+    auto ib = b.containers.begin();
+    for (auto& c : a.containers) {
+        while (ib != b.containers.end() && ib->key < c.key) {
+            ++ib;
+        }
+        if (ib == b.containers.end() || ib->key != c.key) {
+            out.containers.push_back(c);
+            continue;
+        }
+        RoaringContainer diff = andNotContainers(c, *ib);
+        if (diff.card > 0) {
+            out.containers.push_back(std::move(diff));
+        }
+    }
+    return out;
+}
\ No newline at end of file
@@ -0,0 +1,481 @@
+/*
+
+    String Heap Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "string_heap.h"
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#define  STRING_ESCAPE          255
+#define  STRING_TRAIN_ROUNDS    5
+
+struct StringHeapHeader {
+    uint32_t count;                 // Strings, nulls included
+    uint32_t heapSize;              // Bytes of the heap
+    uint32_t tableSize;             // Bytes of the symbol table, 0 when the heap is raw
+    uint32_t reserved;
+};
+
+/* SymbolTable */
+
+/* Codes grouped by first byte, longest first, so the first hit is the longest match */
+void SymbolTable::index() {
+    for (size_t c = 0; c < nSymbols; ++c) {
+        order[c] = static_cast<uint8_t>(c);
+    }
+    std::sort(order, order + nSymbols, [this](uint8_t a, uint8_t b) {
+        uint8_t fa = static_cast<uint8_t>(symbols[a] & 0xFF);
+        uint8_t fb = static_cast<uint8_t>(symbols[b] & 0xFF);
+        return fa != fb ? fa < fb : lengths[a] > lengths[b];
+    });
+
+    memset(firstIdx, 0, sizeof(firstIdx));
+    for (size_t c = 0; c < nSymbols; ++c) {
+        ++firstIdx[static_cast<uint8_t>(*symbol(static_cast<uint8_t>(c))) + 1];
+    }
+    for (size_t b = 1; b < 257; ++b) {
+        firstIdx[b] += firstIdx[b - 1];
+    }
+}
+
+/* Longest symbol at the start of `in`, -1 if none */
+int SymbolTable::match(const char* in, size_t len) const {
+    uint8_t first = static_cast<uint8_t>(in[0]);
+    for (size_t k = firstIdx[first]; k < firstIdx[first + 1]; ++k) {
+        uint8_t code = order[k];
+        if (lengths[code] <= len && memcmp(symbol(code), in, lengths[code]) == 0) {
+            return code;
+        }
+    }
+    return -1;
+}
+
+/*
+
+    Training, a simplified FSST: compress the sample with the current
+    table while counting every symbol (or escaped byte) it emits and every
+    pair of consecutive ones. Each of those, and each pair short enough to
+    merge, is a candidate worth count x length bytes; the best
+    STRING_SYMBOL_MAX become the next table. Ids 0 .. 255 are codes, 256 ..
+    511 escaped bytes.
+
+*/
+void SymbolTable::build(const std::vector<const std::string*>& vals) {
+
+    nSymbols = 0;
+    memset(symbols, 0, sizeof(symbols));
+    memset(lengths, 0, sizeof(lengths));
+
+    size_t total = 0;
+    for (auto val : vals) {
+        total += val ? val->size() : 0;
+    }
+    if (total == 0) {
+        index();
+        return;
+    }
+
+    /* Every k-th string, so the sample spans the whole chunk */
+    std::vector<const std::string*> sample;
+    size_t step = std::max<size_t>(1, total / STRING_SAMPLE_BYTES);
+    for (size_t i = 0; i < vals.size(); i += step) {
+        if (vals[i] && !vals[i]->empty()) {
+            sample.push_back(vals[i]);
+        }
+    }
+
+    std::vector<uint32_t> single(512);
+    std::vector<uint32_t> pairs(512 * 512);
+    auto bytesOf = [this](size_t id, uint64_t& bytes, size_t& len) {
+        if (id < 256) {
+            bytes = symbols[id];
+            len = lengths[id];
+        }
+        else {
+            bytes = id - 256;
+            len = 1;
+        }
+    };
+
+    for (int round = 0; round < STRING_TRAIN_ROUNDS; ++round) {
+
+        index();
+        std::fill(single.begin(), single.end(), 0);
+        std::fill(pairs.begin(), pairs.end(), 0);
+        for (auto val : sample) {
+            size_t prev = SIZE_MAX;
+            for (size_t pos = 0; pos < val->size(); ) {
+                int code = match(val->data() + pos, val->size() - pos);
+                size_t id = code >= 0 ? static_cast<size_t>(code) : 256 + static_cast<uint8_t>((*val)[pos]);
+                pos += code >= 0 ? lengths[code] : 1;
+                ++single[id];
+                if (prev != SIZE_MAX) {
+                    ++pairs[prev * 512 + id];
+                }
+                prev = id;
+            }
+        }
+
+        /* Gain of every candidate, keyed by its bytes and length */
+        std::unordered_map<uint64_t, uint64_t> gains[STRING_SYMBOL_LEN + 1];
+        auto offer = [&gains](uint64_t bytes, size_t len, uint64_t gain) {
+            uint64_t& best = gains[len][bytes];
+            best = std::max(best, gain);
+        };
+        for (size_t a = 0; a < 512; ++a) {
+            if (single[a] == 0) {
+                continue;
+            }
+            uint64_t bytesA, bytesB;
+            size_t lenA, lenB;
+            bytesOf(a, bytesA, lenA);
+            offer(bytesA, lenA, uint64_t(single[a]) * lenA);
+            for (size_t b = 0; b < 512; ++b) {
+                uint32_t n = pairs[a * 512 + b];
+                if (n == 0) {
+                    continue;
+                }
+                bytesOf(b, bytesB, lenB);
+                if (lenA + lenB <= STRING_SYMBOL_LEN) {
+                    offer(bytesA | (bytesB << (8 * lenA)), lenA + lenB, uint64_t(n) * (lenA + lenB));
+                }
+            }
+        }
+
+        struct Candidate {
+            uint64_t gain;
+            uint64_t bytes;
+            uint8_t len;
+        };
+        std::vector<Candidate> candidates;
+        for (size_t len = 1; len <= STRING_SYMBOL_LEN; ++len) {
+            for (auto& entry : gains[len]) {
+                candidates.push_back({ entry.second, entry.first, static_cast<uint8_t>(len) });
+            }
+        }
+        size_t keep = std::min<size_t>(candidates.size(), STRING_SYMBOL_MAX);
+        std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(),
+                          [](const Candidate& a, const Candidate& b) {
+            if (a.gain != b.gain) return a.gain > b.gain;
+            if (a.len != b.len) return a.len > b.len;
+            return a.bytes < b.bytes;
+        });
+
+        nSymbols = keep;
+        memset(symbols, 0, sizeof(symbols));
+        memset(lengths, 0, sizeof(lengths));
+        for (size_t c = 0; c < keep; ++c) {
+            symbols[c] = candidates[c].bytes;
+            lengths[c] = candidates[c].len;
+        }
+    }
+    index();
+}
+
+/* Symbol bytes are built little-endian above, the only byte order the engine runs on */
+void SymbolTable::compress(const char* in, size_t len, std::string& out) const {
+    for (size_t pos = 0; pos < len; ) {
+        int code = match(in + pos, len - pos);
+        if (code >= 0) {
+            out.push_back(static_cast<char>(code));
+            pos += lengths[code];
+        }
+        else {
+            out.push_back(static_cast<char>(STRING_ESCAPE));
+            out.push_back(in[pos++]);
+        }
+    }
+}
+
+/*
+
+    Expand `len` codes into `out`, which needs room for len x 8 bytes: every
+    symbol is copied as a whole word and the cursor moves by its length.
+    Codes without a symbol (only in a corrupt heap) expand to nothing.
+
+*/
+size_t SymbolTable::decompress(const uint8_t* in, size_t len, char* out) const {
+    char* cur = out;
+    for (size_t i = 0; i < len; ) {
+        uint8_t code = in[i++];
+        if (code == STRING_ESCAPE) {
+            if (i < len) {
+                *cur++ = static_cast<char>(in[i++]);
+            }
+            continue;
+        }
+        memcpy(cur, &symbols[code], sizeof(uint64_t));
+        cur += lengths[code];
+    }
+    return cur - out;
+}
+
+/* [nSymbols][length x nSymbols][symbol bytes] */
+void SymbolTable::serialize(std::vector<char>& out) const {
+    out.clear();
+    out.push_back(static_cast<char>(nSymbols));
+    for (size_t c = 0; c < nSymbols; ++c) {
+        out.push_back(static_cast<char>(lengths[c]));
+    }
+    for (size_t c = 0; c < nSymbols; ++c) {
+        out.insert(out.end(), symbol(static_cast<uint8_t>(c)), symbol(static_cast<uint8_t>(c)) + lengths[c]);
+    }
+}
+
+bool SymbolTable::deserialize(const char* data, size_t size) {
+
+    nSymbols = 0;
+    memset(symbols, 0, sizeof(symbols));
+    memset(lengths, 0, sizeof(lengths));
+    if (size < 1) {
+        return false;
+    }
+
+    size_t n = static_cast<uint8_t>(data[0]);
+    size_t pos = 1 + n;
+    if (size < pos) {
+        return false;
+    }
+    for (size_t c = 0; c < n; ++c) {
+        uint8_t len = static_cast<uint8_t>(data[1 + c]);
+        if (len == 0 || len > STRING_SYMBOL_LEN || size - pos < len) {
+            memset(lengths, 0, sizeof(lengths));
+            return false;
+        }
+        lengths[c] = len;
+        memcpy(&symbols[c], data + pos, len);
+        pos += len;
+    }
+    if (pos != size) {
+        memset(lengths, 0, sizeof(lengths));
+        return false;
+    }
+    nSymbols = n;
+    index();
+    return true;
+}
+
+/* StringHeapView */
+
+/* Offsets are checked on access rather than here, so opening a chunk costs no pass over it */
+ColumnStatus StringHeapView::open(const char* data, size_t size, size_t nStrings) {
+
+    StringHeapHeader hdr;
+    if (size < sizeof(hdr)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+    if (hdr.count != nStrings ||
+        size != sizeof(hdr) + uint64_t(hdr.tableSize) + uint64_t(hdr.count) * sizeof(uint32_t) + hdr.heapSize) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+
+    table = SymbolTable();
+    if (hdr.tableSize > 0 && !table.deserialize(data + sizeof(hdr), hdr.tableSize)) {
+        return ColumnStatus::CORRUPT_SEGMENT;
+    }
+    count = hdr.count;
+    heapSize = hdr.heapSize;
+    ends = data + sizeof(hdr) + hdr.tableSize;
+    heap = reinterpret_cast<const uint8_t*>(ends + count * sizeof(uint32_t));
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+uint32_t StringHeapView::end(size_t i) const {
+    uint32_t off;
+    memcpy(&off, ends + i * sizeof(uint32_t), sizeof(off));
+    return std::min(off, heapSize);
+}
+
+void StringHeapView::get(size_t i, std::string& out) const {
+    uint32_t b = begin(i), e = std::max(begin(i), end(i));
+    if (!isCompressed()) {
+        out.assign(reinterpret_cast<const char*>(heap) + b, e - b);
+        return;
+    }
+    out.resize(size_t(e - b) * sizeof(uint64_t));
+    out.resize(table.decompress(heap + b, e - b, &out[0]));
+}
+
+/* Strings begin .. begin + n - 1, expanded through one scratch buffer */
+void StringHeapView::read(size_t first, size_t n, std::vector<std::string>& out) const {
+
+    out.resize(n);
+    if (!isCompressed()) {
+        for (size_t k = 0; k < n; ++k) {
+            get(first + k, out[k]);
+        }
+        return;
+    }
+
+    std::vector<char> scratch;
+    for (size_t k = 0; k < n; ++k) {
+        uint32_t b = begin(first + k), e = std::max(b, end(first + k));
+        scratch.resize(std::max(scratch.size(), size_t(e - b) * sizeof(uint64_t)));
+        out[k].assign(scratch.data(), table.decompress(heap + b, e - b, scratch.data()));
+    }
+}
+
+/* `val` in the stored form of this chunk, for equals() */
+void StringHeapView::pack(const std::string& val, std::string& out) const {
+    if (!isCompressed()) {
+        out = val;
+        return;
+    }
+    out.clear();
+    table.compress(val.data(), val.size(), out);
+}
+
+bool StringHeapView::equals(size_t i, const std::string& packed) const {
+    uint32_t b = begin(i), e = end(i);
+    return e >= b && e - b == packed.size() && memcmp(heap + b, packed.data(), packed.size()) == 0;
+}
+
+bool StringHeapView::startsWith(size_t i, const std::string& prefix) const {
+
+    uint32_t b = begin(i), e = std::max(b, end(i));
+    if (!isCompressed()) {
+        return e - b >= prefix.size() && memcmp(heap + b, prefix.data(), prefix.size()) == 0;
+    }
+
+    size_t pos = 0;
+    for (uint32_t k = b; k < e && pos < prefix.size(); ) {
+        uint8_t code = heap[k++];
+        const char* sym = reinterpret_cast<const char*>(heap + k);
+        size_t len = k < e ? 1 : 0;
+        if (code == STRING_ESCAPE) {
+            ++k;
+        }
+        else {
+            sym = table.symbol(code);
+            len = table.length(code);
+        }
+        size_t n = std::min(len, prefix.size() - pos);
+        if (memcmp(sym, prefix.data() + pos, n) != 0) {
+            return false;
+        }
+        pos += n;
+    }
+    return pos == prefix.size();
+}
+
+/* Byte order comparison with `val`, like std::string::compare */
+int StringHeapView::compare(size_t i, const std::string& val) const {
+
+    uint32_t b = begin(i), e = std::max(b, end(i));
+    if (!isCompressed()) {
+        size_t len = e - b;
+        int c = memcmp(heap + b, val.data(), std::min(len, val.size()));
+        return c != 0 ? c : (len < val.size() ? -1 : len > val.size() ? 1 : 0);
+    }
+
+    size_t pos = 0;
+    for (uint32_t k = b; k < e; ) {
+        uint8_t code = heap[k++];
+        const char* sym = reinterpret_cast<const char*>(heap + k);
+        size_t len = k < e ? 1 : 0;
+        if (code == STRING_ESCAPE) {
+            ++k;
+        }
+        else {
+            sym = table.symbol(code);
+            len = table.length(code);
+        }
+        size_t n = std::min(len, val.size() - pos);
+        int c = memcmp(sym, val.data() + pos, n);
+        if (c != 0) {
+            return c;
+        }
+        if (n < len) {
+            return 1;                   // `val` ran out first
+        }
+        pos += n;
+    }
+    return pos < val.size() ? -1 : 0;
+}
+
+/* First 8 bytes, big-endian and with the sign bit flipped, so keys sort like the strings */
+int64_t stringKey(const char* data, size_t len) {
+    uint64_t key = 0;
+    for (size_t k = 0; k < sizeof(uint64_t); ++k) {
+        key = (key << 8) | (k < len ? static_cast<uint8_t>(data[k]) : 0);
+    }
+    return static_cast<int64_t>(key ^ (1ULL << 63));
+}
+
+/* Nulls are passed as null pointers and stored as empty strings */
+ColumnStatus encodeStrings(const std::vector<const std::string*>& vals, bool compress, std::vector<char>& out) {
+
+    std::string heap;
+    std::vector<uint32_t> ends(vals.size());
+    std::vector<char> tableBytes;
+
+    size_t total = 0;
+    for (auto val : vals) {
+        total += val ? val->size() : 0;
+    }
+    if (total > UINT32_MAX) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+
+    /* Keep the symbol table only if table plus codes beat the raw bytes */
+    if (compress && total > 0) {
+        SymbolTable table;
+        table.build(vals);
+        for (size_t i = 0; i < vals.size() && heap.size() < total; ++i) {
+            if (vals[i]) {
+                table.compress(vals[i]->data(), vals[i]->size(), heap);
+            }
+            ends[i] = static_cast<uint32_t>(std::min<size_t>(heap.size(), UINT32_MAX));
+        }
+        table.serialize(tableBytes);
+        if (table.size() == 0 || tableBytes.size() + heap.size() >= total) {
+            tableBytes.clear();
+            heap.clear();
+        }
+    }
+
+    if (tableBytes.empty()) {
+        heap.reserve(total);
+        for (size_t i = 0; i < vals.size(); ++i) {
+            if (vals[i]) {
+                heap += *vals[i];
+            }
+            ends[i] = static_cast<uint32_t>(heap.size());
+        }
+    }
+
+    StringHeapHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.count = static_cast<uint32_t>(vals.size());
+    hdr.heapSize = static_cast<uint32_t>(heap.size());
+    hdr.tableSize = static_cast<uint32_t>(tableBytes.size());
+
+    out.resize(sizeof(hdr) + tableBytes.size() + ends.size() * sizeof(uint32_t) + heap.size());
+    char* cur = out.data();
+    memcpy(cur, &hdr, sizeof(hdr));
+    cur += sizeof(hdr);
+    memcpy(cur, tableBytes.data(), tableBytes.size());
+    cur += tableBytes.size();
+    memcpy(cur, ends.data(), ends.size() * sizeof(uint32_t));
+    cur += ends.size() * sizeof(uint32_t);
+    memcpy(cur, heap.data(), heap.size());
+    return ColumnStatus::GENERAL_SUCCESS;
+}
\ No newline at end of file
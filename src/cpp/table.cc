@@ -0,0 +1,1694 @@
+/*
+
+    Table Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "table.h"
+#include "column_group.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <numeric>
+
+/*
+
+    Some basic rules about tables:
+        - Only the tuple mover changes groups and delete vectors, and
+          only one mover pass runs at a time (moveLatch)
+        - Writers change the active store under the table latch, so a
+          store never sees a write after it has been frozen
+        - Deleted rows are still written into the new group, which keeps
+          group id ranges contiguous; its delete vector hides them until
+          the group is compacted
+        - Groups never overlap and stay in row id order, a compacted group
+          takes the place of the group it replaces; rows within a group
+          are in row id order unless the table has a sort key
+        - A failed move leaves the frozen store in place, still visible to
+          scans, and the next pass retries it
+
+*/
+
+#define  TABLE_MANIFEST_FILE    "MANIFEST"
+#define  TABLE_MANIFEST_MAGIC   0x4C425448  // "HTBL"
+#define  TABLE_ROW_ID_COLUMN    -1          // Column id of the ids segment of a compacted group
+#define  TABLE_MANIFEST_VERSION 2
+#define  TABLE_GROUP_HAS_IDS    0x1
+#define  TABLE_GROUP_HAS_DROPPED 0x2
+#define  TABLE_COLUMN_NULL_DEFAULT 0x1
+
+/* Manifest layout: header, one entry per column in schema order, then one entry per group */
+struct TableManifestHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nColumns;
+    uint32_t reserved;
+    uint64_t nGroups;
+};
+
+/* Followed by the `defaultSize` bytes of a STRING default */
+struct TableManifestColumn {
+    col_id_t colId;
+    uint32_t defaultSize;
+    uint64_t firstGroupNo;
+    int64_t  defaultVal;        // INT64 and TIMESTAMP only
+    uint64_t flags;
+};
+
+struct TableManifestGroup {
+    uint64_t groupNo;
+    uint64_t firstRow;
+    uint64_t nRows;
+    uint64_t deleteGen;
+    uint64_t flags;
+};
+
+/* Index of the group holding `rowId`, or groups.size() */
+static size_t findGroupIdx(const std::vector<std::shared_ptr<const RowGroup>>& groups, uint64_t rowId) {
+    auto it = std::upper_bound(groups.begin(), groups.end(), rowId,
+                               [](uint64_t id, const std::shared_ptr<const RowGroup>& g) { return id < g->getEndRow(); });
+    if (it == groups.end() || (*it)->firstRow > rowId) {
+        return groups.size();
+    }
+    return it - groups.begin();
+}
+
+bool RowGroup::findRow(uint64_t rowId, uint64_t& offset) const {
+    if (!rowIds) {
+        offset = rowId - firstRow;
+        return rowId >= firstRow && offset < nRows;
+    }
+    if (idOrder) {
+        auto it = std::lower_bound(idOrder->begin(), idOrder->end(), rowId,
+                                   [this](uint32_t off, uint64_t id) { return (*rowIds)[off] < id; });
+        offset = it != idOrder->end() ? *it : 0;
+        return it != idOrder->end() && (*rowIds)[*it] == rowId;
+    }
+    auto it = std::lower_bound(rowIds->begin(), rowIds->end(), rowId);
+    offset = it - rowIds->begin();
+    return it != rowIds->end() && *it == rowId;
+}
+
+const RowGroup* TableVersion::findGroup(uint64_t rowId) const {
+    size_t idx = findGroupIdx(groups, rowId);
+    return idx < groups.size() ? groups[idx].get() : nullptr;
+}
+
+Table::Table(const std::string& dir, const std::vector<TableColumn>& schema, ChunkPool* pool,
+             DecodedCache* cache) :
+    dir(dir), schema(schema), pool(pool), cache(cache), nextRowId(0), nextGroupNo(0), moverStopping(false) {
+    for (size_t c = 0; c < schema.size(); ++c) {
+        if (this->schema[c].colId < 0) {
+            this->schema[c].colId = static_cast<col_id_t>(c);
+        }
+    }
+    indexSchema();
+}
+
+Table::~Table() {
+    stopMover();
+}
+
+/* Positions of the sort key and column group columns, after every schema change */
+void Table::indexSchema() {
+    sortKey.clear();
+    for (size_t c = 0; c < schema.size(); ++c) {
+        if (schema[c].sortKey >= 0) {
+            sortKey.push_back(c);
+        }
+    }
+    std::sort(sortKey.begin(), sortKey.end(), [this](size_t a, size_t b) {
+        return schema[a].sortKey < schema[b].sortKey;
+    });
+    columnGroups.clear();
+    for (size_t c = 0; c < schema.size(); ++c) {
+        if (schema[c].columnGroup >= 0) {
+            size_t g = static_cast<size_t>(schema[c].columnGroup);
+            columnGroups.resize(std::max(columnGroups.size(), g + 1));
+            columnGroups[g].push_back(c);
+        }
+    }
+}
+
+std::string Table::segPath(uint64_t groupNo, col_id_t colId) const {
+    return dir + "/g" + std::to_string(groupNo) + "_c" + std::to_string(colId) + ".seg";
+}
+
+std::string Table::groupPath(uint64_t groupNo, size_t columnGroup) const {
+    return dir + "/g" + std::to_string(groupNo) + "_p" + std::to_string(columnGroup) + ".seg";
+}
+
+std::string Table::idsPath(uint64_t groupNo) const {
+    return dir + "/g" + std::to_string(groupNo) + "_ids.seg";
+}
+
+std::string Table::deletesPath(uint64_t groupNo, uint64_t gen) const {
+    return dir + "/g" + std::to_string(groupNo) + "_" + std::to_string(gen) + ".del";
+}
+
+std::string Table::manifestPath() const {
+    return dir + "/" + TABLE_MANIFEST_FILE;
+}
+
+/* Load the groups of the last completed move */
+ColumnStatus Table::open() {
+
+    /* Sort key positions must be 0, 1, 2, ..., column ids unique */
+    for (size_t k = 0; k < sortKey.size(); ++k) {
+        if (schema[sortKey[k]].sortKey != static_cast<int>(k)) {
+            return ColumnStatus::GENERAL_FAILURE;
+        }
+    }
+    for (size_t c = 0; c < schema.size(); ++c) {
+        for (size_t o = 0; o < c; ++o) {
+            if (schema[o].colId == schema[c].colId) {
+                return ColumnStatus::GENERAL_FAILURE;
+            }
+        }
+    }
+    if (osMkdir(dir.c_str()) != 0) {
+        return ColumnStatus::IO_ERROR;
+    }
+
+    auto ver = std::make_shared<TableVersion>();
+    ver->active = std::make_shared<DeltaStore>();
+
+    if (osExists(manifestPath().c_str())) {
+        os_fd_t fd = osOpen(manifestPath().c_str(), false);
+        if (fd == OS_INVALID_FD) {
+            return ColumnStatus::IO_ERROR;
+        }
+
+        std::vector<char> buf(std::max<int64_t>(osFileSize(fd), 0));
+        bool ok = buf.size() >= sizeof(TableManifestHeader) &&
+                  osRead(fd, buf.data(), buf.size(), 0) == static_cast<ssize_t>(buf.size());
+        osClose(fd);
+
+        TableManifestHeader hdr;
+        if (ok) {
+            memcpy(&hdr, buf.data(), sizeof(hdr));
+            ok = hdr.magic == TABLE_MANIFEST_MAGIC && hdr.version == TABLE_MANIFEST_VERSION;
+        }
+        if (!ok) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+
+        /* The columns must be the schema's, in its order; the table keeps their first groups and defaults */
+        if (hdr.nColumns != schema.size()) {
+            return ColumnStatus::GENERAL_FAILURE;
+        }
+        size_t ofst = sizeof(hdr);
+        for (auto& column : schema) {
+            TableManifestColumn mc;
+            if (ofst + sizeof(mc) > buf.size()) {
+                return ColumnStatus::CORRUPT_SEGMENT;
+            }
+            memcpy(&mc, buf.data() + ofst, sizeof(mc));
+            ofst += sizeof(mc);
+            if (ofst + mc.defaultSize > buf.size()) {
+                return ColumnStatus::CORRUPT_SEGMENT;
+            }
+            if (mc.colId != column.colId) {
+                return ColumnStatus::GENERAL_FAILURE;
+            }
+            column.firstGroupNo = mc.firstGroupNo;
+            nextGroupNo = std::max(nextGroupNo, column.firstGroupNo);    // Added after the last group written
+            column.defaultValue = FieldValue();
+            if (!(mc.flags & TABLE_COLUMN_NULL_DEFAULT)) {
+                column.defaultValue = column.type == ColumnType::STRING
+                                    ? FieldValue::of(std::string(buf.data() + ofst, mc.defaultSize))
+                                    : FieldValue::of(mc.defaultVal);
+            }
+            ofst += mc.defaultSize;
+        }
+
+        std::vector<TableManifestGroup> entries(hdr.nGroups);
+        size_t groupBytes = entries.size() * sizeof(TableManifestGroup);
+        if (ofst + groupBytes != buf.size()) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+        if (groupBytes > 0) {
+            memcpy(entries.data(), buf.data() + ofst, groupBytes);
+        }
+
+        for (auto& entry : entries) {
+            std::shared_ptr<RowGroup> group;
+            ColumnStatus status = openGroup(entry.groupNo, entry.firstRow, entry.nRows,
+                                            entry.flags & TABLE_GROUP_HAS_IDS, entry.deleteGen, group);
+            if (status != ColumnStatus::GENERAL_SUCCESS) {
+                return status;
+            }
+            group->hasDropped = entry.flags & TABLE_GROUP_HAS_DROPPED;
+            if (!ver->groups.empty() && ver->groups.back()->getEndRow() > group->firstRow) {
+                return ColumnStatus::CORRUPT_SEGMENT;
+            }
+            ver->groups.push_back(group);
+            nextRowId = std::max(nextRowId, group->getEndRow());
+            nextGroupNo = std::max(nextGroupNo, entry.groupNo + 1);
+        }
+    }
+
+    ver->schema = std::make_shared<const std::vector<TableColumn>>(schema);
+    std::lock_guard<std::mutex> lock(latch);
+    version = ver;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+std::shared_ptr<const TableVersion> Table::getVersion() {
+    std::lock_guard<std::mutex> lock(latch);
+    return version;
+}
+
+/* Copy of the schema as of now, the one to reopen the table with */
+std::vector<TableColumn> Table::getSchema() {
+    std::lock_guard<std::mutex> lock(latch);
+    return schema;
+}
+
+/* Statistics of column `col` over the current version, GENERAL_FAILURE if a segment has none */
+ColumnStatus Table::getColumnStats(size_t col, ColumnStats& stats) {
+
+    std::shared_ptr<const TableVersion> ver = getVersion();
+    if (!ver || col >= ver->schema->size()) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    ColumnType type = (*ver->schema)[col].type;
+    stats = ColumnStats(type);
+
+    for (auto& group : ver->groups) {
+        ColumnStats segStats;
+        ColumnStatus rc = group->columns[col]->readStats(segStats);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        stats.merge(segStats);
+    }
+
+    ColumnStats delta(type);
+    std::vector<uint64_t> ids;
+    std::vector<FieldValue> vals;
+    for (auto& store : { ver->frozen, ver->active }) {
+        if (!store) {
+            continue;
+        }
+        store->getColumn(col, ids, vals);
+        for (auto& val : vals) {
+            if (val.isNull) {
+                delta.addNull();
+            }
+            else if (type == ColumnType::STRING) {
+                delta.add(val.strVal);
+            }
+            else {
+                delta.add(val.intVal);
+            }
+        }
+    }
+    stats.merge(delta);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+ColumnStatus Table::insert(const table_row_t& row, uint64_t& rowId) {
+
+    std::lock_guard<std::mutex> lock(latch);
+    if (!version) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    if (row.size() != schema.size()) {
+        return ColumnStatus::TYPE_MISMATCH;     // Checked under the latch, a schema change takes it
+    }
+    rowId = nextRowId++;
+    version->active->insert(rowId, row);
+    if (version->active->getNumRows() >= DELTA_MOVE_THRESHOLD) {
+        moverCv.notify_one();
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Is `rowId` a row of this table that has not been deleted? Latch must be held */
+bool Table::isLive(const TableVersion& ver, uint64_t rowId) const {
+    if (rowId >= nextRowId || ver.active->isDeleted(rowId) || (ver.frozen && ver.frozen->isDeleted(rowId))) {
+        return false;
+    }
+
+    /* Not in a group: a delta row, or a row dropped by compaction */
+    const RowGroup* group = ver.findGroup(rowId);
+    uint64_t offset;
+    if (!group) {
+        return (ver.frozen && ver.frozen->hasRow(rowId)) || ver.active->hasRow(rowId);
+    }
+    return group->findRow(rowId, offset) && !(group->deletes && group->deletes->isDeleted(offset));
+}
+
+ColumnStatus Table::remove(uint64_t rowId) {
+    std::lock_guard<std::mutex> lock(latch);
+    if (!version) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    if (!isLive(*version, rowId)) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+    version->active->remove(rowId);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Delete plus insert, the new version of the row gets a new id */
+ColumnStatus Table::update(uint64_t rowId, const table_row_t& row, uint64_t& newRowId) {
+
+    std::lock_guard<std::mutex> lock(latch);
+    if (!version) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+    if (row.size() != schema.size()) {
+        return ColumnStatus::TYPE_MISMATCH;
+    }
+    if (!isLive(*version, rowId)) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+    version->active->remove(rowId);
+    newRowId = nextRowId++;
+    version->active->insert(newRowId, row);
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Copy of a delta store with `change` applied to every row, for a schema change */
+template <typename Change>
+static std::shared_ptr<DeltaStore> remapStore(const DeltaStore& store, Change change) {
+    std::vector<uint64_t> rowIds, deletes;
+    std::vector<table_row_t> rows;
+    store.getRows(rowIds, rows);
+    store.getDeletes(deletes);
+
+    auto remapped = std::make_shared<DeltaStore>();
+    for (size_t r = 0; r < rows.size(); ++r) {
+        change(rows[r]);
+        remapped->insert(rowIds[r], std::move(rows[r]));
+    }
+    for (uint64_t rowId : deletes) {
+        remapped->remove(rowId);
+    }
+    return remapped;
+}
+
+/*
+
+    Add a column at the end of the schema. Its id is the next free one
+    unless the column names one; the groups written so far read it as
+    `column.defaultValue`, and so do the rows in the delta stores, which
+    get it appended. Sort key columns cannot be added.
+
+*/
+ColumnStatus Table::addColumn(const TableColumn& column) {
+
+    std::lock_guard<std::mutex> moving(moveLatch);
+    std::shared_ptr<const TableVersion> base = getVersion();
+    if (!base || column.sortKey >= 0) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+
+    TableColumn added = column;
+    col_id_t maxId = -1;
+    for (auto& other : schema) {
+        if (other.colId == added.colId) {
+            return ColumnStatus::GENERAL_FAILURE;
+        }
+        maxId = std::max(maxId, other.colId);
+    }
+    if (added.colId < 0) {
+        added.colId = maxId + 1;
+    }
+    added.firstGroupNo = nextGroupNo;
+    const FieldValue& def = added.defaultValue;
+
+    std::vector<std::shared_ptr<const RowGroup>> groups;
+    for (auto& group : base->groups) {
+        auto changed = std::make_shared<RowGroup>(*group);
+        auto reader = std::make_shared<ColumnSegmentReader>(std::string());
+        ColumnStatus rc = reader->openDefault(added.colId, added.type, group->nRows, def.isNull, def.intVal,
+                                              def.strVal);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        reader->setPool(pool);
+        reader->setDecodedCache(cache);
+        changed->columns.push_back(reader);
+        groups.push_back(changed);
+    }
+
+    std::vector<TableColumn> columns = schema;
+    columns.push_back(added);
+    ColumnStatus rc = writeManifest(columns, groups);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    /* The groups only change in a move, which the mover latch keeps out */
+    std::lock_guard<std::mutex> lock(latch);
+    auto changed = std::make_shared<TableVersion>(*version);
+    changed->groups = groups;
+    auto append = [&def](table_row_t& row) { row.push_back(def); };
+    changed->active = remapStore(*version->active, append);
+    if (version->frozen) {
+        changed->frozen = remapStore(*version->frozen, append);
+    }
+    changed->schema = std::make_shared<const std::vector<TableColumn>>(columns);
+    schema = columns;
+    indexSchema();
+    version = changed;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Drop column `col`. It leaves the schema and every version from now
+    on at once; the groups storing it are marked, and the mover reclaims
+    their segments of it later. The last column and sort key columns
+    cannot be dropped.
+
+*/
+ColumnStatus Table::dropColumn(size_t col) {
+
+    std::lock_guard<std::mutex> moving(moveLatch);
+    std::shared_ptr<const TableVersion> base = getVersion();
+    if (!base || col >= schema.size() || schema.size() == 1 || schema[col].sortKey >= 0) {
+        return ColumnStatus::GENERAL_FAILURE;
+    }
+
+    std::vector<std::shared_ptr<const RowGroup>> groups;
+    for (auto& group : base->groups) {
+        auto changed = std::make_shared<RowGroup>(*group);
+        changed->hasDropped = changed->hasDropped || !changed->columns[col]->isDefaulted();
+        changed->columns.erase(changed->columns.begin() + col);
+        groups.push_back(changed);
+    }
+
+    std::vector<TableColumn> columns = schema;
+    columns.erase(columns.begin() + col);
+    ColumnStatus rc = writeManifest(columns, groups);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    std::lock_guard<std::mutex> lock(latch);
+    auto changed = std::make_shared<TableVersion>(*version);
+    changed->groups = groups;
+    auto erase = [col](table_row_t& row) { row.erase(row.begin() + col); };
+    changed->active = remapStore(*version->active, erase);
+    if (version->frozen) {
+        changed->frozen = remapStore(*version->frozen, erase);
+    }
+    changed->schema = std::make_shared<const std::vector<TableColumn>>(columns);
+    schema = columns;
+    indexSchema();
+    version = changed;
+    moverCv.notify_one();
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+ColumnStatus Table::openGroup(uint64_t groupNo, uint64_t firstRow, uint64_t nRows, bool hasIds, uint64_t deleteGen,
+                              std::shared_ptr<RowGroup>& group) {
+
+    group = std::make_shared<RowGroup>();
+    group->groupNo = groupNo;
+    group->firstRow = firstRow;
+    group->nRows = nRows;
+    group->deleteGen = deleteGen;
+    group->hasDropped = false;
+
+    /*
+        Where each grouped column's segment ends in its group file. Columns
+        added after the group was written are not in it, and the file may
+        still hold columns dropped since
+    */
+    std::vector<uint64_t> segmentEnds(schema.size(), 0);
+    for (size_t g = 0; g < columnGroups.size(); ++g) {
+        std::vector<size_t> stored;
+        for (size_t c : columnGroups[g]) {
+            if (groupNo >= schema[c].firstGroupNo) {
+                stored.push_back(c);
+            }
+        }
+        if (stored.empty()) {
+            continue;
+        }
+        std::vector<ColumnGroupEntry> entries;
+        ColumnStatus rc = readColumnGroup(groupPath(groupNo, g), entries);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        for (size_t c : stored) {
+            auto entry = std::find_if(entries.begin(), entries.end(), [this, c](const ColumnGroupEntry& e) {
+                return e.colId == schema[c].colId;
+            });
+            if (entry == entries.end()) {
+                return ColumnStatus::CORRUPT_SEGMENT;
+            }
+            segmentEnds[c] = entry->segmentEnd;
+        }
+    }
+
+    for (size_t c = 0; c < schema.size(); ++c) {
+        const TableColumn& column = schema[c];
+        std::shared_ptr<ColumnSegmentReader> reader;
+        ColumnStatus rc;
+        if (groupNo < column.firstGroupNo) {
+            reader = std::make_shared<ColumnSegmentReader>(std::string());
+            rc = reader->openDefault(column.colId, column.type, nRows, column.defaultValue.isNull,
+                                     column.defaultValue.intVal, column.defaultValue.strVal);
+        }
+        else {
+            reader = column.columnGroup >= 0
+                   ? std::make_shared<ColumnSegmentReader>(groupPath(groupNo, column.columnGroup), segmentEnds[c])
+                   : std::make_shared<ColumnSegmentReader>(segPath(groupNo, column.colId));
+            rc = reader->open();
+        }
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        if (reader->getNumRows() != nRows || reader->getType() != schema[c].type) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+        reader->setPool(pool);
+        reader->setDecodedCache(cache);
+        group->columns.push_back(reader);
+    }
+
+    /* The ids of a compacted group are read once and kept */
+    if (hasIds) {
+        ColumnSegmentReader reader(idsPath(groupNo));
+        ColumnStatus rc = reader.open();
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        auto ids = std::make_shared<std::vector<uint64_t>>();
+        ColumnVector vec;
+        for (size_t idx = 0; idx < reader.getNumChunks(); ++idx) {
+            rc = reader.readChunk(idx, vec);
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            ids->insert(ids->end(), vec.values.begin(), vec.values.end());
+        }
+        if (ids->size() != nRows || ids->empty() || nRows > UINT32_MAX) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+
+        /* Rows of a sorted group are not in id order, look them up through an index */
+        if (!std::is_sorted(ids->begin(), ids->end())) {
+            auto order = std::make_shared<std::vector<uint32_t>>(nRows);
+            std::iota(order->begin(), order->end(), 0);
+            std::sort(order->begin(), order->end(), [&ids](uint32_t a, uint32_t b) { return (*ids)[a] < (*ids)[b]; });
+            group->idOrder = order;
+        }
+        uint64_t prev = 0;
+        for (uint64_t offset = 0; offset < nRows; ++offset) {
+            uint64_t id = (*ids)[group->idOrder ? (*group->idOrder)[offset] : offset];
+            if ((offset == 0 && id != firstRow) || (offset > 0 && id <= prev)) {
+                return ColumnStatus::CORRUPT_SEGMENT;
+            }
+            prev = id;
+        }
+        group->rowIds = ids;
+    }
+
+    if (deleteGen != 0) {
+        auto deletes = std::make_shared<DeleteVector>();
+        ColumnStatus rc = readDeleteVector(deletesPath(groupNo, deleteGen), nRows, *deletes);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        if (deletes->getNumDeleted() > 0) {
+            group->deletes = deletes;
+        }
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Order of two rows on the sort key, nulls first */
+static int compareOnKey(const std::vector<TableColumn>& schema, const std::vector<size_t>& sortKey,
+                        const table_row_t& a, const table_row_t& b) {
+    for (size_t c : sortKey) {
+        const FieldValue& x = a[c];
+        const FieldValue& y = b[c];
+        if (x.isNull || y.isNull) {
+            if (x.isNull != y.isNull) {
+                return x.isNull ? -1 : 1;
+            }
+            continue;
+        }
+        int cmp = schema[c].type == ColumnType::STRING ? x.strVal.compare(y.strVal)
+                                                        : (x.intVal > y.intVal) - (x.intVal < y.intVal);
+        if (cmp != 0) {
+            return cmp;
+        }
+    }
+    return 0;
+}
+
+/* Order of two parsed rows on the sort key, nulls first */
+static int compareBatchOnKey(const std::vector<TableColumn>& schema, const std::vector<size_t>& sortKey,
+                             const std::vector<ColumnBatch>& columns, size_t a, size_t b) {
+    for (size_t c : sortKey) {
+        const ColumnBatch& col = columns[c];
+        if (col.nulls[a] || col.nulls[b]) {
+            if (col.nulls[a] != col.nulls[b]) {
+                return col.nulls[a] ? -1 : 1;
+            }
+            continue;
+        }
+        int cmp = schema[c].type == ColumnType::STRING
+                ? col.strings[a].compare(col.strings[b])
+                : (col.values[a] > col.values[b]) - (col.values[a] < col.values[b]);
+        if (cmp != 0) {
+            return cmp;
+        }
+    }
+    return 0;
+}
+
+/* Open `writer` on a segment of column `col`, with the column's codec and filters */
+ColumnStatus Table::startSegment(ColumnSegmentWriter& writer, size_t col) const {
+    ColumnStatus rc = writer.open();
+    if (rc == ColumnStatus::GENERAL_SUCCESS) {
+        rc = writer.setCodec(schema[col].codec);
+    }
+    if (rc == ColumnStatus::GENERAL_SUCCESS && schema[col].bloomFilter) {
+        rc = writer.setBloomFilter(BLOOM_BITS_PER_KEY);
+    }
+    if (rc == ColumnStatus::GENERAL_SUCCESS && schema[col].columnGroup >= 0) {
+        rc = writer.setChunkSize(COLUMN_GROUP_PAGE_ROWS);
+    }
+    return rc;
+}
+
+/* Row ids of a group in row order, for a group whose rows are not in id order */
+ColumnStatus Table::writeIds(uint64_t groupNo, const std::vector<uint64_t>& ids) const {
+    ColumnSegmentWriter writer(idsPath(groupNo), TABLE_ROW_ID_COLUMN, ColumnType::INT64);
+    ColumnStatus rc = writer.open();
+    for (size_t r = 0; r < ids.size() && rc == ColumnStatus::GENERAL_SUCCESS; ++r) {
+        rc = writer.append(static_cast<int64_t>(ids[r]));
+    }
+    if (rc == ColumnStatus::GENERAL_SUCCESS) {
+        rc = writer.finish();
+    }
+    return rc;
+}
+
+/* Move the segments of each column group of a group just written into the group's file */
+ColumnStatus Table::packColumnGroups(uint64_t groupNo) const {
+    for (size_t g = 0; g < columnGroups.size(); ++g) {
+        if (columnGroups[g].empty()) {
+            continue;
+        }
+        std::vector<std::string> segments;
+        for (size_t c : columnGroups[g]) {
+            segments.push_back(segPath(groupNo, schema[c].colId));
+        }
+        ColumnStatus rc = writeColumnGroup(groupPath(groupNo, g), segments);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        for (auto& path : segments) {
+            osRemove(path.c_str());
+        }
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Write rows as a new group, one segment per column plus the ids unless
+    they are contiguous and in order. With a sort key the rows are written
+    sorted on it, ties in row id order.
+
+*/
+ColumnStatus Table::writeGroup(const std::vector<uint64_t>& rowIds, const std::vector<table_row_t>& rows,
+                               std::shared_ptr<RowGroup>& group) {
+
+    std::vector<size_t> order(rows.size());     // Input row of each row written
+    std::iota(order.begin(), order.end(), 0);
+    if (!sortKey.empty()) {
+        std::stable_sort(order.begin(), order.end(), [this, &rows](size_t a, size_t b) {
+            return compareOnKey(schema, sortKey, rows[a], rows[b]) < 0;
+        });
+    }
+
+    uint64_t groupNo = nextGroupNo++;
+    for (size_t c = 0; c < schema.size(); ++c) {
+
+        ColumnSegmentWriter writer(segPath(groupNo, schema[c].colId), schema[c].colId, schema[c].type);
+        ColumnStatus rc = startSegment(writer, c);
+
+        for (size_t r = 0; r < rows.size() && rc == ColumnStatus::GENERAL_SUCCESS; ++r) {
+            const FieldValue& val = rows[order[r]][c];
+            if (val.isNull) {
+                rc = writer.appendNull();
+            }
+            else if (schema[c].type == ColumnType::STRING) {
+                rc = writer.append(val.strVal);
+            }
+            else {
+                rc = writer.append(val.intVal);
+            }
+        }
+        if (rc == ColumnStatus::GENERAL_SUCCESS) {
+            rc = writer.finish();
+        }
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+
+    ColumnStatus rc = packColumnGroups(groupNo);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    uint64_t firstRow = *std::min_element(rowIds.begin(), rowIds.end());
+    bool hasIds = false;
+    for (size_t r = 0; r < rowIds.size() && !hasIds; ++r) {
+        hasIds = rowIds[order[r]] != firstRow + r;
+    }
+    if (hasIds) {
+        std::vector<uint64_t> ids(rowIds.size());
+        for (size_t r = 0; r < rowIds.size(); ++r) {
+            ids[r] = rowIds[order[r]];
+        }
+        if ((rc = writeIds(groupNo, ids)) != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+
+    return openGroup(groupNo, firstRow, rowIds.size(), hasIds, 0, group);
+}
+
+/* Parsed rows with ids firstRow, firstRow + 1, ... as group `groupNo`, like writeGroup() */
+ColumnStatus Table::writeBatchGroup(uint64_t groupNo, uint64_t firstRow, const std::vector<ColumnBatch>& columns,
+                                    std::shared_ptr<RowGroup>& group) {
+
+    size_t nRows = columns[0].size();
+    std::vector<size_t> order(nRows);
+    std::iota(order.begin(), order.end(), 0);
+    if (!sortKey.empty()) {
+        std::stable_sort(order.begin(), order.end(), [this, &columns](size_t a, size_t b) {
+            return compareBatchOnKey(schema, sortKey, columns, a, b) < 0;
+        });
+    }
+
+    for (size_t c = 0; c < schema.size(); ++c) {
+
+        ColumnSegmentWriter writer(segPath(groupNo, schema[c].colId), schema[c].colId, schema[c].type);
+        ColumnStatus rc = startSegment(writer, c);
+
+        const ColumnBatch& col = columns[c];
+        for (size_t r = 0; r < nRows && rc == ColumnStatus::GENERAL_SUCCESS; ++r) {
+            size_t idx = order[r];
+            if (col.nulls[idx]) {
+                rc = writer.appendNull();
+            }
+            else if (schema[c].type == ColumnType::STRING) {
+                rc = writer.append(col.strings[idx]);
+            }
+            else {
+                rc = writer.append(col.values[idx]);
+            }
+        }
+        if (rc == ColumnStatus::GENERAL_SUCCESS) {
+            rc = writer.finish();
+        }
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+
+    ColumnStatus rc = packColumnGroups(groupNo);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    bool hasIds = false;
+    for (size_t r = 0; r < nRows && !hasIds; ++r) {
+        hasIds = order[r] != r;
+    }
+    if (hasIds) {
+        std::vector<uint64_t> ids(nRows);
+        for (size_t r = 0; r < nRows; ++r) {
+            ids[r] = firstRow + order[r];
+        }
+        if ((rc = writeIds(groupNo, ids)) != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+
+    return openGroup(groupNo, firstRow, nRows, hasIds, 0, group);
+}
+
+/* Rewrite a group without its deleted rows (and dropped columns), `compacted` is null if no row is left */
+ColumnStatus Table::compactGroup(const RowGroup& group, std::shared_ptr<RowGroup>& compacted) {
+
+    std::vector<uint64_t> rowIds;
+    for (uint64_t offset = 0; offset < group.nRows; ++offset) {
+        if (!group.deletes || !group.deletes->isDeleted(offset)) {
+            rowIds.push_back(group.getRowId(offset));
+        }
+    }
+    compacted = nullptr;
+    if (rowIds.empty()) {
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    std::vector<table_row_t> rows(rowIds.size(), table_row_t(schema.size()));
+    for (size_t c = 0; c < schema.size(); ++c) {
+        ColumnSegmentReader& segment = *group.columns[c];
+        const std::vector<std::string>& dict = segment.getDictionary();
+        ColumnVector vec;
+        size_t r = 0;
+
+        for (size_t idx = 0; idx < segment.getNumChunks(); ++idx) {
+            ColumnStatus rc = segment.readChunk(idx, vec);
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+            for (size_t i = 0; i < vec.size(); ++i) {
+                if (group.deletes && group.deletes->isDeleted(segment.getFirstRow(idx) + i)) {
+                    continue;
+                }
+                FieldValue& val = rows[r++][c];
+                if (vec.isNull(i)) {
+                    continue;
+                }
+                if (schema[c].type != ColumnType::STRING) {
+                    val = FieldValue::of(vec.values[i]);
+                }
+                else if (segment.getStringLayout() == StringLayout::HEAP) {
+                    val = FieldValue::of(vec.strings[i]);
+                }
+                else if (static_cast<uint64_t>(vec.values[i]) < dict.size()) {
+                    val = FieldValue::of(dict[vec.values[i]]);
+                }
+                else {
+                    return ColumnStatus::CORRUPT_SEGMENT;
+                }
+            }
+        }
+        if (r != rows.size()) {
+            return ColumnStatus::CORRUPT_SEGMENT;
+        }
+    }
+
+    return writeGroup(rowIds, rows, compacted);
+}
+
+/* Replace the manifest atomically: write a temporary file, then rename it */
+ColumnStatus Table::writeManifest(const std::vector<TableColumn>& columns,
+                                  const std::vector<std::shared_ptr<const RowGroup>>& groups) {
+
+    TableManifestHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = TABLE_MANIFEST_MAGIC;
+    hdr.version = TABLE_MANIFEST_VERSION;
+    hdr.nColumns = static_cast<uint32_t>(columns.size());
+    hdr.nGroups = groups.size();
+
+    std::vector<char> buf(sizeof(hdr));
+    memcpy(buf.data(), &hdr, sizeof(hdr));
+    for (auto& column : columns) {
+        const FieldValue& def = column.defaultValue;
+        bool isString = column.type == ColumnType::STRING && !def.isNull;
+        TableManifestColumn entry = { column.colId, isString ? static_cast<uint32_t>(def.strVal.size()) : 0U,
+                                      column.firstGroupNo, def.isNull ? 0 : def.intVal,
+                                      def.isNull ? TABLE_COLUMN_NULL_DEFAULT : 0ULL };
+        buf.insert(buf.end(), reinterpret_cast<char*>(&entry), reinterpret_cast<char*>(&entry + 1));
+        if (isString) {
+            buf.insert(buf.end(), def.strVal.begin(), def.strVal.end());
+        }
+    }
+    for (auto& group : groups) {
+        uint64_t flags = (group->rowIds ? TABLE_GROUP_HAS_IDS : 0) | (group->hasDropped ? TABLE_GROUP_HAS_DROPPED : 0);
+        TableManifestGroup entry = { group->groupNo, group->firstRow, group->nRows, group->deleteGen, flags };
+        buf.insert(buf.end(), reinterpret_cast<char*>(&entry), reinterpret_cast<char*>(&entry + 1));
+    }
+
+    std::string tmp = manifestPath() + ".tmp";
+    osRemove(tmp.c_str());              // Leftover of an earlier failed write
+    os_fd_t fd = osOpen(tmp.c_str(), true);
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::IO_ERROR;
+    }
+    bool ok = osWrite(fd, buf.data(), buf.size(), 0) == static_cast<ssize_t>(buf.size()) &&
+              osDataSync(fd) == 0;
+    osClose(fd);
+
+    if (!ok || osRename(tmp.c_str(), manifestPath().c_str()) != 0 || osSyncDir(dir.c_str()) != 0) {
+        return ColumnStatus::IO_ERROR;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+    Segment, column group and ids files of a group, found by listing the
+    directory: the group may hold segments of columns dropped since, or
+    grouped columns' segments left by a failed write
+*/
+void Table::removeSegments(uint64_t groupNo) const {
+    std::vector<std::string> names;
+    if (osListDir(dir.c_str(), names) != 0) {
+        return;
+    }
+    std::string prefix = "g" + std::to_string(groupNo) + "_";
+    std::string suffix = ".seg";
+    for (auto& name : names) {
+        if (name.size() > prefix.size() + suffix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            osRemove((dir + "/" + name).c_str());
+        }
+    }
+}
+
+/* Files of a group the manifest no longer names, only its delete vector unless `segments` */
+void Table::removeGroupFiles(const RowGroup& group, bool segments) {
+    if (group.deleteGen != 0) {
+        osRemove(deletesPath(group.groupNo, group.deleteGen).c_str());
+    }
+    if (segments) {
+        removeSegments(group.groupNo);
+    }
+}
+
+/* Does a group still store segments of dropped columns? */
+static bool hasDroppedGroup(const TableVersion& ver) {
+    return std::any_of(ver.groups.begin(), ver.groups.end(), [](const std::shared_ptr<const RowGroup>& group) {
+        return group->hasDropped;
+    });
+}
+
+/* One tuple mover pass, see table.h */
+ColumnStatus Table::moveTuples() {
+
+    std::lock_guard<std::mutex> moving(moveLatch);
+
+    /* 1. Freeze the active store, unless a failed pass left one frozen */
+    {
+        std::lock_guard<std::mutex> lock(latch);
+        if (!version) {
+            return ColumnStatus::GENERAL_FAILURE;
+        }
+        if (!version->frozen) {
+            if (version->active->getNumRows() == 0 && version->active->getNumDeletes() == 0 &&
+                !hasDroppedGroup(*version)) {
+                return ColumnStatus::GENERAL_SUCCESS;
+            }
+            freezeActive();
+        }
+    }
+    return moveFrozen({});
+}
+
+/* The active store becomes the frozen one and a new empty store takes the writes, `latch` is held */
+void Table::freezeActive() {
+    auto frozen = std::make_shared<TableVersion>(*version);
+    frozen->frozen = version->active;
+    frozen->active = std::make_shared<DeltaStore>();
+    version = frozen;
+}
+
+/* Steps 2 and 3 of a move, publishing the `loaded` groups of a bulk load after the frozen rows */
+ColumnStatus Table::moveFrozen(const std::vector<std::shared_ptr<const RowGroup>>& loaded) {
+
+    std::shared_ptr<const TableVersion> base = getVersion();
+
+    /* 2. Write the new group, readers and writers carry on meanwhile */
+    std::vector<uint64_t> rowIds, deletes;
+    std::vector<table_row_t> rows;
+    base->frozen->getRows(rowIds, rows);
+    base->frozen->getDeletes(deletes);
+
+    /* Until the manifest names them, the files this pass writes are its own to remove on failure */
+    std::vector<uint64_t> written;          // Numbers of the groups written, complete or not
+    std::vector<std::string> newDeletes;    // Delete vector files written
+    auto failed = [&](ColumnStatus rc) {
+        for (uint64_t groupNo : written) {
+            removeSegments(groupNo);
+        }
+        for (auto& path : newDeletes) {
+            osRemove(path.c_str());
+        }
+        return rc;
+    };
+
+    std::vector<std::shared_ptr<const RowGroup>> groups = base->groups;
+    if (!rowIds.empty()) {
+        std::shared_ptr<RowGroup> group;
+        written.push_back(nextGroupNo);
+        ColumnStatus rc = writeGroup(rowIds, rows, group);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return failed(rc);
+        }
+        groups.push_back(group);
+    }
+    groups.insert(groups.end(), loaded.begin(), loaded.end());
+
+    /* Set the frozen deletes in copies of the delete vectors they touch */
+    std::map<size_t, std::shared_ptr<DeleteVector>> changed;
+    for (uint64_t rowId : deletes) {
+        size_t idx = findGroupIdx(groups, rowId);
+        uint64_t offset;
+        if (idx == groups.size() || !groups[idx]->findRow(rowId, offset)) {
+            continue;
+        }
+        auto& deleteVec = changed[idx];
+        if (!deleteVec) {
+            deleteVec = groups[idx]->deletes ? std::make_shared<DeleteVector>(*groups[idx]->deletes)
+                                             : std::make_shared<DeleteVector>();
+        }
+        deleteVec->markDeleted(offset);
+    }
+
+    /* Compact the groups past the threshold, write the new delete vectors of the rest */
+    std::vector<std::pair<std::shared_ptr<const RowGroup>, bool>> obsolete;
+    for (auto& entry : changed) {
+        const RowGroup& old = *groups[entry.first];
+        auto group = std::make_shared<RowGroup>(old);
+        group->deletes = entry.second;
+        ColumnStatus rc;
+
+        if (entry.second->getNumDeleted() * 100 >= old.nRows * COMPACTION_THRESHOLD) {
+            std::shared_ptr<RowGroup> compacted;
+            written.push_back(nextGroupNo);
+            rc = compactGroup(*group, compacted);
+            obsolete.emplace_back(groups[entry.first], true);
+            groups[entry.first] = compacted;
+        }
+        else {
+            group->deleteGen = old.deleteGen + 1;
+            newDeletes.push_back(deletesPath(group->groupNo, group->deleteGen));
+            rc = writeDeleteVector(newDeletes.back(), *entry.second);
+            if (old.deleteGen != 0) {
+                obsolete.emplace_back(groups[entry.first], false);
+            }
+            groups[entry.first] = group;
+        }
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return failed(rc);
+        }
+    }
+
+    /* Reclaim the dropped columns of one group per pass, the group is written again without them */
+    auto dropped = std::find_if(groups.begin(), groups.end(), [](const std::shared_ptr<const RowGroup>& group) {
+        return group && group->hasDropped;
+    });
+    if (dropped != groups.end()) {
+        std::shared_ptr<RowGroup> compacted;
+        written.push_back(nextGroupNo);
+        ColumnStatus rc = compactGroup(**dropped, compacted);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return failed(rc);
+        }
+        obsolete.emplace_back(*dropped, true);
+        *dropped = compacted;
+    }
+    groups.erase(std::remove(groups.begin(), groups.end(), nullptr), groups.end());
+
+    ColumnStatus rc = writeManifest(schema, groups);
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        return failed(rc);
+    }
+
+    /* 3. Publish, keeping whatever store is active by now */
+    {
+        std::lock_guard<std::mutex> lock(latch);
+        auto moved = std::make_shared<TableVersion>(*version);
+        moved->groups = groups;
+        moved->frozen = nullptr;
+        version = moved;
+    }
+
+    /* Scans still on an older version keep their segments open and their vectors in memory */
+    for (auto& entry : obsolete) {
+        removeGroupFiles(*entry.first, entry.second);
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Load a CSV file (bulk_load.h) as new row groups, one per piece, with
+    row ids after every row inserted so far. The active store is frozen
+    when the ids are taken, so its rows, which all have lower ids, get
+    their group ahead of the loaded ones in the same move. Nothing is
+    visible until the whole file is loaded; on failure the files written
+    are removed and the ids taken are left unused.
+
+*/
+ColumnStatus Table::bulkLoad(const std::string& csvPath, const CsvOptions& opts, uint64_t& nRows) {
+
+    nRows = 0;
+    std::lock_guard<std::mutex> moving(moveLatch);
+    bool leftFrozen;
+    {
+        std::lock_guard<std::mutex> lock(latch);
+        if (!version || schema.empty()) {
+            return ColumnStatus::GENERAL_FAILURE;
+        }
+        leftFrozen = version->frozen != nullptr;
+    }
+
+    /* Rows of a failed move go first, the store frozen below must be the only one */
+    if (leftFrozen) {
+        ColumnStatus rc = moveFrozen({});
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+
+    os_fd_t fd = osOpenRead(csvPath.c_str());
+    if (fd == OS_INVALID_FD) {
+        return ColumnStatus::IO_ERROR;
+    }
+    size_t nThreads = opts.threads ? opts.threads : std::max(1u, std::thread::hardware_concurrency());
+    std::vector<ColumnType> types;
+    for (auto& column : schema) {
+        types.push_back(column.type);
+    }
+
+    /* Count the rows of every piece, which fixes the row ids of each */
+    std::vector<CsvPiece> pieces;
+    ColumnStatus rc = csvSplit(fd, opts, pieces);
+    if (rc == ColumnStatus::GENERAL_SUCCESS) {
+        rc = parallelFor(pieces.size(), nThreads, [fd, &pieces](size_t p) {
+            std::vector<char> buf(pieces[p].end - pieces[p].begin);
+            if (osRead(fd, buf.data(), buf.size(), pieces[p].begin) != static_cast<ssize_t>(buf.size())) {
+                return ColumnStatus::IO_ERROR;
+            }
+            pieces[p].nRows = csvCountRows(buf.data(), buf.size());
+            return ColumnStatus::GENERAL_SUCCESS;
+        });
+    }
+    if (rc != ColumnStatus::GENERAL_SUCCESS || pieces.empty()) {
+        osClose(fd);
+        return rc;
+    }
+
+    uint64_t firstGroupNo = nextGroupNo;
+    nextGroupNo += pieces.size();
+    {
+        std::lock_guard<std::mutex> lock(latch);
+        freezeActive();
+        for (auto& piece : pieces) {
+            piece.firstRow = nextRowId;
+            nextRowId += piece.nRows;
+        }
+    }
+
+    /* Parse, encode and write the groups */
+    std::vector<std::shared_ptr<const RowGroup>> loaded(pieces.size());
+    rc = parallelFor(pieces.size(), nThreads, [&](size_t p) {
+        std::vector<char> buf(pieces[p].end - pieces[p].begin);
+        if (osRead(fd, buf.data(), buf.size(), pieces[p].begin) != static_cast<ssize_t>(buf.size())) {
+            return ColumnStatus::IO_ERROR;
+        }
+        std::vector<ColumnBatch> columns;
+        ColumnStatus status = csvParse(buf.data(), buf.size(), opts.delimiter, types, columns);
+        buf = std::vector<char>();
+        if (status == ColumnStatus::GENERAL_SUCCESS && columns[0].size() != pieces[p].nRows) {
+            status = ColumnStatus::GENERAL_FAILURE;     // File changed since it was counted
+        }
+        std::shared_ptr<RowGroup> group;
+        if (status == ColumnStatus::GENERAL_SUCCESS) {
+            status = writeBatchGroup(firstGroupNo + p, pieces[p].firstRow, columns, group);
+        }
+        loaded[p] = group;
+        return status;
+    });
+    osClose(fd);
+
+    if (rc == ColumnStatus::GENERAL_SUCCESS) {
+        rc = moveFrozen(loaded);
+    }
+    if (rc != ColumnStatus::GENERAL_SUCCESS) {
+        for (size_t p = 0; p < pieces.size(); ++p) {
+            removeSegments(firstGroupNo + p);
+        }
+        return rc;
+    }
+    for (auto& piece : pieces) {
+        nRows += piece.nRows;
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+void Table::startMover() {
+    std::lock_guard<std::mutex> lock(latch);
+    if (!mover.joinable()) {
+        moverStopping = false;
+        mover = std::thread(&Table::moverLoop, this);
+    }
+}
+
+void Table::stopMover() {
+    {
+        std::lock_guard<std::mutex> lock(latch);
+        moverStopping = true;
+    }
+    moverCv.notify_all();
+    if (mover.joinable()) {
+        mover.join();
+    }
+}
+
+/* Wake up every TUPLE_MOVER_INTERVAL ms (or when an insert fills the store) and move if needed */
+void Table::moverLoop() {
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(latch);
+            moverCv.wait_for(lock, std::chrono::milliseconds(TUPLE_MOVER_INTERVAL), [this] {
+                return moverStopping || version->active->getNumRows() >= DELTA_MOVE_THRESHOLD;
+            });
+            if (moverStopping) {
+                return;
+            }
+            if (!version->frozen && version->active->getNumRows() < DELTA_MOVE_THRESHOLD &&
+                !hasDroppedGroup(*version)) {
+                continue;
+            }
+        }
+        moveTuples();
+    }
+}
+
+/* TableScan */
+
+TableScan::TableScan(Table& table, size_t col, const TablePredicate* pred) :
+    version(table.getVersion()), col(col), type((*version->schema)[col].type), pred(pred),
+    groupIdx(0), groupPred{ CompareOp::GE, INT64_MIN, 0 }, groupDeletes(nullptr),
+    deleteWords(COLUMN_VECTOR_SIZE / 64), deltaPos(0) {
+
+    /* Delta stores are copied now, so the scan sees them as of its start */
+    std::vector<uint64_t> ids, dels;
+    std::vector<FieldValue> vals;
+    for (auto& store : { version->frozen, version->active }) {
+        if (!store) {
+            continue;
+        }
+        store->getColumn(col, ids, vals);
+        deltaIds.insert(deltaIds.end(), ids.begin(), ids.end());
+        deltaValues.insert(deltaValues.end(), vals.begin(), vals.end());
+        store->getDeletes(dels);
+        deleted.insert(deleted.end(), dels.begin(), dels.end());
+    }
+    std::sort(deleted.begin(), deleted.end());
+}
+
+bool TableScan::isDeleted(uint64_t rowId) const {
+    return std::binary_search(deleted.begin(), deleted.end(), rowId);
+}
+
+/* `pred` as a segment evaluates it: on codes, or on strings (returning true) for a STRING_HEAP segment */
+static bool segmentPredicate(const ColumnSegmentReader& segment, ColumnType type, const TablePredicate& pred,
+                             ColumnPredicate& codePred, StringPredicate& strPred) {
+    if (type == ColumnType::STRING && segment.getStringLayout() == StringLayout::HEAP) {
+        strPred = StringPredicate{ pred.op, pred.lo.strVal, pred.hi.strVal };
+        return true;
+    }
+    codePred = (type == ColumnType::STRING)
+        ? stringPredicate(segment.getDictionary(), pred.op, pred.lo.strVal, pred.hi.strVal)
+        : ColumnPredicate{ pred.op, pred.lo.intVal, pred.hi.intVal };
+    return false;
+}
+
+/* Delete vector of a group, copied into `merged` with the deletes not moved yet (`deleted`) if it has any */
+static const DeleteVector* mergeGroupDeletes(const RowGroup& group, const std::vector<uint64_t>& deleted,
+                                             DeleteVector& merged) {
+    auto first = std::lower_bound(deleted.begin(), deleted.end(), group.firstRow);
+    auto last = std::lower_bound(first, deleted.end(), group.getEndRow());
+    if (first == last) {
+        return group.deletes.get();
+    }
+    merged = group.deletes ? *group.deletes : DeleteVector();
+    uint64_t offset;
+    for (auto it = first; it != last; ++it) {
+        if (group.findRow(*it, offset)) {
+            merged.markDeleted(offset);
+        }
+    }
+    return &merged;
+}
+
+/* Start on the next group, folding the deletes not moved yet into a copy of its delete vector */
+void TableScan::openGroup() {
+
+    group = version->groups[groupIdx++];
+    ColumnSegmentReader& segment = *group->columns[col];
+    if (!pred) {
+        scan.reset(new ColumnScan(segment));
+    }
+    else if (segmentPredicate(segment, type, *pred, groupPred, groupStrPred)) {
+        scan.reset(new ColumnScan(segment, &groupStrPred));
+    }
+    else {
+        scan.reset(new ColumnScan(segment, &groupPred));
+    }
+    groupDeletes = mergeGroupDeletes(*group, deleted, mergedDeletes);
+}
+
+template <typename T>
+static bool compareMatches(CompareOp op, const T& val, const T& lo, const T& hi) {
+    switch (op) {
+        case CompareOp::EQ:      return val == lo;
+        case CompareOp::NE:      return val != lo;
+        case CompareOp::LT:      return val < lo;
+        case CompareOp::LE:      return val <= lo;
+        case CompareOp::GT:      return val > lo;
+        case CompareOp::GE:      return val >= lo;
+        case CompareOp::BETWEEN: return val >= lo && val <= hi;
+        case CompareOp::PREFIX:  break;        // Strings only, see matches()
+    }
+    return false;
+}
+
+/* Predicate on a delta value, nulls never match */
+static bool deltaMatches(ColumnType type, const TablePredicate& pred, const FieldValue& val) {
+    if (val.isNull) {
+        return false;
+    }
+    if (type == ColumnType::STRING) {
+        if (pred.op == CompareOp::PREFIX) {
+            return val.strVal.compare(0, pred.lo.strVal.size(), pred.lo.strVal) == 0;
+        }
+        return compareMatches(pred.op, val.strVal, pred.lo.strVal, pred.hi.strVal);
+    }
+    return compareMatches(pred.op, val.intVal, pred.lo.intVal, pred.hi.intVal);
+}
+
+bool TableScan::matches(const FieldValue& val) const {
+    return !pred || deltaMatches(type, *pred, val);
+}
+
+/*
+
+    Produce the next batch with at least one live, qualifying row.
+    Returns INDEX_OUT_OF_BOUNDS when the scan is done.
+
+*/
+ColumnStatus TableScan::next(TableBatch& batch) {
+
+    uint64_t firstRow;
+    while (groupIdx < version->groups.size() || scan) {
+
+        if (!scan) {
+            openGroup();
+        }
+
+        ColumnStatus rc = scan->next(batch.values, batch.sel, firstRow);
+        if (rc == ColumnStatus::INDEX_OUT_OF_BOUNDS) {
+            scan.reset();
+            continue;
+        }
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+
+        if (groupDeletes && groupDeletes->getWords(firstRow, batch.values.size(), deleteWords.data())) {
+            maskDeleted(deleteWords.data(), batch.values.size(), batch.sel);
+        }
+        if (batch.sel.empty()) {
+            continue;
+        }
+
+        batch.rowIds.clear();
+        for (uint32_t i : batch.sel) {
+            batch.rowIds.push_back(group->getRowId(firstRow + i));
+        }
+        batch.segment = group->columns[col];
+        batch.dictionary = (type == ColumnType::STRING) ? &batch.segment->getDictionary() : nullptr;
+        if (type == ColumnType::STRING && group->columns[col]->getStringLayout() == StringLayout::HEAP) {
+            vectorDict.swap(batch.values.strings);     // Positions in the vector serve as codes
+            batch.dictionary = &vectorDict;
+        }
+        return ColumnStatus::GENERAL_SUCCESS;
+    }
+
+    while (deltaPos < deltaIds.size()) {
+        ColumnStatus rc = nextDelta(batch);
+        if (rc != ColumnStatus::GENERAL_SUCCESS || !batch.sel.empty()) {
+            return rc;
+        }
+    }
+    return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+}
+
+/* Up to COLUMN_VECTOR_SIZE delta rows as a batch, STRING values coded into a batch dictionary */
+ColumnStatus TableScan::nextDelta(TableBatch& batch) {
+
+    size_t n = std::min<size_t>(deltaIds.size() - deltaPos, COLUMN_VECTOR_SIZE);
+    batch.values.clear();
+    batch.values.values.resize(n);
+    batch.values.validity.assign((n + 63) / 64, 0);
+    batch.sel.clear();
+    batch.rowIds.clear();
+    batch.segment.reset();
+    deltaDict.clear();
+    batch.dictionary = (type == ColumnType::STRING) ? &deltaDict : nullptr;
+
+    bool hasNulls = false;
+    for (size_t i = 0; i < n; ++i) {
+        const FieldValue& val = deltaValues[deltaPos + i];
+        uint64_t rowId = deltaIds[deltaPos + i];
+
+        if (val.isNull) {
+            hasNulls = true;
+        }
+        else {
+            batch.values.validity[i >> 6] |= 1ULL << (i & 63);
+        }
+        if (type == ColumnType::STRING) {
+            batch.values.values[i] = static_cast<int64_t>(deltaDict.size());
+            deltaDict.push_back(val.strVal);
+        }
+        else {
+            batch.values.values[i] = val.intVal;
+        }
+
+        if (matches(val) && !isDeleted(rowId)) {
+            batch.sel.push_back(static_cast<uint32_t>(i));
+            batch.rowIds.push_back(rowId);
+        }
+    }
+    if (!hasNulls) {
+        batch.values.validity.clear();
+    }
+    deltaPos += n;
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+TableSelect::TableSelect(Table& table, const std::vector<TableFilter>& filters, const std::vector<size_t>& columns) :
+    version(table.getVersion()), filters(filters), columns(columns), groupIdx(0), posIdx(0),
+    heapDicts(columns.size()), deltaValues(columns.size()), deltaPos(0), deltaDicts(columns.size()) {
+
+    for (auto& col : *version->schema) {
+        types.push_back(col.type);
+    }
+
+    std::vector<uint64_t> ids;
+    for (auto& store : { version->frozen, version->active }) {
+        if (store) {
+            store->getDeletes(ids);
+            deleted.insert(deleted.end(), ids.begin(), ids.end());
+        }
+    }
+    std::sort(deleted.begin(), deleted.end());
+
+    /* Delta rows are filtered now, as of the scan's start, and only their projected values kept */
+    std::vector<table_row_t> rows;
+    for (auto& store : { version->frozen, version->active }) {
+        if (!store) {
+            continue;
+        }
+        store->getRows(ids, rows);
+        for (size_t r = 0; r < rows.size(); ++r) {
+            const table_row_t& row = rows[r];
+            bool match = !std::binary_search(deleted.begin(), deleted.end(), ids[r]);
+            for (size_t f = 0; f < filters.size() && match; ++f) {
+                size_t col = filters[f].col;
+                match = deltaMatches(types[col], filters[f].pred, col < row.size() ? row[col] : FieldValue::null());
+            }
+            if (!match) {
+                continue;
+            }
+            deltaIds.push_back(ids[r]);
+            for (size_t c = 0; c < columns.size(); ++c) {
+                deltaValues[c].push_back(columns[c] < row.size() ? row[columns[c]] : FieldValue::null());
+            }
+        }
+    }
+}
+
+/* Start on the next group: positions of its live rows that pass every filter */
+ColumnStatus TableSelect::filterGroup() {
+
+    group = version->groups[groupIdx++];
+    positions.clear();
+    posIdx = 0;
+    cursors.assign(columns.size(), FetchCursor());
+    if (group->nRows > UINT32_MAX) {
+        return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+    }
+
+    ColumnPredicate codePred;
+    StringPredicate strPred;
+    ColumnStatus rc;
+    if (filters.empty()) {
+        positions.resize(group->nRows);
+        std::iota(positions.begin(), positions.end(), 0);
+    }
+    else {
+        const TableFilter& first = filters[0];
+        ColumnSegmentReader& segment = *group->columns[first.col];
+        std::unique_ptr<ColumnScan> scan(segmentPredicate(segment, types[first.col], first.pred, codePred, strPred)
+                                         ? new ColumnScan(segment, &strPred) : new ColumnScan(segment, &codePred));
+        ColumnVector vec;
+        sel_vec_t sel;
+        uint64_t firstRow;
+        while ((rc = scan->next(vec, sel, firstRow)) == ColumnStatus::GENERAL_SUCCESS) {
+            for (uint32_t i : sel) {
+                positions.push_back(static_cast<uint32_t>(firstRow + i));
+            }
+        }
+        if (rc != ColumnStatus::INDEX_OUT_OF_BOUNDS) {
+            return rc;
+        }
+    }
+
+    DeleteVector merged;
+    const DeleteVector* deletes = mergeGroupDeletes(*group, deleted, merged);
+    if (deletes) {
+        positions.erase(std::remove_if(positions.begin(), positions.end(),
+                                       [deletes](uint32_t pos) { return deletes->isDeleted(pos); }),
+                        positions.end());
+    }
+
+    for (size_t f = 1; f < filters.size() && !positions.empty(); ++f) {
+        ColumnSegmentReader& segment = *group->columns[filters[f].col];
+        rc = segmentPredicate(segment, types[filters[f].col], filters[f].pred, codePred, strPred)
+            ? filterPositions(segment, &strPred, positions)
+            : filterPositions(segment, &codePred, positions);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Produce the next batches, one per projected column, with at least one
+    row. Returns INDEX_OUT_OF_BOUNDS when the scan is done.
+
+*/
+ColumnStatus TableSelect::next(std::vector<TableBatch>& batches) {
+
+    batches.resize(columns.size());
+    while (posIdx == positions.size()) {
+        if (groupIdx == version->groups.size()) {
+            if (deltaPos == deltaIds.size()) {
+                return ColumnStatus::INDEX_OUT_OF_BOUNDS;
+            }
+            nextDelta(batches);
+            return ColumnStatus::GENERAL_SUCCESS;
+        }
+        ColumnStatus rc = filterGroup();
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+
+    size_t n = std::min<size_t>(positions.size() - posIdx, COLUMN_VECTOR_SIZE);
+    const uint32_t* pos = positions.data() + posIdx;
+    posIdx += n;
+    for (size_t c = 0; c < columns.size(); ++c) {
+        TableBatch& batch = batches[c];
+        batch.segment = group->columns[columns[c]];
+        ColumnStatus rc = fetchPositions(*group->columns[columns[c]], pos, n, batch.values, cursors[c]);
+        if (rc != ColumnStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+        batch.sel.resize(n);
+        std::iota(batch.sel.begin(), batch.sel.end(), 0);
+        if (c == 0) {
+            batch.rowIds.resize(n);
+            for (size_t i = 0; i < n; ++i) {
+                batch.rowIds[i] = group->getRowId(pos[i]);
+            }
+        }
+        else {
+            batch.rowIds = batches[0].rowIds;
+        }
+
+        batch.dictionary = nullptr;
+        if (types[columns[c]] == ColumnType::STRING) {
+            batch.dictionary = &batch.segment->getDictionary();
+            if (batch.segment->getStringLayout() == StringLayout::HEAP) {
+                heapDicts[c].swap(batch.values.strings);   // Positions in the batch serve as codes
+                batch.dictionary = &heapDicts[c];
+            }
+        }
+    }
+    return ColumnStatus::GENERAL_SUCCESS;
+}
+
+/* Up to COLUMN_VECTOR_SIZE qualifying delta rows, STRING values coded into batch dictionaries */
+void TableSelect::nextDelta(std::vector<TableBatch>& batches) {
+
+    size_t n = std::min<size_t>(deltaIds.size() - deltaPos, COLUMN_VECTOR_SIZE);
+    for (size_t c = 0; c < columns.size(); ++c) {
+        TableBatch& batch = batches[c];
+        bool isString = types[columns[c]] == ColumnType::STRING;
+        batch.values.clear();
+        batch.values.values.resize(n);
+        batch.values.validity.assign((n + 63) / 64, 0);
+        batch.sel.resize(n);
+        std::iota(batch.sel.begin(), batch.sel.end(), 0);
+        batch.rowIds.assign(deltaIds.begin() + deltaPos, deltaIds.begin() + deltaPos + n);
+        batch.segment.reset();
+        deltaDicts[c].clear();
+        batch.dictionary = isString ? &deltaDicts[c] : nullptr;
+
+        bool hasNulls = false;
+        for (size_t i = 0; i < n; ++i) {
+            const FieldValue& val = deltaValues[c][deltaPos + i];
+            if (val.isNull) {
+                hasNulls = true;
+            }
+            else {
+                batch.values.validity[i >> 6] |= 1ULL << (i & 63);
+            }
+            if (isString) {
+                batch.values.values[i] = static_cast<int64_t>(deltaDicts[c].size());
+                deltaDicts[c].push_back(val.strVal);
+            }
+            else {
+                batch.values.values[i] = val.intVal;
+            }
+        }
+        if (!hasNulls) {
+            batch.values.validity.clear();
+        }
+    }
+    deltaPos += n;
+}
\ No newline at end of file
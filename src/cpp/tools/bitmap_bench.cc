@@ -0,0 +1,251 @@
+/*
+
+    Bitmap Benchmark
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "roaring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+
+/*
+
+    Usage:
+        heracles_bitmap_bench [--rows N] [--rounds N]
+
+    Builds pairs of sets over N rows (default 2^24) at several densities,
+    spread at random or in clustered runs, and times the three bitmap
+    representations on what the engine does with them:
+
+        bytes       Memory held by one set
+        and ms      Intersection of the pair, result counted
+        andnot ms   Difference of the pair (a filter minus deletes)
+        probe ns    Membership test of a random row
+
+    std::vector<uint64_t> is the plain bitset<uint64_t>, combined one word
+    at a time; std::vector<bool> is the standard library's packed bitmap.
+
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+static void usage() {
+    fprintf(stderr, "usage: heracles_bitmap_bench [--rows N] [--rounds N]\n");
+}
+
+static double secondsSince(bench_clock_t::time_point start) {
+    return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+/* Row numbers of one set, sorted */
+static std::vector<uint32_t> makeSet(uint32_t nRows, double density, bool clustered, std::mt19937& rng) {
+    std::vector<uint32_t> rows;
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    if (!clustered) {
+        for (uint32_t r = 0; r < nRows; ++r) {
+            if (coin(rng) < density) {
+                rows.push_back(r);
+            }
+        }
+        return rows;
+    }
+
+    /* Runs of about 1000 rows, placed so that the density comes out the same */
+    const uint32_t runLength = 1000;
+    double startOdds = density / runLength;
+    for (uint32_t r = 0; r < nRows; ++r) {
+        if (coin(rng) < startOdds) {
+            uint32_t end = std::min(nRows, r + runLength);
+            for (; r < end; ++r) {
+                rows.push_back(r);
+            }
+        }
+    }
+    return rows;
+}
+
+struct BenchResult {
+    size_t bytes;
+    double andSecs;
+    double andNotSecs;
+    double probeSecs;
+    uint64_t checksum;      // Keeps the compiler honest, and the three structures in agreement
+};
+
+int main(int argc, char** argv) {
+
+    uint32_t nRows = 1U << 24;
+    size_t nRounds = 5;
+    const size_t nProbes = 1 << 20;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--rows") && i + 1 < argc) {
+            nRows = static_cast<uint32_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--rounds") && i + 1 < argc) {
+            nRounds = static_cast<size_t>(atol(argv[++i]));
+        }
+        else {
+            usage();
+            return 2;
+        }
+    }
+    if (nRows == 0 || nRounds == 0) {
+        usage();
+        return 2;
+    }
+
+    std::mt19937 rng(42);
+    std::vector<uint32_t> probes(nProbes);
+    for (auto& p : probes) {
+        p = rng() % nRows;
+    }
+
+    printf("%u rows, %zu rounds, roaring kernels: %s\n\n", nRows, nRounds, roaringKernelName());
+    printf("%-16s %-12s %12s %10s %10s %10s\n", "set", "structure", "bytes", "and ms", "andnot ms", "probe ns");
+
+    const double densities[] = { 0.001, 0.01, 0.1, 0.5 };
+    for (int clustered = 0; clustered <= 1; ++clustered) {
+        for (double density : densities) {
+
+            std::vector<uint32_t> rowsA = makeSet(nRows, density, clustered, rng);
+            std::vector<uint32_t> rowsB = makeSet(nRows, density, clustered, rng);
+            BenchResult results[3];
+
+            /* RoaringBitmap */
+            {
+                RoaringBitmap a, b, out;
+                for (uint32_t r : rowsA) a.add(r);
+                for (uint32_t r : rowsB) b.add(r);
+                a.runOptimize();
+                b.runOptimize();
+
+                BenchResult& res = results[0];
+                res.bytes = a.bytes();
+                auto start = bench_clock_t::now();
+                for (size_t k = 0; k < nRounds; ++k) {
+                    out = roaringAnd(a, b);
+                }
+                res.andSecs = secondsSince(start);
+                res.checksum = out.cardinality();
+                start = bench_clock_t::now();
+                for (size_t k = 0; k < nRounds; ++k) {
+                    out = roaringAndNot(a, b);
+                }
+                res.andNotSecs = secondsSince(start);
+                res.checksum += out.cardinality();
+                start = bench_clock_t::now();
+                for (uint32_t p : probes) {
+                    res.checksum += a.contains(p);
+                }
+                res.probeSecs = secondsSince(start);
+            }
+
+            /* bitset<uint64_t> */
+            {
+                size_t nWords = (nRows + 63) / 64;
+                bitset<uint64_t> a(nWords, 0), b(nWords, 0), out(nWords);
+                for (uint32_t r : rowsA) a[r >> 6] |= 1ULL << (r & 63);
+                for (uint32_t r : rowsB) b[r >> 6] |= 1ULL << (r & 63);
+
+                BenchResult& res = results[1];
+                res.bytes = nWords * sizeof(uint64_t);
+                uint64_t count = 0;
+                auto start = bench_clock_t::now();
+                for (size_t k = 0; k < nRounds; ++k) {
+                    count = 0;
+                    for (size_t w = 0; w < nWords; ++w) {
+                        out[w] = a[w] & b[w];
+                        count += __builtin_popcountll(out[w]);
+                    }
+                }
+                res.andSecs = secondsSince(start);
+                res.checksum = count;
+                start = bench_clock_t::now();
+                for (size_t k = 0; k < nRounds; ++k) {
+                    count = 0;
+                    for (size_t w = 0; w < nWords; ++w) {
+                        out[w] = a[w] & ~b[w];
+                        count += __builtin_popcountll(out[w]);
+                    }
+                }
+                res.andNotSecs = secondsSince(start);
+                res.checksum += count;
+                start = bench_clock_t::now();
+                for (uint32_t p : probes) {
+                    res.checksum += (a[p >> 6] >> (p & 63)) & 1;
+                }
+                res.probeSecs = secondsSince(start);
+            }
+
+            /* std::vector<bool> */
+            {
+                std::vector<bool> a(nRows), b(nRows), out(nRows);
+                for (uint32_t r : rowsA) a[r] = true;
+                for (uint32_t r : rowsB) b[r] = true;
+
+                BenchResult& res = results[2];
+                res.bytes = (nRows + 7) / 8;
+                uint64_t count = 0;
+                auto start = bench_clock_t::now();
+                for (size_t k = 0; k < nRounds; ++k) {
+                    count = 0;
+                    for (uint32_t r = 0; r < nRows; ++r) {
+                        out[r] = a[r] && b[r];
+                        count += out[r];
+                    }
+                }
+                res.andSecs = secondsSince(start);
+                res.checksum = count;
+                start = bench_clock_t::now();
+                for (size_t k = 0; k < nRounds; ++k) {
+                    count = 0;
+                    for (uint32_t r = 0; r < nRows; ++r) {
+                        out[r] = a[r] && !b[r];
+                        count += out[r];
+                    }
+                }
+                res.andNotSecs = secondsSince(start);
+                res.checksum += count;
+                start = bench_clock_t::now();
+                for (uint32_t p : probes) {
+                    res.checksum += a[p];
+                }
+                res.probeSecs = secondsSince(start);
+            }
+
+            if (results[0].checksum != results[1].checksum || results[1].checksum != results[2].checksum) {
+                fprintf(stderr, "bitmap_bench: results disagree at density %g\n", density);
+                return 1;
+            }
+
+            char label[32];
+            snprintf(label, sizeof(label), "%s %g%%", clustered ? "runs" : "random", density * 100);
+            const char* names[] = { "roaring", "uint64_t", "vector<bool>" };
+            for (int s = 0; s < 3; ++s) {
+                printf("%-16s %-12s %12zu %10.3f %10.3f %10.1f\n", s == 0 ? label : "", names[s],
+                       results[s].bytes, results[s].andSecs * 1e3 / nRounds,
+                       results[s].andNotSecs * 1e3 / nRounds, results[s].probeSecs * 1e9 / nProbes);
+            }
+        }
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,168 @@
+/*
+
+    Bloom Filter Benchmark
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "column_scan.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+
+    Usage:
+        heracles_bloom_bench [--rows N] [--lookups N] [--bits N] <dir>
+
+    Writes N random user ids (default 2^22, drawn from 2^40 values so
+    nearly all are distinct) to two segments in <dir>, one plain and one
+    with Bloom filters of --bits bits per key, then runs the same point
+    lookups (WHERE user_id = ?) on both: half for ids that are in the
+    column, half for ids that are not. Prints per segment its size, the
+    chunks read per lookup and the lookups per second; for the filtered
+    segment also the false positive rate, the share of chunks without
+    the id that were still read.
+
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+static void usage() {
+    fprintf(stderr, "usage: heracles_bloom_bench [--rows N] [--lookups N] [--bits N] <dir>\n");
+}
+
+static double secondsSince(bench_clock_t::time_point start) {
+    return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+static bool writeSegment(const std::string& path, const std::vector<int64_t>& ids, size_t bits) {
+    ColumnSegmentWriter writer(path, 0, ColumnType::INT64);
+    if (writer.open() != ColumnStatus::GENERAL_SUCCESS || writer.setBloomFilter(bits) != ColumnStatus::GENERAL_SUCCESS) {
+        return false;
+    }
+    for (int64_t id : ids) {
+        if (writer.append(id) != ColumnStatus::GENERAL_SUCCESS) {
+            return false;
+        }
+    }
+    return writer.finish() == ColumnStatus::GENERAL_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+
+    size_t nRows = 1 << 22;
+    size_t nLookups = 1000;
+    size_t nBits = BLOOM_BITS_PER_KEY;
+    const char* dir = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--rows") && i + 1 < argc) {
+            nRows = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--lookups") && i + 1 < argc) {
+            nLookups = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--bits") && i + 1 < argc) {
+            nBits = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (argv[i][0] == '-' || dir) {
+            usage();
+            return 2;
+        }
+        else {
+            dir = argv[i];
+        }
+    }
+    if (!dir || nRows == 0 || nLookups == 0 || nBits == 0) {
+        usage();
+        return 2;
+    }
+
+    std::mt19937_64 rng(42);
+    std::vector<int64_t> ids(nRows);
+    for (auto& id : ids) {
+        id = static_cast<int64_t>(rng() & ((1ULL << 40) - 1));
+    }
+    std::vector<int64_t> keys(nLookups);
+    for (size_t q = 0; q < nLookups; ++q) {
+        keys[q] = q % 2 ? ids[rng() % nRows] : static_cast<int64_t>((1ULL << 40) + rng() % (1ULL << 40));
+    }
+
+    printf("bloom kernel: %s\n", bloomKernelName());
+    printf("%-8s %12s %10s %14s %12s %10s\n", "segment", "bytes", "chunks", "read/lookup", "lookups/s", "fp rate");
+
+    const char* names[] = { "plain", "bloom" };
+    uint64_t found[2] = { 0, 0 };
+    for (int b = 0; b < 2; ++b) {
+
+        std::string path = std::string(dir) + "/bloom_bench_" + names[b];
+        if (!writeSegment(path, ids, b ? nBits : 0)) {
+            fprintf(stderr, "bloom_bench: cannot write %s\n", path.c_str());
+            return 1;
+        }
+        ColumnSegmentReader reader(path);
+        if (reader.open() != ColumnStatus::GENERAL_SUCCESS) {
+            fprintf(stderr, "bloom_bench: cannot open %s\n", path.c_str());
+            return 1;
+        }
+        size_t nChunks = reader.getNumChunks();
+        uint64_t bytes = reader.getChunk(nChunks - 1).offset + reader.getChunk(nChunks - 1).size;
+        if (b) {
+            bytes = reader.getChunk(nChunks - 1).bloomOffset +
+                    reader.getChunk(nChunks - 1).bloomBlocks * static_cast<uint64_t>(BLOOM_BLOCK_BYTES);
+        }
+
+        /* Chunks that really hold a key, to tell false positives from hits */
+        size_t nRead = 0, nHolding = 0;
+        auto start = bench_clock_t::now();
+        for (int64_t key : keys) {
+            ColumnPredicate pred{ CompareOp::EQ, key, 0 };
+            ColumnScan scan(reader, &pred);
+            ColumnVector vec;
+            sel_vec_t sel;
+            uint64_t firstRow;
+            size_t lastChunk = SIZE_MAX;
+            while (scan.next(vec, sel, firstRow) == ColumnStatus::GENERAL_SUCCESS) {
+                found[b] += sel.size();
+                size_t chunk = firstRow / COLUMN_CHUNK_SIZE;
+                nHolding += chunk != lastChunk;
+                lastChunk = chunk;
+            }
+            nRead += scan.getChunksRead();
+        }
+        double secs = secondsSince(start);
+
+        size_t nEmpty = nLookups * nChunks - nHolding;
+        printf("%-8s %12llu %10zu %14.2f %12.0f", names[b], static_cast<unsigned long long>(bytes), nChunks,
+               static_cast<double>(nRead) / nLookups, nLookups / secs);
+        if (b && nEmpty > 0) {
+            printf(" %9.3f%%", 100.0 * (nRead - nHolding) / nEmpty);
+        }
+        printf("\n");
+        remove(path.c_str());
+    }
+
+    if (found[0] != found[1]) {
+        fprintf(stderr, "bloom_bench: lookups disagree between the segments\n");
+        return 1;
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,414 @@
+/*
+
+    B+ Tree Benchmark
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "bptree.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <numeric>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+
+    Usage:
+        heracles_bptree_bench [--keys N] [--frames N] [--lookups N] [--scans N]
+                              [--scan-len N] [--threads N] [--bulk] [--fill N]
+                              [--random] <dir>
+        heracles_bptree_bench --check N [--frames N] [--threads N] <dir>
+
+    Builds a B+ tree of N keys (default 10^8) in <dir>/bptree.idx, key i
+    mapping to value i, by inserting the keys one at a time in ascending
+    order, or with --random in a scrambled order (key i is i times an odd
+    constant, so the keys stay distinct). With --bulk it bulk loads them
+    instead (BPlusTreeBuilder), filling nodes to --fill percent (default
+    BPTREE_FILL_FACTOR); scrambled keys are sorted first, on --threads
+    threads, and the sort is timed on its own. Flushes it, then measures on the
+    same pool of --frames pages (default PAGE_POOL_FRAMES):
+
+        lookups     --lookups point lookups of random keys (default 10^7),
+                    each must find exactly its value
+        scans       --scans range scans (default 10^5) of --scan-len
+                    entries (default 1000) from random keys
+        full scan   every entry, in order
+
+    and prints the operations and entries per second of each, the tree's
+    height and pages, and the pages the pool read. A tree bigger than the
+    pool is read from the file, or the page cache, as it would be in use.
+
+    With --threads N (default 1) the inserts, lookups and scans are split
+    over N threads working on the tree at once, thread t inserting the
+    keys i with i % N == t; the full scan stays on one thread.
+
+    --check N instead runs N random inserts, deletes and lookups on each
+    of --threads threads against a tree in <dir>/bptree_check.idx, each
+    thread on its own keys (i % threads == t, several values a key) and
+    checking every result against its own std::set, while the other
+    threads change the leaves and split the nodes around it; every 64th
+    operation is a range scan, checked for order. The tree must then
+    hold exactly the entries of all the sets. Use a small --frames to
+    have pages evicted and read back under the threads too.
+
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+static void usage() {
+    fprintf(stderr, "usage: heracles_bptree_bench [--keys N] [--frames N] [--lookups N] [--scans N] "
+                    "[--scan-len N] [--threads N] [--bulk] [--fill N] [--random] <dir>\n"
+                    "       heracles_bptree_bench --check N [--frames N] [--threads N] <dir>\n");
+}
+
+static double secondsSince(bench_clock_t::time_point start) {
+    return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+static bool scrambled = false;      // --random
+static bool bulk = false;           // --bulk
+
+static int64_t keyOf(uint64_t i) {
+    return scrambled ? static_cast<int64_t>(i * 0x9E3779B97F4A7C15ULL) : static_cast<int64_t>(i);
+}
+
+/* Run fn(t) on threads 0 .. nThreads - 1, false if any of them failed */
+template<typename Fn>
+static bool runThreads(size_t nThreads, Fn fn) {
+    std::vector<std::thread> threads;
+    std::vector<char> ok(nThreads, 0);
+    for (size_t t = 0; t < nThreads; ++t) {
+        threads.emplace_back([&, t] { ok[t] = fn(t); });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    return std::find(ok.begin(), ok.end(), 0) == ok.end();
+}
+
+/* Entries of every key in order: sorted in nThreads runs side by side, then the runs merged */
+static void sortedEntries(size_t nKeys, size_t nThreads, std::vector<BPTreeEntry>& entries) {
+    entries.resize(nKeys);
+    std::vector<size_t> bounds;
+    for (size_t t = 0; t <= nThreads; ++t) {
+        bounds.push_back(nKeys * t / nThreads);
+    }
+    runThreads(nThreads, [&](size_t t) {
+        for (size_t i = bounds[t]; i < bounds[t + 1]; ++i) {
+            entries[i] = { keyOf(i), i };
+        }
+        std::sort(entries.begin() + bounds[t], entries.begin() + bounds[t + 1]);
+        return true;
+    });
+    for (size_t width = 1; width < nThreads; width *= 2) {
+        for (size_t t = 0; t + width < nThreads; t += 2 * width) {
+            std::inplace_merge(entries.begin() + bounds[t], entries.begin() + bounds[t + width],
+                               entries.begin() + bounds[std::min(t + 2 * width, nThreads)]);
+        }
+    }
+}
+
+/* Concurrent inserts, deletes, lookups and scans checked against one std::set per thread */
+static int runCheck(const char* dir, size_t nFrames, size_t nThreads, size_t nOps) {
+    std::string path = std::string(dir) + "/bptree_check.idx";
+    remove(path.c_str());
+    PagePool pool(nFrames);
+    BPlusTree tree(pool);
+    if (pool.open(path) != ColumnStatus::GENERAL_SUCCESS || tree.open() != ColumnStatus::GENERAL_SUCCESS) {
+        fprintf(stderr, "bptree_bench: cannot create %s\n", path.c_str());
+        return 1;
+    }
+
+    typedef std::set<std::pair<int64_t, uint64_t>> model_t;
+    std::vector<model_t> models(nThreads);
+    auto start = bench_clock_t::now();
+    bool ok = runThreads(nThreads, [&](size_t t) {
+        std::mt19937_64 rng(7 + t);
+        model_t& model = models[t];
+        std::vector<uint64_t> values, expected;
+        std::vector<BPTreeEntry> batch;
+        for (size_t op = 0; op < nOps; ++op) {
+            int64_t key = static_cast<int64_t>((rng() % 100000) * nThreads + t);
+            uint64_t value = rng() % 4;
+            bool had = model.count({ key, value }) != 0;
+            switch (rng() % 4) {
+            case 0:
+            case 1:
+                if (tree.insert(key, value) != (had ? ColumnStatus::GENERAL_FAILURE : ColumnStatus::GENERAL_SUCCESS)) {
+                    fprintf(stderr, "bptree_bench: insert of %lld/%llu went wrong\n", static_cast<long long>(key),
+                            static_cast<unsigned long long>(value));
+                    return false;
+                }
+                model.insert({ key, value });
+                break;
+            case 2:
+                if (tree.remove(key, value) !=
+                    (had ? ColumnStatus::GENERAL_SUCCESS : ColumnStatus::INDEX_OUT_OF_BOUNDS)) {
+                    fprintf(stderr, "bptree_bench: delete of %lld/%llu went wrong\n", static_cast<long long>(key),
+                            static_cast<unsigned long long>(value));
+                    return false;
+                }
+                model.erase({ key, value });
+                break;
+            default:
+                expected.clear();
+                for (auto it = model.lower_bound({ key, 0 }); it != model.end() && it->first == key; ++it) {
+                    expected.push_back(it->second);
+                }
+                if (tree.lookup(key, values) != ColumnStatus::GENERAL_SUCCESS || values != expected) {
+                    fprintf(stderr, "bptree_bench: lookup of %lld went wrong\n", static_cast<long long>(key));
+                    return false;
+                }
+                break;
+            }
+            if (op % 64 == 63) {
+                BPlusTreeScan scan(tree, key, key + 5000);
+                BPTreeEntry prev = { INT64_MIN, 0 };
+                while (scan.next(batch) == ColumnStatus::GENERAL_SUCCESS) {
+                    for (const BPTreeEntry& entry : batch) {
+                        if (!(prev < entry) || entry.key < key || entry.key > key + 5000) {
+                            fprintf(stderr, "bptree_bench: scan from %lld out of order\n",
+                                    static_cast<long long>(key));
+                            return false;
+                        }
+                        prev = entry;
+                    }
+                }
+            }
+        }
+        return true;
+    });
+    double seconds = secondsSince(start);
+    if (!ok) {
+        return 1;
+    }
+
+    model_t all;
+    for (const model_t& model : models) {
+        all.insert(model.begin(), model.end());
+    }
+    BPlusTreeScan full(tree, INT64_MIN, INT64_MAX);
+    std::vector<BPTreeEntry> batch;
+    auto it = all.begin();
+    while (ok && full.next(batch) == ColumnStatus::GENERAL_SUCCESS) {
+        for (const BPTreeEntry& entry : batch) {
+            ok = ok && it != all.end() && it->first == entry.key && it->second == entry.value;
+            ++it;
+        }
+    }
+    if (!ok || it != all.end() || tree.getNumEntries() != all.size()) {
+        fprintf(stderr, "bptree_bench: tree does not hold the entries of the threads\n");
+        return 1;
+    }
+    printf("check passed: %zu threads, %zu operations in %.2f s, %zu entries, height %u, %llu pages read\n",
+           nThreads, nThreads * nOps, seconds, all.size(), tree.getHeight(),
+           static_cast<unsigned long long>(pool.getReads()));
+    return 0;
+}
+
+int main(int argc, char** argv) {
+
+    size_t nKeys = 100000000;
+    size_t nFrames = PAGE_POOL_FRAMES;
+    size_t nLookups = 10000000;
+    size_t nScans = 100000;
+    size_t scanLen = 1000;
+    size_t nThreads = 1;
+    int fill = BPTREE_FILL_FACTOR;
+    size_t nChecks = 0;
+    const char* dir = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--keys") && i + 1 < argc) {
+            nKeys = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            nFrames = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--lookups") && i + 1 < argc) {
+            nLookups = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--scans") && i + 1 < argc) {
+            nScans = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--scan-len") && i + 1 < argc) {
+            scanLen = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            nThreads = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--bulk")) {
+            bulk = true;
+        }
+        else if (!strcmp(argv[i], "--fill") && i + 1 < argc) {
+            fill = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--check") && i + 1 < argc) {
+            nChecks = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--random")) {
+            scrambled = true;
+        }
+        else if (argv[i][0] == '-' || dir) {
+            usage();
+            return 2;
+        }
+        else {
+            dir = argv[i];
+        }
+    }
+    if (!dir || nKeys == 0 || scanLen == 0 || nThreads == 0) {
+        usage();
+        return 2;
+    }
+    if (nChecks > 0) {
+        return runCheck(dir, nFrames, nThreads, nChecks);
+    }
+
+    std::string path = std::string(dir) + "/bptree.idx";
+    remove(path.c_str());
+    PagePool pool(nFrames);
+    BPlusTree tree(pool);
+    if (pool.open(path) != ColumnStatus::GENERAL_SUCCESS || tree.open() != ColumnStatus::GENERAL_SUCCESS) {
+        fprintf(stderr, "bptree_bench: cannot create %s\n", path.c_str());
+        return 1;
+    }
+
+    printf("%zu keys, %s order, %zu frames (%.0f mb), %zu threads\n", nKeys, scrambled ? "random" : "ascending",
+           nFrames, nFrames * static_cast<double>(PAGE_SIZE) / 1e6, nThreads);
+    printf("%-10s %12s %10s %14s %14s\n", "phase", "ops", "seconds", "ops/s", "entries/s");
+
+    auto start = bench_clock_t::now();
+    bool ok = true;
+    double seconds;
+    if (bulk) {
+        std::vector<BPTreeEntry> entries;
+        if (scrambled) {
+            sortedEntries(nKeys, nThreads, entries);
+            seconds = secondsSince(start);
+            printf("%-10s %12d %10.2f %14.0f %14.0f\n", "sort", 1, seconds, 1 / seconds, nKeys / seconds);
+            start = bench_clock_t::now();
+        }
+        BPlusTreeBuilder builder(tree);
+        ColumnStatus rc = builder.setFillFactor(fill);
+        if (rc == ColumnStatus::GENERAL_SUCCESS) {
+            rc = builder.open();
+        }
+        for (size_t i = 0; i < nKeys && rc == ColumnStatus::GENERAL_SUCCESS; ++i) {
+            rc = scrambled ? builder.append(entries[i].key, entries[i].value) : builder.append(keyOf(i), i);
+        }
+        if (rc != ColumnStatus::GENERAL_SUCCESS || builder.finish() != ColumnStatus::GENERAL_SUCCESS) {
+            fprintf(stderr, "bptree_bench: bulk load failed\n");
+            return 1;
+        }
+        seconds = secondsSince(start);
+        printf("%-10s %12zu %10.2f %14.0f %14.0f\n", "bulk load", nKeys, seconds, nKeys / seconds, nKeys / seconds);
+    }
+    else {
+        ok = runThreads(nThreads, [&](size_t t) {
+            for (size_t i = t; i < nKeys; i += nThreads) {
+                if (tree.insert(keyOf(i), i) != ColumnStatus::GENERAL_SUCCESS) {
+                    fprintf(stderr, "bptree_bench: insert of key %zu failed\n", i);
+                    return false;
+                }
+            }
+            return true;
+        });
+        if (!ok) {
+            return 1;
+        }
+        if (tree.flush() != ColumnStatus::GENERAL_SUCCESS) {
+            fprintf(stderr, "bptree_bench: flush failed\n");
+            return 1;
+        }
+        seconds = secondsSince(start);
+        printf("%-10s %12zu %10.2f %14.0f %14.0f\n", "insert", nKeys, seconds, nKeys / seconds, nKeys / seconds);
+    }
+
+    uint64_t readsBefore = pool.getReads();
+    start = bench_clock_t::now();
+    ok = runThreads(nThreads, [&](size_t t) {
+        std::mt19937_64 rng(42 + t);
+        std::vector<uint64_t> values;
+        for (size_t l = t; l < nLookups; l += nThreads) {
+            uint64_t i = rng() % nKeys;
+            if (tree.lookup(keyOf(i), values) != ColumnStatus::GENERAL_SUCCESS || values.size() != 1 ||
+                values[0] != i) {
+                fprintf(stderr, "bptree_bench: lookup of key %llu failed\n", static_cast<unsigned long long>(i));
+                return false;
+            }
+        }
+        return true;
+    });
+    if (!ok) {
+        return 1;
+    }
+    seconds = secondsSince(start);
+    printf("%-10s %12zu %10.2f %14.0f %14.0f\n", "lookup", nLookups, seconds, nLookups / seconds,
+           nLookups / seconds);
+
+    std::vector<uint64_t> scanned(nThreads, 0);
+    start = bench_clock_t::now();
+    runThreads(nThreads, [&](size_t t) {
+        std::mt19937_64 rng(1042 + t);
+        std::vector<BPTreeEntry> batch;
+        for (size_t s = t; s < nScans; s += nThreads) {
+            BPlusTreeScan scan(tree, keyOf(rng() % nKeys), INT64_MAX);
+            size_t n = 0;
+            while (n < scanLen && scan.next(batch) == ColumnStatus::GENERAL_SUCCESS) {
+                n += batch.size();
+            }
+            scanned[t] += std::min(n, scanLen);
+        }
+        return true;
+    });
+    seconds = secondsSince(start);
+    printf("%-10s %12zu %10.2f %14.0f %14.0f\n", "scan", nScans, seconds, nScans / seconds,
+           std::accumulate(scanned.begin(), scanned.end(), uint64_t(0)) / seconds);
+
+    std::vector<BPTreeEntry> batch;
+    BPlusTreeScan full(tree, INT64_MIN, INT64_MAX);
+    ColumnStatus rc;
+    uint64_t nSeen = 0;
+    int64_t prev = INT64_MIN;
+    start = bench_clock_t::now();
+    while ((rc = full.next(batch)) == ColumnStatus::GENERAL_SUCCESS) {
+        if (batch.front().key < prev) {
+            fprintf(stderr, "bptree_bench: full scan out of order\n");
+            return 1;
+        }
+        prev = batch.back().key;
+        nSeen += batch.size();
+    }
+    seconds = secondsSince(start);
+    if (rc != ColumnStatus::INDEX_OUT_OF_BOUNDS || nSeen != nKeys) {
+        fprintf(stderr, "bptree_bench: full scan saw %llu entries\n", static_cast<unsigned long long>(nSeen));
+        return 1;
+    }
+    printf("%-10s %12d %10.2f %14.0f %14.0f\n", "full scan", 1, seconds, 1 / seconds, nSeen / seconds);
+
+    printf("height %u, %lld pages (%.0f mb), %llu pages read after the build\n", tree.getHeight(),
+           static_cast<long long>(pool.getNumPages()), pool.getNumPages() * static_cast<double>(PAGE_SIZE) / 1e6,
+           static_cast<unsigned long long>(pool.getReads() - readsBefore));
+    return 0;
+}
\ No newline at end of file
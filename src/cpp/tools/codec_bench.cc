@@ -0,0 +1,145 @@
+/*
+
+    Codec Benchmark
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "column_segment.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+/*
+
+    Usage:
+        heracles_codec_bench [--rounds N] <segment> [<segment> ...]
+
+    Takes the encoded values of every chunk of the given column segments
+    (so the input is what a codec would really see) and compresses and
+    decompresses them with every codec in this build. Prints one row per
+    codec: compression ratio over the encoded bytes, compression speed and
+    decompression speed, both in MB/s of encoded input. The decode column
+    is the one that matters for scans, since chunks are decompressed every
+    time they are loaded into the chunk pool.
+
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+static void usage() {
+    fprintf(stderr, "usage: heracles_codec_bench [--rounds N] <segment> [<segment> ...]\n");
+}
+
+static double secondsSince(bench_clock_t::time_point start) {
+    return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+
+    size_t nRounds = 5;
+    std::vector<std::string> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--rounds") && i + 1 < argc) {
+            nRounds = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        }
+        else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty() || nRounds == 0) {
+        usage();
+        return 2;
+    }
+
+    /* Encoded values of every chunk, validity bitmaps left out */
+    std::vector<std::vector<char>> blocks;
+    size_t rawBytes = 0;
+    uint64_t nValues = 0;
+
+    for (auto& path : paths) {
+        ColumnSegmentReader reader(path);
+        if (reader.open() != ColumnStatus::GENERAL_SUCCESS) {
+            fprintf(stderr, "codec_bench: cannot open segment %s\n", path.c_str());
+            return 1;
+        }
+        std::vector<char> data;
+        for (size_t idx = 0; idx < reader.getNumChunks(); ++idx) {
+            if (reader.readChunkData(idx, data) != ColumnStatus::GENERAL_SUCCESS) {
+                fprintf(stderr, "codec_bench: cannot read chunk %zu of %s\n", idx, path.c_str());
+                return 1;
+            }
+            const ChunkFooter& cf = reader.getChunk(idx);
+            blocks.emplace_back(data.begin() + cf.validitySize, data.end());
+            rawBytes += blocks.back().size();
+        }
+        nValues += reader.getNumRows();
+    }
+
+    printf("%zu chunks, %llu values, %.2f MB encoded (%.2f bytes/value)\n\n", blocks.size(),
+           static_cast<unsigned long long>(nValues), rawBytes / 1048576.0,
+           nValues ? static_cast<double>(rawBytes) / nValues : 0.0);
+    printf("%-8s %10s %8s %14s %14s\n", "codec", "bytes", "ratio", "compress MB/s", "decode MB/s");
+
+    const ColumnCodec codecs[] = { ColumnCodec::LZ, ColumnCodec::LZ4, ColumnCodec::ZSTD };
+    for (ColumnCodec id : codecs) {
+        const Codec* codec = getCodec(id);
+        if (!codec) {
+            continue;
+        }
+
+        std::vector<std::vector<char>> packed(blocks.size());
+        size_t packedBytes = 0;
+        auto start = bench_clock_t::now();
+        for (size_t r = 0; r < nRounds; ++r) {
+            packedBytes = 0;
+            for (size_t b = 0; b < blocks.size(); ++b) {
+                packed[b].resize(codec->maxCompressedSize(blocks[b].size()));
+                size_t n = codec->compress(blocks[b].data(), blocks[b].size(), packed[b].data(), packed[b].size());
+                packed[b].resize(n);
+                packedBytes += n;
+            }
+        }
+        double compressSecs = secondsSince(start);
+
+        std::vector<char> out;
+        start = bench_clock_t::now();
+        for (size_t r = 0; r < nRounds; ++r) {
+            for (size_t b = 0; b < blocks.size(); ++b) {
+                out.resize(blocks[b].size());
+                if (!codec->decompress(packed[b].data(), packed[b].size(), out.data(), out.size())) {
+                    fprintf(stderr, "codec_bench: %s failed to round-trip chunk %zu\n", codec->name(), b);
+                    return 1;
+                }
+            }
+        }
+        double decodeSecs = secondsSince(start);
+
+        double mb = rawBytes * static_cast<double>(nRounds) / 1048576.0;
+        printf("%-8s %10zu %8.2f %14.1f %14.1f\n", codec->name(), packedBytes,
+               packedBytes ? static_cast<double>(rawBytes) / packedBytes : 0.0,
+               mb / (compressSecs > 0 ? compressSecs : 1e-9), mb / (decodeSecs > 0 ? decodeSecs : 1e-9));
+    }
+    return 0;
+}
\ No newline at end of file
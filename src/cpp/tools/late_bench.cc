@@ -0,0 +1,314 @@
+/*
+
+    Late Materialization Benchmark
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+/*
+
+    Usage:
+        heracles_late_bench [--rows N] [--group] <dir>
+
+    Bulk loads N rows (default 2^21) of a TPC-H style lineitem table into
+    <dir>, each row group sorted on l_shipdate, then runs Q6 twice:
+
+        SELECT l_extendedprice, l_discount FROM lineitem
+        WHERE l_shipdate >= '1994-01-01' AND l_shipdate < '1995-01-01'
+          AND l_discount BETWEEN 5 AND 7 AND l_quantity < 24
+
+    once projecting the two columns, once every column. Each query runs
+    with early materialization (a TableScan of every column it touches,
+    filtered row by row afterwards) and with late materialization
+    (TableSelect), on a freshly opened table without a chunk pool. Prints
+    the rows found, the time taken and the chunk bytes read per run; the
+    two paths must agree on the rows and on a checksum of the projected
+    values.
+
+    With --group the columns Q6 does not filter on are stored together in
+    one column group (column_group.h) rather than in segments of their
+    own, which the wide late run, fetching all of them at few rows, is
+    the case for.
+
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+enum LineitemColumn {
+    L_ORDERKEY, L_PARTKEY, L_QUANTITY, L_EXTENDEDPRICE, L_DISCOUNT, L_TAX,
+    L_RETURNFLAG, L_LINESTATUS, L_SHIPDATE, L_SHIPMODE, L_COMMENT
+};
+
+struct BenchQuery {
+    const char* name;
+    std::vector<TableFilter> filters;
+    std::vector<size_t> columns;
+};
+
+struct BenchResult {
+    uint64_t rows = 0;
+    uint64_t checksum = 0;          // Sum of the projected values, string lengths for STRING columns
+    uint64_t bytesRead = 0;
+    double seconds = 0;
+};
+
+static void usage() {
+    fprintf(stderr, "usage: heracles_late_bench [--rows N] [--group] <dir>\n");
+}
+
+static double secondsSince(bench_clock_t::time_point start) {
+    return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+static bool grouped = false;        // --group
+
+static std::vector<TableColumn> lineitemSchema() {
+    std::vector<TableColumn> schema = {
+        { "l_orderkey", ColumnType::INT64 },
+        { "l_partkey", ColumnType::INT64 },
+        { "l_quantity", ColumnType::INT64 },
+        { "l_extendedprice", ColumnType::INT64 },
+        { "l_discount", ColumnType::INT64 },
+        { "l_tax", ColumnType::INT64 },
+        { "l_returnflag", ColumnType::STRING },
+        { "l_linestatus", ColumnType::STRING },
+        { "l_shipdate", ColumnType::TIMESTAMP },
+        { "l_shipmode", ColumnType::STRING },
+        { "l_comment", ColumnType::STRING, ColumnCodec::LZ }
+    };
+    schema[L_SHIPDATE].sortKey = 0;
+    if (grouped) {
+        for (size_t c = 0; c < schema.size(); ++c) {
+            if (c != L_SHIPDATE && c != L_DISCOUNT && c != L_QUANTITY) {
+                schema[c].columnGroup = 0;
+            }
+        }
+    }
+    return schema;
+}
+
+static bool writeLineitem(const std::string& path, size_t nRows) {
+
+    static const char* MODES[] = { "AIR", "FOB", "MAIL", "RAIL", "REG AIR", "SHIP", "TRUCK" };
+    static const char* WORDS[] = { "carefully", "final", "deposits", "quickly", "express", "packages",
+                                   "sleep", "furiously", "regular", "accounts", "ironic", "requests" };
+    FILE* csv = fopen(path.c_str(), "w");
+    if (!csv) {
+        return false;
+    }
+    std::mt19937_64 rng(42);
+    int64_t firstDay = 8036;        // 1992-01-02, days since the epoch
+    for (size_t r = 0; r < nRows; ++r) {
+        int64_t quantity = 1 + static_cast<int64_t>(rng() % 50);
+        int64_t day = firstDay + static_cast<int64_t>(rng() % 2526);
+        time_t secs = static_cast<time_t>(day * 86400);
+        struct tm date;
+        gmtime_r(&secs, &date);
+        std::string comment;
+        for (size_t w = 0, n = 2 + rng() % 5; w < n; ++w) {
+            comment += (w ? " " : "") + std::string(WORDS[rng() % 12]);
+        }
+        fprintf(csv, "%zu,%llu,%lld,%lld,%llu,%llu,%c,%c,%04d-%02d-%02d,%s,%s\n",
+                r / 4, static_cast<unsigned long long>(rng() % 200000), static_cast<long long>(quantity),
+                static_cast<long long>(quantity * (90000 + static_cast<int64_t>(rng() % 20000))),
+                static_cast<unsigned long long>(rng() % 11), static_cast<unsigned long long>(rng() % 9),
+                "ANR"[rng() % 3], "OF"[rng() % 2], date.tm_year + 1900, date.tm_mon + 1, date.tm_mday,
+                MODES[rng() % 7], comment.c_str());
+    }
+    return fclose(csv) == 0;
+}
+
+static uint64_t bytesRead(Table& table) {
+    uint64_t bytes = 0;
+    for (auto& group : table.getVersion()->groups) {
+        for (auto& segment : group->columns) {
+            bytes += segment->getBytesRead();
+        }
+    }
+    return bytes;
+}
+
+static uint64_t valueSum(const TableBatch& batch, size_t i) {
+    if (batch.values.isNull(i)) {
+        return 0;
+    }
+    int64_t val = batch.values.values[i];
+    return batch.dictionary ? (*batch.dictionary)[val].size() : static_cast<uint64_t>(val);
+}
+
+/* Every column the query touches scanned in full, rows filtered afterwards */
+static bool runEarly(const std::string& dir, const BenchQuery& query, BenchResult& result) {
+
+    Table table(dir, lineitemSchema());
+    if (table.open() != ColumnStatus::GENERAL_SUCCESS) {
+        return false;
+    }
+    auto start = bench_clock_t::now();
+
+    std::vector<size_t> cols = query.columns;
+    for (auto& filter : query.filters) {
+        cols.push_back(filter.col);
+    }
+    std::vector<std::unique_ptr<TableScan>> scans;
+    for (size_t col : cols) {
+        scans.emplace_back(new TableScan(table, col));
+    }
+
+    std::vector<TableBatch> batches(cols.size());
+    for (;;) {
+        for (size_t c = 0; c < cols.size(); ++c) {
+            ColumnStatus rc = scans[c]->next(batches[c]);
+            if (rc == ColumnStatus::INDEX_OUT_OF_BOUNDS) {
+                result.seconds = secondsSince(start);
+                result.bytesRead = bytesRead(table);
+                return true;
+            }
+            if (rc != ColumnStatus::GENERAL_SUCCESS) {
+                return false;
+            }
+        }
+        const sel_vec_t& sel = batches[0].sel;
+        for (uint32_t i : sel) {
+            bool match = true;
+            for (size_t f = 0; f < query.filters.size() && match; ++f) {
+                const TableBatch& batch = batches[query.columns.size() + f];
+                const TablePredicate& pred = query.filters[f].pred;
+                match = !batch.values.isNull(i) &&
+                        ColumnPredicate{ pred.op, pred.lo.intVal, pred.hi.intVal }.matches(batch.values.values[i]);
+            }
+            if (match) {
+                ++result.rows;
+                for (size_t c = 0; c < query.columns.size(); ++c) {
+                    result.checksum += valueSum(batches[c], i);
+                }
+            }
+        }
+    }
+}
+
+/* Filters first, projected columns fetched at the qualifying positions only */
+static bool runLate(const std::string& dir, const BenchQuery& query, BenchResult& result) {
+
+    Table table(dir, lineitemSchema());
+    if (table.open() != ColumnStatus::GENERAL_SUCCESS) {
+        return false;
+    }
+    auto start = bench_clock_t::now();
+
+    TableSelect select(table, query.filters, query.columns);
+    std::vector<TableBatch> batches;
+    ColumnStatus rc;
+    while ((rc = select.next(batches)) == ColumnStatus::GENERAL_SUCCESS) {
+        result.rows += batches[0].sel.size();
+        for (auto& batch : batches) {
+            for (uint32_t i : batch.sel) {
+                result.checksum += valueSum(batch, i);
+            }
+        }
+    }
+    result.seconds = secondsSince(start);
+    result.bytesRead = bytesRead(table);
+    return rc == ColumnStatus::INDEX_OUT_OF_BOUNDS;
+}
+
+int main(int argc, char** argv) {
+
+    size_t nRows = 1 << 21;
+    const char* dir = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--rows") && i + 1 < argc) {
+            nRows = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--group")) {
+            grouped = true;
+        }
+        else if (argv[i][0] == '-' || dir) {
+            usage();
+            return 2;
+        }
+        else {
+            dir = argv[i];
+        }
+    }
+    if (!dir || nRows == 0) {
+        usage();
+        return 2;
+    }
+
+    std::string csvPath = std::string(dir) + "/lineitem.csv";
+    std::string tableDir = std::string(dir) + "/lineitem";
+    if (!writeLineitem(csvPath, nRows)) {
+        fprintf(stderr, "late_bench: cannot write %s\n", csvPath.c_str());
+        return 1;
+    }
+    {
+        Table table(tableDir, lineitemSchema());
+        uint64_t loaded;
+        if (table.open() != ColumnStatus::GENERAL_SUCCESS ||
+            table.bulkLoad(csvPath, CsvOptions(), loaded) != ColumnStatus::GENERAL_SUCCESS) {
+            fprintf(stderr, "late_bench: cannot load %s\n", tableDir.c_str());
+            return 1;
+        }
+    }
+    remove(csvPath.c_str());
+
+    int64_t from, to;
+    parseTimestamp("1994-01-01", 10, from);
+    parseTimestamp("1995-01-01", 10, to);
+    std::vector<TableFilter> q6 = {
+        { L_SHIPDATE, { CompareOp::BETWEEN, FieldValue::of(from), FieldValue::of(to - 1) } },
+        { L_DISCOUNT, { CompareOp::BETWEEN, FieldValue::of(int64_t(5)), FieldValue::of(int64_t(7)) } },
+        { L_QUANTITY, { CompareOp::LT, FieldValue::of(int64_t(24)), FieldValue() } }
+    };
+    std::vector<BenchQuery> queries = {
+        { "q6", q6, { L_EXTENDEDPRICE, L_DISCOUNT } },
+        { "q6 wide", q6, { L_ORDERKEY, L_PARTKEY, L_QUANTITY, L_EXTENDEDPRICE, L_DISCOUNT, L_TAX,
+                           L_RETURNFLAG, L_LINESTATUS, L_SHIPDATE, L_SHIPMODE, L_COMMENT } }
+    };
+
+    printf("%zu rows, %s\n", nRows, grouped ? "payload columns grouped" : "columnar");
+    printf("%-8s %-6s %10s %10s %12s\n", "query", "path", "rows", "seconds", "mb read");
+    for (auto& query : queries) {
+        BenchResult early, late;
+        if (!runEarly(tableDir, query, early) || !runLate(tableDir, query, late)) {
+            fprintf(stderr, "late_bench: %s failed\n", query.name);
+            return 1;
+        }
+        if (early.rows != late.rows || early.checksum != late.checksum) {
+            fprintf(stderr, "late_bench: %s results differ\n", query.name);
+            return 1;
+        }
+        printf("%-8s %-6s %10llu %10.3f %12.1f\n", query.name, "early",
+               static_cast<unsigned long long>(early.rows), early.seconds, early.bytesRead / 1e6);
+        printf("%-8s %-6s %10llu %10.3f %12.1f   %.1fx fewer bytes\n", query.name, "late",
+               static_cast<unsigned long long>(late.rows), late.seconds, late.bytesRead / 1e6,
+               static_cast<double>(early.bytesRead) / std::max<uint64_t>(late.bytesRead, 1));
+    }
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,169 @@
+/*
+
+    Bulk Load Benchmark
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "table.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+
+    Usage:
+        heracles_load_bench [--rows N] [--threads N] [--inserts N] <dir>
+
+    Writes a CSV file of N orders (default 2^24) to <dir>: an id, a
+    timestamp, a customer name and an amount per line. Loads it into an
+    empty table with Table::bulkLoad() on --threads workers (default one
+    per core) and prints the time taken and the CSV bytes and rows loaded
+    per second. Then inserts the first --inserts rows (default 2^20) one
+    at a time into a second table and moves them into a group, the path
+    the bulk load replaces, for comparison. The file is read from the
+    page cache, so the numbers are for parsing and writing only.
+
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+static void usage() {
+    fprintf(stderr, "usage: heracles_load_bench [--rows N] [--threads N] [--inserts N] <dir>\n");
+}
+
+static double secondsSince(bench_clock_t::time_point start) {
+    return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+static std::vector<TableColumn> orderSchema() {
+    return {
+        { "id", ColumnType::INT64, ColumnCodec::NONE },
+        { "ts", ColumnType::TIMESTAMP, ColumnCodec::NONE },
+        { "customer", ColumnType::STRING, ColumnCodec::NONE },
+        { "amount", ColumnType::INT64, ColumnCodec::NONE }
+    };
+}
+
+int main(int argc, char** argv) {
+
+    size_t nRows = 1 << 24;
+    size_t nThreads = 0;
+    size_t nInserts = 1 << 20;
+    const char* dir = nullptr;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--rows") && i + 1 < argc) {
+            nRows = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            nThreads = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--inserts") && i + 1 < argc) {
+            nInserts = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (argv[i][0] == '-' || dir) {
+            usage();
+            return 2;
+        }
+        else {
+            dir = argv[i];
+        }
+    }
+    if (!dir || nRows == 0) {
+        usage();
+        return 2;
+    }
+    nInserts = std::min(nInserts, nRows);
+
+    /* Orders over one year from 2023-01-01, a few thousand customers */
+    std::string csvPath = std::string(dir) + "/orders.csv";
+    FILE* csv = fopen(csvPath.c_str(), "w");
+    if (!csv) {
+        fprintf(stderr, "load_bench: cannot write %s\n", csvPath.c_str());
+        return 1;
+    }
+    std::mt19937_64 rng(42);
+    std::vector<table_row_t> rows;
+    fprintf(csv, "id,ts,customer,amount\n");
+    for (size_t r = 0; r < nRows; ++r) {
+        int64_t ts = 1672531200000000LL + static_cast<int64_t>(rng() % (365ULL * 86400 * 1000000));
+        std::string customer = "customer_" + std::to_string(rng() % 5000);
+        int64_t amount = static_cast<int64_t>(rng() % 100000);
+        fprintf(csv, "%zu,%lld,%s,%lld\n", r, static_cast<long long>(ts), customer.c_str(),
+                static_cast<long long>(amount));
+        if (r < nInserts) {
+            rows.push_back({ FieldValue::of(static_cast<int64_t>(r)), FieldValue::of(ts),
+                             FieldValue::of(customer), FieldValue::of(amount) });
+        }
+    }
+    long csvBytes = ftell(csv);
+    fclose(csv);
+
+    if (nThreads == 0) {
+        nThreads = std::thread::hardware_concurrency();
+    }
+    printf("%zu rows, %.1f mb of csv, %zu threads\n", nRows, csvBytes / 1e6, nThreads);
+    printf("%-8s %12s %10s %12s %12s\n", "path", "rows", "seconds", "mb/s", "rows/s");
+
+    {
+        Table table(std::string(dir) + "/bulk", orderSchema());
+        CsvOptions opts;
+        opts.header = true;
+        opts.threads = nThreads;
+        uint64_t loaded = 0;
+        auto start = bench_clock_t::now();
+        if (table.open() != ColumnStatus::GENERAL_SUCCESS ||
+            table.bulkLoad(csvPath, opts, loaded) != ColumnStatus::GENERAL_SUCCESS || loaded != nRows) {
+            fprintf(stderr, "load_bench: bulk load failed\n");
+            return 1;
+        }
+        double secs = secondsSince(start);
+        printf("%-8s %12llu %10.3f %12.1f %12.0f\n", "bulk", static_cast<unsigned long long>(loaded), secs,
+               csvBytes / 1e6 / secs, loaded / secs);
+    }
+
+    if (nInserts > 0) {
+        Table table(std::string(dir) + "/insert", orderSchema());
+        uint64_t rowId;
+        auto start = bench_clock_t::now();
+        if (table.open() != ColumnStatus::GENERAL_SUCCESS) {
+            fprintf(stderr, "load_bench: cannot open the insert table\n");
+            return 1;
+        }
+        for (auto& row : rows) {
+            if (table.insert(row, rowId) != ColumnStatus::GENERAL_SUCCESS) {
+                fprintf(stderr, "load_bench: insert failed\n");
+                return 1;
+            }
+        }
+        if (table.moveTuples() != ColumnStatus::GENERAL_SUCCESS) {
+            fprintf(stderr, "load_bench: tuple move failed\n");
+            return 1;
+        }
+        double secs = secondsSince(start);
+        printf("%-8s %12zu %10.3f %12.1f %12.0f\n", "insert", nInserts, secs,
+               csvBytes / 1e6 * nInserts / nRows / secs, nInserts / secs);
+    }
+
+    remove(csvPath.c_str());
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,270 @@
+/*
+
+    String Benchmark
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "dictionary.h"
+#include "string_heap.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+/*
+
+    Usage:
+        heracles_string_bench [--rows N] [--rounds N] [<file> ...]
+
+    Runs on the lines of each file given (one string per line), or on N
+    generated URLs and N generated log messages (default 2^20 each). The
+    strings are cut into chunks of COLUMN_CHUNK_SIZE like a segment would
+    be, and every layout is measured on the same chunks:
+
+        dict        Sorted dictionary plus fixed-width codes (what a
+                    low-cardinality column stores)
+        heap        Offsets plus the raw byte heap
+        fsst        Offsets plus the heap compressed with a symbol table
+
+    followed by the speed of the fsst layout: encoding (table training
+    included) and decoding in MB/s of raw strings, then an equality and a
+    prefix scan over every string, once on the compressed form and once
+    by decompressing each string and comparing it.
+
+*/
+
+typedef std::chrono::steady_clock bench_clock_t;
+
+static void usage() {
+    fprintf(stderr, "usage: heracles_string_bench [--rows N] [--rounds N] [<file> ...]\n");
+}
+
+static double secondsSince(bench_clock_t::time_point start) {
+    return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+static bool readLines(const char* path, std::vector<std::string>& lines) {
+    FILE* f = fopen(path, "r");
+    if (!f) {
+        return false;
+    }
+    char buf[65536];
+    while (fgets(buf, sizeof(buf), f)) {
+        size_t len = strlen(buf);
+        while (len > 0 && (buf[len - 1] == '\n' || buf[len - 1] == '\r')) {
+            --len;
+        }
+        lines.emplace_back(buf, len);
+    }
+    fclose(f);
+    return true;
+}
+
+static std::vector<std::string> makeUrls(size_t n, std::mt19937& rng) {
+    const char* hosts[] = { "www.example.com", "api.example.com", "cdn.example.net", "shop.example.org",
+                            "static.example.com", "mail.example.com" };
+    const char* paths[] = { "products", "users", "search", "images", "v1", "v2", "account", "orders",
+                            "category", "item", "assets", "checkout" };
+    const char* params[] = { "?id=", "?q=", "?page=", "?ref=home&id=", "?utm_source=mail&id=" };
+    std::vector<std::string> urls(n);
+    for (auto& url : urls) {
+        url = std::string(rng() % 8 ? "https://" : "http://") + hosts[rng() % 6];
+        for (size_t d = 1 + rng() % 3; d > 0; --d) {
+            url += "/";
+            url += paths[rng() % 12];
+        }
+        url += params[rng() % 5] + std::to_string(rng() % 1000000);
+    }
+    return urls;
+}
+
+static std::vector<std::string> makeLogs(size_t n, std::mt19937& rng) {
+    const char* levels[] = { "INFO", "INFO", "INFO", "WARN", "ERROR", "DEBUG" };
+    const char* messages[] = { "connection accepted from", "request completed for user", "cache miss for key",
+                               "timeout waiting for response from", "retrying upstream request to",
+                               "session expired for user", "checkpoint finished, segments flushed:" };
+    std::vector<std::string> logs(n);
+    for (size_t i = 0; i < n; ++i) {
+        char stamp[32];
+        snprintf(stamp, sizeof(stamp), "2023-06-%02zu %02zu:%02zu:%02zu.%03zu ", 1 + i * 30 / n,
+                 (i / 3600) % 24, (i / 60) % 60, i % 60, static_cast<size_t>(rng() % 1000));
+        logs[i] = std::string(stamp) + levels[rng() % 6] + " [worker-" + std::to_string(rng() % 16) + "] " +
+                  messages[rng() % 7] + " " + std::to_string(rng() % 100000);
+    }
+    return logs;
+}
+
+/* Bytes of the same chunk with a dictionary: the dictionary itself plus one code per string */
+static size_t dictBytes(const std::vector<const std::string*>& chunk) {
+    std::unordered_set<std::string> distinct;
+    for (auto val : chunk) {
+        distinct.insert(*val);
+    }
+    std::vector<std::string> dict(distinct.begin(), distinct.end());
+    std::vector<char> bytes;
+    dictSerialize(dict, bytes);
+    return bytes.size() + chunk.size() * dictCodeWidth(dict.size());
+}
+
+static int runSet(const char* name, const std::vector<std::string>& strings, size_t nRounds) {
+
+    std::vector<std::vector<const std::string*>> chunks;
+    size_t rawBytes = 0;
+    for (size_t i = 0; i < strings.size(); ++i) {
+        if (i % COLUMN_CHUNK_SIZE == 0) {
+            chunks.emplace_back();
+        }
+        chunks.back().push_back(&strings[i]);
+        rawBytes += strings[i].size();
+    }
+
+    size_t dictTotal = 0, heapTotal = 0, fsstTotal = 0;
+    std::vector<std::vector<char>> stored(chunks.size());
+    std::vector<char> plain;
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        dictTotal += dictBytes(chunks[c]);
+        encodeStrings(chunks[c], false, plain);
+        heapTotal += plain.size();
+    }
+
+    auto start = bench_clock_t::now();
+    for (size_t k = 0; k < nRounds; ++k) {
+        fsstTotal = 0;
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            encodeStrings(chunks[c], true, stored[c]);
+            fsstTotal += stored[c].size();
+        }
+    }
+    double encodeSecs = secondsSince(start);
+
+    std::vector<StringHeapView> views(chunks.size());
+    for (size_t c = 0; c < chunks.size(); ++c) {
+        if (views[c].open(stored[c].data(), stored[c].size(), chunks[c].size()) != ColumnStatus::GENERAL_SUCCESS) {
+            fprintf(stderr, "string_bench: cannot open chunk %zu of %s\n", c, name);
+            return 1;
+        }
+    }
+
+    std::vector<std::string> decoded;
+    start = bench_clock_t::now();
+    for (size_t k = 0; k < nRounds; ++k) {
+        for (size_t c = 0; c < chunks.size(); ++c) {
+            views[c].read(0, chunks[c].size(), decoded);
+        }
+    }
+    double decodeSecs = secondsSince(start);
+    for (size_t i = 0; i < decoded.size(); ++i) {
+        if (decoded[i] != *chunks.back()[i]) {
+            fprintf(stderr, "string_bench: %s does not decode to its input\n", name);
+            return 1;
+        }
+    }
+
+    /* Operands: a string from the middle of the data, and its first half as a prefix */
+    const std::string& needle = strings[strings.size() / 2];
+    std::string prefix = needle.substr(0, needle.size() / 2);
+
+    uint64_t found[4] = { 0, 0, 0, 0 };
+    double secs[4];
+    std::string packed, val;
+    for (int q = 0; q < 4; ++q) {
+        start = bench_clock_t::now();
+        for (size_t k = 0; k < nRounds; ++k) {
+            found[q] = 0;
+            for (size_t c = 0; c < chunks.size(); ++c) {
+                const StringHeapView& view = views[c];
+                if (q == 0) {
+                    view.pack(needle, packed);
+                }
+                for (size_t i = 0; i < view.size(); ++i) {
+                    switch (q) {
+                        case 0: found[q] += view.equals(i, packed);                 break;
+                        case 1: found[q] += view.startsWith(i, prefix);             break;
+                        case 2: view.get(i, val);
+                                found[q] += val == needle;                          break;
+                        case 3: view.get(i, val);
+                                found[q] += val.compare(0, prefix.size(), prefix) == 0;     break;
+                    }
+                }
+            }
+        }
+        secs[q] = secondsSince(start);
+    }
+    if (found[0] != found[2] || found[1] != found[3]) {
+        fprintf(stderr, "string_bench: compressed and decompressed scans disagree on %s\n", name);
+        return 1;
+    }
+
+    double mb = rawBytes * static_cast<double>(nRounds) / (1 << 20);
+    double perString = 1e9 / (static_cast<double>(strings.size()) * nRounds);
+    printf("%-20s %10zu %12zu %12zu %12zu %12zu %8.1f %8.1f %7.1f %7.1f %7.1f %7.1f\n", name,
+           strings.size(), rawBytes, dictTotal, heapTotal, fsstTotal, mb / encodeSecs, mb / decodeSecs,
+           secs[0] * perString, secs[2] * perString, secs[1] * perString, secs[3] * perString);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+
+    size_t nRows = 1 << 20;
+    size_t nRounds = 3;
+    std::vector<const char*> paths;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--rows") && i + 1 < argc) {
+            nRows = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (!strcmp(argv[i], "--rounds") && i + 1 < argc) {
+            nRounds = static_cast<size_t>(atol(argv[++i]));
+        }
+        else if (argv[i][0] == '-') {
+            usage();
+            return 2;
+        }
+        else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (nRows == 0 || nRounds == 0) {
+        usage();
+        return 2;
+    }
+
+    printf("%-20s %10s %12s %12s %12s %12s %8s %8s %7s %7s %7s %7s\n", "data", "strings", "raw", "dict",
+           "heap", "fsst", "enc MB/s", "dec MB/s", "eq ns", "eq+dec", "pfx ns", "pfx+dec");
+
+    if (paths.empty()) {
+        std::mt19937 rng(42);
+        return runSet("urls", makeUrls(nRows, rng), nRounds) | runSet("logs", makeLogs(nRows, rng), nRounds);
+    }
+
+    int rc = 0;
+    for (const char* path : paths) {
+        std::vector<std::string> lines;
+        if (!readLines(path, lines)) {
+            fprintf(stderr, "string_bench: cannot read %s\n", path);
+            return 1;
+        }
+        if (!lines.empty()) {
+            rc |= runSet(path, lines, nRounds);
+        }
+    }
+    return rc;
+}
\ No newline at end of file
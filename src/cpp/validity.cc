@@ -0,0 +1,277 @@
+/*
+
+    Validity Kernels Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "validity.h"
+#include "simd.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if SIMD_ENABLED && defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#   define VALIDITY_X86         1
+#   include <immintrin.h>
+#endif
+
+/* ORs bit i of `matches` in when lo <= values[i] <= hi, for a non-empty range */
+typedef void (*compare_fn)(const int64_t*, size_t, int64_t, int64_t, uint64_t*);
+
+/* Sum, min and max of the values whose bit is set in `mask` (every value when it is null) */
+typedef void (*aggregate_fn)(const int64_t*, const uint64_t*, size_t, uint64_t&, int64_t&, int64_t&);
+
+/* One unsigned compare per value: v - lo wraps past hi - lo when v is below lo */
+static void compareScalarFrom(const int64_t* values, size_t begin, size_t count, int64_t lo, int64_t hi,
+                              uint64_t* matches) {
+    uint64_t span = static_cast<uint64_t>(hi) - static_cast<uint64_t>(lo);
+    for (size_t i = begin; i < count; ++i) {
+        uint64_t in = static_cast<uint64_t>(values[i]) - static_cast<uint64_t>(lo) <= span;
+        matches[i >> 6] |= in << (i & 63);
+    }
+}
+
+static void compareScalar(const int64_t* values, size_t count, int64_t lo, int64_t hi, uint64_t* matches) {
+    compareScalarFrom(values, 0, count, lo, hi, matches);
+}
+
+template <bool Masked>
+static void aggregateScalarFrom(const int64_t* values, const uint64_t* mask, size_t begin, size_t count,
+                                uint64_t& sum, int64_t& minVal, int64_t& maxVal) {
+    for (size_t i = begin; i < count; ++i) {
+        uint64_t bit = Masked ? (mask[i >> 6] >> (i & 63)) & 1 : 1;
+        int64_t val = values[i];
+        sum += static_cast<uint64_t>(val) & (0 - bit);
+        minVal = std::min(minVal, bit ? val : INT64_MAX);
+        maxVal = std::max(maxVal, bit ? val : INT64_MIN);
+    }
+}
+
+static void aggregateScalar(const int64_t* values, const uint64_t* mask, size_t count,
+                            uint64_t& sum, int64_t& minVal, int64_t& maxVal) {
+    if (mask) {
+        aggregateScalarFrom<true>(values, mask, 0, count, sum, minVal, maxVal);
+    }
+    else {
+        aggregateScalarFrom<false>(values, mask, 0, count, sum, minVal, maxVal);
+    }
+}
+
+#if defined(VALIDITY_X86)
+
+SIMD_KERNELS_BEGIN
+
+/* AVX2 has no unsigned 64-bit compare, so outside = (lo > v) | (v > hi) */
+__attribute__((target("avx2")))
+static void compareAvx2(const int64_t* values, size_t count, int64_t lo, int64_t hi, uint64_t* matches) {
+
+    const __m256i vlo = _mm256_set1_epi64x(lo);
+    const __m256i vhi = _mm256_set1_epi64x(hi);
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        __m256i out = _mm256_or_si256(_mm256_cmpgt_epi64(vlo, v), _mm256_cmpgt_epi64(v, vhi));
+        uint64_t in = ~_mm256_movemask_pd(_mm256_castsi256_pd(out)) & 0xF;
+        matches[i >> 6] |= in << (i & 63);
+    }
+    compareScalarFrom(values, i, count, lo, hi, matches);
+}
+
+/* Mask bits become whole lanes by testing each lane's own bit of the nibble */
+__attribute__((target("avx2")))
+static void aggregateAvx2(const int64_t* values, const uint64_t* mask, size_t count,
+                          uint64_t& sum, int64_t& minVal, int64_t& maxVal) {
+
+    const __m256i laneBits = _mm256_setr_epi64x(1, 2, 4, 8);
+    const __m256i top = _mm256_set1_epi64x(INT64_MAX);
+    const __m256i bottom = _mm256_set1_epi64x(INT64_MIN);
+    __m256i vsum = _mm256_setzero_si256();
+    __m256i vmin = top;
+    __m256i vmax = bottom;
+
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(values + i));
+        __m256i lanes = _mm256_set1_epi64x(-1);
+        if (mask) {
+            __m256i bits = _mm256_set1_epi64x(static_cast<int64_t>((mask[i >> 6] >> (i & 63)) & 0xF));
+            lanes = _mm256_cmpeq_epi64(_mm256_and_si256(bits, laneBits), laneBits);
+        }
+        vsum = _mm256_add_epi64(vsum, _mm256_and_si256(v, lanes));
+        __m256i lowCand = _mm256_blendv_epi8(top, v, lanes);
+        vmin = _mm256_blendv_epi8(vmin, lowCand, _mm256_cmpgt_epi64(vmin, lowCand));
+        __m256i highCand = _mm256_blendv_epi8(bottom, v, lanes);
+        vmax = _mm256_blendv_epi8(vmax, highCand, _mm256_cmpgt_epi64(highCand, vmax));
+    }
+
+    uint64_t s[4];
+    int64_t lo[4], hi[4];
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(s), vsum);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(lo), vmin);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(hi), vmax);
+    for (int k = 0; k < 4; ++k) {
+        sum += s[k];
+        minVal = std::min(minVal, lo[k]);
+        maxVal = std::max(maxVal, hi[k]);
+    }
+
+    if (mask) {
+        aggregateScalarFrom<true>(values, mask, i, count, sum, minVal, maxVal);
+    }
+    else {
+        aggregateScalarFrom<false>(values, mask, i, count, sum, minVal, maxVal);
+    }
+}
+
+__attribute__((target("avx512f")))
+static void compareAvx512(const int64_t* values, size_t count, int64_t lo, int64_t hi, uint64_t* matches) {
+
+    const __m512i vlo = _mm512_set1_epi64(lo);
+    const __m512i vhi = _mm512_set1_epi64(hi);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m512i v = _mm512_loadu_si512(values + i);
+        __mmask8 in = _mm512_mask_cmple_epi64_mask(_mm512_cmpge_epi64_mask(v, vlo), v, vhi);
+        matches[i >> 6] |= static_cast<uint64_t>(in) << (i & 63);
+    }
+    compareScalarFrom(values, i, count, lo, hi, matches);
+}
+
+/* The mask byte of 8 values is the write mask of the add, min and max */
+__attribute__((target("avx512f")))
+static void aggregateAvx512(const int64_t* values, const uint64_t* mask, size_t count,
+                            uint64_t& sum, int64_t& minVal, int64_t& maxVal) {
+
+    __m512i vsum = _mm512_setzero_si512();
+    __m512i vmin = _mm512_set1_epi64(INT64_MAX);
+    __m512i vmax = _mm512_set1_epi64(INT64_MIN);
+
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m512i v = _mm512_loadu_si512(values + i);
+        __mmask8 k = mask ? static_cast<__mmask8>(mask[i >> 6] >> (i & 63)) : 0xFF;
+        vsum = _mm512_mask_add_epi64(vsum, k, vsum, v);
+        vmin = _mm512_mask_min_epi64(vmin, k, vmin, v);
+        vmax = _mm512_mask_max_epi64(vmax, k, vmax, v);
+    }
+    uint64_t lanes[8];                  // Summed unsigned, so the total wraps like the scalar one
+    _mm512_storeu_si512(lanes, vsum);
+    for (int k = 0; k < 8; ++k) {
+        sum += lanes[k];
+    }
+    minVal = std::min(minVal, static_cast<int64_t>(_mm512_reduce_min_epi64(vmin)));
+    maxVal = std::max(maxVal, static_cast<int64_t>(_mm512_reduce_max_epi64(vmax)));
+
+    if (mask) {
+        aggregateScalarFrom<true>(values, mask, i, count, sum, minVal, maxVal);
+    }
+    else {
+        aggregateScalarFrom<false>(values, mask, i, count, sum, minVal, maxVal);
+    }
+}
+
+SIMD_KERNELS_END
+
+#endif // VALIDITY_X86
+
+/* Dispatch */
+
+struct ValidityKernels {
+    compare_fn compare;
+    aggregate_fn aggregate;
+    const char* name;
+};
+
+static const ValidityKernels& kernels() {
+    static const ValidityKernels best = [] {
+#if defined(VALIDITY_X86)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return ValidityKernels{ compareAvx512, aggregateAvx512, "avx512" };
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return ValidityKernels{ compareAvx2, aggregateAvx2, "avx2" };
+        }
+#endif
+        return ValidityKernels{ compareScalar, aggregateScalar, "scalar" };
+    }();
+    return best;
+}
+
+/*
+
+    Sets bit i of `matches` when lo <= values[i] <= hi, or when it is not
+    in that range if `negate`. Null slots get a bit like any other value,
+    bits past `count` are cleared.
+
+*/
+void compareRange(const int64_t* values, size_t count, int64_t lo, int64_t hi, bool negate,
+                  uint64_t* matches) {
+    size_t nWords = (count + 63) >> 6;
+    memset(matches, 0, nWords * sizeof(uint64_t));
+    if (lo <= hi) {
+        kernels().compare(values, count, lo, hi, matches);
+    }
+    if (negate) {
+        for (size_t w = 0; w < nWords; ++w) {
+            matches[w] = ~matches[w];
+        }
+        if (count & 63) {
+            matches[nWords - 1] &= (1ULL << (count & 63)) - 1;
+        }
+    }
+}
+
+/* Clears the bits of null slots, one AND per 64 values */
+void maskValidity(uint64_t* matches, const uint64_t* validity, size_t count) {
+    for (size_t w = 0; w < (count + 63) >> 6; ++w) {
+        matches[w] &= validity[w];
+    }
+}
+
+/* Folds the values whose bit is set in `mask` into `agg`, all `count` of them when it is null */
+void aggregateMasked(const int64_t* values, const uint64_t* mask, size_t count, ColumnAggregate& agg) {
+
+    uint64_t n = count;
+    if (mask) {
+        n = 0;
+        for (size_t w = 0; w < count >> 6; ++w) {
+            n += __builtin_popcountll(mask[w]);
+        }
+        if (count & 63) {
+            n += __builtin_popcountll(mask[count >> 6] & ((1ULL << (count & 63)) - 1));
+        }
+    }
+    if (n == 0) {
+        return;
+    }
+
+    uint64_t sum = 0;
+    int64_t minVal = INT64_MAX;
+    int64_t maxVal = INT64_MIN;
+    kernels().aggregate(values, mask, count, sum, minVal, maxVal);
+
+    agg.count += n;
+    agg.sum = static_cast<int64_t>(static_cast<uint64_t>(agg.sum) + sum);     // Wraps on overflow
+    agg.minVal = std::min(agg.minVal, minVal);
+    agg.maxVal = std::max(agg.maxVal, maxVal);
+}
+
+const char* validityKernelName() {
+    return kernels().name;
+}
\ No newline at end of file
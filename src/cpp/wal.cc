@@ -0,0 +1,692 @@
+/*
+
+    Write-Ahead Log (WAL) Implementation
+    Copyright 2023 Marcus Antonelli
+
+    Licensed under the Apache License, Version 2.0 (the "License");
+    you may not use this file except in compliance with the License.
+    You may obtain a copy of the License at:
+
+        http://www.apache.org/licenses/LICENSE-2.0
+
+    Unless required by applicable law or agreed to in writing, software
+    distributed under the License is distributed on an "AS IS" BASIS,
+    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+    See the License for the specific language governing permissions and
+    limitations under the License.
+
+*/
+
+#include "wal.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <stdio.h>
+
+/* Fixed rather than CRC_POLYNOMIAL so logs are portable across word sizes */
+#define  LOG_CRC_POLYNOMIAL     0xEDB88320
+
+/*
+
+    Some basic rules about the log:
+        - LSNs start at 1 and every record takes the next LSN
+        - Records never span segments, a record that does not fit in the
+          rest of the current segment starts the next one
+        - Records are padded to LOG_RECORD_ALIGN bytes
+        - The end of the log is the first record with a bad CRC or an
+          unexpected LSN, which is how stale recycled data is ignored
+
+*/
+
+static size_t alignRecord(size_t len) {
+    return (len + LOG_RECORD_ALIGN - 1) & ~static_cast<size_t>(LOG_RECORD_ALIGN - 1);
+}
+
+uint32_t logCrc(const void* data, size_t len, uint32_t crc) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> t(256);
+        for (uint32_t i = 0; i < 256; ++i) {
+            uint32_t c = i;
+            for (int j = 0; j < 8; ++j) {
+                c = (c & 1) ? (LOG_CRC_POLYNOMIAL ^ (c >> 1)) : (c >> 1);
+            }
+            t[i] = c;
+        }
+        return t;
+    }();
+
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+int64_t logTimestamp() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+std::string logSegmentName(uint64_t segNo) {
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.wal", static_cast<unsigned long long>(segNo));
+    return name;
+}
+
+bool logParseSegmentName(const std::string& name, uint64_t& segNo) {
+    if (name.size() != 20 || name.compare(16, 4, ".wal") != 0) {
+        return false;
+    }
+    segNo = 0;
+    for (size_t i = 0; i < 16; ++i) {
+        char c = name[i];
+        int digit;
+        if (c >= '0' && c <= '9') digit = c - '0';
+        else if (c >= 'a' && c <= 'f') digit = c - 'a' + 10;
+        else return false;
+        segNo = (segNo << 4) | digit;
+    }
+    return true;
+}
+
+static uint32_t recordCrc(const LogRecordHeader& hdr, const void* payload) {
+    const char* begin = reinterpret_cast<const char*>(&hdr) + offsetof(LogRecordHeader, size);
+    uint32_t crc = logCrc(begin, sizeof(LogRecordHeader) - offsetof(LogRecordHeader, size));
+    return logCrc(payload, hdr.size, crc);
+}
+
+static uint32_t segmentCrc(const LogSegmentHeader& hdr) {
+    const char* begin = reinterpret_cast<const char*>(&hdr) + offsetof(LogSegmentHeader, segNo);
+    return logCrc(begin, sizeof(LogSegmentHeader) - offsetof(LogSegmentHeader, segNo));
+}
+
+/* Read and validate a segment header, the file name must agree with it */
+static bool readSegmentHeader(const std::string& path, uint64_t segNo, LogSegmentHeader& hdr) {
+    os_fd_t fd = osOpen(path.c_str(), false);
+    if (fd == OS_INVALID_FD) {
+        return false;
+    }
+    ssize_t n = osRead(fd, &hdr, sizeof(hdr), 0);
+    osClose(fd);
+
+    return n == static_cast<ssize_t>(sizeof(hdr)) &&
+           hdr.magic == LOG_SEGMENT_MAGIC &&
+           hdr.segNo == segNo &&
+           hdr.crc == segmentCrc(hdr);
+}
+
+/* LogReader */
+
+LogReader::LogReader(const std::string& dir) :
+    dir(dir), segIdx(0), segNo(0), segSize(0), offset(0), nextLsn(0), startLsn(0) {}
+
+LogReader::~LogReader() = default;
+
+/*
+    Find the segment to start from: the last valid one beginning at or
+    before `start`, END_OF_LOG if there is none. LSNs start at 1, so a
+    `start` of 0 opens the first valid segment, wherever it begins
+*/
+LogStatus LogReader::open(log_id_t start) {
+
+    std::vector<std::string> names;
+    if (osListDir(dir.c_str(), names) != 0) {
+        return LogStatus::IO_ERROR;
+    }
+
+    segNos.clear();
+    for (auto& name : names) {
+        uint64_t no;
+        if (logParseSegmentName(name, no)) {
+            segNos.push_back(no);
+        }
+    }
+    std::sort(segNos.begin(), segNos.end());
+
+    startLsn = start;
+    long first = -1;
+    for (size_t i = 0; i < segNos.size(); ++i) {
+        LogSegmentHeader hdr;
+        if (!readSegmentHeader(dir + "/" + logSegmentName(segNos[i]), segNos[i], hdr)) {
+            continue;
+        }
+        if (hdr.firstLsn > start) {
+            if (first < 0 && start == 0) {
+                first = static_cast<long>(i);
+            }
+            break;
+        }
+        first = static_cast<long>(i);
+    }
+
+    if (first < 0) {
+        return LogStatus::END_OF_LOG;
+    }
+    return loadSegment(static_cast<size_t>(first), true);
+}
+
+/* Read a whole segment into memory, it has to continue the chain unless it is the first */
+LogStatus LogReader::loadSegment(size_t idx, bool first) {
+
+    std::string path = dir + "/" + logSegmentName(segNos[idx]);
+    LogSegmentHeader hdr;
+
+    if (!readSegmentHeader(path, segNos[idx], hdr)) {
+        return LogStatus::END_OF_LOG;
+    }
+    if (!first && (hdr.firstLsn != nextLsn || hdr.segSize != segSize)) {
+        return LogStatus::END_OF_LOG;
+    }
+
+    std::vector<char> buf(hdr.segSize);
+    os_fd_t fd = osOpen(path.c_str(), false);
+    if (fd == OS_INVALID_FD) {
+        return LogStatus::IO_ERROR;
+    }
+    ssize_t n = osRead(fd, buf.data(), buf.size(), 0);
+    osClose(fd);
+
+    if (n < 0) {
+        return LogStatus::IO_ERROR;
+    }
+    buf.resize(static_cast<size_t>(n));   // Short files just end the chain early
+
+    data.swap(buf);
+    segIdx = idx;
+    segNo = segNos[idx];
+    segSize = hdr.segSize;
+    offset = sizeof(LogSegmentHeader);
+    nextLsn = hdr.firstLsn;
+    return LogStatus::GENERAL_SUCCESS;
+}
+
+LogStatus LogReader::next(LogRecordHeader& hdr, std::vector<char>& payload) {
+
+    while (!data.empty()) {
+
+        if (offset + sizeof(LogRecordHeader) <= data.size()) {
+
+            LogRecordHeader rec;
+            memcpy(&rec, data.data() + offset, sizeof(rec));
+            size_t total = alignRecord(sizeof(rec) + rec.size);
+            const char* body = data.data() + offset + sizeof(rec);
+
+            if (rec.lsn == nextLsn && rec.type != static_cast<uint16_t>(LogRecordType::INVALID) &&
+                offset + total <= data.size() && rec.crc == recordCrc(rec, body)) {
+
+                offset += total;
+                ++nextLsn;
+                if (rec.lsn < startLsn) {
+                    continue;
+                }
+                hdr = rec;
+                payload.assign(body, body + rec.size);
+                return LogStatus::GENERAL_SUCCESS;
+            }
+        }
+
+        /* No more records here, carry on if the next segment continues the chain */
+        if (segIdx + 1 < segNos.size() && segNos[segIdx + 1] == segNo + 1 &&
+            loadSegment(segIdx + 1, false) == LogStatus::GENERAL_SUCCESS) {
+            continue;
+        }
+        break;
+    }
+    return LogStatus::END_OF_LOG;
+}
+
+/* LogManager */
+
+LogManager::LogManager(const std::string& dir, size_t segSize) :
+    dir(dir), segSize(segSize), fd(OS_INVALID_FD), maxSegNo(0), writeOfst(0),
+    buffer(LOG_BUFFER_SIZE), bufLen(0), nextLsn(1), flushedLsn(0), stopArchiver(false) {}
+
+LogManager::~LogManager() {
+    close();
+}
+
+std::string LogManager::segPath(uint64_t segNo) const {
+    return dir + "/" + logSegmentName(segNo);
+}
+
+/* Enable archiving, must be called before open() */
+void LogManager::setArchiveDir(const std::string& path) {
+    std::lock_guard<std::mutex> lock(latch);
+    archiveDir = path;
+}
+
+/*
+
+    Open (or create) the log. The existing chain is read to its end so that
+    appends resume after the last intact record. Segment files that are not
+    part of the chain are spares left behind by earlier checkpoints.
+
+*/
+LogStatus LogManager::open() {
+
+    std::lock_guard<std::mutex> lock(latch);
+
+    if (osMkdir(dir.c_str()) != 0) {
+        return LogStatus::IO_ERROR;
+    }
+
+    std::vector<std::string> names;
+    std::vector<uint64_t> found;
+    if (osListDir(dir.c_str(), names) != 0) {
+        return LogStatus::IO_ERROR;
+    }
+    for (auto& name : names) {
+        uint64_t no;
+        if (logParseSegmentName(name, no)) {
+            found.push_back(no);
+            maxSegNo = std::max(maxSegNo, no);
+        }
+    }
+    std::sort(found.begin(), found.end());
+
+    LogReader reader(dir);
+    LogStatus rc = reader.open();
+
+    /* Fresh log, anything on disk is a spare */
+    if (rc == LogStatus::END_OF_LOG) {
+        spares.assign(found.begin(), found.end());
+        nextLsn = 1;
+        flushedLsn = 0;
+        rc = startSegment(spares.empty() ? maxSegNo + 1 : spares.front());
+        if (rc == LogStatus::GENERAL_SUCCESS && !archiveDir.empty()) {
+            if (osMkdir(archiveDir.c_str()) != 0) {
+                return LogStatus::IO_ERROR;
+            }
+            archiver = std::thread(&LogManager::archiveLoop, this);
+        }
+        return rc;
+    }
+    if (rc != LogStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    segSize = reader.getSegSize();
+    segments.push_back({ reader.getSegNo(), reader.getNextLsn() });
+
+    LogRecordHeader hdr;
+    std::vector<char> payload;
+    while (reader.next(hdr, payload) == LogStatus::GENERAL_SUCCESS) {
+        if (reader.getSegNo() != segments.back().segNo) {
+            segments.push_back({ reader.getSegNo(), hdr.lsn });
+        }
+    }
+
+    /* The current segment may hold nothing but its header */
+    if (reader.getSegNo() != segments.back().segNo) {
+        segments.push_back({ reader.getSegNo(), reader.getNextLsn() });
+    }
+
+    for (uint64_t no : found) {
+        if (no > segments.back().segNo) {
+            spares.push_back(no);
+        }
+        else if (no < segments.front().segNo) {
+            osRemove(segPath(no).c_str());   // Retired before a crash
+        }
+    }
+
+    fd = osOpen(segPath(segments.back().segNo).c_str(), false);
+    if (fd == OS_INVALID_FD) {
+        return LogStatus::IO_ERROR;
+    }
+    writeOfst = reader.getOffset();
+    nextLsn = reader.getNextLsn();
+    flushedLsn = nextLsn - 1;
+
+    /* Completed segments that never made it to the archive before a restart */
+    if (!archiveDir.empty()) {
+        if (osMkdir(archiveDir.c_str()) != 0) {
+            return LogStatus::IO_ERROR;
+        }
+        for (size_t i = 0; i + 1 < segments.size(); ++i) {
+            std::string name = archiveDir + "/" + logSegmentName(segments[i].segNo);
+            if (!osExists(name.c_str())) {
+                archiveQueue.push_back(segments[i].segNo);
+            }
+        }
+        archiver = std::thread(&LogManager::archiveLoop, this);
+    }
+    return LogStatus::GENERAL_SUCCESS;
+}
+
+/* Closing waits for the archiver to copy every completed segment */
+void LogManager::close() {
+
+    {
+        std::lock_guard<std::mutex> lock(latch);
+
+        if (fd != OS_INVALID_FD) {
+            writeBuffer();
+            osDataSync(fd);
+            osClose(fd);
+            fd = OS_INVALID_FD;
+            flushedLsn = nextLsn - 1;
+        }
+        stopArchiver = true;
+    }
+
+    archiveCv.notify_all();
+    if (archiver.joinable()) {
+        archiver.join();
+    }
+}
+
+/* Append a record to the log buffer, it is durable after the next flush() */
+LogStatus LogManager::append(LogRecordType type, txn_id_t txnId,
+                             const void* data, uint32_t size, log_id_t& lsn) {
+
+    std::lock_guard<std::mutex> lock(latch);
+
+    size_t total = alignRecord(sizeof(LogRecordHeader) + size);
+    if (total > buffer.size() || total > segSize - sizeof(LogSegmentHeader)) {
+        return LogStatus::RECORD_TOO_LARGE;
+    }
+    if (fd == OS_INVALID_FD) {
+        return LogStatus::GENERAL_FAILURE;
+    }
+
+    LogStatus rc;
+    if (writeOfst + bufLen + total > segSize) {
+        if ((rc = switchSegment()) != LogStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+    else if (bufLen + total > buffer.size()) {
+        if ((rc = writeBuffer()) != LogStatus::GENERAL_SUCCESS) {
+            return rc;
+        }
+    }
+
+    LogRecordHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.size = size;
+    hdr.lsn = nextLsn;
+    hdr.txnId = txnId;
+    hdr.type = static_cast<uint16_t>(type);
+    hdr.timestamp = logTimestamp();
+    hdr.crc = recordCrc(hdr, data);
+
+    char* dst = buffer.data() + bufLen;
+    memcpy(dst, &hdr, sizeof(hdr));
+    memcpy(dst + sizeof(hdr), data, size);
+    memset(dst + sizeof(hdr) + size, 0, total - sizeof(hdr) - size);
+    bufLen += total;
+
+    lsn = nextLsn++;
+    return LogStatus::GENERAL_SUCCESS;
+}
+
+/* Write out the buffer and fdatasync, the segment size never changes */
+LogStatus LogManager::flush() {
+
+    std::lock_guard<std::mutex> lock(latch);
+
+    if (fd == OS_INVALID_FD) {
+        return LogStatus::GENERAL_FAILURE;
+    }
+
+    LogStatus rc = writeBuffer();
+    if (rc != LogStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    if (osDataSync(fd) != 0) {
+        return LogStatus::IO_ERROR;
+    }
+    flushedLsn = nextLsn - 1;
+    return LogStatus::GENERAL_SUCCESS;
+}
+
+/*
+
+    Record a checkpoint at `redoLsn` and recycle every segment that only
+    holds records below it. Keeping a spare preallocated here means the
+    commit path never has to create and zero-fill a segment itself.
+
+*/
+LogStatus LogManager::checkpoint(log_id_t redoLsn) {
+
+    log_id_t lsn;
+    LogStatus rc = append(LogRecordType::CHECKPOINT, INVALID_ID, &redoLsn, sizeof(redoLsn), lsn);
+    if (rc == LogStatus::GENERAL_SUCCESS) {
+        rc = flush();
+    }
+    if (rc != LogStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+
+    bool needSpare;
+    {
+        std::lock_guard<std::mutex> lock(latch);
+        while (segments.size() > 1 && segments[1].firstLsn <= redoLsn &&
+               isArchived(segments.front().segNo)) {
+            if ((rc = retireSegment()) != LogStatus::GENERAL_SUCCESS) {
+                return rc;
+            }
+        }
+        needSpare = spares.empty();
+    }
+
+    if (needSpare && (rc = prepareSpare()) != LogStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    return osSyncDir(dir.c_str()) == 0 ? LogStatus::GENERAL_SUCCESS : LogStatus::IO_ERROR;
+}
+
+/* Close the current segment early so everything logged so far gets archived */
+LogStatus LogManager::switchLog() {
+
+    std::lock_guard<std::mutex> lock(latch);
+
+    if (fd == OS_INVALID_FD) {
+        return LogStatus::GENERAL_FAILURE;
+    }
+    if (bufLen == 0 && writeOfst == static_cast<int64_t>(sizeof(LogSegmentHeader))) {
+        return LogStatus::GENERAL_SUCCESS;      // Nothing in it yet
+    }
+    LogStatus rc = switchSegment();
+    if (rc == LogStatus::GENERAL_SUCCESS) {
+        flushedLsn = nextLsn - 1;
+    }
+    return rc;
+}
+
+log_id_t LogManager::getNextLsn() {
+    std::lock_guard<std::mutex> lock(latch);
+    return nextLsn;
+}
+
+log_id_t LogManager::getFlushedLsn() {
+    std::lock_guard<std::mutex> lock(latch);
+    return flushedLsn;
+}
+
+size_t LogManager::getNumSegments() {
+    std::lock_guard<std::mutex> lock(latch);
+    return segments.size();
+}
+
+size_t LogManager::getNumSpares() {
+    std::lock_guard<std::mutex> lock(latch);
+    return spares.size();
+}
+
+size_t LogManager::getNumUnarchived() {
+    std::lock_guard<std::mutex> lock(latch);
+    return archiveQueue.size();
+}
+
+LogStatus LogManager::writeBuffer() {
+    if (bufLen == 0) {
+        return LogStatus::GENERAL_SUCCESS;
+    }
+    if (osWrite(fd, buffer.data(), bufLen, writeOfst) < 0) {
+        return LogStatus::IO_ERROR;
+    }
+    writeOfst += bufLen;
+    bufLen = 0;
+    return LogStatus::GENERAL_SUCCESS;
+}
+
+/* The finished segment is synced here so a later flush() only needs the new one */
+LogStatus LogManager::switchSegment() {
+
+    LogStatus rc = writeBuffer();
+    if (rc != LogStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    if (osDataSync(fd) != 0) {
+        return LogStatus::IO_ERROR;
+    }
+
+    uint64_t done = segments.back().segNo;
+    if ((rc = startSegment(done + 1)) != LogStatus::GENERAL_SUCCESS) {
+        return rc;
+    }
+    if (!archiveDir.empty()) {
+        archiveQueue.push_back(done);
+        archiveCv.notify_one();
+    }
+    return LogStatus::GENERAL_SUCCESS;
+}
+
+/* Begin writing `segNo`, reusing its spare file when there is one */
+LogStatus LogManager::startSegment(uint64_t segNo) {
+
+    std::string path = segPath(segNo);
+    bool reuse = !spares.empty() && spares.front() == segNo;
+
+    os_fd_t nfd = osOpen(path.c_str(), true);
+    if (nfd == OS_INVALID_FD) {
+        return LogStatus::IO_ERROR;
+    }
+
+    if (!reuse || osFileSize(nfd) < static_cast<int64_t>(segSize)) {
+        if (osPreallocate(nfd, segSize) != 0 || osSyncDir(dir.c_str()) != 0) {
+            osClose(nfd);
+            return LogStatus::IO_ERROR;
+        }
+    }
+    if (reuse) {
+        spares.pop_front();
+    }
+
+    LogSegmentHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = LOG_SEGMENT_MAGIC;
+    hdr.segNo = segNo;
+    hdr.segSize = segSize;
+    hdr.firstLsn = nextLsn;
+    hdr.crc = segmentCrc(hdr);
+
+    if (osWrite(nfd, &hdr, sizeof(hdr), 0) < 0) {
+        osClose(nfd);
+        return LogStatus::IO_ERROR;
+    }
+
+    if (fd != OS_INVALID_FD) {
+        osClose(fd);
+    }
+    fd = nfd;
+    writeOfst = sizeof(hdr);
+    maxSegNo = std::max(maxSegNo, segNo);
+    segments.push_back({ segNo, nextLsn });
+    return LogStatus::GENERAL_SUCCESS;
+}
+
+/* Zero-fill a new spare without holding the latch, then name it in place */
+LogStatus LogManager::prepareSpare() {
+
+    std::string tmp = dir + "/spare.tmp";
+    os_fd_t nfd = osOpen(tmp.c_str(), true);
+    if (nfd == OS_INVALID_FD) {
+        return LogStatus::IO_ERROR;
+    }
+    int err = osPreallocate(nfd, segSize);
+    osClose(nfd);
+    if (err != 0) {
+        osRemove(tmp.c_str());
+        return LogStatus::IO_ERROR;
+    }
+
+    std::lock_guard<std::mutex> lock(latch);
+    uint64_t no = maxSegNo + 1;
+    if (osRename(tmp.c_str(), segPath(no).c_str()) != 0) {
+        return LogStatus::IO_ERROR;
+    }
+    maxSegNo = no;
+    spares.push_back(no);
+    return LogStatus::GENERAL_SUCCESS;
+}
+
+/* Rename the oldest segment ahead of the log, or drop it if there are enough spares */
+LogStatus LogManager::retireSegment() {
+
+    uint64_t oldNo = segments.front().segNo;
+
+    if (spares.size() < LOG_SEGMENT_SPARES) {
+        uint64_t no = maxSegNo + 1;
+        if (osRename(segPath(oldNo).c_str(), segPath(no).c_str()) != 0) {
+            return LogStatus::IO_ERROR;
+        }
+        maxSegNo = no;
+        spares.push_back(no);
+    }
+    else if (osRemove(segPath(oldNo).c_str()) != 0) {
+        return LogStatus::IO_ERROR;
+    }
+
+    segments.pop_front();
+    return LogStatus::GENERAL_SUCCESS;
+}
+
+/* Segments leave the queue in order, once their archived copy is durable */
+bool LogManager::isArchived(uint64_t segNo) const {
+    return archiveDir.empty() || archiveQueue.empty() || segNo < archiveQueue.front();
+}
+
+/*
+
+    Archiver thread. A segment is copied under a temporary name and renamed
+    once synced, so the archive never holds a partial segment. On failure
+    the segment stays queued (and is not recycled) and the copy is retried.
+
+*/
+void LogManager::archiveLoop() {
+
+    for (;;) {
+        uint64_t segNo;
+        {
+            std::unique_lock<std::mutex> lock(latch);
+            archiveCv.wait(lock, [this] { return stopArchiver || !archiveQueue.empty(); });
+            if (archiveQueue.empty()) {
+                return;
+            }
+            segNo = archiveQueue.front();
+        }
+
+        std::string name = archiveDir + "/" + logSegmentName(segNo);
+        std::string tmp = name + ".tmp";
+        bool copied = osCopyFile(segPath(segNo).c_str(), tmp.c_str()) == 0 &&
+                      osRename(tmp.c_str(), name.c_str()) == 0 &&
+                      osSyncDir(archiveDir.c_str()) == 0;
+
+        std::unique_lock<std::mutex> lock(latch);
+        if (copied) {
+            archiveQueue.pop_front();
+        }
+        else if (stopArchiver) {
+            return;     // Picked up again by the next open()
+        }
+        else {
+            archiveCv.wait_for(lock, std::chrono::seconds(1));
+        }
+    }
+}
\ No newline at end of file